@@ -68,6 +68,8 @@ int main(int argc, char **argv) {
   int randomize = 0;
   int mask = 0;
   int limit_seconds = 0;
+  int core = OSPC_CORE_CYCLE_EXACT;
+  OSPC_Context *ctx;
   off_t size;
   void *ptr;
   void *buf;
@@ -84,6 +86,8 @@ int main(int argc, char **argv) {
       fprintf(stderr, "  -r       Randomize song order\n");
       fprintf(stderr, "  -m MASK  Set muted channel bitmask (0-255)\n");
       fprintf(stderr, "  -s SECS  End playback after this many seconds\n");
+      fprintf(stderr, "  -c CORE  Select the CPU core (0 cycle-exact, "
+                      "1 whole-instruction)\n");
       return 0;
     } else if (!strcmp(argv[first_file], "-r")) {
       randomize = 1;
@@ -91,6 +95,8 @@ int main(int argc, char **argv) {
       mask = GetIntArg(argc, argv, &first_file, "-m");
     } else if (!strcmp(argv[first_file], "-s")) {
       limit_seconds = GetIntArg(argc, argv, &first_file, "-s");
+    } else if (!strcmp(argv[first_file], "-c")) {
+      core = GetIntArg(argc, argv, &first_file, "-c");
     } else {
       // First file.
       break;
@@ -116,6 +122,11 @@ int main(int argc, char **argv) {
     }
   }
   buf = malloc(BUFSIZE_1S);
+  ctx = OSPC_CreateContext();
+  if (!ctx) {
+    fprintf(stderr, "Unable to create an emulator context!\n");
+    exit(1);
+  }
   fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK);
   fprintf(stderr, "Press RETURN to change songs\n");
   for (f = 0; f < n_files; f++) {
@@ -135,24 +146,26 @@ int main(int argc, char **argv) {
     }
 
     close(fd);
-    if ((fd = OSPC_Init(ptr, size))) {
-      fprintf(stderr, "\nOSPC_Init returned %d!\n", fd);
+    if ((fd = OSPC_ContextInit(ctx, ptr, size))) {
+      fprintf(stderr, "\nOSPC_ContextInit returned %d!\n", fd);
       continue;
     }
     free(ptr);
 
-    OSPC_SetChannelMask(mask);
+    OSPC_ContextSetChannelMask(ctx, mask);
+    OSPC_ContextSetCpuCore(ctx, core);
 
     for (int elapsed_seconds = 0;
          (limit_seconds <= 0) || (elapsed_seconds < limit_seconds);
          ++elapsed_seconds) {
       if ((read(STDIN_FILENO, &c, 1) > 0) && (c == '\n')) { break; }
-      size = OSPC_Run(-1, buf, BUFSIZE_1S);
+      size = OSPC_ContextRun(ctx, -1, buf, BUFSIZE_1S);
       if (write(STDOUT_FILENO, buf, size) < size) {
         fprintf(stderr, "\nLost output data!\n");
       }
     }
   }
 
+  OSPC_DestroyContext(ctx);
   return 0;
 }
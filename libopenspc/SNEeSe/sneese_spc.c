@@ -129,13 +129,6 @@ static const char *     SPC_OpID[ 256 ]
                                     /* Opcode page FX               */
     };
 
-/*========== VARIABLES ==========*/
-
-uint8_t In_CPU;
-uint8_t SPC_CPU_cycles;
-uint8_t SPC_CPU_cycles_mul;
-uint8_t sound_cycle_latch;
-
 /*========== PROCEDURES ==========*/
 
 
@@ -145,7 +138,9 @@ uint8_t sound_cycle_latch;
 /***** DisplaySPC *****/
 
 void DisplaySPC
-    ( void )
+    (
+    SPC700_CONTEXT *    active_context
+    )
 {
 int                     c;
 char                    Message[ 9 ];
@@ -158,7 +153,7 @@ fprintf(
        active_context->SP
        );
 
-active_context->PSW = get_SPC_PSW();
+active_context->PSW = get_SPC_PSW( active_context );
 for( c = 0; c < 8; c++ )
     {
     Message[ 7 - c ] = ( active_context->PSW & ( 1 << c ) ) ? '1' : '0';
@@ -214,9 +209,11 @@ fprintf(
 /***** InvalidSPCOpcode *****/
 
 void InvalidSPCOpcode
-    ( void )
+    (
+    SPC700_CONTEXT *    active_context
+    )
 {
-DisplaySPC();
+DisplaySPC( active_context );
 fprintf(
        stderr,
        "Unemulated SPC opcode 0x%02X (%s)\n",
@@ -236,8 +233,11 @@ exit( 1 );
 /***** SPC_READ_DSP *****/
 
 void SPC_READ_DSP
-    ( void )
+    (
+    SPC700_CONTEXT *    active_context
+    )
 {
+SPC_SYNC_DSP( active_context );
 
 #ifdef DBG_DSP
 fprintf(
@@ -261,10 +261,13 @@ if( 8 == ( SPCRAM[ 0xF2 ] & 0xF ) )
 /***** SPC_WRITE_DSP *****/
 
 void SPC_WRITE_DSP
-    ( void )
+    (
+    SPC700_CONTEXT *    active_context
+    )
 {
 int                     addr;
 
+SPC_SYNC_DSP( active_context );
 addr = SPCRAM[ 0xF2 ];
 
 #ifdef DBG_DSP
@@ -278,11 +281,53 @@ fprintf(
 
 if( 0x7C == addr )
     {
-    DSP_WRITE_7C( SPC_DSP_DATA );
+    DSP_WRITE_7C( SPC_DSP, SPC_DSP_DATA );
     }
 else
     {
     SPC_DSP[ addr ] = SPC_DSP_DATA;
     }
 
+/* Let the DSP account for the new register value, e.g. in which memory it
+   may access from here on. */
+if( active_context->dsp_reg_written )
+    {
+    active_context->dsp_reg_written( active_context->dsp_opaque, addr );
+    }
+
 }   /* _SPC_WRITE_DSP() */
+
+
+/***** SPC_SYNC_DSP *****/
+
+void SPC_SYNC_DSP
+    (
+    SPC700_CONTEXT *    active_context
+    )
+{
+if( active_context->dsp_sync )
+    {
+    active_context->dsp_sync(
+                            active_context->dsp_opaque,
+                            ( int32_t )( active_context->Cycles
+                                       - active_context->TotalCycles )
+                            );
+    }
+
+}   /* SPC_SYNC_DSP() */
+
+
+/***** SPC_RAM_WRITTEN *****/
+
+void SPC_RAM_WRITTEN
+    (
+    SPC700_CONTEXT *    active_context,
+    uint16_t            address
+    )
+{
+if( active_context->dsp_ram_written )
+    {
+    active_context->dsp_ram_written( active_context->dsp_opaque, address );
+    }
+
+}   /* SPC_RAM_WRITTEN() */
@@ -43,6 +43,9 @@ typedef union {
   } b;
 } Word2B;
 
+// Blocks translated to native code by spc700_jit.c; see SPC700_CONTEXT::jit.
+struct SPC700_JIT;
+
 typedef struct {
   // The following contents of this struct should be functionally equivalent
   // to what appears in include/apu/spc.h in the SNEeSe source.
@@ -89,8 +92,9 @@ typedef struct {
   uint8_t C_flag;
 
   struct {
-    uint32_t cycle_latch;
-    int16_t position;
+    // Cycle on which the counter next increments, while the timer runs.
+    // Stands in for SNEeSe's cycle_latch and position.
+    uint32_t next_tick;
     int16_t target;
     uint8_t counter;
   } timers[3];
@@ -105,50 +109,169 @@ typedef struct {
   uint8_t* dsp_regs;
   // Data for DSP register transactions.
   uint8_t dsp_data;
+
+  // The value of this variable doesn't matter at all.  Its value is saved and
+  // set to zero when entering SPC_START(), restored afterwards, and otherwise
+  // never used outside of SNEeSe.
+  uint8_t in_cpu;
+  // This value is only ever set to zero and never used.
+  uint8_t spc_cpu_cycles;
+  // This value is also regularly set to only zero, though it is read from.
+  uint8_t spc_cpu_cycles_mul;
+  // Only set to zero and never read.
+  uint8_t sound_cycle_latch;
+
+  // Callback used to bring the DSP up to date before the CPU performs an
+  // access that the DSP may observe or affect; may be null.  The second
+  // argument is the number of cycles remaining before SPC_START() returns.
+  void (*dsp_sync)(void* opaque, int32_t cycles_remaining);
+  // Callback invoked right after each DSP register write, with the address
+  // of the register written; may be null.
+  void (*dsp_reg_written)(void* opaque, int addr);
+  // Callback invoked right after each write to a RAM page flagged with
+  // SPC_WATCH_NOTIFY, with the address written; may be null.
+  void (*dsp_ram_written)(void* opaque, int address);
+  void* dsp_opaque;
+  // SPC_WATCH_* flags for each 256-byte page of RAM, indicating which kinds
+  // of access to that page require a call to dsp_sync first, or to
+  // dsp_ram_written afterwards.
+  uint8_t watch[256];
+  // Nonzero for each 256-byte page of RAM that blocks in jit were translated
+  // from.  Writes to these pages drop the blocks they overwrite.
+  uint8_t code_watch[256];
+  // If nonzero, SPC_START() only stops between instructions, and so may
+  // overrun the cycles requested by up to SPC_MAX_OPCODE_CYCLES - 1.  The
+  // overrun is carried into the next call like any other.
+  uint8_t whole_instructions;
+  // If nonzero, SPC_START() runs every instruction cycle by cycle, never
+  // handing over to the whole-instruction path, even at an instruction
+  // boundary.  Much slower.  Both paths expand the same instruction bodies
+  // from spc700_ops.h, so an instance running this way can only check one
+  // that doesn't on what the paths do differently: splitting instructions
+  // into cycles, dispatch and fetching, fused compares, reads straight from
+  // RAM, loop skipping and translated blocks.
+  uint8_t cycle_by_cycle;
+  // Set once the CPU has executed SLEEP or STOP, after which SPC_START() only
+  // lets time pass until the CPU is reset.
+  uint8_t halted;
+  // Callback told of every instruction the CPU starts, every write it makes,
+  // and every read of the register page, with the kind of event
+  // (SPC_TRACE_*), the address (PC for an instruction) and the data; may be
+  // null.  The cycle counter in the context is up to date whenever it is
+  // called, and so are the CPU registers for an instruction.  For a read, the
+  // value returned is what the CPU reads instead, otherwise it is ignored.
+  // A loop the CPU skips iterations of is reported as SPC_TRACE_SKIP, with
+  // the address the loop starts at, before the first iteration skipped; the
+  // next event is the first after the iterations skipped.
+  uint8_t (*trace)(void* opaque, int kind, uint16_t address, uint8_t data);
+  void* trace_opaque;
+  // Blocks of instructions translated to native code, in builds with
+  // SPC_JIT defined.  Allocated on first use; must be null initially, and
+  // released with spc_jit_free().
+  struct SPC700_JIT* jit;
+  // Host pointer to each 256-byte page of the address space, for reads and
+  // for writes respectively, or null if the page needs special handling: the
+  // register page, and the IPL ROM page while the ROM is mapped in.  Set up
+  // by spc_setup_memory_map().
+  const uint8_t* read_map[256];
+  uint8_t* write_map[256];
+
   uint8_t ram[65536];
 } SPC700_CONTEXT;
 
-// Aliases for stuff moved into the context.
+// Aliases for stuff moved into the context.  All SNEeSe functions take the
+// context they operate on as a parameter named active_context, which is what
+// these (and the similar aliases in spc700.c) refer to.
 #define Map_Address (active_context->map_address)
 #define Map_Byte (active_context->map_byte)
 #define SPC_DSP (active_context->dsp_regs)
 #define SPC_DSP_DATA (active_context->dsp_data)
 #define SPCRAM (active_context->ram)
-
-// sneese_spc.c variables.
-
-// The value of this variable doesn't matter at all.  Its value is saved and
-// set to zero when entering SPC_START(), restored afterwards, and otherwise
-// never used outside of SNEeSe.
-extern uint8_t In_CPU;
-// This value is only ever set to zero and never used.
-extern uint8_t SPC_CPU_cycles;
-// This value is also regularly set to only zero, though it is read from.
-extern uint8_t SPC_CPU_cycles_mul;
-// Only set to zero and never read.
-extern uint8_t sound_cycle_latch;
-
-// spc700.c variables.
-
-extern SPC700_CONTEXT* active_context;
+#define In_CPU (active_context->in_cpu)
+#define SPC_CPU_cycles (active_context->spc_cpu_cycles)
+#define SPC_CPU_cycles_mul (active_context->spc_cpu_cycles_mul)
+#define sound_cycle_latch (active_context->sound_cycle_latch)
+
+// Flags for SPC700_CONTEXT::watch.
+#define SPC_WATCH_READ 0x01
+#define SPC_WATCH_WRITE 0x02
+#define SPC_WATCH_NOTIFY 0x04
+
+// Kinds of event passed to SPC700_CONTEXT::trace.
+#define SPC_TRACE_INSTRUCTION 0
+#define SPC_TRACE_WRITE 1
+#define SPC_TRACE_READ 2
+#define SPC_TRACE_SKIP 3
+
+// Length of the longest instruction (DIV YA,X), in cycles.
+#define SPC_MAX_OPCODE_CYCLES 12
+
+// Called by the core before every memory access.  Brings the DSP up to date
+// if the page being accessed is watched for the given kind of access.
+#define update_sound(address, flag)                       \
+  do {                                                    \
+    if (active_context->watch[(address) >> 8] & (flag)) { \
+      save_cycles_spc(active_context);                    \
+      SPC_SYNC_DSP(active_context);                       \
+    }                                                     \
+  } while (0)
+
+// Called by the core after every memory write.  Tells the DSP about the write
+// if the page written is flagged for it.
+#define notify_written(address)                                     \
+  do {                                                              \
+    if (active_context->watch[(address) >> 8] & SPC_WATCH_NOTIFY) { \
+      SPC_RAM_WRITTEN(active_context, (address));                   \
+    }                                                               \
+  } while (0)
 
 // Stubs for functions called that we don't need.
 #define Wrap_SDSP_Cyclecounter()
-#define update_sound()
 
 // Other functions called by spc700.c, defined in sneese_spc.c.
-void DisplaySPC(void);
-void InvalidSPCOpcode(void);
-void SPC_READ_DSP(void);
-void SPC_WRITE_DSP(void);
+void DisplaySPC(SPC700_CONTEXT* active_context);
+void InvalidSPCOpcode(SPC700_CONTEXT* active_context);
+void SPC_READ_DSP(SPC700_CONTEXT* active_context);
+void SPC_WRITE_DSP(SPC700_CONTEXT* active_context);
+void SPC_SYNC_DSP(SPC700_CONTEXT* active_context);
+void SPC_RAM_WRITTEN(SPC700_CONTEXT* active_context, uint16_t address);
 
 // Functions in spc700.c that we need to be able to call.
-void Reset_SPC(void);
-uint8_t SPC_READ_PORT_W(uint16_t address);
-void SPC_START(unsigned cycles);
-void SPC_WRITE_PORT_R(uint16_t address, uint8_t data);
-uint8_t get_SPC_PSW(void);
-void spc_restore_flags(void);
+void Reset_SPC(SPC700_CONTEXT* active_context);
+uint8_t SPC_READ_PORT_W(SPC700_CONTEXT* active_context, uint16_t address);
+void SPC_START(SPC700_CONTEXT* active_context, unsigned cycles);
+void SPC_WRITE_PORT_R(SPC700_CONTEXT* active_context, uint16_t address,
+                      uint8_t data);
+uint8_t get_SPC_PSW(SPC700_CONTEXT* active_context);
+void save_cycles_spc(SPC700_CONTEXT* active_context);
+void spc_start_timer(SPC700_CONTEXT* active_context, int timer);
+void spc_restore_flags(SPC700_CONTEXT* active_context);
+void spc_setup_memory_map(SPC700_CONTEXT* active_context);
+void spc_map_rom(SPC700_CONTEXT* active_context, int enabled);
+void spc_ram_written(SPC700_CONTEXT* active_context, uint16_t address,
+                     int len);
+uint8_t get_byte_spc(SPC700_CONTEXT* active_context, uint16_t address);
+void set_byte_spc(SPC700_CONTEXT* active_context, uint16_t address,
+                  uint8_t data);
+
+// Functions in spc700_jit.c, in builds with SPC_JIT defined.
+
+// Translated code for a block, which runs it from the registers in the
+// context and leaves them there.
+typedef void (*SPC_JIT_CODE)(SPC700_CONTEXT* active_context);
+// Returns the code for the block at pc, or null if the interpreter should
+// run the instruction there instead: because the block is not hot yet, or
+// would run past the cycle limit of the whole-instruction path.
+SPC_JIT_CODE spc_jit_block(SPC700_CONTEXT* active_context, uint16_t pc,
+                           int32_t work_cycles, int32_t limit);
+// Drops the blocks translated from a byte the CPU writes to.
+void spc_jit_written(SPC700_CONTEXT* active_context, uint16_t address);
+// Drops every block translated from a page.
+void spc_jit_drop_page(SPC700_CONTEXT* active_context, int page);
+// Drops every block, and forgets the pages that were left to the
+// interpreter for being written to too often.
+void spc_jit_flush_all(SPC700_CONTEXT* active_context);
+void spc_jit_free(SPC700_CONTEXT* active_context);
 
 #ifdef __cplusplus
 }  // extern "C"
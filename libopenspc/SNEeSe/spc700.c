@@ -22,18 +22,24 @@ You must read and accept the license prior to use.
 
 #define SNEeSe_apu_spc700_c
 
-// NOTE(bmartin) The content of this file should be a verbatim copy of the
-// similarly-named file in the SNEeSe source, with the single exception that
-// all of the includes have been removed and replaced with the following
-// statement.  The below referenced file needs to be specially crafted so this
-// file can find all of the symbols it normally expects to find elsewhere in
-// the SNEeSe tree.
+// NOTE(bmartin) The content of this file was originally a verbatim copy of
+// the similarly-named file in the SNEeSe source, except that all of the
+// includes have been removed and replaced with the following statement.  The
+// below referenced file needs to be specially crafted so this file can find
+// all of the symbols it normally expects to find elsewhere in the SNEeSe tree.
+//
+// The other systematic deviation from upstream is that there is no global
+// active_context.  Instead, every function takes the context it operates on
+// as its first parameter, named active_context so that all of the register
+// access macros below still work unmodified.  This allows any number of
+// independent contexts to run concurrently.  The update_sound() hook also
+// takes the address and the kind of access being performed, and writes are
+// followed by a new notify_written() hook.  Finally, the opcode switch body
+// now lives in spc700_ops.h, so Execute_SPC() can also expand it as a
+// whole-instruction path with no per-cycle stop checks, which reads
+// instructions straight from the RAM they are in.
 #include "sneese_spc.h"
 
-SPC700_CONTEXT primary_context;
-
-SPC700_CONTEXT *active_context = &primary_context;
-
 /*
   SNEeSe SPC700 CPU emulation core
   Originally written by Lee Hammerton in AT&T assembly
@@ -106,6 +112,8 @@ SPC700_CONTEXT *active_context = &primary_context;
 #define _PORT3W         (_PORT_W[3])
 
 #define _FFC0_Address   (active_context->FFC0_Address)
+#define _read_map       (active_context->read_map)
+#define _write_map      (active_context->write_map)
 
 #define _PC             (active_context->PC.w)
 #define _PCL            (active_context->PC.b.l)
@@ -120,6 +128,7 @@ SPC700_CONTEXT *active_context = &primary_context;
 #define _PSW            (active_context->PSW)
 
 #define _cycle          (active_context->cycle)
+#define _halted         (active_context->halted)
 #define _opcode         (active_context->opcode)
 #define _data           (active_context->data)
 #define _data2          (active_context->data2)
@@ -144,7 +153,7 @@ SPC700_CONTEXT *active_context = &primary_context;
 #define _timers         (active_context->timers)
 
 /* bits used all over the core */
-void set_flag_spc(unsigned char flag)
+void set_flag_spc(SPC700_CONTEXT *active_context, unsigned char flag)
 {
   if (flag & SPC_FLAG_N)
   {
@@ -182,7 +191,7 @@ void set_flag_spc(unsigned char flag)
 }
 
 
-void clr_flag_spc(unsigned char flag)
+void clr_flag_spc(SPC700_CONTEXT *active_context, unsigned char flag)
 {
   if (flag & SPC_FLAG_N)
   {
@@ -220,12 +229,12 @@ void clr_flag_spc(unsigned char flag)
 }
 
 
-void complement_carry_spc(void)
+void complement_carry_spc(SPC700_CONTEXT *active_context)
 {
   _C_flag = !_C_flag;
 }
 
-unsigned char flag_state_spc(unsigned char flag)
+unsigned char flag_state_spc(SPC700_CONTEXT *active_context, unsigned char flag)
 {
   if (flag == SPC_FLAG_N)
   {
@@ -264,24 +273,24 @@ unsigned char flag_state_spc(unsigned char flag)
 }
 
 
-void load_cycles_spc(void)
+void load_cycles_spc(SPC700_CONTEXT *active_context)
 {
   _WorkCycles = _TotalCycles - _Cycles;
 }
 
-unsigned get_cycles_spc(void)
+unsigned get_cycles_spc(SPC700_CONTEXT *active_context)
 {
   return _WorkCycles + _Cycles;
 }
 
-void save_cycles_spc(void)
+void save_cycles_spc(SPC700_CONTEXT *active_context)
 {
   _TotalCycles = _WorkCycles + _Cycles;
 }
 
 
 /* Set up the flags from our flag format to SPC flag format */
-void spc_setup_flags(int B_flag)
+void spc_setup_flags(SPC700_CONTEXT *active_context, int B_flag)
 {
     unsigned char PSW = 0;
 
@@ -298,15 +307,15 @@ void spc_setup_flags(int B_flag)
 }
 
 /* Restore the flags from SPC flag format to our flag format */
-void spc_restore_flags(void)
+void spc_restore_flags(SPC700_CONTEXT *active_context)
 {
   unsigned char PSW = _PSW;
 
   _N_flag = PSW;
   _V_flag = PSW & SPC_FLAG_V;
 
-  if (PSW & SPC_FLAG_P) set_flag_spc(SPC_FLAG_P);
-  else clr_flag_spc(SPC_FLAG_P);
+  if (PSW & SPC_FLAG_P) set_flag_spc(active_context, SPC_FLAG_P);
+  else clr_flag_spc(active_context, SPC_FLAG_P);
 
   _B_flag = PSW & SPC_FLAG_B;
   _H_flag = PSW & SPC_FLAG_H;
@@ -316,77 +325,80 @@ void spc_restore_flags(void)
 }
 
 
-void store_flag_n(unsigned char value)
+void store_flag_n(SPC700_CONTEXT *active_context, unsigned char value)
 {
  _N_flag = value;
 }
 
-void store_flag_v(unsigned char value)
+void store_flag_v(SPC700_CONTEXT *active_context, unsigned char value)
 {
  _V_flag = value;
 }
 
-void store_flag_p(unsigned char value)
+void store_flag_p(SPC700_CONTEXT *active_context, unsigned char value)
 {
  _P_flag = value;
   _direct_page = value ? 0x01 : 0x00;
 }
 
-void store_flag_h(unsigned char value)
+void store_flag_h(SPC700_CONTEXT *active_context, unsigned char value)
 {
  _H_flag = value;
 }
 
-void store_flag_i(unsigned char value)
+void store_flag_i(SPC700_CONTEXT *active_context, unsigned char value)
 {
  _I_flag = value;
 }
 
-void store_flag_z(unsigned char value)
+void store_flag_z(SPC700_CONTEXT *active_context, unsigned char value)
 {
  _Z_flag = value;
 }
 
-void store_flag_c(unsigned char value)
+void store_flag_c(SPC700_CONTEXT *active_context, unsigned char value)
 {
  _C_flag = value;
 }
 
 
-void store_flags_nz(unsigned char value)
+void store_flags_nz(SPC700_CONTEXT *active_context, unsigned char value)
 {
- store_flag_n(value);
- store_flag_z(value);
+ store_flag_n(active_context, value);
+ store_flag_z(active_context, value);
 }
 
-void store_flags_nzc(unsigned char nz, unsigned char c)
+void store_flags_nzc(SPC700_CONTEXT *active_context, unsigned char nz,
+                     unsigned char c)
 {
- store_flag_n(nz);
- store_flag_z(nz);
- store_flag_c(c);
+ store_flag_n(active_context, nz);
+ store_flag_z(active_context, nz);
+ store_flag_c(active_context, c);
 }
 
 
 /* bits for external access by the 5A22 core */
-unsigned char SPC_READ_PORT_W(unsigned short address)
+unsigned char SPC_READ_PORT_W(SPC700_CONTEXT *active_context,
+                              unsigned short address)
 {
   return _PORT_W[address & 3];
 }
 
-void SPC_WRITE_PORT_R(unsigned short address, unsigned char data)
+void SPC_WRITE_PORT_R(SPC700_CONTEXT *active_context, unsigned short address,
+                      unsigned char data)
 {
   _PORT_R[address & 3] = data;
 }
 
 
 /* bits for handling cycle counter overflows */
-void Wrap_SPC_Cyclecounter()
+void Wrap_SPC_Cyclecounter(SPC700_CONTEXT *active_context)
 {
   _TotalCycles -= 0xF0000000;
   _Cycles -= 0xF0000000;
-  _timers[0].cycle_latch -= 0xF0000000;
-  _timers[1].cycle_latch -= 0xF0000000;
-  _timers[2].cycle_latch -= 0xF0000000;
+  _timers[0].next_tick -= 0xF0000000;
+  _timers[1].next_tick -= 0xF0000000;
+  _timers[2].next_tick -= 0xF0000000;
 
   Wrap_SDSP_Cyclecounter();
 }
@@ -406,7 +418,8 @@ static unsigned char SPC_ROM_CODE[64] =
 };
 
 
-static unsigned char SPC_READ_INVALID(unsigned short address)
+static unsigned char SPC_READ_INVALID(SPC700_CONTEXT *active_context,
+                                      unsigned short address)
 {
 #ifdef TRAP_INVALID_READ
 #ifdef DEBUG
@@ -414,20 +427,22 @@ static unsigned char SPC_READ_INVALID(unsigned short address)
   Map_Address = address;
   Map_Byte = 0;
 
-  InvalidSPCHWRead();   /* Display read from invalid HW warning */
+  InvalidSPCHWRead(active_context);   /* Display read from invalid HW warning */
 #endif
 #endif
   return 0;
 }
 
-static unsigned char SPC_READ_RAM(unsigned short address)
+static unsigned char SPC_READ_RAM(SPC700_CONTEXT *active_context,
+                                  unsigned short address)
 {
   return SPCRAM[address];
 }
 
-static unsigned char SPC_READ_DSP_DATA(unsigned short address)
+static unsigned char SPC_READ_DSP_DATA(SPC700_CONTEXT *active_context,
+                                       unsigned short address)
 {
-  SPC_READ_DSP();
+  SPC_READ_DSP(active_context);
 
   /* read from DSP register */
   /* DSP address bit 7 ignored during reads only! */
@@ -435,7 +450,8 @@ static unsigned char SPC_READ_DSP_DATA(unsigned short address)
 }
 
 
-unsigned char SPC_READ_PORT_R(unsigned short address)
+unsigned char SPC_READ_PORT_R(SPC700_CONTEXT *active_context,
+                              unsigned short address)
 {
   return _PORT_R[address & 3];
 }
@@ -445,47 +461,44 @@ unsigned char SPC_READ_PORT_R(unsigned short address)
 /* not accessible! */
 /*  counters are 4-bit, upon read/write they reset to 0 */
 
-void Update_SPC_Timer(int timer)
-{
-  unsigned shift, mask, cycles, position;
+/*  each timer keeps the cycle its counter next ticks on, so catching up */
+/* only takes any work once that has passed */
 
-  if (timer != 2)
-  {
-    shift = 7;
-  }
-  else
-  {
-    shift = 4;
-  }
-  mask = -BIT(shift);
+static unsigned spc_timer_shift(int timer)
+{
+  return timer != 2 ? 7 : 4;
+}
 
-  cycles = _TotalCycles - _timers[timer].cycle_latch;
-  _timers[timer].cycle_latch += cycles & mask;
+void Update_SPC_Timer(SPC700_CONTEXT *active_context, int timer)
+{
+  unsigned period, ticks;
+  int32_t late;
 
-  /* nothing to do if timer turned off */
+  /* nothing to do if timer turned off, or not due yet */
   if (!(SPC_CTRL & BIT(timer))) return;
+  late = (int32_t) (_TotalCycles - _timers[timer].next_tick);
+  if (late < 0) return;
 
-  position = _timers[timer].position + (cycles >> shift);
-  _timers[timer].position = position;
-  if (position < _timers[timer].target)
+  period = (unsigned) _timers[timer].target << spc_timer_shift(timer);
+  ticks = 1;
+  if ((unsigned) late >= period)
   {
-    return;
+    ticks += (unsigned) late / period;
   }
 
-  _timers[timer].counter += position / _timers[timer].target;
   /* 4-bit counter without saturation */
-  _timers[timer].counter &= 0x0F;
-
-  _timers[timer].position = position % _timers[timer].target;
+  _timers[timer].counter = (_timers[timer].counter + ticks) & 0x0F;
+  _timers[timer].next_tick += ticks * period;
 }
 
-static unsigned char SPC_READ_COUNTER(unsigned short address)
+static unsigned char SPC_READ_COUNTER(SPC700_CONTEXT *active_context,
+                                      unsigned short address)
 {
   /* 0xFD = read address for first timer's counter */
   int timer = address - 0xFD;
   unsigned char counter; 
 
-  Update_SPC_Timer(timer);
+  Update_SPC_Timer(active_context, timer);
   counter = _timers[timer].counter;
   _timers[timer].counter = 0;
 
@@ -504,26 +517,93 @@ static unsigned char SPC_READ_COUNTER(unsigned short address)
  ST0   - start timer 0 (8kHz)
 */
 
-void spc_start_timer(int timer)
+/* Drop the blocks translated from a page of RAM */
+static void spc_drop_page_code(SPC700_CONTEXT *active_context, int page)
+{
+  if (!active_context->code_watch[page]) return;
+  active_context->code_watch[page] = 0;
+#ifdef SPC_JIT
+  spc_jit_drop_page(active_context, page);
+#endif
+}
+
+/* Drop the blocks translated from a byte the CPU writes to */
+static void spc_drop_code(SPC700_CONTEXT *active_context,
+                          unsigned short address)
+{
+#ifdef SPC_JIT
+  spc_jit_written(active_context, address);
+#else
+  (void) active_context;
+  (void) address;
+#endif
+}
+
+/* Drop the blocks translated from len bytes of RAM at address, wrapping
+   around the end of RAM, after they are written other than by the CPU */
+void spc_ram_written(SPC700_CONTEXT *active_context, unsigned short address,
+                     int len)
 {
-  unsigned shift, mask;
+  int first = address >> 8;
+  int page;
 
-  if (timer != 2)
+#ifdef SPC_JIT
+  /* all of RAM is new, so what was learned about its code no longer holds */
+  if (len >= 0x10000) spc_jit_flush_all(active_context);
+#endif
+  for (page = first; page <= (address + len - 1) >> 8 && page < first + 256;
+       page++)
   {
-    shift = 7;
+    spc_drop_page_code(active_context, page & 0xFF);
   }
-  else
+}
+
+/* The IPL ROM page only needs special handling while the ROM is mapped in,
+   and blocks translated from the RAM under it are no good while it is */
+static void spc_map_ffc0(SPC700_CONTEXT *active_context)
+{
+  if (_FFC0_Address != SPCRAM)
+  {
+    spc_drop_page_code(active_context, 0xFF);
+  }
+  _read_map[0xFF] = _FFC0_Address == SPCRAM ? SPCRAM + 0xFF00 : 0;
+}
+
+/* Point every page of the memory map straight at RAM, except for the
+   register page and the IPL ROM page */
+void spc_setup_memory_map(SPC700_CONTEXT *active_context)
+{
+  int page;
+
+  for (page = 0; page < 256; page++)
   {
-    shift = 4;
+    _read_map[page] = SPCRAM + (page << 8);
+    _write_map[page] = SPCRAM + (page << 8);
   }
-  mask = -BIT(shift);
+  _read_map[0x00] = 0;
+  _write_map[0x00] = 0;
+  spc_map_ffc0(active_context);
+}
+
+/* Map the IPL ROM in or out of the top of the address space */
+void spc_map_rom(SPC700_CONTEXT *active_context, int enabled)
+{
+  _FFC0_Address = enabled ? SPC_ROM_CODE - 0xFFC0 : SPCRAM;
+  spc_map_ffc0(active_context);
+}
+
+void spc_start_timer(SPC700_CONTEXT *active_context, int timer)
+{
+  unsigned shift = spc_timer_shift(timer);
 
-  _timers[timer].cycle_latch = _TotalCycles & mask;
-  _timers[timer].position = 0;
+  /* the stage clock keeps running, so the first tick is on its schedule */
+  _timers[timer].next_tick = (_TotalCycles & -BIT(shift)) +
+    ((unsigned) _timers[timer].target << shift);
   _timers[timer].counter = 0;
 }
 
-static void SPC_WRITE_INVALID(unsigned short address, unsigned char data)
+static void SPC_WRITE_INVALID(SPC700_CONTEXT *active_context,
+                              unsigned short address, unsigned char data)
 {
 #ifdef TRAP_INVALID_WRITE
 #ifdef DEBUG
@@ -531,15 +611,16 @@ static void SPC_WRITE_INVALID(unsigned short address, unsigned char data)
   Map_Address = address;
   Map_Byte = data;
 
-  InvalidSPCHWWrite();  /* Display write to invalid HW warning */
+  InvalidSPCHWWrite(active_context);  /* Display write to invalid HW warning */
 #endif
 #endif
 }
 
-static void SPC_WRITE_CTRL(unsigned short address, unsigned char data)
+static void SPC_WRITE_CTRL(SPC700_CONTEXT *active_context,
+                           unsigned short address, unsigned char data)
 {
   /* IPL ROM enable */
-  _FFC0_Address = data & 0x80 ? SPC_ROM_CODE - 0xFFC0 : SPCRAM;
+  spc_map_rom(active_context, data & 0x80);
 
   /* read ports 0/1 reset */
   if (data & 0x10)
@@ -555,52 +636,62 @@ static void SPC_WRITE_CTRL(unsigned short address, unsigned char data)
     _PORT_R[3] = 0;
   }
 
+  /* stopped timers keep what they counted so far */
+  Update_SPC_Timer(active_context, 0);
+  Update_SPC_Timer(active_context, 1);
+  Update_SPC_Timer(active_context, 2);
+
   /* timer 0 control */
   if (!(SPCRAM[address] & 1) && (data & 1))
   {
-    spc_start_timer(0);
+    spc_start_timer(active_context, 0);
   }
 
   /* timer 0 control */
   if (!(SPCRAM[address] & 2) && (data & 2))
   {
-    spc_start_timer(1);
+    spc_start_timer(active_context, 1);
   }
 
   /* timer 2 control */
   if (!(SPCRAM[address] & 4) && (data & 4))
   {
-    spc_start_timer(2);
+    spc_start_timer(active_context, 2);
   }
 
   SPC_CTRL = data;
 }
 
 
-static void SPC_WRITE_RAM(unsigned short address, unsigned char data)
+static void SPC_WRITE_RAM(SPC700_CONTEXT *active_context, unsigned short address,
+                          unsigned char data)
 {
   SPCRAM[address] = data;
 }
 
-static void SPC_WRITE_DSP_DATA(unsigned short address, unsigned char data)
+static void SPC_WRITE_DSP_DATA(SPC700_CONTEXT *active_context,
+                               unsigned short address, unsigned char data)
 {
   SPC_DSP_DATA = data;
 
   /* write to DSP register */
-  SPC_WRITE_DSP();
+  SPC_WRITE_DSP(active_context);
 }
 
 
-void SPC_WRITE_PORT_W(unsigned short address, unsigned char data)
+void SPC_WRITE_PORT_W(SPC700_CONTEXT *active_context, unsigned short address,
+                      unsigned char data)
 {
   _PORT_W[address & 3] = data;
 }
 
-static void SPC_WRITE_TIMER(unsigned short address, unsigned char data)
+static void SPC_WRITE_TIMER(SPC700_CONTEXT *active_context,
+                            unsigned short address, unsigned char data)
 {
   /* 0xFA = write address for first timer's target */
   int timer = address - 0xFA;
   int target;
+  unsigned shift;
 
   if ((_timers[timer].target & 0xFF) == data)
   {
@@ -610,21 +701,25 @@ static void SPC_WRITE_TIMER(unsigned short address, unsigned char data)
   target = data ? data : 256;
 
   /* Timer must catch up before changing target */
-  Update_SPC_Timer(timer);
+  Update_SPC_Timer(active_context, timer);
 
+  shift = spc_timer_shift(timer);
+  _timers[timer].next_tick += ((unsigned) target << shift) -
+    ((unsigned) _timers[timer].target << shift);
   _timers[timer].target = target;
 
   /* does setting target for current position raise counter? assuming not */
-  if (target <= _timers[timer].position)
+  if ((int32_t) (_TotalCycles - _timers[timer].next_tick) >= 0)
   /* handle 'delay' where new target is set below position */
   {
-    _timers[timer].position -= 256;
+    _timers[timer].next_tick += 256 << shift;
   }
 }
 
 
 /* Mappings for SPC Registers */
-static unsigned char (*Read_Func_Map[16])(unsigned short address) =
+static unsigned char (*Read_Func_Map[16])(SPC700_CONTEXT *active_context,
+                                           unsigned short address) =
 {
   SPC_READ_INVALID,
   SPC_READ_INVALID,
@@ -644,7 +739,8 @@ static unsigned char (*Read_Func_Map[16])(unsigned short address) =
   SPC_READ_COUNTER
 };
 
-static void (*Write_Func_Map[16])(unsigned short address, unsigned char data) =
+static void (*Write_Func_Map[16])(SPC700_CONTEXT *active_context,
+                                  unsigned short address, unsigned char data) =
 {
   SPC_WRITE_INVALID,
   SPC_WRITE_CTRL,
@@ -674,12 +770,23 @@ static unsigned char offset_to_not[8] =
   0xFE,0xFD,0xFB,0xF7,0xEF,0xDF,0xBF,0x7F
 };
 
-unsigned char get_byte_spc(unsigned short address)
+unsigned char get_byte_spc(SPC700_CONTEXT *active_context,
+                           unsigned short address)
 {
+  const unsigned char *page;
+
   /*  Note: need to update sound if echo write enabled and accessing echo */
   /* region */
+  update_sound(address, SPC_WATCH_READ);
+  page = _read_map[address >> 8];
+  if (page)
+  /* plain RAM */
+  {
+    return page[address & 0xFF];
+  }
+
   if (address >= 0x0100)
-  /* not zero page */
+  /* IPL ROM page */
   {
     if (address >= 0xFFC0)
     /* return ROM if it's mapped in, else RAM */
@@ -697,30 +804,61 @@ unsigned char get_byte_spc(unsigned short address)
     return SPCRAM[address];
   }
 
-  save_cycles_spc();    /* Set cycle counter */
-  return Read_Func_Map[address - 0xF0](address);
+  save_cycles_spc(active_context);    /* Set cycle counter */
+  if (active_context->trace)
+  {
+    return active_context->trace(active_context->trace_opaque, SPC_TRACE_READ,
+      address, Read_Func_Map[address - 0xF0](active_context, address));
+  }
+  return Read_Func_Map[address - 0xF0](active_context, address);
 }
 
 /* -------- */
 
-void set_byte_spc(unsigned short address, unsigned char data)
+void set_byte_spc(SPC700_CONTEXT *active_context, unsigned short address,
+                  unsigned char data)
 {
+  unsigned char *page;
+
+  if (active_context->trace)
+  {
+    save_cycles_spc(active_context);
+    active_context->trace(active_context->trace_opaque, SPC_TRACE_WRITE,
+      address, data);
+  }
+
+  if (active_context->code_watch[address >> 8])
+  {
+    spc_drop_code(active_context, address);
+  }
+
   /* Note: need to update sound always, since all (?) writes affect RAM */
-  if (address >= 0x0100 || address < 0xF0)
+  page = _write_map[address >> 8];
+  if (page)
+  /* plain RAM */
+  {
+    update_sound(address, SPC_WATCH_WRITE);
+    page[address & 0xFF] = data;
+    notify_written(address);
+  }
+  else if (address < 0xF0)
   /* write to RAM */
   {
-    save_cycles_spc();    /* Set cycle counter */
-    update_sound();
+    save_cycles_spc(active_context);    /* Set cycle counter */
+    update_sound(address, SPC_WATCH_WRITE);
     SPCRAM[address] = data;
+    notify_written(address);
   }
   else
   {
-    save_cycles_spc();    /* Set cycle counter */
-    Write_Func_Map[address - 0xF0](address, data);
+    save_cycles_spc(active_context);    /* Set cycle counter */
+    update_sound(address, SPC_WATCH_WRITE);
+    Write_Func_Map[address - 0xF0](active_context, address, data);
+    notify_written(address);
   }
 }
 
-void Reset_SPC(void)
+void Reset_SPC(SPC700_CONTEXT *active_context)
 {
   int i;
 
@@ -735,6 +873,7 @@ void Reset_SPC(void)
   _last_cycles = 0;
 
   _cycle = 0;
+  _halted = 0;
 
   /* Reset SSMP registers */
   _dp = 0;  /* Used to save P flag check for dp addressing */
@@ -743,23 +882,23 @@ void Reset_SPC(void)
   _X = 0;
   /* Clear flags register */
   _PSW = 0;
-  clr_flag_spc(SPC_FLAG_N);
-  clr_flag_spc(SPC_FLAG_V);
-  clr_flag_spc(SPC_FLAG_P);
-  clr_flag_spc(SPC_FLAG_B);
-  clr_flag_spc(SPC_FLAG_H);
-  clr_flag_spc(SPC_FLAG_I);
-  clr_flag_spc(SPC_FLAG_Z);
-  clr_flag_spc(SPC_FLAG_C);
+  clr_flag_spc(active_context, SPC_FLAG_N);
+  clr_flag_spc(active_context, SPC_FLAG_V);
+  clr_flag_spc(active_context, SPC_FLAG_P);
+  clr_flag_spc(active_context, SPC_FLAG_B);
+  clr_flag_spc(active_context, SPC_FLAG_H);
+  clr_flag_spc(active_context, SPC_FLAG_I);
+  clr_flag_spc(active_context, SPC_FLAG_Z);
+  clr_flag_spc(active_context, SPC_FLAG_C);
 
   SPC_CTRL = 0x80;
   _FFC0_Address = SPC_ROM_CODE - 0xFFC0;
+  spc_setup_memory_map(active_context);
 
   /* Reset timers */
   for (i = 0; i < 3; i++)
   {
-    _timers[i].cycle_latch = 0;
-    _timers[i].position = 0;
+    _timers[i].next_tick = 256 << spc_timer_shift(i);
     _timers[i].target = 256;
     _timers[i].counter = 0;
   }
@@ -784,14 +923,14 @@ void Reset_SPC(void)
 }
 
 
-void SPC_SHOW_REGISTERS(void)
+void SPC_SHOW_REGISTERS(SPC700_CONTEXT *active_context)
 {
-  DisplaySPC();
+  DisplaySPC(active_context);
 }
 
-unsigned char get_SPC_PSW(void)
+unsigned char get_SPC_PSW(SPC700_CONTEXT *active_context)
 {
-  spc_setup_flags(_B_flag);
+  spc_setup_flags(active_context, _B_flag);
 
   return _PSW;
 }
@@ -813,19 +952,19 @@ void dummy_fprintf()
 #ifdef OPCODE_TRACE_LOG
 /* cycle #, PC, TotalCycles */
 #define SINGLE_STEP_START(c) \
-  if (dump_flag && debug_log_file){ fprintf(debug_log_file, "START_CYCLE(%u) PC:%04X %u\n", c, _PC & 0xFFFF, get_cycles_spc()); if ((c == 1) && (_PC == 0x02C4)) exit(0); }
+  if (dump_flag && debug_log_file){ fprintf(debug_log_file, "START_CYCLE(%u) PC:%04X %u\n", c, _PC & 0xFFFF, get_cycles_spc(active_context)); if ((c == 1) && (_PC == 0x02C4)) exit(0); }
 
-void single_step_end(void)
+void single_step_end(SPC700_CONTEXT *active_context)
 {
   if (!dump_flag || !debug_log_file) return;
   fprintf(debug_log_file, "NVPBHIZC R:%02X %02X %02X %02X X:%02X Y:%02X A:%02X SP:%02X dp:%02X Op:%02X\n",
     _PORT0R & 0xFF, _PORT1R & 0xFF, _PORT2R & 0xFF, _PORT3R & 0xFF,
     _X & 0xFF, _Y & 0xFF, _A & 0xFF, _SP & 0xFF, _direct_page & 0xFF, _opcode & 0xFF);
   fprintf(debug_log_file, "%c%c%c%c%c%c%c%c W:%02X %02X %02X %02X Ad%04X %04X Off%02X D%02X %02X D16 %04X",
-    flag_state_spc(SPC_FLAG_N) ? '1' : '0', flag_state_spc(SPC_FLAG_V) ? '1' : '0',
-    flag_state_spc(SPC_FLAG_P) ? '1' : '0', flag_state_spc(SPC_FLAG_B) ? '1' : '0',
-    flag_state_spc(SPC_FLAG_H) ? '1' : '0', flag_state_spc(SPC_FLAG_I) ? '1' : '0',
-    flag_state_spc(SPC_FLAG_Z) ? '1' : '0', flag_state_spc(SPC_FLAG_C) ? '1' : '0',
+    flag_state_spc(active_context, SPC_FLAG_N) ? '1' : '0', flag_state_spc(active_context, SPC_FLAG_V) ? '1' : '0',
+    flag_state_spc(active_context, SPC_FLAG_P) ? '1' : '0', flag_state_spc(active_context, SPC_FLAG_B) ? '1' : '0',
+    flag_state_spc(active_context, SPC_FLAG_H) ? '1' : '0', flag_state_spc(active_context, SPC_FLAG_I) ? '1' : '0',
+    flag_state_spc(active_context, SPC_FLAG_Z) ? '1' : '0', flag_state_spc(active_context, SPC_FLAG_C) ? '1' : '0',
     _PORT0W & 0xFF, _PORT1W & 0xFF, _PORT2W & 0xFF, _PORT3W & 0xFF,
     _address & 0xFFFF, _address2 & 0xFFFF, _offset & 0xFF, _data & 0xFF, _data2 & 0xFF,
     _data16 & 0xFFFF);
@@ -836,7 +975,7 @@ void single_step_end(void)
 
 /* op, R ports, W ports, X Y A */
 /* address1 address2 offset data1 data2 data16 */
-#define SINGLE_STEP_END single_step_end();
+#define SINGLE_STEP_END single_step_end(active_context);
 
 #else
 #define SINGLE_STEP_START(c)
@@ -860,6 +999,15 @@ void single_step_end(void)
 
 #define END_OPCODE(n) EXIT_OPCODE(n) }
 
+#define CASE_OPCODE(n) case n
+
+#define END_INVALID_OPCODE() break;
+
+#define BRANCH_TAKEN()
+
+/* Fetch of an instruction byte */
+#define get_code_spc(ctx, address) get_byte_spc(ctx, address)
+
 #define END_BRANCH_OPCODE(cycle, TEST) \
   TEST \
   END_CYCLE((cycle), 1) \
@@ -871,18 +1019,19 @@ void single_step_end(void)
  \
   START_CYCLE((cycle) + 2) \
   _PC = _address; \
+  BRANCH_TAKEN() \
   END_OPCODE(1)
 
 
 #define REL_TEST_BRA ;
-#define REL_TEST_BPL if (flag_state_spc(SPC_FLAG_N)) EXIT_OPCODE(1)
-#define REL_TEST_BMI if (!flag_state_spc(SPC_FLAG_N)) EXIT_OPCODE(1)
-#define REL_TEST_BVC if (flag_state_spc(SPC_FLAG_V)) EXIT_OPCODE(1)
-#define REL_TEST_BVS if (!flag_state_spc(SPC_FLAG_V)) EXIT_OPCODE(1)
-#define REL_TEST_BCC if (flag_state_spc(SPC_FLAG_C)) EXIT_OPCODE(1)
-#define REL_TEST_BCS if (!flag_state_spc(SPC_FLAG_C)) EXIT_OPCODE(1)
-#define REL_TEST_BNE if (flag_state_spc(SPC_FLAG_Z)) EXIT_OPCODE(1)
-#define REL_TEST_BEQ if (!flag_state_spc(SPC_FLAG_Z)) EXIT_OPCODE(1)
+#define REL_TEST_BPL if (flag_state_spc(active_context, SPC_FLAG_N)) EXIT_OPCODE(1)
+#define REL_TEST_BMI if (!flag_state_spc(active_context, SPC_FLAG_N)) EXIT_OPCODE(1)
+#define REL_TEST_BVC if (flag_state_spc(active_context, SPC_FLAG_V)) EXIT_OPCODE(1)
+#define REL_TEST_BVS if (!flag_state_spc(active_context, SPC_FLAG_V)) EXIT_OPCODE(1)
+#define REL_TEST_BCC if (flag_state_spc(active_context, SPC_FLAG_C)) EXIT_OPCODE(1)
+#define REL_TEST_BCS if (!flag_state_spc(active_context, SPC_FLAG_C)) EXIT_OPCODE(1)
+#define REL_TEST_BNE if (flag_state_spc(active_context, SPC_FLAG_Z)) EXIT_OPCODE(1)
+#define REL_TEST_BEQ if (!flag_state_spc(active_context, SPC_FLAG_Z)) EXIT_OPCODE(1)
 
 #define OP_TCALL(vector) \
   /*  8 cycles - opcode, new PCL, new PCH, stack address load, PCH */ \
@@ -891,11 +1040,11 @@ void single_step_end(void)
   /* fetch address for PC */ \
   START_CYCLE(2) \
   _address = 0xFFC0 + ((15 - (vector)) * 2); \
-  _address2 = get_byte_spc(_address); \
+  _address2 = get_byte_spc(active_context, _address); \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address2 += (get_byte_spc(_address + 1) << 8); \
+  _address2 += (get_byte_spc(active_context, _address + 1) << 8); \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
@@ -903,13 +1052,13 @@ void single_step_end(void)
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
-  set_byte_spc(_address, _PC >> 8); \
+  set_byte_spc(active_context, _address, _PC >> 8); \
   _SP--; \
   _address = 0x0100 + _SP; \
   END_CYCLE(5, 1) \
  \
   START_CYCLE(6) \
-  set_byte_spc(_address, _PC); \
+  set_byte_spc(active_context, _address, _PC); \
   _SP--; \
   _address = 0x0100 + _SP; \
   END_CYCLE(6, 1) \
@@ -928,7 +1077,7 @@ void single_step_end(void)
   /* +2 cycles (taken branch) add PC to offset, reload PC */ \
  \
   START_CYCLE(2) \
-  _offset = get_byte_spc(_PC); \
+  _offset = get_code_spc(active_context, _PC); \
   _PC++; \
   END_BRANCH_OPCODE(2, TEST)
 
@@ -944,7 +1093,7 @@ void single_step_end(void)
 
 #define DP_REL_TEST_DBNZ \
   --_data; \
-  set_byte_spc(_address, _data); \
+  set_byte_spc(active_context, _address, _data); \
   if (!_data) EXIT_OPCODE(1)
 
 #define COND_DP_REL(TEST) \
@@ -952,17 +1101,17 @@ void single_step_end(void)
   /* and data write (DBNZ only); +2 cycles (taken branch) add PC to */ \
   /* offset, reload PC */ \
   START_CYCLE(2) \
-  _address = _dp + get_byte_spc(_PC); \
+  _address = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _offset = get_byte_spc(_PC); \
+  _offset = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
@@ -972,12 +1121,12 @@ void single_step_end(void)
 #define OP_READ_DP(OP,dest) \
   /*  3 cycles - opcode, address, data read + op */ \
   START_CYCLE(2) \
-  _address = _dp + get_byte_spc(_PC); \
+  _address = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP((dest), _data) \
   END_OPCODE(1)
 
@@ -988,17 +1137,17 @@ void single_step_end(void)
 #define OP_READ_ABS(OP,dest) \
   /*  4 cycles - opcode, address low, address high, data read + op */ \
   START_CYCLE(2) \
-  _address = get_byte_spc(_PC); \
+  _address = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address += get_byte_spc(_PC) << 8; \
+  _address += get_code_spc(active_context, _PC) << 8; \
   _PC++; \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP((dest), _data) \
   END_OPCODE(1)
 
@@ -1013,7 +1162,7 @@ void single_step_end(void)
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP(_A, _data) \
   END_OPCODE(1)
 
@@ -1024,8 +1173,8 @@ void single_step_end(void)
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  if (NEED_OLD_DATA) _data = get_byte_spc(_address); \
-  else get_byte_spc(_address); \
+  if (NEED_OLD_DATA) _data = get_byte_spc(active_context, _address); \
+  else get_byte_spc(active_context, _address); \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
@@ -1040,7 +1189,7 @@ void single_step_end(void)
   /*  6 cycles - opcode, offset, address calc, address low, */ \
   /* address high, data read + op */ \
   START_CYCLE(2) \
-  _address2 = get_byte_spc(_PC); \
+  _address2 = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
@@ -1049,15 +1198,15 @@ void single_step_end(void)
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _address = get_byte_spc(_address2); \
+  _address = get_byte_spc(active_context, _address2); \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
-  _address += get_byte_spc(_address2 + 1) << 8; \
+  _address += get_byte_spc(active_context, _address2 + 1) << 8; \
   END_CYCLE(5, 1) \
  \
   START_CYCLE(6) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP((dest), _data) \
   END_OPCODE(1)
 
@@ -1065,7 +1214,7 @@ void single_step_end(void)
   /*  7 cycles - opcode, offset, address calc, address low, */ \
   /* address high, data read, data read + op */ \
   START_CYCLE(2) \
-  _address2 = get_byte_spc(_PC); \
+  _address2 = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
@@ -1074,16 +1223,16 @@ void single_step_end(void)
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _address = get_byte_spc(_address2); \
+  _address = get_byte_spc(active_context, _address2); \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
-  _address += get_byte_spc(_address2 + 1) << 8; \
+  _address += get_byte_spc(active_context, _address2 + 1) << 8; \
   END_CYCLE(5, 1) \
  \
   START_CYCLE(6) \
-  if (NEED_OLD_DATA) _data = get_byte_spc(_address); \
-  else get_byte_spc(_address); \
+  if (NEED_OLD_DATA) _data = get_byte_spc(active_context, _address); \
+  else get_byte_spc(active_context, _address); \
   END_CYCLE(6, 1) \
  \
   START_CYCLE(7) \
@@ -1097,7 +1246,7 @@ void single_step_end(void)
 #define OP_READ_IMM(OP,dest) \
   /*  2 cycles - opcode, data read + op */ \
   START_CYCLE(2) \
-  _data = get_byte_spc(_PC); \
+  _data = get_code_spc(active_context, _PC); \
   _PC++; \
   OP_##OP((dest), _data) \
   END_OPCODE(1)
@@ -1109,50 +1258,50 @@ void single_step_end(void)
 #define OP_OR(dest,src) \
   { \
     (dest) |= (src); \
-    store_flags_nz(dest); \
+    store_flags_nz(active_context, dest); \
   }
 
 #define OP_AND(dest,src) \
   { \
   (dest) &= (src); \
-  store_flags_nz(dest); \
+  store_flags_nz(active_context, dest); \
   }
 
 #define OP_EOR(dest,src) \
   { \
   (dest) ^= (src); \
-  store_flags_nz(dest); \
+  store_flags_nz(active_context, dest); \
   }
 
 #define OP_CMP(dest,src) \
   { \
     unsigned temp = (dest) - (src); \
  \
-    store_flag_c(temp <= 0xFF); \
-    store_flags_nz(temp); \
+    store_flag_c(active_context, temp <= 0xFF); \
+    store_flags_nz(active_context, temp); \
   }
 
 #define OP_ADC(dest,src) \
   { \
-    unsigned result = (dest) + (src) + (flag_state_spc(SPC_FLAG_C) ? 1 : 0); \
+    unsigned result = (dest) + (src) + (flag_state_spc(active_context, SPC_FLAG_C) ? 1 : 0); \
  \
-    store_flag_h(((unsigned) (((dest) & 0x0F) + ((src) & 0x0F) + \
-      (flag_state_spc(SPC_FLAG_C) ? 1 : 0))) > 0x0F ? 1 : 0); \
-    store_flag_c(result > 0xFF); \
-    store_flag_v((~((dest) ^ (src))) & (((dest) ^ result) & 0x80)); \
-    store_flags_nz(result); \
+    store_flag_h(active_context, ((unsigned) (((dest) & 0x0F) + ((src) & 0x0F) + \
+      (flag_state_spc(active_context, SPC_FLAG_C) ? 1 : 0))) > 0x0F ? 1 : 0); \
+    store_flag_c(active_context, result > 0xFF); \
+    store_flag_v(active_context, (~((dest) ^ (src))) & (((dest) ^ result) & 0x80)); \
+    store_flags_nz(active_context, result); \
     (dest) = result; \
   }
 
 #define OP_SBC(dest,src) \
   { \
-    unsigned result = (dest) - (src) - (flag_state_spc(SPC_FLAG_C) ? 0 : 1); \
+    unsigned result = (dest) - (src) - (flag_state_spc(active_context, SPC_FLAG_C) ? 0 : 1); \
  \
-    store_flag_h(((unsigned) (((dest) & 0x0F) - ((src) & 0x0F) - \
-      (flag_state_spc(SPC_FLAG_C) ? 0 : 1))) > 0x0F ? 0 : 1); \
-    store_flag_c(result <= 0xFF); \
-    store_flag_v(((dest) ^ (src)) & (((dest) ^ result) & 0x80)); \
-    store_flags_nz(result); \
+    store_flag_h(active_context, ((unsigned) (((dest) & 0x0F) - ((src) & 0x0F) - \
+      (flag_state_spc(active_context, SPC_FLAG_C) ? 0 : 1))) > 0x0F ? 0 : 1); \
+    store_flag_c(active_context, result <= 0xFF); \
+    store_flag_v(active_context, ((dest) ^ (src)) & (((dest) ^ result) & 0x80)); \
+    store_flags_nz(active_context, result); \
     (dest) = result; \
   }
 
@@ -1164,7 +1313,7 @@ void single_step_end(void)
 #define OP_MOV_READ(dest,src) \
   { \
     (dest) = (src); \
-    store_flags_nz(src); \
+    store_flags_nz(active_context, src); \
   }
 
 
@@ -1175,15 +1324,15 @@ void single_step_end(void)
     temp_low = ((dest) & 0xFF) + ((src) & 0xFF); \
     carry_low = temp_low > 0xFF ? 1 : 0; \
  \
-    store_flag_h(((unsigned) ((((dest) >> 8) & 0x0F) + \
+    store_flag_h(active_context, ((unsigned) ((((dest) >> 8) & 0x0F) + \
       (((src) >> 8) & 0x0F) + carry_low)) > 0x0F ? 1 : 0); \
  \
     temp_high = ((dest) >> 8) + ((src) >> 8) + carry_low; \
-    store_flag_c(temp_high > 0xFF); \
+    store_flag_c(active_context, temp_high > 0xFF); \
     result = ((temp_low & 0xFF) + (temp_high << 8)) & 0xFFFF; \
  \
-    store_flag_v(((~((dest) ^ (src))) & (((dest) ^ result) & 0x8000)) >> 8); \
-    store_flag_n(result >> 8); store_flag_z(result != 0); \
+    store_flag_v(active_context, ((~((dest) ^ (src))) & (((dest) ^ result) & 0x8000)) >> 8); \
+    store_flag_n(active_context, result >> 8); store_flag_z(active_context, result != 0); \
     (dest) = result; \
   }
 
@@ -1194,84 +1343,84 @@ void single_step_end(void)
     temp_low = ((dest) & 0xFF) - ((src) & 0xFF); \
     carry_low = temp_low > 0xFF ? 1 : 0; \
  \
-    store_flag_h(((unsigned) ((((dest) >> 8) & 0x0F) - \
+    store_flag_h(active_context, ((unsigned) ((((dest) >> 8) & 0x0F) - \
       (((src) >> 8) & 0x0F) - carry_low)) > 0x0F ? 0 : 1); \
  \
     temp_high = ((dest) >> 8) - ((src) >> 8) - carry_low; \
-    store_flag_c(temp_high <= 0xFF); \
+    store_flag_c(active_context, temp_high <= 0xFF); \
     result = ((temp_low & 0xFF) + (temp_high << 8)) & 0xFFFF; \
  \
-    store_flag_v((((dest) ^ (src)) & (((dest) ^ result) & 0x8000)) >> 8); \
-    store_flag_n(result >> 8); store_flag_z(result != 0); \
+    store_flag_v(active_context, (((dest) ^ (src)) & (((dest) ^ result) & 0x8000)) >> 8); \
+    store_flag_n(active_context, result >> 8); store_flag_z(active_context, result != 0); \
     (dest) = result; \
   }
 
 #define OP_MOVW_READ(dest,src) \
   { \
     (dest) = (src); \
-    store_flag_n((dest) >> 8); \
-    store_flag_z((dest) != 0); \
+    store_flag_n(active_context, (dest) >> 8); \
+    store_flag_z(active_context, (dest) != 0); \
   }
 
 
 #define OP_ASL(var) \
   { \
-    store_flag_c((var) & 0x80); \
+    store_flag_c(active_context, (var) & 0x80); \
     (var) <<= 1; \
-    store_flags_nz(var); \
+    store_flags_nz(active_context, var); \
   }
 
 #define OP_ROL(var) \
   { \
-    int c = flag_state_spc(SPC_FLAG_C) ? 1 : 0; \
+    int c = flag_state_spc(active_context, SPC_FLAG_C) ? 1 : 0; \
  \
-    store_flag_c((var) & 0x80); \
+    store_flag_c(active_context, (var) & 0x80); \
     (var) = ((var) << 1) + c; \
-    store_flags_nz(var); \
+    store_flags_nz(active_context, var); \
   }
 
 #define OP_LSR(var) \
   { \
-    store_flag_c((var) & 1); \
+    store_flag_c(active_context, (var) & 1); \
     (var) >>= 1; \
-    store_flags_nz(var); \
+    store_flags_nz(active_context, var); \
   }
 
 #define OP_ROR(var) \
   { \
-    int c = flag_state_spc(SPC_FLAG_C) ? 0x80 : 0; \
+    int c = flag_state_spc(active_context, SPC_FLAG_C) ? 0x80 : 0; \
  \
-    store_flag_c((var) & 1); \
+    store_flag_c(active_context, (var) & 1); \
     (var) = ((var) >> 1) + c; \
-    store_flags_nz(var); \
+    store_flags_nz(active_context, var); \
   }
 
 
 #define OP_DECW(var) \
   { \
     (var)--; \
-    store_flag_n(var >> 8); \
-    store_flag_z((var & 0xFFFF) != 0); \
+    store_flag_n(active_context, var >> 8); \
+    store_flag_z(active_context, (var & 0xFFFF) != 0); \
   }
 
 #define OP_INCW(var) \
   { \
     (var)++; \
-    store_flag_n(var >> 8); \
-    store_flag_z((var & 0xFFFF) != 0); \
+    store_flag_n(active_context, var >> 8); \
+    store_flag_z(active_context, (var & 0xFFFF) != 0); \
   }
 
 
 #define OP_DEC(var) \
   { \
     (var)--; \
-    store_flags_nz(var); \
+    store_flags_nz(active_context, var); \
   }
 
 #define OP_INC(var) \
   { \
     (var)++; \
-    store_flags_nz(var); \
+    store_flags_nz(active_context, var); \
   }
 
 
@@ -1284,36 +1433,36 @@ void single_step_end(void)
     (var) &= offset_to_not[_opcode >> 5]; \
   }
 
-#define WRITE_OP(OP) OP_##OP(_data); set_byte_spc(_address, _data);
-#define WRITE_MOV(var) set_byte_spc(_address, (var));
+#define WRITE_OP(OP) OP_##OP(_data); set_byte_spc(active_context, _address, _data);
+#define WRITE_MOV(var) set_byte_spc(active_context, _address, (var));
 
 
 #define WRITE_ASL \
-    OP_ASL(_data); set_byte_spc(_address, _data);
+    OP_ASL(_data); set_byte_spc(active_context, _address, _data);
 #define WRITE_LSR \
-    OP_LSR(_data); set_byte_spc(_address, _data);
+    OP_LSR(_data); set_byte_spc(active_context, _address, _data);
 #define WRITE_ROL \
-    OP_ROL(_data); set_byte_spc(_address, _data);
+    OP_ROL(_data); set_byte_spc(active_context, _address, _data);
 #define WRITE_ROR \
-    OP_ROR(_data); set_byte_spc(_address, _data);
+    OP_ROR(_data); set_byte_spc(active_context, _address, _data);
 
 #define WRITE_DEC \
-    OP_DEC(_data); set_byte_spc(_address, _data);
+    OP_DEC(_data); set_byte_spc(active_context, _address, _data);
 #define WRITE_INC \
-    OP_INC(_data); set_byte_spc(_address, _data);
+    OP_INC(_data); set_byte_spc(active_context, _address, _data);
 
 
 /* xxx01011 */
 #define OP_RMW_DP(OP,NEED_OLD_DATA) \
   /*  4 cycles - opcode, address, data read, op + data write */ \
   START_CYCLE(2) \
-  _address = _dp + get_byte_spc(_PC); \
+  _address = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  if (NEED_OLD_DATA) _data = get_byte_spc(_address); \
-  else get_byte_spc(_address); \
+  if (NEED_OLD_DATA) _data = get_byte_spc(active_context, _address); \
+  else get_byte_spc(active_context, _address); \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
@@ -1325,26 +1474,26 @@ void single_step_end(void)
   /*  6 cycles - opcode, src address, dest address, src read, */ \
   /* dest read + op, dest write */ \
   START_CYCLE(2) \
-  _address2 = _dp + get_byte_spc(_PC); \
+  _address2 = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address = _dp + get_byte_spc(_PC); \
+  _address = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _data2 = get_byte_spc(_address2); \
+  _data2 = get_byte_spc(active_context, _address2); \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP(_data, _data2) \
   END_CYCLE(5, 1) \
  \
   START_CYCLE(6) \
-  set_byte_spc(_address, _data); \
+  set_byte_spc(active_context, _address, _data); \
   END_OPCODE(1)
 
 /* xxx01100 */
@@ -1352,18 +1501,18 @@ void single_step_end(void)
   /*  5 cycles - opcode, address low, address high, data read, */ \
   /* op + data write */ \
   START_CYCLE(2) \
-  _address = get_byte_spc(_PC); \
+  _address = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address += get_byte_spc(_PC) << 8; \
+  _address += get_code_spc(active_context, _PC) << 8; \
   _PC++; \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  if (NEED_OLD_DATA) _data = get_byte_spc(_address); \
-  else get_byte_spc(_address); \
+  if (NEED_OLD_DATA) _data = get_byte_spc(active_context, _address); \
+  else get_byte_spc(active_context, _address); \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
@@ -1380,7 +1529,7 @@ void single_step_end(void)
     END_CYCLE(2, 1) \
  \
     START_CYCLE(3) \
-    set_byte_spc(_address, src); \
+    set_byte_spc(active_context, _address, src); \
     END_CYCLE(3, 1) \
  \
     START_CYCLE(4) \
@@ -1401,7 +1550,7 @@ void single_step_end(void)
     END_CYCLE(3, 1) \
  \
     START_CYCLE(4) \
-    (dest) = get_byte_spc(_address); \
+    (dest) = get_byte_spc(active_context, _address); \
     END_OPCODE(1) \
   }
 
@@ -1409,7 +1558,7 @@ void single_step_end(void)
 #define OP_READ_DP_reg_INDEXED(OP,dest,index) \
   /*  4 cycles - opcode, address, address calc, data read + op */ \
   START_CYCLE(2) \
-  _address = get_byte_spc(_PC); \
+  _address = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
@@ -1418,7 +1567,7 @@ void single_step_end(void)
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP((dest), _data) \
   END_OPCODE(1)
 
@@ -1426,7 +1575,7 @@ void single_step_end(void)
   /*  5 cycles - opcode, address, address calc, data read, */ \
   /* data write */ \
   START_CYCLE(2) \
-  _address = get_byte_spc(_PC); \
+  _address = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
@@ -1435,8 +1584,8 @@ void single_step_end(void)
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  if (NEED_OLD_DATA) _data = get_byte_spc(_address); \
-  else get_byte_spc(_address); \
+  if (NEED_OLD_DATA) _data = get_byte_spc(active_context, _address); \
+  else get_byte_spc(active_context, _address); \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
@@ -1461,12 +1610,12 @@ void single_step_end(void)
   /*  5 cycles - opcode, address low, address high, address calc, */ \
   /* data read + op */ \
   START_CYCLE(2) \
-  _address = get_byte_spc(_PC); \
+  _address = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address += get_byte_spc(_PC) << 8; \
+  _address += get_code_spc(active_context, _PC) << 8; \
   _PC++; \
   END_CYCLE(3, 1) \
  \
@@ -1475,7 +1624,7 @@ void single_step_end(void)
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP((dest), _data) \
   END_OPCODE(1)
 
@@ -1483,12 +1632,12 @@ void single_step_end(void)
   /*  6 cycles - opcode, address low, address high, address calc, */ \
   /* data read, data write */ \
   START_CYCLE(2) \
-  _address = get_byte_spc(_PC); \
+  _address = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address += get_byte_spc(_PC) << 8; \
+  _address += get_code_spc(active_context, _PC) << 8; \
   _PC++; \
   END_CYCLE(3, 1) \
  \
@@ -1497,8 +1646,8 @@ void single_step_end(void)
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
-  if (NEED_OLD_DATA) _data = get_byte_spc(_address); \
-  else get_byte_spc(_address); \
+  if (NEED_OLD_DATA) _data = get_byte_spc(active_context, _address); \
+  else get_byte_spc(active_context, _address); \
   END_CYCLE(5, 1) \
  \
   START_CYCLE(6) \
@@ -1520,16 +1669,16 @@ void single_step_end(void)
   /*  6 cycles - opcode, offset, address low, address high, */ \
   /* address calc, data read + op */ \
   START_CYCLE(2) \
-  _address2 = _dp + get_byte_spc(_PC); \
+  _address2 = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address = get_byte_spc(_address2); \
+  _address = get_byte_spc(active_context, _address2); \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _address += get_byte_spc(_address2 + 1) << 8; \
+  _address += get_byte_spc(active_context, _address2 + 1) << 8; \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
@@ -1537,7 +1686,7 @@ void single_step_end(void)
   END_CYCLE(5, 1) \
  \
   START_CYCLE(6) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP((dest), _data) \
   END_OPCODE(1)
 
@@ -1545,16 +1694,16 @@ void single_step_end(void)
   /*  7 cycles - opcode, offset, address low, address high, */ \
   /* address calc, data read + op, data write */ \
   START_CYCLE(2) \
-  _address2 = _dp + get_byte_spc(_PC); \
+  _address2 = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address = get_byte_spc(_address2); \
+  _address = get_byte_spc(active_context, _address2); \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _address += get_byte_spc(_address2 + 1) << 8; \
+  _address += get_byte_spc(active_context, _address2 + 1) << 8; \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
@@ -1562,8 +1711,8 @@ void single_step_end(void)
   END_CYCLE(5, 1) \
  \
   START_CYCLE(6) \
-  if (NEED_OLD_DATA) _data = get_byte_spc(_address); \
-  else get_byte_spc(_address); \
+  if (NEED_OLD_DATA) _data = get_byte_spc(active_context, _address); \
+  else get_byte_spc(active_context, _address); \
   END_CYCLE(6, 1) \
  \
   START_CYCLE(7) \
@@ -1579,22 +1728,22 @@ void single_step_end(void)
   /*  5 cycles - opcode, src data, dest address, dest read + op, */ \
   /* dest write */ \
   START_CYCLE(2) \
-  _data2 = get_byte_spc(_PC); \
+  _data2 = get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _address = _dp + get_byte_spc(_PC); \
+  _address = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP(_data, _data2) \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
-  set_byte_spc(_address, _data); \
+  set_byte_spc(active_context, _address, _data); \
   END_OPCODE(1)
 
 
@@ -1607,17 +1756,17 @@ void single_step_end(void)
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _data2 = get_byte_spc(_address); \
+  _data2 = get_byte_spc(active_context, _address); \
   _address = _dp + _X; \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _data = get_byte_spc(_address); \
+  _data = get_byte_spc(active_context, _address); \
   OP_##OP(_data, _data2) \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
-  set_byte_spc(_address, _data); \
+  set_byte_spc(active_context, _address, _data); \
   END_OPCODE(1)
 
 
@@ -1630,16 +1779,16 @@ void single_step_end(void)
   /*  5 cycles - opcode, address, data low read, data high read + op, */ \
   /* (?) */ \
   START_CYCLE(2) \
-  _address = _dp + get_byte_spc(_PC); \
+  _address = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _data16 = get_byte_spc(_address); \
+  _data16 = get_byte_spc(active_context, _address); \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _data16 += get_byte_spc(_address + 1) << 8; \
+  _data16 += get_byte_spc(active_context, _address + 1) << 8; \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
@@ -1650,25 +1799,25 @@ void single_step_end(void)
   /*  6 cycles - opcode, address, data low read, data high read + op, */ \
   /* data low (?) write, data high write */ \
   START_CYCLE(2) \
-  _address = _dp + get_byte_spc(_PC); \
+  _address = _dp + get_code_spc(active_context, _PC); \
   _PC++; \
   END_CYCLE(2, 1) \
  \
   START_CYCLE(3) \
-  _data16 = get_byte_spc(_address); \
+  _data16 = get_byte_spc(active_context, _address); \
   END_CYCLE(3, 1) \
  \
   START_CYCLE(4) \
-  _data16 += get_byte_spc(_address + 1) << 8; \
+  _data16 += get_byte_spc(active_context, _address + 1) << 8; \
   END_CYCLE(4, 1) \
  \
   START_CYCLE(5) \
   OP_##OP(_data16) \
-  set_byte_spc(_address, _data16); \
+  set_byte_spc(active_context, _address, _data16); \
   END_CYCLE(5, 1) \
  \
   START_CYCLE(6) \
-  set_byte_spc(_address + 1, _data16 >> 8); \
+  set_byte_spc(active_context, _address + 1, _data16 >> 8); \
   END_OPCODE(1)
 
 
@@ -1694,1849 +1843,551 @@ void single_step_end(void)
   END_OPCODE(1)
 
 
-static void Execute_SPC(void)
+static void Execute_SPC_Whole(SPC700_CONTEXT *active_context);
+
+static void Execute_SPC(SPC700_CONTEXT *active_context)
 {
   unsigned char was_in_cpu = In_CPU;
   In_CPU = 0;
 
-  load_cycles_spc();
+  load_cycles_spc(active_context);
   
-  while (_WorkCycles < 0)
+  while (_WorkCycles < 0 && !_halted)
   {
     int opcode_done = 1;
 
+#ifndef OPCODE_TRACE_LOG
+    if (_cycle == 0 && !active_context->cycle_by_cycle)
+    {
+      Execute_SPC_Whole(active_context);
+      continue;
+    }
+#endif
+
     START_CYCLE(1)
+      if (active_context->trace)
+      {
+        save_cycles_spc(active_context);
+        active_context->trace(active_context->trace_opaque,
+          SPC_TRACE_INSTRUCTION, _PC, 0);
+      }
       /* fetch opcode */
-      _opcode = get_byte_spc(_PC);
+      _opcode = get_code_spc(active_context, _PC);
       _PC++;
     END_FETCH_CYCLE()
 
     switch (_opcode)
     {
-    /* xxx00000 */
-    case 0x00:  /* NOP */
-      {
-        START_CYCLE(2)
-        END_OPCODE(1)
-      }
-
-    case 0x20:  /* CLRP */
-      {
-        START_CYCLE(2)
-        clr_flag_spc(SPC_FLAG_P);
-        END_OPCODE(1)
-      }
-
-    case 0x40:  /* SETP */
-      {
-        START_CYCLE(2)
-        set_flag_spc(SPC_FLAG_P);
-        END_OPCODE(1)
-      }
-
-    case 0x60:  /* CLRC */
-      {
-        START_CYCLE(2)
-        clr_flag_spc(SPC_FLAG_C);
-        END_OPCODE(1)
-      }
-
-    case 0x80:  /* SETC */
-      {
-        START_CYCLE(2)
-        set_flag_spc(SPC_FLAG_C);
-        END_OPCODE(1)
-      }
-
-    case 0xA0:  /* EI */
-      {
-        START_CYCLE(2)
-        set_flag_spc(SPC_FLAG_I);
-        END_OPCODE(1)
-      }
-
-    case 0xC0:  /* DI */
-      {
-        START_CYCLE(2)
-        clr_flag_spc(SPC_FLAG_I);
-        END_OPCODE(1)
-      }
-
-    case 0xE0:  /* CLRV */
-      {
-        START_CYCLE(2)
-        clr_flag_spc(SPC_FLAG_H | SPC_FLAG_V);
-        END_OPCODE(1)
-      }
-
-
-    /* xxxx0001 */
-#define opcode_TCALL(vector) (((vector) << 4) + 0x01)
-    case opcode_TCALL( 0): case opcode_TCALL( 1):
-    case opcode_TCALL( 2): case opcode_TCALL( 3):
-    case opcode_TCALL( 4): case opcode_TCALL( 5):
-    case opcode_TCALL( 6): case opcode_TCALL( 7):
-    case opcode_TCALL( 8): case opcode_TCALL( 9):
-    case opcode_TCALL(10): case opcode_TCALL(11):
-    case opcode_TCALL(12): case opcode_TCALL(13):
-    case opcode_TCALL(14): case opcode_TCALL(15):
-      {
-        OP_TCALL(_opcode >> 4)
-      }
-
-
-    /* xxx00010 */
-#define opcode_SET1(bit) (((bit) << 5) + 0x02)
-    case opcode_SET1(0): case opcode_SET1(1):
-    case opcode_SET1(2): case opcode_SET1(3):
-    case opcode_SET1(4): case opcode_SET1(5):
-    case opcode_SET1(6): case opcode_SET1(7):
-      {
-        OP_RMW_DP(WRITE_OP(SET1), 1)
-      }
-
-    /* xxx00011 */
-#define opcode_BBS(bit) (((bit) << 5) + 0x03)
-    case opcode_BBS(0): case opcode_BBS(1):
-    case opcode_BBS(2): case opcode_BBS(3):
-    case opcode_BBS(4): case opcode_BBS(5):
-    case opcode_BBS(6): case opcode_BBS(7):
-      {
-        COND_DP_REL(DP_REL_TEST_BBS)
-      }
-
-    /* xxx00100 */
-    case 0x04:  /* OR A,dp */
-      {
-        OP_READ_DP_A(OR)
-      }
-
-    case 0x24:  /* AND A,dp */
-      {
-        OP_READ_DP_A(AND)
-      }
-
-    case 0x44:  /* EOR A,dp */
-      {
-        OP_READ_DP_A(EOR)
-      }
+#include "spc700_ops.h"
+    }
+    if (opcode_done) _cycle = 0;
+  }
 
-    case 0x64:  /* CMP A,dp */
-      {
-        OP_READ_DP_A(CMP)
-      }
+  /* A halted CPU just lets the time go by */
+  if (_halted && _WorkCycles < 0) _WorkCycles = 0;
 
-    case 0x84:  /* ADC A,dp */
-      {
-        OP_READ_DP_A(ADC)
-      }
+  save_cycles_spc(active_context);    /* Set cycle counter */
 
-    case 0xA4:  /* SBC A,dp */
-      {
-        OP_READ_DP_A(SBC)
-      }
+  /* update SPC700 timers to prevent overflow */
+  Update_SPC_Timer(active_context, 0);
+  Update_SPC_Timer(active_context, 1);
+  Update_SPC_Timer(active_context, 2);
 
-    case 0xC4:  /* MOV dp,A */
-      {
-        OP_RMW_DP(WRITE_MOV(_A), 0)
-      }
+  In_CPU = was_in_cpu;
+}
 
-    case 0xE4:  /* MOV A,dp */
-      {
-        OP_READ_DP_A(MOV_READ)
-      }
+/* Cycles taken by each opcode, counting the taken path of conditional
+   branches.  SLEEP and STOP are given their nominal length. */
+static const unsigned char SPC_OpCycles[256] =
+{
+   2,  8,  4,  7,  3,  4,  3,  6,  2,  6,  5,  4,  5,  4,  6,  8,  /* 0 */
+   4,  8,  4,  7,  4,  5,  5,  6,  5,  5,  6,  5,  2,  2,  4,  6,  /* 1 */
+   2,  8,  4,  7,  3,  4,  3,  6,  2,  6,  5,  4,  5,  4,  7,  4,  /* 2 */
+   4,  8,  4,  7,  4,  5,  5,  6,  5,  5,  6,  5,  2,  2,  3,  8,  /* 3 */
+   2,  8,  4,  7,  3,  4,  3,  6,  2,  6,  4,  4,  5,  4,  6,  6,  /* 4 */
+   4,  8,  4,  7,  4,  5,  5,  6,  5,  5,  4,  5,  2,  2,  4,  3,  /* 5 */
+   2,  8,  4,  7,  3,  4,  3,  6,  2,  6,  4,  4,  5,  4,  7,  5,  /* 6 */
+   4,  8,  4,  7,  4,  5,  5,  6,  5,  5,  5,  5,  2,  2,  3,  6,  /* 7 */
+   2,  8,  4,  7,  3,  4,  3,  6,  2,  6,  5,  4,  5,  2,  4,  5,  /* 8 */
+   4,  8,  4,  7,  4,  5,  5,  6,  5,  5,  5,  5,  2,  2, 12,  5,  /* 9 */
+   2,  8,  4,  7,  3,  4,  3,  6,  2,  6,  4,  4,  5,  2,  4,  4,  /* A */
+   4,  8,  4,  7,  4,  5,  5,  6,  5,  5,  5,  5,  2,  2,  3,  4,  /* B */
+   2,  8,  4,  7,  4,  5,  4,  7,  2,  5,  6,  4,  5,  2,  4,  9,  /* C */
+   4,  8,  4,  7,  5,  6,  6,  7,  4,  5,  5,  5,  2,  2,  8,  3,  /* D */
+   2,  8,  4,  7,  3,  4,  3,  6,  2,  4,  5,  3,  4,  2,  4,  3,  /* E */
+   4,  8,  4,  7,  4,  5,  5,  6,  3,  4,  5,  4,  2,  2,  6,  3,  /* F */
+};
 
+/* Whole-instruction path.  Entered at an instruction boundary, it runs every
+   instruction that will complete within the cycles remaining, and hands any
+   other over to the resumable path above just after fetching it, so only an
+   instruction a stop actually lands in is run cycle by cycle.  Unless
+   whole_instructions is set, in which case nothing is handed over and the
+   run may end past its stop.  Either way, the per-cycle stop checks and the
+   saved _cycle position are dropped here, and the instruction temporaries
+   live in locals rather than in the context.  So do PC, YA, X, SP and the
+   cycle counter, which would otherwise have to be reloaded after every store
+   to RAM; they are only written back to the context on the way out, and the
+   cycle counter also before any access that may reach a handler needing it.
+   Under GCC-compatible compilers each handler ends by fetching the next
+   opcode and jumping straight to its handler through a label table, instead
+   of going back around a shared switch.  Instructions are read straight
+   from the RAM they are in where possible; see FETCH_PLAIN_OPCODE(). */
+
+/* Memory accesses from the whole-instruction path.  Plain RAM in a page with
+   nothing watching it is accessed inline, and so is the RAM below the
+   registers in the zero page, which is where drivers keep their variables;
+   anything else goes through the usual handlers, with the cycle counter
+   stored back for them first.  So does every write while tracing, and every
+   write to a page blocks were translated from, to drop them. */
+static unsigned char get_byte_spc_whole(SPC700_CONTEXT *active_context,
+                                        unsigned short address,
+                                        int32_t work_cycles)
+{
+  const unsigned char *page = _read_map[address >> 8];
 
-    /* xxx00101 */
-    case 0x05:  /* OR A,abs */
-      {
-        OP_READ_ABS_A(OR)
-      }
+  if (!(active_context->watch[address >> 8] & SPC_WATCH_READ))
+  {
+    if (page) return page[address & 0xFF];
+    if (address < 0xF0) return SPCRAM[address];
+  }
+  _WorkCycles = work_cycles;
+  return get_byte_spc(active_context, address);
+}
 
-    case 0x25:  /* AND A,abs */
-      {
-        OP_READ_ABS_A(AND)
-      }
+static void set_byte_spc_whole(SPC700_CONTEXT *active_context,
+                               unsigned short address, unsigned char data,
+                               int32_t work_cycles)
+{
+  unsigned char *page = _write_map[address >> 8];
 
-    case 0x45:  /* EOR A,abs */
-      {
-        OP_READ_ABS_A(EOR)
-      }
+  if (!(active_context->watch[address >> 8] &
+        (SPC_WATCH_WRITE | SPC_WATCH_NOTIFY)) && !active_context->trace &&
+      !active_context->code_watch[address >> 8])
+  {
+    if (page)
+    {
+      page[address & 0xFF] = data;
+      return;
+    }
+    if (address < 0xF0)
+    {
+      SPCRAM[address] = data;
+      return;
+    }
+  }
+  _WorkCycles = work_cycles;
+  set_byte_spc(active_context, address, data);
+}
 
-    case 0x65:  /* CMP A,abs */
-      {
-        OP_READ_ABS_A(CMP)
-      }
+/* Nonzero for the compares that run fused with a conditional branch after
+   them, all 2 bytes long; see FETCH_PLAIN_OPCODE() */
+static const unsigned char spc_fusable_compare[256] =
+{
+  [0x64] = 1,  /* CMP A,dp */
+  [0x3E] = 1,  /* CMP X,dp */
+  [0x7E] = 1,  /* CMP Y,dp */
+  [0x68] = 1,  /* CMP A,#imm */
+  [0xC8] = 1,  /* CMP X,#imm */
+  [0xAD] = 1   /* CMP Y,#imm */
+};
 
-    case 0x85:  /* ADC A,abs */
-      {
-        OP_READ_ABS_A(ADC)
-      }
+/* Fast-forward through a timer polling loop such as
 
-    case 0xA5:  /* SBC A,abs */
-      {
-        OP_READ_ABS_A(SBC)
-      }
+     loop: MOV A,$FD
+           BEQ loop
 
-    case 0xC5:  /* MOV abs,A */
-      {
-        OP_RMW_ABS(WRITE_MOV(_A), 0)
-      }
+   which is where most sound drivers spend most of their time.  Called with
+   pc pointing at the MOV as the BEQ jumps back to it, and work_cycles as of
+   that point.  An iteration takes 7 cycles and reads the counter 2 cycles
+   in; for as long as the counter reads zero, all it leaves behind is a zero
+   in the register and the flags.  Returns the cycles taken by however many
+   iterations are certain to see a zero, and fit in the cycles remaining. */
+static int32_t spc_idle_loop_cycles(SPC700_CONTEXT *active_context,
+                                    unsigned short pc, int32_t work_cycles)
+{
+  const unsigned char *page = _read_map[pc >> 8];
+  unsigned char opcode, operand;
+  int32_t iterations, until_tick;
+  int timer;
+
+  if (!page || (pc & 0xFF) == 0xFF || _direct_page) return 0;
+  opcode = page[pc & 0xFF];
+  operand = page[(pc & 0xFF) + 1];
+  if ((opcode != 0xE4 && opcode != 0xF8 && opcode != 0xEB) ||
+      operand < 0xFD)
+  {
+    return 0;
+  }
 
-    case 0xE5:  /* MOV A,abs */
-      {
-        OP_READ_ABS_A(MOV_READ)
-      }
+  iterations = -work_cycles / 7;
 
+  /* A stopped timer never counts, otherwise stop short of its next tick */
+  timer = operand - 0xFD;
+  if (SPC_CTRL & BIT(timer))
+  {
+    if (_timers[timer].counter) return 0;
+    until_tick = _timers[timer].next_tick - (_Cycles + work_cycles + 2);
+    if (until_tick <= 0) return 0;
+    if ((until_tick + 6) / 7 < iterations) iterations = (until_tick + 6) / 7;
+  }
 
-    /* xxx00110 */
-    case 0x06:  /* OR A,(X) */
-      {
-        OP_READ_INDIRECT_A(OR)
-      }
+  return iterations * 7;
+}
 
-    case 0x26:  /* AND A,(X) */
-      {
-        OP_READ_INDIRECT_A(AND)
-      }
+#undef START_CYCLE
+#undef END_FETCH_CYCLE
+#undef END_CYCLE
+#undef EXIT_OPCODE
+#undef END_OPCODE
+#undef CASE_OPCODE
+#undef END_INVALID_OPCODE
+#undef BRANCH_TAKEN
+#undef get_code_spc
+
+#define START_CYCLE(c) {
+#define END_CYCLE(c,n) _WorkCycles += n; }
+#define END_OPCODE(n) EXIT_OPCODE(n) }
+#define END_INVALID_OPCODE() goto done;
 
-    case 0x46:  /* EOR A,(X) */
-      {
-        OP_READ_INDIRECT_A(EOR)
-      }
+/* Only ever a BEQ back over a 2-byte instruction can close a polling loop,
+   and a BNE back over a DEC, or a DBNZ Y onto itself, a delay loop.  The
+   last cycle of the branch has yet to be counted here. */
+#define BRANCH_TAKEN() \
+  if (_opcode == 0xF0 && _offset == 0xFC) \
+  { \
+    int32_t idle = spc_idle_loop_cycles(active_context, _PC, _WorkCycles + 1); \
+    if (idle) \
+    { \
+      TRACE_SKIP() \
+      switch (_read_map[_PC >> 8][_PC & 0xFF]) \
+      { \
+        case 0xE4: _A = 0; break; \
+        case 0xF8: _X = 0; break; \
+        default: _Y = 0; break; \
+      } \
+      store_flags_nz(active_context, 0); \
+      _WorkCycles += idle; \
+    } \
+  } \
+  else if (_opcode == 0xD0 && _offset == 0xFD && _read_map[_PC >> 8]) \
+  { \
+    switch (_read_map[_PC >> 8][_PC & 0xFF]) \
+    { \
+      case 0x9C: SKIP_DELAY_LOOP(_A, 6, store_flags_nz(active_context, _A)) \
+        break; \
+      case 0x1D: SKIP_DELAY_LOOP(_X, 6, store_flags_nz(active_context, _X)) \
+        break; \
+      case 0xDC: SKIP_DELAY_LOOP(_Y, 6, store_flags_nz(active_context, _Y)) \
+        break; \
+    } \
+  } \
+  else if (_opcode == 0xFE && _offset == 0xFE) \
+  { \
+    SKIP_DELAY_LOOP(_Y, 6, ) \
+  }
 
-    case 0x66:  /* CMP A,(X) */
-      {
-        OP_READ_INDIRECT_A(CMP)
-      }
+/* Tells the trace that the loop starting at PC is about to be skipped, from
+   the current cycle up to wherever the next event comes */
+#define TRACE_SKIP() \
+  if (active_context->trace) \
+  { \
+    save_cycles_spc(active_context); \
+    active_context->trace(active_context->trace_opaque, SPC_TRACE_SKIP, \
+      _PC, 0); \
+  }
 
-    case 0x86:  /* ADC A,(X) */
-      {
-        OP_READ_INDIRECT_A(ADC)
-      }
+/* Counts reg down by as many whole iterations of a delay loop as leave it
+   nonzero and fit in the cycles remaining, then reruns FLAGS. */
+#define SKIP_DELAY_LOOP(reg, cycles, FLAGS) \
+  { \
+    int32_t skip = -(_WorkCycles + 1) / (cycles); \
+    if (skip >= (reg)) skip = (reg) - 1; \
+    if (skip > 0) \
+    { \
+      TRACE_SKIP() \
+      (reg) -= skip; \
+      FLAGS; \
+      _WorkCycles += skip * (cycles); \
+    } \
+  }
+
+#undef _opcode
+#undef _data
+#undef _data2
+#undef _data16
+#undef _offset
+#undef _address
+#undef _address_l
+#undef _address_h
+#undef _address2
+#undef _address2_l
+#undef _address2_h
+
+#define _opcode         opcode
+#define _data           data
+#define _data2          data2
+#define _data16         data16.w
+#define _offset         offset
+#define _address        address.w
+#define _address_l      address.b.l
+#define _address_h      address.b.h
+#define _address2       address2.w
+#define _address2_l     address2.b.l
+#define _address2_h     address2.b.h
+
+#undef _PC
+#undef _YA
+#undef _A
+#undef _Y
+#undef _X
+#undef _SP
+#undef _WorkCycles
+
+#define _PC             pc.w
+#define _YA             ya.w
+#define _A              ya.b.l
+#define _Y              ya.b.h
+#define _X              x
+#define _SP             sp
+#define _WorkCycles     work_cycles
+
+#define LOAD_REGISTERS() \
+  (pc.w = active_context->PC.w, ya.w = active_context->YA.w, \
+   x = active_context->X, sp = active_context->SP, \
+   work_cycles = active_context->WorkCycles)
+
+#define SAVE_REGISTERS() \
+  (active_context->PC.w = pc.w, active_context->YA.w = ya.w, \
+   active_context->X = x, active_context->SP = sp, \
+   active_context->WorkCycles = work_cycles)
+
+#define get_byte_spc(ctx, address) \
+  get_byte_spc_whole(ctx, address, work_cycles)
+#define set_byte_spc(ctx, address, data) \
+  set_byte_spc_whole(ctx, address, data, work_cycles)
+#define get_code_spc(ctx, address) \
+  (code ? code[(address) & 0xFF] : get_byte_spc(ctx, address))
+#define save_cycles_spc(ctx) (SAVE_REGISTERS(), save_cycles_spc(ctx))
+#define load_cycles_spc(ctx) (load_cycles_spc(ctx), LOAD_REGISTERS())
+
+/* Tracing is left to a single out-of-line copy, as this is expanded at the
+   end of every handler */
+#define FETCH_OPCODE() \
+  if (_WorkCycles >= 0) goto done; \
+  if (active_context->trace) goto trace_fetch; \
+  FETCH_UNTRACED_OPCODE()
+
+#define TRACE_FETCH() \
+  trace_fetch: \
+  save_cycles_spc(active_context); \
+  active_context->trace(active_context->trace_opaque, SPC_TRACE_INSTRUCTION, \
+    _PC, 0); \
+  FETCH_UNTRACED_OPCODE()
+
+#ifdef SPC_JIT
+#define FETCH_UNTRACED_OPCODE() goto jit_fetch;
+#else
+#define FETCH_UNTRACED_OPCODE() FETCH_PLAIN_OPCODE()
+#endif
 
-    case 0xA6:  /* SBC A,(X) */
-      {
-        OP_READ_INDIRECT_A(SBC)
-      }
+/* A block translated by spc700_jit.c runs from the registers in the context
+   instead of the instructions it was translated from, after which fetching
+   starts over */
+#define JIT_FETCH() \
+  jit_fetch: \
+  jit_code = spc_jit_block(active_context, _PC, _WorkCycles, limit); \
+  if (jit_code) \
+  { \
+    SAVE_REGISTERS(); \
+    jit_code(active_context); \
+    LOAD_REGISTERS(); \
+    FETCH_OPCODE() \
+  } \
+  FETCH_PLAIN_OPCODE()
+
+/* An instruction lying wholly within a page of plain RAM that nothing
+   watches for reads is read straight from the page, through code, opcode and
+   operands alike; any other goes through get_byte_spc().  Nothing is kept
+   from one fetch to the next, so writes to code, by the CPU or by the DSP
+   to its echo region, need no handling here.  A compare followed by a
+   conditional branch is run as a pair, without a fetch in between, if the
+   branch would be fetched and run without a hand-over anyway. */
+#define FETCH_PLAIN_OPCODE() \
+  code = (_PC & 0xFF) > 0xFD || \
+         (active_context->watch[_PC >> 8] & SPC_WATCH_READ) ? \
+         0 : _read_map[_PC >> 8]; \
+  _opcode = get_code_spc(active_context, _PC); \
+  _PC++; \
+  _WorkCycles++; \
+  if (_WorkCycles + SPC_OpCycles[_opcode] > limit) \
+  { \
+    active_context->opcode = _opcode; \
+    _cycle = 1; \
+    goto done; \
+  } \
+  /* conditional branches are xxx10000, and all take the same cycles */ \
+  if (spc_fusable_compare[_opcode] && code && (_PC & 0xFF) < 0xFD && \
+      (code[(_PC + 1) & 0xFF] & 0x1F) == 0x10 && \
+      _WorkCycles + SPC_OpCycles[_opcode] <= 0 && \
+      _WorkCycles + SPC_OpCycles[_opcode] + SPC_OpCycles[0x10] <= limit) \
+  { \
+    goto fused; \
+  }
 
-    case 0xC6:  /* MOV (X),A */
-      {
-        OP_RMW_INDIRECT(WRITE_MOV(_A), 0)
-      }
+/* A fused compare goes straight on to the branch once it is done, so the
+   branch has to be traced here.  Should the compare have led the DSP to
+   write over the branch, whatever is there now is fetched as usual instead.
+   Expanded with EXIT_OPCODE() redefined to go to fused_branch, and followed
+   by a dispatch on _opcode. */
+#define FUSED_COMPARES() \
+  fused: \
+  switch (_opcode) \
+  { \
+    case 0x64: { OP_READ_DP_A(CMP) } \
+    case 0x3E: { OP_READ_DP(CMP, _X) } \
+    case 0x7E: { OP_READ_DP(CMP, _Y) } \
+    case 0x68: { OP_READ_IMM_A(CMP) } \
+    case 0xC8: { OP_READ_IMM(CMP, _X) } \
+    case 0xAD: { OP_READ_IMM(CMP, _Y) } \
+  } \
+ \
+  fused_branch: \
+  if ((code[_PC & 0xFF] & 0x1F) != 0x10) \
+  { \
+    FETCH_OPCODE() \
+    goto fused_dispatch; \
+  } \
+  if (active_context->trace) \
+  { \
+    save_cycles_spc(active_context); \
+    active_context->trace(active_context->trace_opaque, \
+      SPC_TRACE_INSTRUCTION, _PC, 0); \
+  } \
+  _opcode = code[_PC & 0xFF]; \
+  _PC++; \
+  _WorkCycles++; \
+ \
+  fused_dispatch:
 
-    case 0xE6:  /* MOV A,(X) */
-      {
-        OP_READ_INDIRECT_A(MOV_READ)
-      }
+#ifdef __GNUC__
 
+#define CASE_OPCODE(n) op_##n
+#define EXIT_OPCODE(n) { _WorkCycles += n; FETCH_OPCODE() goto *dispatch[_opcode]; }
 
-    /* xxx00111 */
-    case 0x07:  /* OR A,(dp+X) */
-      {
-        OP_READ_INDEXED_INDIRECT_A(OR)
-      }
+#define OPCODE_ROW(h) \
+  &&op_0x##h##0, &&op_0x##h##1, &&op_0x##h##2, &&op_0x##h##3, \
+  &&op_0x##h##4, &&op_0x##h##5, &&op_0x##h##6, &&op_0x##h##7, \
+  &&op_0x##h##8, &&op_0x##h##9, &&op_0x##h##A, &&op_0x##h##B, \
+  &&op_0x##h##C, &&op_0x##h##D, &&op_0x##h##E, &&op_0x##h##F
 
-    case 0x27:  /* AND A,(dp+X) */
-      {
-        OP_READ_INDEXED_INDIRECT_A(AND)
-      }
+/* Labels as values and computed goto are GNU extensions */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
 
-    case 0x47:  /* EOR A,(dp+X) */
-      {
-        OP_READ_INDEXED_INDIRECT_A(EOR)
-      }
+static void Execute_SPC_Whole(SPC700_CONTEXT *active_context)
+{
+  static const void *const dispatch[256] =
+  {
+    OPCODE_ROW(0), OPCODE_ROW(1), OPCODE_ROW(2), OPCODE_ROW(3),
+    OPCODE_ROW(4), OPCODE_ROW(5), OPCODE_ROW(6), OPCODE_ROW(7),
+    OPCODE_ROW(8), OPCODE_ROW(9), OPCODE_ROW(A), OPCODE_ROW(B),
+    OPCODE_ROW(C), OPCODE_ROW(D), OPCODE_ROW(E), OPCODE_ROW(F)
+  };
+  /* Nothing fetched in whole_instructions mode goes over this */
+  const int32_t limit =
+    active_context->whole_instructions ? SPC_MAX_OPCODE_CYCLES + 1 : 1;
+  unsigned char opcode, data, data2, offset;
+  Word2B address, address2, data16;
+  Word2B pc, ya;
+  unsigned char x, sp;
+  int32_t work_cycles;
+  const unsigned char *code;
+#ifdef SPC_JIT
+  SPC_JIT_CODE jit_code;
+#endif
 
-    case 0x67:  /* CMP A,(dp+X) */
-      {
-        OP_READ_INDEXED_INDIRECT_A(CMP)
-      }
+  LOAD_REGISTERS();
 
-    case 0x87:  /* ADC A,(dp+X) */
-      {
-        OP_READ_INDEXED_INDIRECT_A(ADC)
-      }
+  FETCH_OPCODE()
+  goto *dispatch[_opcode];
 
-    case 0xA7:  /* SBC A,(dp+X) */
-      {
-        OP_READ_INDEXED_INDIRECT_A(SBC)
-      }
+  TRACE_FETCH()
+  goto *dispatch[_opcode];
 
-    case 0xC7:  /* MOV (dp+X),A */
-      {
-        OP_RMW_INDEXED_INDIRECT(WRITE_MOV(_A), 0)
-      }
+#ifdef SPC_JIT
+  JIT_FETCH()
+  goto *dispatch[_opcode];
+#endif
 
-    case 0xE7:  /* MOV A,(dp+X) */
-      {
-        OP_READ_INDEXED_INDIRECT_A(MOV_READ)
-      }
+#include "spc700_ops.h"
 
+#undef EXIT_OPCODE
+#define EXIT_OPCODE(n) { _WorkCycles += n; goto fused_branch; }
 
-    /* xxx01000 */
-    case 0x08:  /* OR A,#imm */
-      {
-        OP_READ_IMM_A(OR)
-      }
+  FUSED_COMPARES()
+  goto *dispatch[_opcode];
 
-    case 0x28:  /* AND A,#imm */
-      {
-        OP_READ_IMM_A(AND)
-      }
+done:
+  SAVE_REGISTERS();
+}
 
-    case 0x48:  /* EOR A,#imm */
-      {
-        OP_READ_IMM_A(EOR)
-      }
+#pragma GCC diagnostic pop
 
-    case 0x68:  /* CMP A,#imm */
-      {
-        OP_READ_IMM_A(CMP)
-      }
+#else  /* !__GNUC__ */
 
-    case 0x88:  /* ADC A,#imm */
-      {
-        OP_READ_IMM_A(ADC)
-      }
+#define CASE_OPCODE(n) case n
+#define EXIT_OPCODE(n) { _WorkCycles += n; continue; }
 
-    case 0xA8:  /* SBC A,#imm */
-      {
-        OP_READ_IMM_A(SBC)
-      }
+static void Execute_SPC_Whole(SPC700_CONTEXT *active_context)
+{
+  /* Nothing fetched in whole_instructions mode goes over this */
+  const int32_t limit =
+    active_context->whole_instructions ? SPC_MAX_OPCODE_CYCLES + 1 : 1;
+  unsigned char opcode, data, data2, offset;
+  Word2B address, address2, data16;
+  Word2B pc, ya;
+  unsigned char x, sp;
+  int32_t work_cycles;
+  const unsigned char *code;
+#ifdef SPC_JIT
+  SPC_JIT_CODE jit_code;
+#endif
 
-    case 0xC8:  /* CMP X,#imm */
-      {
-        OP_READ_IMM(CMP, _X)
-      }
+  LOAD_REGISTERS();
 
-    case 0xE8:  /* MOV A,#imm */
-      {
-        OP_READ_IMM_A(MOV_READ)
-      }
+  for (;;)
+  {
+    FETCH_OPCODE()
 
+  dispatch:
+    switch (_opcode)
+    {
+#include "spc700_ops.h"
+    }
+  }
 
-    /* xxx01001 */
-    case 0x09:  /* OR dp(d),dp(s) */
-      {
-        OP_RMW_DP_DP(OR)
-      }
+  TRACE_FETCH()
+  goto dispatch;
 
-    case 0x29:  /* AND dp(d),dp(s) */
-      {
-        OP_RMW_DP_DP(AND)
-      }
+#ifdef SPC_JIT
+  JIT_FETCH()
+  goto dispatch;
+#endif
 
-    case 0x49:  /* EOR dp(d),dp(s) */
-      {
-        OP_RMW_DP_DP(EOR)
-      }
+#undef EXIT_OPCODE
+#define EXIT_OPCODE(n) { _WorkCycles += n; goto fused_branch; }
 
-    case 0x69:  /* CMP dp(d),dp(s) */
-      {
-        /*  6 cycles - opcode, src address, dest address, src read, */
-        /* dest read + op, dummy cycle */
-        START_CYCLE(2)
-        _address2 = _dp + get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address = _dp + get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data2 = get_byte_spc(_address2);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        _data = get_byte_spc(_address);
-        OP_CMP(_data, _data2)
-        END_OPCODE(2)
-      }
+  FUSED_COMPARES()
+  goto dispatch;
 
-    case 0x89:  /* ADC dp(d),dp(s) */
-      {
-        OP_RMW_DP_DP(ADC)
-      }
+done:
+  SAVE_REGISTERS();
+}
 
-    case 0xA9:  /* SBC dp(d),dp(s) */
-      {
-        OP_RMW_DP_DP(SBC)
-      }
-
-    case 0xC9:  /* MOV abs,X */
-      {
-        OP_RMW_ABS(WRITE_MOV(_X), 0)
-      }
-
-    case 0xE9:  /* MOV X,abs */
-      {
-        OP_READ_ABS(MOV_READ, _X)
-      }
-
-
-    /* xxx01010 */
-    case 0x0A:  /* OR1 C,mem.bit */
-      {
-        /*  5 cycles - opcode, address low, address high, data read, op */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        /* separate bit number, address */
-        _offset = _address >> 13;
-        _address &= 0x1FFF;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        if (_data & offset_to_bit[_offset]) set_flag_spc(SPC_FLAG_C);
-        END_OPCODE(1)
-      }
-
-    case 0x2A:  /* OR1 C,/mem.bit */
-      {
-        /*  5 cycles - opcode, address low, address high, data read, op */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        /* separate bit number, address */
-        _offset = _address >> 13;
-        _address &= 0x1FFF;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        if (!(_data & offset_to_bit[_offset])) set_flag_spc(SPC_FLAG_C);
-        END_OPCODE(1)
-      }
-
-    case 0x4A:  /* AND1 C,mem.bit */
-      {
-        /*  4 cycles - opcode, address low, address high, data read + op */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        /* separate bit number, address */
-        _offset = _address >> 13;
-        _address &= 0x1FFF;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        if (!(_data & offset_to_bit[_offset])) clr_flag_spc(SPC_FLAG_C);
-        END_OPCODE(1)
-      }
-
-    case 0x6A:  /* AND1 C,/mem.bit */
-      {
-        /*  4 cycles - opcode, address low, address high, data read + op */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        /* separate bit number, address */
-        _offset = _address >> 13;
-        _address &= 0x1FFF;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        if (_data & offset_to_bit[_offset]) clr_flag_spc(SPC_FLAG_C);
-        END_OPCODE(1)
-      }
-
-    case 0x8A:  /* EOR1 C,mem.bit */
-      {
-        /*  5 cycles - opcode, address low, address high, data read, op */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        /* separate bit number, address */
-        _offset = _address >> 13;
-        _address &= 0x1FFF;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        if (_data & offset_to_bit[_offset]) complement_carry_spc();
-        END_OPCODE(1)
-      }
-
-    case 0xAA:  /* MOV1 C,mem.bit */
-      {
-        /*  4 cycles - opcode, address low, address high, data read */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        /* separate bit number, address */
-        _offset = _address >> 13;
-        _address &= 0x1FFF;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        store_flag_c(_data & offset_to_bit[_offset]);
-        END_OPCODE(1)
-      }
-
-    case 0xCA:  /* MOV1 mem.bit,C */
-      {
-        /*  6 cycles - opcode, address low, address high, data read, op, */
-        /* data write */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        /* separate bit number, address */
-        _offset = _address >> 13;
-        _address &= 0x1FFF;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        if (flag_state_spc(SPC_FLAG_C)) _data |= offset_to_bit[_offset];
-        else _data &= offset_to_not[_offset];
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        set_byte_spc(_address, _data);
-        END_OPCODE(1)
-      }
-
-    case 0xEA:  /* NOT1 mem.bit */
-      {
-        /*  5 cycles - opcode, address low, address high, data read, */
-        /* op + data write */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        /* separate bit number, address */
-        _offset = _address >> 13;
-        _address &= 0x1FFF;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        _data ^= offset_to_bit[_offset];
-        set_byte_spc(_address, _data);
-        END_OPCODE(1)
-      }
-
-
-    /* xxx01011 */
-    case 0x0B:  /* ASL dp */
-      {
-        OP_RMW_DP(WRITE_OP(ASL), 1)
-      }
-
-    case 0x2B:  /* ROL dp */
-      {
-        OP_RMW_DP(WRITE_OP(ROL), 1)
-      }
-
-    case 0x4B:  /* LSR dp */
-      {
-        OP_RMW_DP(WRITE_OP(LSR), 1)
-      }
-
-    case 0x6B:  /* ROR dp */
-      {
-        OP_RMW_DP(WRITE_OP(ROR), 1)
-      }
-
-    case 0x8B:  /* DEC dp */
-      {
-        OP_RMW_DP(WRITE_OP(DEC), 1)
-      }
-
-    case 0xAB:  /* INC dp */
-      {
-        OP_RMW_DP(WRITE_OP(INC), 1)
-      }
-
-    case 0xCB:  /* MOV dp,Y */
-      {
-        OP_RMW_DP(WRITE_MOV(_Y), 0)
-      }
-
-    case 0xEB:  /* MOV Y,dp */
-      {
-        OP_READ_DP(MOV_READ, _Y)
-      }
-
-
-    /* xxx01100 */
-    case 0x0C:  /* ASL abs */
-      {
-        OP_RMW_ABS(WRITE_OP(ASL), 1)
-      }
-
-    case 0x2C:  /* ROL abs */
-      {
-        OP_RMW_ABS(WRITE_OP(ROL), 1)
-      }
-
-    case 0x4C:  /* LSR abs */
-      {
-        OP_RMW_ABS(WRITE_OP(LSR), 1)
-      }
-
-    case 0x6C:  /* ROR abs */
-      {
-        OP_RMW_ABS(WRITE_OP(ROR), 1)
-      }
-
-    case 0x8C:  /* DEC abs */
-      {
-        OP_RMW_ABS(WRITE_OP(DEC), 1)
-      }
-
-    case 0xAC:  /* INC abs */
-      {
-        OP_RMW_ABS(WRITE_OP(INC), 1)
-      }
-
-    case 0xCC:  /* MOV abs,Y */
-      {
-        OP_RMW_ABS(WRITE_MOV(_Y), 0)
-      }
-
-    case 0xEC:  /* MOV Y,abs */
-      {
-        OP_READ_ABS(MOV_READ, _Y)
-      }
-
-
-    /* xxx01101 */
-    case 0x0D:  /* PUSH PSW */
-      {
-        /*  4 cycles - opcode, address load, data write, SP decrement */
-        START_CYCLE(2)
-        _address = 0x0100 + _SP;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        spc_setup_flags(_B_flag);
-        set_byte_spc(_address, _PSW);
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _SP--;
-        END_OPCODE(1)
-      }
-
-    case 0x2D:  /* PUSH A */
-      {
-        OP_PUSH(_A)
-      }
-
-    case 0x4D:  /* PUSH X */
-      {
-        OP_PUSH(_X)
-      }
-
-    case 0x6D:  /* PUSH Y */
-      {
-        OP_PUSH(_Y)
-      }
-
-    case 0x8D:  /* MOV Y,#imm */
-      {
-        OP_READ_IMM(MOV_READ, _Y)
-      }
-
-    case 0xAD:  /* CMP Y,#imm */
-      {
-        OP_READ_IMM(CMP, _Y)
-      }
-
-    case 0xCD:  /* MOV X,#imm */
-      {
-        OP_READ_IMM(MOV_READ, _X)
-      }
-
-    case 0xED:  /* NOTC */
-      {
-        /*  2 cycles - opcode, op */
-        START_CYCLE(2)
-        complement_carry_spc();
-        END_OPCODE(1)
-      }
-
-
-    /* xxx01110 */
-    case 0x0E:  /* TSET1 abs */
-      {
-        /*  6 cycles - opcode, address low, address high, data read, */
-        /* test for flags, op + data write */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        store_flags_nz(_data & _A);
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        _data |= _A;
-        set_byte_spc(_address, _data);
-        END_OPCODE(1)
-      }
-
-    case 0x2E:  /* CBNE dp,rel */
-      {
-        COND_DP_REL(TEST_CBNE)
-      }
-
-    case 0x4E:  /* TCLR1 abs */
-      {
-        /*  6 cycles - opcode, address low, address high, data read, */
-        /* test for flags, op + data write */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        store_flags_nz(_data & _A);
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        _data &= ~_A;
-        set_byte_spc(_address, _data);
-        END_OPCODE(1)
-      }
-
-    case 0x6E:  /* DBNZ dp,rel */
-      {
-        COND_DP_REL(DP_REL_TEST_DBNZ)
-      }
-
-    case 0x8E:  /* POP PSW */
-      {
-        /*  4 cycles - opcode, SP increment, address load, data read */
-        START_CYCLE(2)
-        _SP++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address = 0x0100 + _SP;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _PSW = get_byte_spc(_address);
-        spc_restore_flags();
-        END_OPCODE(1)
-      }
-
-    case 0xAE:  /* POP A */
-      {
-        OP_POP(_A)
-      }
-
-    case 0xCE:  /* POP X */
-      {
-        OP_POP(_X)
-      }
-
-    case 0xEE:  /* POP Y */
-      {
-        OP_POP(_Y)
-      }
-
-
-    /* xxx01111 */
-    case 0x0F:  /* BRK */
-      {
-        /*  8 cycles - opcode, new PCL, new PCH, stack address load, */
-        /* PSW write, PCH write, PCL write, SP decrement */
-        /* fetch address for PC */
-        START_CYCLE(2)
-        /* same vector as TCALL 0 */
-        _address = 0xFFC0 + ((15 - (0)) * 2);
-        _address2 = get_byte_spc(_address);
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address2 += (get_byte_spc(_address + 1) << 8);
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _address = 0x0100 + _SP;
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        set_byte_spc(_address, _PC >> 8);
-        _SP--;
-        _address = 0x0100 + _SP;
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        set_byte_spc(_address, _PC);
-        _SP--;
-        _address = 0x0100 + _SP;
-        END_CYCLE(6, 1)
-
-        START_CYCLE(7)
-        spc_setup_flags(_B_flag);
-        set_byte_spc(_address, _PSW);
-        set_flag_spc(SPC_FLAG_B);
-        clr_flag_spc(SPC_FLAG_I);
-        END_CYCLE(7, 1)
-
-        START_CYCLE(8)
-        _PC = _address2;
-        _SP--;
-        END_OPCODE(1)
-      }
-
-    case 0x2F:  /* BRA rel */
-      {
-        COND_REL(REL_TEST_BRA)
-      }
-
-    case 0x4F:  /* PCALL upage */
-      {
-        /*  6 cycles - opcode, new PCL, stack address load, PCH write, */
-        /* PCL write, SP decrement */
-        /* fetch address for PC */
-        START_CYCLE(2)
-        _address2 = 0xFF00 + get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address = 0x0100 + _SP;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        set_byte_spc(_address, _PC >> 8);
-        _SP--;
-        _address = 0x0100 + _SP;
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        set_byte_spc(_address, _PC);
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        _PC = _address2;
-        _SP--;
-        END_OPCODE(1)
-      }
-
-    case 0x6F:  /* RET */
-      {
-        /*  5 cycles - opcode, SP increment, address load, new PCL, new PCH */
-        /* pop address to PC */
-        START_CYCLE(2)
-        _SP++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3) \
-        _address = 0x0100 + _SP; \
-        END_CYCLE(3, 1) \
-
-        START_CYCLE(4) \
-        _address2 = get_byte_spc(_address);
-        _SP++;
-        _address = 0x0100 + _SP;
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        _PC = (get_byte_spc(_address) << 8) + _address2;
-        END_OPCODE(1)
-      }
-
-    case 0x8F:  /* MOV dp,#imm */
-      {
-        OP_RMW_DP_IMM(MOV_READ_NOFLAGS)
-      }
-
-    case 0xAF:  /* MOV (X)+,A */
-      {
-        /*  4 cycles - opcode, address load, data write, X increment */
-        START_CYCLE(2)
-        _address = _dp + _X;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        set_byte_spc(_address, _A);
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _X++;
-        END_OPCODE(1)
-      }
-
-    case 0xCF:  /* MUL YA */
-      {
-        /*  9 cycles - opcode, 8(op) */
-        START_CYCLE(2)
-        _YA = (unsigned) _Y * _A;
-        store_flags_nz(_Y);
-        END_OPCODE(8)
-      }
-
-    /* xxx10000 */
-    case 0x10:  /* BPL rel */
-      {
-        COND_REL(REL_TEST_BPL)
-      }
-
-    case 0x30:  /* BMI rel */
-      {
-        COND_REL(REL_TEST_BMI)
-      }
-
-    case 0x50:  /* BVC rel */
-      {
-        COND_REL(REL_TEST_BVC)
-      }
-
-    case 0x70:  /* BVS rel */
-      {
-        COND_REL(REL_TEST_BVS)
-      }
-
-    case 0x90:  /* BCC rel */
-      {
-        COND_REL(REL_TEST_BCC)
-      }
-
-    case 0xB0:  /* BCS rel */
-      {
-        COND_REL(REL_TEST_BCS)
-      }
-
-    case 0xD0:  /* BNE rel */
-      {
-        COND_REL(REL_TEST_BNE)
-      }
-
-    case 0xF0:  /* BEQ rel */
-      {
-        COND_REL(REL_TEST_BEQ)
-      }
-
-
-    /* xxx10010 */
-#define opcode_CLR1(bit) (((bit) << 5) + 0x12)
-    case opcode_CLR1(0): case opcode_CLR1(1):
-    case opcode_CLR1(2): case opcode_CLR1(3):
-    case opcode_CLR1(4): case opcode_CLR1(5):
-    case opcode_CLR1(6): case opcode_CLR1(7):
-      {
-        OP_RMW_DP(WRITE_OP(CLR1), 1)
-      }
-
-
-    /* xxx10011 */
-#define opcode_BBC(bit) (((bit) << 5) + 0x13)
-    case opcode_BBC(0): case opcode_BBC(1):
-    case opcode_BBC(2): case opcode_BBC(3):
-    case opcode_BBC(4): case opcode_BBC(5):
-    case opcode_BBC(6): case opcode_BBC(7):
-      {
-        COND_DP_REL(DP_REL_TEST_BBC)
-      }
-
-
-    /* xxx10100 */
-    case 0x14:  /* OR A,dp+X */
-      {
-        OP_READ_DP_X_INDEXED_A(OR)
-      }
-
-    case 0x34:  /* AND A,dp+X */
-      {
-        OP_READ_DP_X_INDEXED_A(AND)
-      }
-
-    case 0x54:  /* EOR A,dp+X */
-      {
-        OP_READ_DP_X_INDEXED_A(EOR)
-      }
-
-    case 0x74:  /* CMP A,dp+X */
-      {
-        OP_READ_DP_X_INDEXED_A(CMP)
-      }
-
-    case 0x94:  /* ADC A,dp+X */
-      {
-        OP_READ_DP_X_INDEXED_A(ADC)
-      }
-
-    case 0xB4:  /* SBC A,dp+X */
-      {
-        OP_READ_DP_X_INDEXED_A(SBC)
-      }
-
-    case 0xD4:  /* MOV dp+X,A */
-      {
-        OP_RMW_DP_X_INDEXED(WRITE_MOV(_A), 0)
-      }
-
-    case 0xF4:  /* MOV A,dp+X */
-      {
-        OP_READ_DP_X_INDEXED_A(MOV_READ)
-      }
-
-
-    /* xxx10101 */
-    case 0x15:  /* OR A,abs+X */
-      {
-        OP_READ_ABS_X_INDEXED_A(OR)
-      }
-
-    case 0x35:  /* AND A,abs+X */
-      {
-        OP_READ_ABS_X_INDEXED_A(AND)
-      }
-
-    case 0x55:  /* EOR A,abs+X */
-      {
-        OP_READ_ABS_X_INDEXED_A(EOR)
-      }
-
-    case 0x75:  /* CMP A,abs+X */
-      {
-        OP_READ_ABS_X_INDEXED_A(CMP)
-      }
-
-    case 0x95:  /* ADC A,abs+X */
-      {
-        OP_READ_ABS_X_INDEXED_A(ADC)
-      }
-
-    case 0xB5:  /* SBC A,abs+X */
-      {
-        OP_READ_ABS_X_INDEXED_A(SBC)
-      }
-
-    case 0xD5:  /* MOV abs+X,A */
-      {
-        OP_RMW_ABS_X_INDEXED(WRITE_MOV(_A), 0)
-      }
-
-    case 0xF5:  /* MOV A,abs+X */
-      {
-        OP_READ_ABS_X_INDEXED_A(MOV_READ)
-      }
-
-
-    /* xxx10110 */
-    case 0x16:  /* OR A,abs+Y */
-      {
-        OP_READ_ABS_Y_INDEXED_A(OR)
-      }
-
-    case 0x36:  /* AND A,abs+Y */
-      {
-        OP_READ_ABS_Y_INDEXED_A(AND)
-      }
-
-    case 0x56:  /* EOR A,abs+Y */
-      {
-        OP_READ_ABS_Y_INDEXED_A(EOR)
-      }
-
-    case 0x76:  /* CMP A,abs+Y */
-      {
-        OP_READ_ABS_Y_INDEXED_A(CMP)
-      }
-
-    case 0x96:  /* ADC A,abs+Y */
-      {
-        OP_READ_ABS_Y_INDEXED_A(ADC)
-      }
-
-    case 0xB6:  /* SBC A,abs+Y */
-      {
-        OP_READ_ABS_Y_INDEXED_A(SBC)
-      }
-
-    case 0xD6:  /* MOV abs+Y,A */
-      {
-        OP_RMW_ABS_Y_INDEXED(WRITE_MOV(_A), 0)
-      }
-
-    case 0xF6:  /* MOV A,abs+Y */
-      {
-        OP_READ_ABS_Y_INDEXED_A(MOV_READ)
-      }
-
-
-    /* xxx10111 */
-    case 0x17:  /* OR A,(dp)+Y */
-      {
-        OP_READ_INDIRECT_INDEXED_A(OR)
-      }
-
-    case 0x37:  /* AND A,(dp)+Y */
-      {
-        OP_READ_INDIRECT_INDEXED_A(AND)
-      }
-
-    case 0x57:  /* EOR A,(dp)+Y */
-      {
-        OP_READ_INDIRECT_INDEXED_A(EOR)
-      }
-
-    case 0x77:  /* CMP A,(dp)+Y */
-      {
-        OP_READ_INDIRECT_INDEXED_A(CMP)
-      }
-
-    case 0x97:  /* ADC A,(dp)+Y */
-      {
-        OP_READ_INDIRECT_INDEXED_A(ADC)
-      }
-
-    case 0xB7:  /* SBC A,(dp)+Y */
-      {
-        OP_READ_INDIRECT_INDEXED_A(SBC)
-      }
-
-    case 0xD7:  /* MOV (dp)+Y,A */
-      {
-        OP_RMW_INDIRECT_INDEXED(WRITE_MOV(_A), 0)
-      }
-
-    case 0xF7:  /* MOV A,(dp)+Y */
-      {
-        OP_READ_INDIRECT_INDEXED_A(MOV_READ)
-      }
-
-
-    /* xxx11000 */
-    case 0x18:  /* OR dp,#imm */
-      {
-        OP_RMW_DP_IMM(OR)
-      }
-
-    case 0x38:  /* AND dp,#imm */
-      {
-        OP_RMW_DP_IMM(AND)
-      }
-
-    case 0x58:  /* EOR dp,#imm */
-      {
-        OP_RMW_DP_IMM(EOR)
-      }
-
-    case 0x78:  /* CMP dp,#imm */
-      {
-        /*  5 cycles - opcode, src data, dest address, dest read + op, */
-        /* dummy cycle */
-        START_CYCLE(2)
-        _data2 = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address = _dp + get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        OP_CMP(_data, _data2)
-        END_OPCODE(2)
-      }
-
-    case 0x98:  /* ADC dp,#imm */
-      {
-        OP_RMW_DP_IMM(ADC)
-      }
-
-    case 0xB8:  /* SBC dp,#imm */
-      {
-        OP_RMW_DP_IMM(SBC)
-      }
-
-    case 0xD8:  /* MOV dp,X */
-      {
-        OP_RMW_DP(WRITE_MOV(_X), 0)
-      }
-
-    case 0xF8:  /* MOV X,dp */
-      {
-        OP_READ_DP(MOV_READ, _X)
-      }
-
-
-    /* xxx11001 */
-    case 0x19:  /* OR (X),(Y) */
-      {
-        OP_RMW_INDIRECT_INDIRECT(OR)
-      }
-
-    case 0x39:  /* AND (X),(Y) */
-      {
-        OP_RMW_INDIRECT_INDIRECT(AND)
-      }
-
-    case 0x59:  /* EOR (X),(Y) */
-      {
-        OP_RMW_INDIRECT_INDIRECT(EOR)
-      }
-
-    case 0x79:  /* CMP (X),(Y) */
-      {
-        /*  5 cycles - opcode, address calc, src read, dest read + op, */
-        /* dummy cycle */
-        START_CYCLE(2)
-        _address = _dp + _Y;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _data2 = get_byte_spc(_address);
-        _address = _dp + _X;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address);
-        OP_CMP(_data, _data2)
-        END_OPCODE(2)
-      }
-
-    case 0x99:  /* ADC (X),(Y) */
-      {
-        OP_RMW_INDIRECT_INDIRECT(ADC)
-      }
-
-    case 0xB9:  /* SBC (X),(Y) */
-      {
-        OP_RMW_INDIRECT_INDIRECT(SBC)
-      }
-
-    case 0xD9:  /* MOV dp+Y,X */
-      {
-        OP_RMW_DP_Y_INDEXED(WRITE_MOV(_X), 0)
-      }
-
-    case 0xF9:  /* MOV X,dp+Y */
-      {
-        OP_READ_DP_Y_INDEXED(MOV_READ, _X)
-      }
-
-
-    /* xxx11010 */
-    case 0x1A:  /* DECW dp */
-      {
-        OP_RMW16_DP(DECW)
-      }
-
-    case 0x3A:  /* INCW dp */
-      {
-        OP_RMW16_DP(INCW)
-      }
-
-    case 0x5A:  /* CMPW YA,dp */
-      {
-        unsigned temp;
-
-        /*  4 cycles - opcode, address, data low read, data high read + op */
-        START_CYCLE(2)
-        _address = _dp + get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _data16 = get_byte_spc(_address);
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data16 += get_byte_spc(_address + 1) << 8;
-        temp = _YA - _data16;
-        store_flag_c(temp <= 0xFFFF);
-        store_flag_n(temp >> 8);
-        store_flag_z(temp != 0);
-        END_OPCODE(1)
-      }
-
-    case 0x7A:  /* ADDW YA,dp */
-      {
-        OP_READ16_YA_DP(ADDW)
-      }
-
-    case 0x9A:  /* SUBW YA,dp */
-      {
-        OP_READ16_YA_DP(SUBW)
-      }
-
-    case 0xBA:  /* MOVW YA,dp */
-      {
-        OP_READ16_YA_DP(MOVW_READ)
-      }
-
-    case 0xDA:  /* MOVW dp,YA */
-      {
-        /*  5 cycles - opcode, address, (?), data low write, data high write, */
-        START_CYCLE(2)
-        _address = _dp + get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        get_byte_spc(_address);
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        set_byte_spc(_address, _A);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        set_byte_spc(_address + 1, _Y);
-        END_OPCODE(1)
-      }
-
-    case 0xFA:  /* MOV dp(d),dp(s) */
-      {
-        /*  5 cycles - opcode, src address, dest address, src read, */
-        /* dest write */
-        START_CYCLE(2)
-        _address2 = _dp + get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address = _dp + get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data = get_byte_spc(_address2);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        set_byte_spc(_address, _data);
-        END_OPCODE(1)
-      }
-
-    /* xxx11011 */
-    case 0x1B:  /* ASL dp+X */
-      {
-        OP_RMW_DP_X_INDEXED(WRITE_OP(ASL), 1)
-      }
-
-    case 0x3B:  /* ROL dp+X */
-      {
-        OP_RMW_DP_X_INDEXED(WRITE_OP(ROL), 1)
-      }
-
-    case 0x5B:  /* LSR dp+X */
-      {
-        OP_RMW_DP_X_INDEXED(WRITE_OP(LSR), 1)
-      }
-
-    case 0x7B:  /* ROR dp+X */
-      {
-        OP_RMW_DP_X_INDEXED(WRITE_OP(ROR), 1)
-      }
-
-    case 0x9B:  /* DEC dp+X */
-      {
-        OP_RMW_DP_X_INDEXED(WRITE_OP(DEC), 1)
-      }
-
-    case 0xBB:  /* INC dp+X */
-      {
-        OP_RMW_DP_X_INDEXED(WRITE_OP(INC), 1)
-      }
-
-    case 0xDB:  /* MOV dp+X,Y */
-      {
-        OP_RMW_DP_X_INDEXED(WRITE_MOV(_Y), 0)
-      }
-
-    case 0xFB:  /* MOV Y,dp+X */
-      {
-        OP_READ_DP_X_INDEXED(MOV_READ, _Y)
-      }
-
-
-    /* xxx11100 */
-    case 0x1C:  /* ASL A */
-      {
-        OP_RMW_IMPLIED(ASL, _A)
-      }
-
-    case 0x3C:  /* ROL A */
-      {
-        OP_RMW_IMPLIED(ROL, _A)
-      }
-
-    case 0x5C:  /* LSR A */
-      {
-        OP_RMW_IMPLIED(LSR, _A)
-      }
-
-    case 0x7C:  /* ROR A */
-      {
-        OP_RMW_IMPLIED(ROR, _A)
-      }
-
-    case 0x9C:  /* DEC A */
-      {
-        OP_RMW_IMPLIED(DEC, _A)
-      }
-
-    case 0xBC:  /* INC A */
-      {
-        OP_RMW_IMPLIED(INC, _A)
-      }
-
-    case 0xDC:  /* DEC Y */
-      {
-        OP_RMW_IMPLIED(DEC, _Y)
-      }
-
-    case 0xFC:  /* INC Y */
-      {
-        OP_RMW_IMPLIED(INC, _Y)
-      }
-
-
-    /* xxx11101 */
-    case 0x1D:  /* DEC X */
-      {
-        OP_RMW_IMPLIED(DEC, _X)
-      }
-
-    case 0x3D:  /* INC X */
-      {
-        OP_RMW_IMPLIED(INC, _X)
-      }
-
-    case 0x5D:  /* MOV X,A */
-      {
-        OP_MOV_IMPLIED(_X, _A)
-      }
-
-    case 0x7D:  /* MOV A,X */
-      {
-        OP_MOV_IMPLIED(_A, _X)
-      }
-
-    case 0x9D:  /* MOV X,SP */
-      {
-        OP_MOV_IMPLIED(_X, _SP)
-      }
-
-    case 0xBD:  /* MOV SP,X */
-      {
-        OP_MOV_IMPLIED_NO_FLAGS(_SP, _X)
-      }
-
-    case 0xDD:  /* MOV A,Y */
-      {
-        OP_MOV_IMPLIED(_A, _Y)
-      }
-
-    case 0xFD:  /* MOV Y,A */
-      {
-        OP_MOV_IMPLIED(_Y, _A)
-      }
-
-
-    /* xxx11110 */
-    case 0x1E:  /* CMP X,abs */
-      {
-        OP_READ_ABS(CMP, _X)
-      }
-
-    case 0x3E:  /* CMP X,dp */
-      {
-        OP_READ_DP(CMP, _X)
-      }
-
-    case 0x5E:  /* CMP Y,abs */
-      {
-        OP_READ_ABS(CMP, _Y)
-      }
-
-    case 0x7E:  /* CMP Y,dp */
-      {
-        OP_READ_DP(CMP, _Y)
-      }
-
-    case 0x9E:  /* DIV YA,X */
-      {
-        /*  12 cycles - opcode, 11(op) */
-        /* timing of operations completely wrong here, at least */
-        START_CYCLE(2)
-          unsigned yva, work_x, i;
-          yva = _YA;
-          work_x = (unsigned) _X << 9;
-
-          if ((_X & 0xF) <= (_Y & 0xF)) set_flag_spc(SPC_FLAG_H);
-          else clr_flag_spc(SPC_FLAG_H);
-
-          for (i = 0; i < 9; i++)
-          {
-           yva <<= 1; if (yva & 0x20000) yva = (yva & 0x1FFFF) | 1;  /* 17-bit ROL */
-           if (yva >= work_x) yva ^= 1;  /* Why XOR i don't know, but it's what works */
-           /* and I guess this was easier than a compound if */
-           if (yva & 1) yva = (yva - work_x) & 0x1FFFF; /* enforce 17-bit register limit! */
-          }
-
-          if (yva & 0x100) set_flag_spc(SPC_FLAG_V);
-          else clr_flag_spc(SPC_FLAG_V);
-
-          _YA = (((yva >> 9) & 0xFF) << 8) + (yva & 0xFF);
-          store_flags_nz(_YA);
-        END_OPCODE(11)
-      }
-
-    case 0xBE:  /* DAS */
-      {
-        /*  3 cycles - opcode, 2(op) */
-        START_CYCLE(2)
-        _data = _A;
-        if ((_data & 0x0F) > 9 || !flag_state_spc(SPC_FLAG_H))
-        {
-         _A -= 6;
-        }
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        if (_data > 0x99 || !flag_state_spc(SPC_FLAG_C))
-        {
-         _A -= 0x60;
-         clr_flag_spc(SPC_FLAG_C);
-        }
-        store_flags_nz(_A);
-        END_OPCODE(1)
-      }
-
-    case 0xDE:  /* CBNE dp+X,rel */
-      {
-        /*  6 cycles - opcode, address, branch offset, address index */
-        /* (add X), data read, branch logic; */
-        /* +2 cycles (taken branch) add PC to offset, reload PC */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _offset = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _address = _dp + ((_address + _X) & 0xFF);
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        _data = get_byte_spc(_address);
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        END_BRANCH_OPCODE(6, TEST_CBNE)
-      }
-
-    case 0xFE:  /* DBNZ Y,rel */
-      {
-        /*  4 cycles - opcode, branch offset, decrement Y, branch logic; */
-        /* +2 cycles (taken branch) add PC to offset, reload PC */
-
-        START_CYCLE(2)
-        _offset = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _Y--;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        END_BRANCH_OPCODE(4, if (!_Y) EXIT_OPCODE(1))
-      }
-
-
-    /* xxx11111 */
-    case 0x1F:  /* JMP (abs+X) */
-      {
-        /*  6 cycles - opcode, address low, address high */
-        /* address index (add X), new PCL, new PCH */
-        /* fetch base adderss */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address += get_byte_spc(_PC) << 8;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _address += _X;
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        _offset = get_byte_spc(_address);
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        _PC = (get_byte_spc(_address + 1) << 8) + _offset;
-        END_OPCODE(1)
-      }
-
-    case 0x3F:  /* CALL abs */
-      {
-        /*  8 cycles - opcode, new PCL, new PCH, stack address load, PCH */
-        /* write, PCL write, dummy cycle (PSW write in BRK?) */
-        /* SP decrement */
-        /* fetch address for PC */
-        START_CYCLE(2)
-        _address2 = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _address2 += (get_byte_spc(_PC) << 8);
-        _PC++;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _address = 0x0100 + _SP;
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        set_byte_spc(_address, _PC >> 8);
-        _SP--;
-        _address = 0x0100 + _SP;
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        set_byte_spc(_address, _PC);
-        _SP--;
-        _address = 0x0100 + _SP;
-        END_CYCLE(6, 1)
-
-        START_CYCLE(7)
-        /* should we write PSW to stack here? */
-        END_CYCLE(7, 1)
-
-        START_CYCLE(8)
-        _PC = _address2;
-        END_OPCODE(1)
-      }
-
-
-    case 0x5F:  /* JMP abs */
-      {
-        /*  3 cycles - opcode, new PCL, new PCH */
-        /* fetch address to PC */
-        START_CYCLE(2)
-        _address = get_byte_spc(_PC);
-        _PC++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _PC = (get_byte_spc(_PC) << 8) + _address;
-        END_OPCODE(1)
-      }
-
-    case 0x7F:  /* RETI */
-      {
-        /*  6 cycles - opcode, SP increment, address load, new PSW, new PCL, */
-        /* new PCH, pop address to PC */
-        START_CYCLE(2)
-        _SP++;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3) \
-        _address = 0x0100 + _SP; \
-        END_CYCLE(3, 1) \
-
-        START_CYCLE(4) \
-        _PSW = get_byte_spc(_address);
-        spc_restore_flags();
-        _SP++;
-        _address = 0x0100 + _SP;
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5) \
-        _address2 = get_byte_spc(_address);
-        _SP++;
-        _address = 0x0100 + _SP;
-        END_CYCLE(5, 1)
-
-        START_CYCLE(6)
-        _PC = (get_byte_spc(_address) << 8) + _address2;
-        END_OPCODE(1)
-      }
-
-    case 0x9F:  /* XCN A */
-      {
-        /*  5 cycles - opcode, 4(op) */
-        /* timing of operations may be off here */
-        START_CYCLE(2)
-        _data = _A;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _A <<= 4;
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _data >>= 4;
-        END_CYCLE(4, 1)
-
-        START_CYCLE(5)
-        OP_OR(_A, _data);
-        END_OPCODE(1)
-      }
-
-    case 0xBF:  /* MOV A,(X)+ */
-      {
-        /*  4 cycles - opcode, address load, data read, X increment */
-        START_CYCLE(2)
-        _address = _dp + _X;
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        _data = get_byte_spc(_address);
-        OP_MOV_READ(_A, _data)
-        END_CYCLE(3, 1)
-
-        START_CYCLE(4)
-        _X++;
-        END_OPCODE(1)
-      }
-
-    case 0xDF:  /* DAA */
-      {
-        /*  3 cycles - opcode, 2(op) */
-        START_CYCLE(2)
-        _data = _A;
-        if ((_data & 0x0F) > 9 || flag_state_spc(SPC_FLAG_H))
-        {
-         _A += 6;
-         if (_A < 6) set_flag_spc(SPC_FLAG_C);
-        }
-        END_CYCLE(2, 1)
-
-        START_CYCLE(3)
-        if (_data > 0x99 || flag_state_spc(SPC_FLAG_C))
-        {
-         _A += 0x60;
-         set_flag_spc(SPC_FLAG_C);
-        }
-        store_flags_nz(_A);
-        END_OPCODE(1)
-      }
-
-
-    /* handle unhandled or invalid opcodes */
-    case 0xEF:  /* SLEEP */
-    case 0xFF:  /* STOP */
-    default:
-      {
-        /* set up address (PC) and opcode for display */
-        Map_Byte = _opcode;
-        /* Adjust address to correct for increment */
-        Map_Address = (_PC - 1) & 0xFFFF;
-        save_cycles_spc();    /* Set cycle counter */
-        InvalidSPCOpcode();   /* This exits.. aviods conflict with other things! */
-        load_cycles_spc();
-        break;
-      }
-    }
-    if (opcode_done) _cycle = 0;
-  }
-
-  save_cycles_spc();    /* Set cycle counter */
-
-#ifdef INDEPENDENT_SPC
-  /* update SPC700 timers to prevent overflow */
-  Update_SPC_Timer(0);
-  Update_SPC_Timer(1);
-  Update_SPC_Timer(2);
-#endif
-
-  In_CPU = was_in_cpu;
-}
+#endif  /* __GNUC__ */
 
-void SPC_START(unsigned cycles)
+void SPC_START(SPC700_CONTEXT *active_context, unsigned cycles)
 {
  unsigned long long temp = cycles;
  temp = (temp * SPC_CPU_cycle_multiplicand) + SPC_CPU_cycles_mul;
@@ -3553,8 +2404,8 @@ void SPC_START(unsigned cycles)
  {
   if ((int) _Cycles < 0) return;
   if ((int) _TotalCycles >= 0) return;
-  Wrap_SPC_Cyclecounter();
+  Wrap_SPC_Cyclecounter(active_context);
  }
 
- Execute_SPC();
+ Execute_SPC(active_context);
 }
@@ -0,0 +1,1692 @@
+/**************************************************************************
+
+        Copyright (c) 2026 the OpenSPC contributors.
+        Some portions copyright (c) 1998-2005 Charles Bilyue'.
+
+This file is part of OpenSPC.
+
+spc700_jit.c: Translates hot basic blocks of SPC700 code into x86-64 code,
+for the whole-instruction path in spc700.c to run instead of interpreting
+them.  Only built with SPC_JIT defined.  It reproduces what the handlers in
+spc700_ops.h do, cycle for cycle, and therefore falls under the SNEeSe
+license; see the file 'LICENSE' in this directory for more information.
+
+A block runs from the address it was entered at to the first instruction
+that transfers control, or that is not translated, never leaving its page.
+Its instructions keep the SPC700 registers in the context, so that calls
+out of the block see them as they are.  Every cycle count within a block is
+fixed, so each memory access is made with the cycle counter exactly as the
+interpreter would have it, and a block is only entered if it cannot run
+into the end of the SPC_START() call or the whole-instruction limit.
+
+Accesses go straight to RAM unless the page is watched, or is the register
+page or the IPL ROM page, in which case they go through get_byte_spc() and
+set_byte_spc() as the interpreter's would.  Writes to a page a block was
+translated from drop every block on the page, and a block making a call
+checks after each such instruction whether it should stop.
+
+The code buffer is never writable and executable at once: it is made
+writable only while a block is being translated into it.  Each context
+keeps its own buffer and tables, allocated on first use, with the tables
+split by page so that only pages holding hot code cost any memory.
+
+ **************************************************************************/
+
+#define _DEFAULT_SOURCE
+
+#include "sneese_spc.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Times an instruction is fetched before a block is translated from it */
+#define JIT_HOT 16
+/* Blocks dropped from a page by writes from the CPU, after which the page
+   is left to the interpreter */
+#define JIT_MAX_DROPS 8
+/* Most instructions in one block */
+#define JIT_MAX_INSNS 64
+/* Size of the buffer holding generated code, which is flushed when full.
+   Only the part of it code was written to takes up memory */
+#define JIT_CODE_SIZE (1 << 20)
+/* Room needed in the buffer to translate one more instruction, which is
+   more than any instruction takes */
+#define JIT_INSN_ROOM 1024
+
+/* A translated block, kept in the code buffer ahead of its code */
+typedef struct
+{
+  SPC_JIT_CODE code;
+  /* Cycles from the start of the block to the start of its last
+     instruction */
+  int32_t last;
+  /* Most cycles from the start of the block to the end of any of its
+     instructions, plus one for the fetch, as FETCH_OPCODE() checks */
+  int32_t need;
+  /* Direct page it was translated for, and whether it traces */
+  uint8_t direct_page;
+  uint8_t traced;
+} SPC_JIT_BLOCK;
+
+/* Blocks translated from one page of RAM */
+typedef struct
+{
+  SPC_JIT_BLOCK *block[256];
+  /* Fetches of each address towards JIT_HOT, which is left in place once a
+     block was translated, or could not be */
+  uint8_t heat[256];
+  /* One bit for each byte some block was translated from */
+  uint8_t covered[256 / 8];
+  /* Nonzero if the page holds blocks */
+  uint8_t blocks;
+} SPC_JIT_PAGE;
+
+struct SPC700_JIT
+{
+  /* Buffer for generated code, mapped on the first translation */
+  unsigned char *code;
+  size_t used;
+  /* Pages code was fetched from, allocated on the first fetch */
+  SPC_JIT_PAGE *page[256];
+  uint8_t drops[256];
+  /* Set when blocks are dropped, for a running block to stop */
+  uint8_t stop;
+  /* Set if the buffer could not be mapped or protected */
+  uint8_t failed;
+};
+
+/* File descriptor of the perf map shared by every context in the process,
+   or -1 if there is none; JIT_PERF_MAP_UNOPENED until the first block */
+#define JIT_PERF_MAP_UNOPENED (-2)
+static atomic_int spc_jit_perf_map_fd = JIT_PERF_MAP_UNOPENED;
+
+/* Length of each instruction in bytes */
+static const unsigned char spc_jit_lengths[256] =
+{
+ /*      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, A, B, C, D, E, F */
+ /* 0 */ 1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 3, 1,
+ /* 1 */ 2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 3, 3,
+ /* 2 */ 1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 3, 2,
+ /* 3 */ 2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 2, 3,
+ /* 4 */ 1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 3, 2,
+ /* 5 */ 2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 3, 3,
+ /* 6 */ 1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 3, 1,
+ /* 7 */ 2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 2, 1,
+ /* 8 */ 1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 2, 1, 3,
+ /* 9 */ 2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 1, 1,
+ /* A */ 1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 2, 1, 1,
+ /* B */ 2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 1, 1,
+ /* C */ 1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 2, 1, 1,
+ /* D */ 2, 1, 2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 3, 1,
+ /* E */ 1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 1, 1,
+ /* F */ 2, 1, 2, 3, 2, 3, 3, 2, 2, 2, 3, 2, 1, 1, 2, 1
+};
+
+/* State of a translation in progress */
+typedef struct
+{
+  struct SPC700_JIT *jit;
+  unsigned char *p;
+  const unsigned char *epilogue;
+  /* Address of the instruction being translated, and cycles from the start
+     of the block to its start */
+  uint16_t pc;
+  int32_t cycles;
+  /* Base of the direct page: 0 or 0x100 */
+  int dp;
+  int traced;
+  /* Length of the instruction; its cycles, not counting a branch taken;
+     and the extra cycles if a branch is taken */
+  int length;
+  int insn_cycles;
+  int taken;
+  /* Set if the instruction may call out of the block */
+  int calls;
+  /* Set if a short jump was out of range */
+  int failed;
+} SPC_JIT_EMITTER;
+
+/* What translating an instruction led to */
+#define JIT_NONE 0  /* not translated */
+#define JIT_NEXT 1  /* goes on to the next instruction */
+#define JIT_END 2   /* leaves the block itself */
+
+#define FIELD(name) offsetof(SPC700_CONTEXT, name)
+#define FIELD_A FIELD(YA.b.l)
+#define FIELD_Y FIELD(YA.b.h)
+
+/* x86-64 registers, and the roles generated code gives some of them: the
+   context, the cycle counter at the start of the block, an address, and two
+   values kept across calls */
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSI 6
+#define RDI 7
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
+
+#define CTX RBX
+#define BASE_CYCLES R12
+#define ADDR R13
+#define SAVE1 R14
+#define SAVE2 R15
+
+/* Condition codes */
+#define CC_O 0x0
+#define CC_C 0x2
+#define CC_NC 0x3
+#define CC_Z 0x4
+#define CC_NZ 0x5
+#define CC_ALWAYS -1
+
+/* ALU operations and shifts, by their ModRM opcode extensions */
+#define X86_ADD 0
+#define X86_OR 1
+#define X86_ADC 2
+#define X86_SBB 3
+#define X86_AND 4
+#define X86_SUB 5
+#define X86_XOR 6
+#define X86_CMP 7
+
+#define X86_ROL 0
+#define X86_RCL 2
+#define X86_RCR 3
+#define X86_SHL 4
+#define X86_SHR 5
+
+/* Operations of the ALU rows of the opcode map, in order */
+#define JIT_OR 0
+#define JIT_AND 1
+#define JIT_EOR 2
+#define JIT_CMP 3
+#define JIT_ADC 4
+#define JIT_SBC 5
+#define JIT_MOV 7
+
+/* Read-modify-write operations, in the order of their rows */
+#define JIT_ASL 0
+#define JIT_ROL 1
+#define JIT_LSR 2
+#define JIT_ROR 3
+#define JIT_DEC 4
+#define JIT_INC 5
+
+/* Addressing modes */
+#define MODE_DP 0
+#define MODE_ABS 1
+#define MODE_IND_X 2      /* (X) */
+#define MODE_DP_X_IND 3   /* [dp+X] */
+#define MODE_DP_X 4
+#define MODE_DP_Y 5
+#define MODE_ABS_X 6
+#define MODE_ABS_Y 7
+#define MODE_DP_IND_Y 8   /* [dp]+Y */
+
+/* Addressing modes of the ALU rows, by the low five bits of their opcodes */
+static const signed char spc_jit_alu_modes[32] =
+{
+  -1, -1, -1, -1, MODE_DP, MODE_ABS, MODE_IND_X, MODE_DP_X_IND,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, MODE_DP_X, MODE_ABS_X, MODE_ABS_Y, MODE_DP_IND_Y,
+  -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+
+/* Accesses and trace events made by generated code other than inline, as
+   get_byte_spc_whole() and set_byte_spc_whole() in spc700.c make them */
+static uint8_t spc_jit_read(SPC700_CONTEXT *active_context, uint32_t address,
+                            int32_t work_cycles)
+{
+  active_context->WorkCycles = work_cycles;
+  return get_byte_spc(active_context, address);
+}
+
+static void spc_jit_write(SPC700_CONTEXT *active_context, uint32_t address,
+                          uint32_t data, int32_t work_cycles)
+{
+  active_context->WorkCycles = work_cycles;
+  set_byte_spc(active_context, address, data);
+}
+
+static void spc_jit_trace(SPC700_CONTEXT *active_context, uint32_t pc,
+                          int32_t work_cycles)
+{
+  active_context->PC.w = pc;
+  active_context->WorkCycles = work_cycles;
+  save_cycles_spc(active_context);
+  active_context->trace(active_context->trace_opaque, SPC_TRACE_INSTRUCTION,
+                        pc, 0);
+}
+
+
+/* x86-64 encoding */
+
+static void emit(SPC_JIT_EMITTER *e, unsigned byte)
+{
+  *e->p++ = (unsigned char) byte;
+}
+
+static void emit32(SPC_JIT_EMITTER *e, uint32_t value)
+{
+  memcpy(e->p, &value, sizeof(value));
+  e->p += sizeof(value);
+}
+
+static void emit64(SPC_JIT_EMITTER *e, uint64_t value)
+{
+  memcpy(e->p, &value, sizeof(value));
+  e->p += sizeof(value);
+}
+
+/* A REX prefix, if any of its bits are needed, or a byte operand is one of
+   registers 4-7, which means AH-BH without one */
+static void emit_rex(SPC_JIT_EMITTER *e, int w, int reg, int index, int base,
+                     int byte_regs)
+{
+  int rex = (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (index & 8 ? 2 : 0) |
+            (base & 8 ? 1 : 0);
+
+  if (rex || byte_regs) emit(e, 0x40 | rex);
+}
+
+static void emit_opcode(SPC_JIT_EMITTER *e, unsigned opcode)
+{
+  if (opcode > 0xFF) emit(e, opcode >> 8);
+  emit(e, opcode & 0xFF);
+}
+
+/* An instruction with operands reg and [CTX + disp], or [CTX + index + disp]
+   if index is not negative */
+static void emit_mem(SPC_JIT_EMITTER *e, int w, int byte, unsigned opcode,
+                     int reg, int index, size_t disp)
+{
+  emit_rex(e, w, reg, index < 0 ? 0 : index, CTX,
+           byte && reg >= 4 && reg < 8);
+  emit_opcode(e, opcode);
+  if (index < 0)
+  {
+    emit(e, 0x80 | (reg & 7) << 3 | CTX);
+  }
+  else
+  {
+    emit(e, 0x84 | (reg & 7) << 3);
+    emit(e, (index & 7) << 3 | CTX);
+  }
+  emit32(e, (uint32_t) disp);
+}
+
+/* An instruction with register operands reg and rm */
+static void emit_rr(SPC_JIT_EMITTER *e, int w, int byte, unsigned opcode,
+                    int reg, int rm)
+{
+  emit_rex(e, w, reg, 0, rm,
+           byte && ((reg >= 4 && reg < 8) || (rm >= 4 && rm < 8)));
+  emit_opcode(e, opcode);
+  emit(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* movzx reg, byte [CTX + index + disp] */
+static void x86_load8(SPC_JIT_EMITTER *e, int reg, int index, size_t disp)
+{
+  emit_mem(e, 0, 0, 0x0FB6, reg, index, disp);
+}
+
+/* mov byte [CTX + index + disp], reg */
+static void x86_store8(SPC_JIT_EMITTER *e, int reg, int index, size_t disp)
+{
+  emit_mem(e, 0, 1, 0x88, reg, index, disp);
+}
+
+/* movzx reg, word [CTX + disp] */
+static void x86_load16(SPC_JIT_EMITTER *e, int reg, size_t disp)
+{
+  emit_mem(e, 0, 0, 0x0FB7, reg, -1, disp);
+}
+
+/* mov word [CTX + disp], reg */
+static void x86_store16(SPC_JIT_EMITTER *e, int reg, size_t disp)
+{
+  emit(e, 0x66);
+  emit_mem(e, 0, 0, 0x89, reg, -1, disp);
+}
+
+/* mov dword [CTX + disp], reg */
+static void x86_store32(SPC_JIT_EMITTER *e, int reg, size_t disp)
+{
+  emit_mem(e, 0, 0, 0x89, reg, -1, disp);
+}
+
+/* An instruction with operands byte [CTX + index + disp] and imm8, given by
+   its opcode and extension: mov, test, or an ALU operation */
+static void x86_mem_imm8(SPC_JIT_EMITTER *e, unsigned opcode, int ext,
+                         int index, size_t disp, unsigned imm)
+{
+  emit_mem(e, 0, 0, opcode, ext, index, disp);
+  emit(e, imm);
+}
+
+#define x86_set_field(e, disp, imm) x86_mem_imm8(e, 0xC6, 0, -1, disp, imm)
+#define x86_test_field(e, disp, imm) x86_mem_imm8(e, 0xF6, 0, -1, disp, imm)
+#define x86_cmp_field(e, disp, imm) \
+  x86_mem_imm8(e, 0x80, X86_CMP, -1, disp, imm)
+
+/* setcc byte [CTX + disp] */
+static void x86_setcc(SPC_JIT_EMITTER *e, int cc, size_t disp)
+{
+  emit_mem(e, 0, 0, 0x0F90 | cc, 0, -1, disp);
+}
+
+/* mov word [CTX + disp], imm16 */
+static void x86_store_imm16(SPC_JIT_EMITTER *e, size_t disp, unsigned imm)
+{
+  emit(e, 0x66);
+  emit_mem(e, 0, 0, 0xC7, 0, -1, disp);
+  emit(e, imm & 0xFF);
+  emit(e, imm >> 8);
+}
+
+/* op dst, src on 32, 16 and 8 bits */
+static void x86_alu(SPC_JIT_EMITTER *e, int op, int dst, int src)
+{
+  emit_rr(e, 0, 0, op << 3 | 1, src, dst);
+}
+
+static void x86_alu16(SPC_JIT_EMITTER *e, int op, int dst, int src)
+{
+  emit(e, 0x66);
+  emit_rr(e, 0, 0, op << 3 | 1, src, dst);
+}
+
+static void x86_alu8(SPC_JIT_EMITTER *e, int op, int dst, int src)
+{
+  emit_rr(e, 0, 1, op << 3, src, dst);
+}
+
+/* op dst, imm on 32 and 8 bits */
+static void x86_alu_imm(SPC_JIT_EMITTER *e, int op, int dst, uint32_t imm)
+{
+  emit_rr(e, 0, 0, 0x81, op, dst);
+  emit32(e, imm);
+}
+
+static void x86_alu8_imm(SPC_JIT_EMITTER *e, int op, int dst, unsigned imm)
+{
+  emit_rr(e, 0, 1, 0x80, op, dst);
+  emit(e, imm);
+}
+
+/* test reg, reg on 8 bits, and test reg, imm8 */
+static void x86_test8(SPC_JIT_EMITTER *e, int reg)
+{
+  emit_rr(e, 0, 1, 0x84, reg, reg);
+}
+
+static void x86_test8_imm(SPC_JIT_EMITTER *e, int reg, unsigned imm)
+{
+  emit_rr(e, 0, 1, 0xF6, 0, reg);
+  emit(e, imm);
+}
+
+/* mov dst, src; mov dst, imm32; mov dst, imm64 */
+static void x86_mov(SPC_JIT_EMITTER *e, int dst, int src)
+{
+  emit_rr(e, 0, 0, 0x89, src, dst);
+}
+
+static void x86_mov_imm(SPC_JIT_EMITTER *e, int dst, uint32_t imm)
+{
+  emit_rex(e, 0, 0, 0, dst, 0);
+  emit(e, 0xB8 | (dst & 7));
+  emit32(e, imm);
+}
+
+static void x86_mov_imm64(SPC_JIT_EMITTER *e, int dst, uint64_t imm)
+{
+  emit_rex(e, 1, 0, 0, dst, 0);
+  emit(e, 0xB8 | (dst & 7));
+  emit64(e, imm);
+}
+
+/* lea dst, [base + disp] on 32 bits */
+static void x86_lea(SPC_JIT_EMITTER *e, int dst, int base, int32_t disp)
+{
+  emit_rex(e, 0, dst, 0, base, 0);
+  emit(e, 0x8D);
+  emit(e, 0x80 | (dst & 7) << 3 | (base & 7));
+  if ((base & 7) == 4) emit(e, 0x24);
+  emit32(e, (uint32_t) disp);
+}
+
+/* shift reg by count on 32 bits, and by one or count on 8 bits */
+static void x86_shift(SPC_JIT_EMITTER *e, int op, int reg, int count)
+{
+  emit_rr(e, 0, 0, 0xC1, op, reg);
+  emit(e, count);
+}
+
+static void x86_shift8(SPC_JIT_EMITTER *e, int op, int reg)
+{
+  emit_rr(e, 0, 1, 0xD0, op, reg);
+}
+
+static void x86_shift8_imm(SPC_JIT_EMITTER *e, int op, int reg, int count)
+{
+  emit_rr(e, 0, 1, 0xC0, op, reg);
+  emit(e, count);
+}
+
+static void x86_call(SPC_JIT_EMITTER *e, uintptr_t function)
+{
+  x86_mov_imm64(e, RAX, function);
+  emit(e, 0xFF);  /* call rax */
+  emit(e, 0xD0);
+}
+
+/* A short jump, taken if cc holds, to be landed by x86_land() */
+static unsigned char *x86_jump8(SPC_JIT_EMITTER *e, int cc)
+{
+  emit(e, cc == CC_ALWAYS ? 0xEB : 0x70 | cc);
+  emit(e, 0);
+  return e->p - 1;
+}
+
+static void x86_land(SPC_JIT_EMITTER *e, unsigned char *jump)
+{
+  ptrdiff_t distance = e->p - (jump + 1);
+
+  if (distance > 127) e->failed = 1;
+  *jump = (unsigned char) distance;
+}
+
+
+/* Pieces of SPC700 instructions */
+
+/* N and Z from the byte in reg */
+static void jit_nz(SPC_JIT_EMITTER *e, int reg)
+{
+  x86_store8(e, reg, -1, FIELD(N_flag));
+  x86_store8(e, reg, -1, FIELD(Z_flag));
+}
+
+/* N and Z from the word in EAX, as the 16-bit instructions set them */
+static void jit_nz16(SPC_JIT_EMITTER *e)
+{
+  x86_mov(e, RCX, RAX);
+  x86_shift(e, X86_SHR, RCX, 8);
+  x86_store8(e, RCX, -1, FIELD(N_flag));
+  x86_alu(e, X86_OR, RAX, RAX);
+  x86_setcc(e, CC_NZ, FIELD(Z_flag));
+}
+
+/* The cycle counter as of the given cycle of the instruction, into reg */
+static void jit_cycle(SPC_JIT_EMITTER *e, int reg, int cycle)
+{
+  x86_lea(e, reg, BASE_CYCLES, e->cycles + cycle - 1);
+}
+
+static void jit_call_read(SPC_JIT_EMITTER *e, int address, int cycle)
+{
+  emit_rr(e, 1, 0, 0x89, CTX, RDI);
+  if (address >= 0) x86_mov_imm(e, RSI, address);
+  else x86_mov(e, RSI, ADDR);
+  jit_cycle(e, RDX, cycle);
+  x86_call(e, (uintptr_t) &spc_jit_read);
+  emit_rr(e, 0, 1, 0x0FB6, RAX, RAX);
+}
+
+static void jit_call_write(SPC_JIT_EMITTER *e, int address, int cycle)
+{
+  x86_mov(e, RDX, RAX);
+  emit_rr(e, 1, 0, 0x89, CTX, RDI);
+  if (address >= 0) x86_mov_imm(e, RSI, address);
+  else x86_mov(e, RSI, ADDR);
+  jit_cycle(e, RCX, cycle);
+  x86_call(e, (uintptr_t) &spc_jit_write);
+}
+
+/* Checks that leave an access to ADDR, or to a fixed address, to the
+   helpers if need be, as the interpreter would: for the register page, the
+   IPL ROM page, and watched pages.  page is the page ADDR lies in if it is
+   known, or negative.  Returns the number of jumps added to slow. */
+static int jit_access_checks(SPC_JIT_EMITTER *e, int address, int page,
+                             unsigned flags, int write, unsigned char **slow)
+{
+  int slows = 0;
+
+  if (address < 0 && page < 0)
+  {
+    x86_alu_imm(e, X86_CMP, ADDR, 0xFF00);
+    slow[slows++] = x86_jump8(e, CC_NC);
+    x86_lea(e, RCX, ADDR, -0xF0);
+    x86_alu_imm(e, X86_CMP, RCX, 0x10);
+    slow[slows++] = x86_jump8(e, CC_C);
+    x86_mov(e, RCX, ADDR);
+    x86_shift(e, X86_SHR, RCX, 8);
+    x86_mem_imm8(e, 0xF6, 0, RCX, FIELD(watch), flags);
+    slow[slows++] = x86_jump8(e, CC_NZ);
+    if (write)
+    {
+      x86_mem_imm8(e, 0x80, X86_CMP, RCX, FIELD(code_watch), 0);
+      slow[slows++] = x86_jump8(e, CC_NZ);
+    }
+    return slows;
+  }
+
+  if (address >= 0) page = address >> 8;
+  else if (page == 0)
+  {
+    x86_alu_imm(e, X86_CMP, ADDR, 0xF0);
+    slow[slows++] = x86_jump8(e, CC_NC);
+  }
+  x86_test_field(e, FIELD(watch) + page, flags);
+  slow[slows++] = x86_jump8(e, CC_NZ);
+  if (write)
+  {
+    x86_cmp_field(e, FIELD(code_watch) + page, 0);
+    slow[slows++] = x86_jump8(e, CC_NZ);
+  }
+  return slows;
+}
+
+/* Whether an access always goes to the helpers */
+static int jit_always_slow(int address, int page)
+{
+  if (address >= 0)
+  {
+    return address >= 0xFF00 || (address >= 0xF0 && address < 0x100);
+  }
+  return page == 0xFF;
+}
+
+/* Reads the byte at a fixed address, or at ADDR if address is negative,
+   into EAX, on the given cycle of the instruction.  page is the page ADDR
+   is known to lie in, or negative. */
+static void jit_read(SPC_JIT_EMITTER *e, int address, int page, int cycle)
+{
+  unsigned char *slow[4], *done;
+  int slows, i;
+
+  e->calls = 1;
+  if (jit_always_slow(address, page))
+  {
+    jit_call_read(e, address, cycle);
+    return;
+  }
+
+  slows = jit_access_checks(e, address, page, SPC_WATCH_READ, 0, slow);
+  if (address >= 0) x86_load8(e, RAX, -1, FIELD(ram) + address);
+  else x86_load8(e, RAX, ADDR, FIELD(ram));
+  done = x86_jump8(e, CC_ALWAYS);
+  for (i = 0; i < slows; i++) x86_land(e, slow[i]);
+  jit_call_read(e, address, cycle);
+  x86_land(e, done);
+}
+
+/* Writes the byte in EAX as jit_read() reads */
+static void jit_write(SPC_JIT_EMITTER *e, int address, int page, int cycle)
+{
+  unsigned char *slow[4], *done;
+  int slows, i;
+
+  e->calls = 1;
+  if (e->traced || jit_always_slow(address, page))
+  {
+    jit_call_write(e, address, cycle);
+    return;
+  }
+
+  slows = jit_access_checks(e, address, page,
+                            SPC_WATCH_WRITE | SPC_WATCH_NOTIFY, 1, slow);
+  if (address >= 0) x86_store8(e, RAX, -1, FIELD(ram) + address);
+  else x86_store8(e, RAX, ADDR, FIELD(ram));
+  done = x86_jump8(e, CC_ALWAYS);
+  for (i = 0; i < slows; i++) x86_land(e, slow[i]);
+  jit_call_write(e, address, cycle);
+  x86_land(e, done);
+}
+
+/* Leaves the block for pc, or for the address in EAX if pc is negative,
+   with the given number of cycles run */
+static void jit_exit(SPC_JIT_EMITTER *e, int pc, int32_t cycles)
+{
+  if (pc >= 0) x86_store_imm16(e, FIELD(PC), pc);
+  else x86_store16(e, RAX, FIELD(PC));
+  x86_lea(e, RAX, BASE_CYCLES, cycles);
+  x86_store32(e, RAX, FIELD(WorkCycles));
+  emit(e, 0xE9);
+  emit32(e, (uint32_t) (e->epilogue - (e->p + 4)));
+}
+
+/* Leaves the block before the instruction at e->pc if blocks were dropped,
+   or the page became watched for reads, which the interpreter handles */
+static void jit_check_stop(SPC_JIT_EMITTER *e)
+{
+  unsigned char *stop, *go_on;
+
+  x86_mov_imm64(e, RAX, (uintptr_t) &e->jit->stop);
+  emit(e, 0x80);  /* cmp byte [rax], 0 */
+  emit(e, 0x38);
+  emit(e, 0x00);
+  stop = x86_jump8(e, CC_NZ);
+  x86_test_field(e, FIELD(watch) + (e->pc >> 8), SPC_WATCH_READ);
+  go_on = x86_jump8(e, CC_Z);
+  x86_land(e, stop);
+  jit_exit(e, e->pc, e->cycles);
+  x86_land(e, go_on);
+}
+
+/* Ends the block with a branch to target, taken if cc holds, or else going
+   on to the next instruction */
+static int jit_branch(SPC_JIT_EMITTER *e, int cc, int target, int cycles)
+{
+  unsigned char *taken = x86_jump8(e, cc);
+
+  jit_exit(e, (e->pc + e->length) & 0xFFFF, e->cycles + cycles);
+  x86_land(e, taken);
+  jit_exit(e, target & 0xFFFF, e->cycles + cycles + 2);
+  e->insn_cycles = cycles;
+  e->taken = 2;
+  return JIT_END;
+}
+
+static int jit_relative(SPC_JIT_EMITTER *e, const unsigned char *op)
+{
+  return e->pc + e->length + (signed char) op[e->length - 1];
+}
+
+/* One of the ALU operations on EAX and ECX, as OP_<op>() does it, leaving
+   the result in EAX */
+static void jit_alu(SPC_JIT_EMITTER *e, int op)
+{
+  switch (op)
+  {
+  case JIT_OR:
+    x86_alu(e, X86_OR, RAX, RCX);
+    break;
+
+  case JIT_AND:
+    x86_alu(e, X86_AND, RAX, RCX);
+    break;
+
+  case JIT_EOR:
+    x86_alu(e, X86_XOR, RAX, RCX);
+    break;
+
+  case JIT_MOV:
+    x86_mov(e, RAX, RCX);
+    break;
+
+  case JIT_CMP:
+    x86_mov(e, RDX, RAX);
+    x86_alu8(e, X86_SUB, RDX, RCX);
+    x86_setcc(e, CC_NC, FIELD(C_flag));
+    jit_nz(e, RDX);
+    return;
+
+  case JIT_ADC:
+  case JIT_SBC:
+    x86_mov(e, RDX, RAX);
+    x86_alu(e, X86_XOR, RDX, RCX);
+    x86_cmp_field(e, FIELD(C_flag), 1);
+    if (op == JIT_ADC)
+    {
+      emit(e, 0xF5);  /* cmc */
+      x86_alu8(e, X86_ADC, RAX, RCX);
+      x86_setcc(e, CC_C, FIELD(C_flag));
+    }
+    else
+    {
+      x86_alu8(e, X86_SBB, RAX, RCX);
+      x86_setcc(e, CC_NC, FIELD(C_flag));
+    }
+    x86_setcc(e, CC_O, FIELD(V_flag));
+    x86_alu(e, X86_XOR, RDX, RAX);
+    x86_shift(e, X86_SHR, RDX, 4);
+    x86_alu_imm(e, X86_AND, RDX, 1);
+    if (op == JIT_SBC) x86_alu_imm(e, X86_XOR, RDX, 1);
+    x86_store8(e, RDX, -1, FIELD(H_flag));
+    break;
+  }
+  jit_nz(e, RAX);
+}
+
+/* One of the read-modify-write operations on AL */
+static void jit_modify(SPC_JIT_EMITTER *e, int op)
+{
+  switch (op)
+  {
+  case JIT_ASL:
+  case JIT_LSR:
+    x86_shift8(e, op == JIT_ASL ? X86_SHL : X86_SHR, RAX);
+    x86_setcc(e, CC_C, FIELD(C_flag));
+    break;
+
+  case JIT_ROL:
+  case JIT_ROR:
+    x86_cmp_field(e, FIELD(C_flag), 1);
+    emit(e, 0xF5);  /* cmc */
+    x86_shift8(e, op == JIT_ROL ? X86_RCL : X86_RCR, RAX);
+    x86_setcc(e, CC_C, FIELD(C_flag));
+    break;
+
+  case JIT_DEC:
+  case JIT_INC:
+    emit_rr(e, 0, 1, 0xFE, op == JIT_INC ? 0 : 1, RAX);
+    break;
+  }
+  jit_nz(e, RAX);
+}
+
+/* Works out the address of an operand, into ADDR unless it is fixed, and
+   returns the cycle the operand is read on */
+static int jit_operand(SPC_JIT_EMITTER *e, int mode, const unsigned char *op,
+                       int *address, int *page)
+{
+  *address = -1;
+  *page = -1;
+  switch (mode)
+  {
+  case MODE_DP:
+    *address = e->dp + op[1];
+    return 3;
+
+  case MODE_ABS:
+    *address = op[1] | op[2] << 8;
+    return 4;
+
+  case MODE_IND_X:
+    x86_load8(e, ADDR, -1, FIELD(X));
+    if (e->dp) x86_alu_imm(e, X86_OR, ADDR, e->dp);
+    *page = e->dp >> 8;
+    return 3;
+
+  case MODE_DP_X:
+  case MODE_DP_Y:
+  case MODE_DP_X_IND:
+    x86_load8(e, ADDR, -1, mode == MODE_DP_Y ? FIELD_Y : FIELD(X));
+    x86_alu_imm(e, X86_ADD, ADDR, op[1]);
+    x86_alu_imm(e, X86_AND, ADDR, 0xFF);
+    if (e->dp) x86_alu_imm(e, X86_OR, ADDR, e->dp);
+    if (mode != MODE_DP_X_IND)
+    {
+      *page = e->dp >> 8;
+      return 4;
+    }
+    jit_read(e, -1, e->dp >> 8, 4);
+    x86_mov(e, SAVE2, RAX);
+    x86_alu_imm(e, X86_ADD, ADDR, 1);
+    jit_read(e, -1, -1, 5);
+    x86_shift(e, X86_SHL, RAX, 8);
+    x86_alu(e, X86_OR, RAX, SAVE2);
+    x86_mov(e, ADDR, RAX);
+    return 6;
+
+  case MODE_ABS_X:
+  case MODE_ABS_Y:
+    x86_load8(e, ADDR, -1, mode == MODE_ABS_Y ? FIELD_Y : FIELD(X));
+    x86_alu_imm(e, X86_ADD, ADDR, op[1] | op[2] << 8);
+    x86_alu_imm(e, X86_AND, ADDR, 0xFFFF);
+    return 5;
+
+  case MODE_DP_IND_Y:
+    jit_read(e, e->dp + op[1], 0, 3);
+    x86_mov(e, SAVE2, RAX);
+    jit_read(e, e->dp + op[1] + 1, 0, 4);
+    x86_shift(e, X86_SHL, RAX, 8);
+    x86_alu(e, X86_OR, RAX, SAVE2);
+    x86_load8(e, RCX, -1, FIELD_Y);
+    x86_alu(e, X86_ADD, RAX, RCX);
+    x86_alu_imm(e, X86_AND, RAX, 0xFFFF);
+    x86_mov(e, ADDR, RAX);
+    return 6;
+  }
+  return 0;
+}
+
+/* OP_READ_*: reg op= memory, or an immediate if mode is negative */
+static int jit_read_op(SPC_JIT_EMITTER *e, int op, int mode,
+                       const unsigned char *code, size_t reg)
+{
+  int address, page, cycle;
+
+  if (mode < 0)
+  {
+    x86_mov_imm(e, RCX, code[1]);
+    cycle = 2;
+  }
+  else
+  {
+    cycle = jit_operand(e, mode, code, &address, &page);
+    jit_read(e, address, page, cycle);
+    x86_mov(e, RCX, RAX);
+  }
+  if (op != JIT_MOV) x86_load8(e, RAX, -1, reg);
+  jit_alu(e, op);
+  if (op != JIT_CMP) x86_store8(e, RAX, -1, reg);
+  e->insn_cycles = cycle;
+  return JIT_NEXT;
+}
+
+/* OP_WRITE_*: memory = reg, after a read of it */
+static int jit_write_op(SPC_JIT_EMITTER *e, int mode,
+                        const unsigned char *code, size_t reg)
+{
+  int address, page;
+  int cycle = jit_operand(e, mode, code, &address, &page);
+
+  jit_read(e, address, page, cycle);
+  x86_load8(e, RAX, -1, reg);
+  jit_write(e, address, page, cycle + 1);
+  e->insn_cycles = cycle + 1;
+  return JIT_NEXT;
+}
+
+/* OP_RMW_*: memory op= nothing */
+static int jit_modify_op(SPC_JIT_EMITTER *e, int op, int mode,
+                         const unsigned char *code)
+{
+  int address, page;
+  int cycle = jit_operand(e, mode, code, &address, &page);
+
+  jit_read(e, address, page, cycle);
+  jit_modify(e, op);
+  jit_write(e, address, page, cycle + 1);
+  e->insn_cycles = cycle + 1;
+  return JIT_NEXT;
+}
+
+/* Reads a word of the direct page, as for MOVW and the like, into EAX */
+static void jit_read_word(SPC_JIT_EMITTER *e, int address, int cycle)
+{
+  jit_read(e, address, 0, cycle);
+  x86_mov(e, SAVE1, RAX);
+  jit_read(e, (address + 1) & 0xFFFF, 0, cycle + 1);
+  x86_shift(e, X86_SHL, RAX, 8);
+  x86_alu(e, X86_OR, RAX, SAVE1);
+}
+
+/* ADDW, SUBW and CMPW on YA and the word in ECX */
+static void jit_word_op(SPC_JIT_EMITTER *e, int op)
+{
+  x86_load16(e, RAX, FIELD(YA));
+  if (op == X86_CMP)
+  {
+    x86_alu16(e, X86_SUB, RAX, RCX);
+    x86_setcc(e, CC_NC, FIELD(C_flag));
+    jit_nz16(e);
+    return;
+  }
+  x86_mov(e, RDX, RAX);
+  x86_alu(e, X86_XOR, RDX, RCX);
+  x86_alu16(e, op, RAX, RCX);
+  x86_setcc(e, op == X86_ADD ? CC_C : CC_NC, FIELD(C_flag));
+  x86_setcc(e, CC_O, FIELD(V_flag));
+  x86_alu(e, X86_XOR, RDX, RAX);
+  x86_shift(e, X86_SHR, RDX, 12);
+  x86_alu_imm(e, X86_AND, RDX, 1);
+  if (op == X86_SUB) x86_alu_imm(e, X86_XOR, RDX, 1);
+  x86_store8(e, RDX, -1, FIELD(H_flag));
+  x86_store16(e, RAX, FIELD(YA));
+  jit_nz16(e);
+}
+
+/* The stack address, 0x100 + SP, into ADDR */
+static void jit_stack_address(SPC_JIT_EMITTER *e)
+{
+  x86_load8(e, ADDR, -1, FIELD(SP));
+  x86_alu_imm(e, X86_OR, ADDR, 0x100);
+}
+
+static void jit_push(SPC_JIT_EMITTER *e, int cycle)
+{
+  jit_stack_address(e);
+  jit_write(e, -1, 1, cycle);
+  x86_mem_imm8(e, 0x80, X86_SUB, -1, FIELD(SP), 1);
+}
+
+static void jit_pop(SPC_JIT_EMITTER *e, int cycle)
+{
+  x86_mem_imm8(e, 0x80, X86_ADD, -1, FIELD(SP), 1);
+  jit_stack_address(e);
+  jit_read(e, -1, 1, cycle);
+}
+
+/* reg = reg2, with the flags set unless it is SP */
+static int jit_transfer(SPC_JIT_EMITTER *e, size_t reg, size_t reg2)
+{
+  x86_load8(e, RAX, -1, reg2);
+  x86_store8(e, RAX, -1, reg);
+  if (reg != FIELD(SP)) jit_nz(e, RAX);
+  e->insn_cycles = 2;
+  return JIT_NEXT;
+}
+
+static int jit_set_flag(SPC_JIT_EMITTER *e, size_t flag, int value)
+{
+  x86_set_field(e, flag, value);
+  e->insn_cycles = 2;
+  return JIT_NEXT;
+}
+
+/* Translates the instruction at code, which lies wholly within its page */
+static int jit_insn(SPC_JIT_EMITTER *e, const unsigned char *code)
+{
+  int opcode = code[0];
+  int row = opcode >> 5;
+  int mode = spc_jit_alu_modes[opcode & 0x1F];
+  int dp = e->dp;
+  int address, page, cycle, bit;
+  unsigned char *skip, *skip2;
+
+  /* ALU rows: OR, AND, EOR, CMP, ADC, SBC A with memory, MOV memory,A and
+     MOV A,memory */
+  if (mode >= 0)
+  {
+    return row == 6 ? jit_write_op(e, mode, code, FIELD_A) :
+                      jit_read_op(e, row, mode, code, FIELD_A);
+  }
+
+  switch (opcode)
+  {
+  /* OR, AND, EOR, CMP, ADC, SBC, MOV A,#imm */
+  case 0x08: case 0x28: case 0x48: case 0x68: case 0x88: case 0xA8:
+  case 0xE8:
+    return jit_read_op(e, row, -1, code, FIELD_A);
+
+  /* MOV and CMP X and Y */
+  case 0xCD: return jit_read_op(e, JIT_MOV, -1, code, FIELD(X));
+  case 0xF8: return jit_read_op(e, JIT_MOV, MODE_DP, code, FIELD(X));
+  case 0xE9: return jit_read_op(e, JIT_MOV, MODE_ABS, code, FIELD(X));
+  case 0xF9: return jit_read_op(e, JIT_MOV, MODE_DP_Y, code, FIELD(X));
+  case 0x8D: return jit_read_op(e, JIT_MOV, -1, code, FIELD_Y);
+  case 0xEB: return jit_read_op(e, JIT_MOV, MODE_DP, code, FIELD_Y);
+  case 0xEC: return jit_read_op(e, JIT_MOV, MODE_ABS, code, FIELD_Y);
+  case 0xFB: return jit_read_op(e, JIT_MOV, MODE_DP_X, code, FIELD_Y);
+  case 0xC8: return jit_read_op(e, JIT_CMP, -1, code, FIELD(X));
+  case 0x3E: return jit_read_op(e, JIT_CMP, MODE_DP, code, FIELD(X));
+  case 0x1E: return jit_read_op(e, JIT_CMP, MODE_ABS, code, FIELD(X));
+  case 0xAD: return jit_read_op(e, JIT_CMP, -1, code, FIELD_Y);
+  case 0x7E: return jit_read_op(e, JIT_CMP, MODE_DP, code, FIELD_Y);
+  case 0x5E: return jit_read_op(e, JIT_CMP, MODE_ABS, code, FIELD_Y);
+
+  case 0xD8: return jit_write_op(e, MODE_DP, code, FIELD(X));
+  case 0xC9: return jit_write_op(e, MODE_ABS, code, FIELD(X));
+  case 0xD9: return jit_write_op(e, MODE_DP_Y, code, FIELD(X));
+  case 0xCB: return jit_write_op(e, MODE_DP, code, FIELD_Y);
+  case 0xCC: return jit_write_op(e, MODE_ABS, code, FIELD_Y);
+  case 0xDB: return jit_write_op(e, MODE_DP_X, code, FIELD_Y);
+
+  /* OR, AND, EOR, CMP, ADC, SBC dp,dp */
+  case 0x09: case 0x29: case 0x49: case 0x69: case 0x89: case 0xA9:
+    jit_read(e, dp + code[1], 0, 4);
+    x86_mov(e, SAVE1, RAX);
+    jit_read(e, dp + code[2], 0, 5);
+    x86_mov(e, RCX, SAVE1);
+    jit_alu(e, row);
+    if (row != JIT_CMP) jit_write(e, dp + code[2], 0, 6);
+    e->insn_cycles = 6;
+    return JIT_NEXT;
+
+  /* OR, AND, EOR, CMP, ADC, SBC dp,#imm */
+  case 0x18: case 0x38: case 0x58: case 0x78: case 0x98: case 0xB8:
+    jit_read(e, dp + code[2], 0, 4);
+    x86_mov_imm(e, RCX, code[1]);
+    jit_alu(e, row);
+    if (row != JIT_CMP) jit_write(e, dp + code[2], 0, 5);
+    e->insn_cycles = 5;
+    return JIT_NEXT;
+
+  /* OR, AND, EOR, CMP, ADC, SBC (X),(Y) */
+  case 0x19: case 0x39: case 0x59: case 0x79: case 0x99: case 0xB9:
+    x86_load8(e, ADDR, -1, FIELD_Y);
+    if (dp) x86_alu_imm(e, X86_OR, ADDR, dp);
+    jit_read(e, -1, dp >> 8, 3);
+    x86_mov(e, SAVE1, RAX);
+    x86_load8(e, ADDR, -1, FIELD(X));
+    if (dp) x86_alu_imm(e, X86_OR, ADDR, dp);
+    jit_read(e, -1, dp >> 8, 4);
+    x86_mov(e, RCX, SAVE1);
+    jit_alu(e, row);
+    if (row != JIT_CMP) jit_write(e, -1, dp >> 8, 5);
+    e->insn_cycles = 5;
+    return JIT_NEXT;
+
+  case 0xFA:  /* MOV dp,dp */
+    jit_read(e, dp + code[1], 0, 4);
+    jit_write(e, dp + code[2], 0, 5);
+    e->insn_cycles = 5;
+    return JIT_NEXT;
+
+  case 0x8F:  /* MOV dp,#imm */
+    jit_read(e, dp + code[2], 0, 4);
+    x86_mov_imm(e, RAX, code[1]);
+    jit_write(e, dp + code[2], 0, 5);
+    e->insn_cycles = 5;
+    return JIT_NEXT;
+
+  case 0xAF:  /* MOV (X)+,A */
+    x86_load8(e, ADDR, -1, FIELD(X));
+    if (dp) x86_alu_imm(e, X86_OR, ADDR, dp);
+    x86_load8(e, RAX, -1, FIELD_A);
+    jit_write(e, -1, dp >> 8, 3);
+    x86_mem_imm8(e, 0x80, X86_ADD, -1, FIELD(X), 1);
+    e->insn_cycles = 4;
+    return JIT_NEXT;
+
+  case 0xBF:  /* MOV A,(X)+ */
+    x86_load8(e, ADDR, -1, FIELD(X));
+    if (dp) x86_alu_imm(e, X86_OR, ADDR, dp);
+    jit_read(e, -1, dp >> 8, 3);
+    x86_store8(e, RAX, -1, FIELD_A);
+    jit_nz(e, RAX);
+    x86_mem_imm8(e, 0x80, X86_ADD, -1, FIELD(X), 1);
+    e->insn_cycles = 4;
+    return JIT_NEXT;
+
+  /* ASL, ROL, LSR, ROR, DEC, INC */
+  case 0x0B: case 0x2B: case 0x4B: case 0x6B: case 0x8B: case 0xAB:
+    return jit_modify_op(e, row, MODE_DP, code);
+  case 0x0C: case 0x2C: case 0x4C: case 0x6C: case 0x8C: case 0xAC:
+    return jit_modify_op(e, row, MODE_ABS, code);
+  case 0x1B: case 0x3B: case 0x5B: case 0x7B: case 0x9B: case 0xBB:
+    return jit_modify_op(e, row, MODE_DP_X, code);
+  case 0x1C: case 0x3C: case 0x5C: case 0x7C: case 0x9C: case 0xBC:
+    x86_load8(e, RAX, -1, FIELD_A);
+    jit_modify(e, row);
+    x86_store8(e, RAX, -1, FIELD_A);
+    e->insn_cycles = 2;
+    return JIT_NEXT;
+  case 0x1D: case 0x3D: case 0xDC: case 0xFC:
+    {
+      size_t reg = opcode & 0x80 ? FIELD_Y : FIELD(X);
+
+      x86_load8(e, RAX, -1, reg);
+      jit_modify(e, opcode & 0x20 ? JIT_INC : JIT_DEC);
+      x86_store8(e, RAX, -1, reg);
+      e->insn_cycles = 2;
+      return JIT_NEXT;
+    }
+
+  /* Transfers */
+  case 0x5D: return jit_transfer(e, FIELD(X), FIELD_A);
+  case 0x7D: return jit_transfer(e, FIELD_A, FIELD(X));
+  case 0x9D: return jit_transfer(e, FIELD(X), FIELD(SP));
+  case 0xBD: return jit_transfer(e, FIELD(SP), FIELD(X));
+  case 0xDD: return jit_transfer(e, FIELD_A, FIELD_Y);
+  case 0xFD: return jit_transfer(e, FIELD_Y, FIELD_A);
+
+  /* Flags */
+  case 0x00:  /* NOP */
+    e->insn_cycles = 2;
+    return JIT_NEXT;
+  case 0x60: return jit_set_flag(e, FIELD(C_flag), 0);
+  case 0x80: return jit_set_flag(e, FIELD(C_flag), 1);
+  case 0xA0: return jit_set_flag(e, FIELD(I_flag), 1);
+  case 0xC0: return jit_set_flag(e, FIELD(I_flag), 0);
+  case 0xE0:  /* CLRV */
+    x86_set_field(e, FIELD(H_flag), 0);
+    return jit_set_flag(e, FIELD(V_flag), 0);
+  case 0xED:  /* NOTC */
+    x86_cmp_field(e, FIELD(C_flag), 0);
+    x86_setcc(e, CC_Z, FIELD(C_flag));
+    e->insn_cycles = 2;
+    return JIT_NEXT;
+
+  /* 16-bit */
+  case 0xBA:  /* MOVW YA,dp */
+    jit_read_word(e, dp + code[1], 3);
+    x86_store16(e, RAX, FIELD(YA));
+    jit_nz16(e);
+    e->insn_cycles = 5;
+    return JIT_NEXT;
+  case 0xDA:  /* MOVW dp,YA */
+    jit_read(e, dp + code[1], 0, 3);
+    x86_load8(e, RAX, -1, FIELD_A);
+    jit_write(e, dp + code[1], 0, 4);
+    x86_load8(e, RAX, -1, FIELD_Y);
+    jit_write(e, (dp + code[1] + 1) & 0xFFFF, 0, 5);
+    e->insn_cycles = 5;
+    return JIT_NEXT;
+  case 0x7A:  /* ADDW YA,dp */
+  case 0x9A:  /* SUBW YA,dp */
+  case 0x5A:  /* CMPW YA,dp */
+    jit_read_word(e, dp + code[1], 3);
+    x86_mov(e, RCX, RAX);
+    jit_word_op(e, opcode == 0x7A ? X86_ADD :
+                   opcode == 0x9A ? X86_SUB : X86_CMP);
+    e->insn_cycles = opcode == 0x5A ? 4 : 5;
+    return JIT_NEXT;
+  case 0x3A:  /* INCW dp */
+  case 0x1A:  /* DECW dp */
+    jit_read_word(e, dp + code[1], 3);
+    x86_alu_imm(e, opcode == 0x3A ? X86_ADD : X86_SUB, RAX, 1);
+    x86_alu_imm(e, X86_AND, RAX, 0xFFFF);
+    x86_mov(e, SAVE1, RAX);
+    jit_nz16(e);
+    x86_mov(e, RAX, SAVE1);
+    jit_write(e, dp + code[1], 0, 5);
+    x86_mov(e, RAX, SAVE1);
+    x86_shift(e, X86_SHR, RAX, 8);
+    jit_write(e, (dp + code[1] + 1) & 0xFFFF, 0, 6);
+    e->insn_cycles = 6;
+    return JIT_NEXT;
+
+  case 0xCF:  /* MUL YA */
+    x86_load8(e, RAX, -1, FIELD_A);
+    x86_load8(e, RCX, -1, FIELD_Y);
+    emit_rr(e, 0, 0, 0x0FAF, RAX, RCX);  /* imul eax, ecx */
+    x86_store16(e, RAX, FIELD(YA));
+    x86_shift(e, X86_SHR, RAX, 8);
+    jit_nz(e, RAX);
+    e->insn_cycles = 9;
+    return JIT_NEXT;
+
+  case 0x9F:  /* XCN A */
+    x86_load8(e, RAX, -1, FIELD_A);
+    x86_shift8_imm(e, X86_ROL, RAX, 4);
+    x86_store8(e, RAX, -1, FIELD_A);
+    jit_nz(e, RAX);
+    e->insn_cycles = 5;
+    return JIT_NEXT;
+
+  /* Stack */
+  case 0x2D: case 0x4D: case 0x6D:  /* PUSH A, X, Y */
+    x86_load8(e, RAX, -1, opcode == 0x2D ? FIELD_A :
+                          opcode == 0x4D ? FIELD(X) : FIELD_Y);
+    jit_push(e, 3);
+    e->insn_cycles = 4;
+    return JIT_NEXT;
+  case 0xAE: case 0xCE: case 0xEE:  /* POP A, X, Y */
+    jit_pop(e, 4);
+    x86_store8(e, RAX, -1, opcode == 0xAE ? FIELD_A :
+                           opcode == 0xCE ? FIELD(X) : FIELD_Y);
+    e->insn_cycles = 4;
+    return JIT_NEXT;
+
+  /* Bits */
+  case 0x02: case 0x22: case 0x42: case 0x62:  /* SET1 dp.bit */
+  case 0x82: case 0xA2: case 0xC2: case 0xE2:
+  case 0x12: case 0x32: case 0x52: case 0x72:  /* CLR1 dp.bit */
+  case 0x92: case 0xB2: case 0xD2: case 0xF2:
+    jit_read(e, dp + code[1], 0, 3);
+    if (opcode & 0x10) x86_alu8_imm(e, X86_AND, RAX, ~(1 << row) & 0xFF);
+    else x86_alu8_imm(e, X86_OR, RAX, 1 << row);
+    jit_write(e, dp + code[1], 0, 4);
+    e->insn_cycles = 4;
+    return JIT_NEXT;
+
+  case 0x0E:  /* TSET1 abs */
+  case 0x4E:  /* TCLR1 abs */
+    address = code[1] | code[2] << 8;
+    jit_read(e, address, 0, 4);
+    x86_load8(e, RCX, -1, FIELD_A);
+    x86_mov(e, RDX, RAX);
+    x86_alu(e, X86_AND, RDX, RCX);
+    jit_nz(e, RDX);
+    if (opcode == 0x0E)
+    {
+      x86_alu(e, X86_OR, RAX, RCX);
+    }
+    else
+    {
+      x86_alu_imm(e, X86_XOR, RCX, 0xFF);
+      x86_alu(e, X86_AND, RAX, RCX);
+    }
+    jit_write(e, address, 0, 6);
+    e->insn_cycles = 6;
+    return JIT_NEXT;
+
+  /* OR1, AND1, EOR1, MOV1, NOT1 on mem.bit */
+  case 0x0A: case 0x2A: case 0x4A: case 0x6A:
+  case 0x8A: case 0xAA: case 0xCA: case 0xEA:
+    address = (code[1] | code[2] << 8) & 0x1FFF;
+    bit = 1 << (code[2] >> 5);
+    jit_read(e, address, 0, 4);
+    cycle = 4;
+    switch (opcode)
+    {
+    case 0x0A:
+    case 0x2A:
+      x86_test8_imm(e, RAX, bit);
+      skip = x86_jump8(e, opcode == 0x0A ? CC_Z : CC_NZ);
+      x86_set_field(e, FIELD(C_flag), 1);
+      x86_land(e, skip);
+      cycle = 5;
+      break;
+    case 0x4A:
+    case 0x6A:
+      x86_test8_imm(e, RAX, bit);
+      skip = x86_jump8(e, opcode == 0x4A ? CC_NZ : CC_Z);
+      x86_set_field(e, FIELD(C_flag), 0);
+      x86_land(e, skip);
+      break;
+    case 0x8A:
+      x86_test8_imm(e, RAX, bit);
+      skip = x86_jump8(e, CC_Z);
+      x86_cmp_field(e, FIELD(C_flag), 0);
+      x86_setcc(e, CC_Z, FIELD(C_flag));
+      x86_land(e, skip);
+      cycle = 5;
+      break;
+    case 0xAA:
+      x86_alu8_imm(e, X86_AND, RAX, bit);
+      x86_store8(e, RAX, -1, FIELD(C_flag));
+      break;
+    case 0xCA:
+      x86_cmp_field(e, FIELD(C_flag), 0);
+      skip = x86_jump8(e, CC_Z);
+      x86_alu8_imm(e, X86_OR, RAX, bit);
+      skip2 = x86_jump8(e, CC_ALWAYS);
+      x86_land(e, skip);
+      x86_alu8_imm(e, X86_AND, RAX, ~bit & 0xFF);
+      x86_land(e, skip2);
+      jit_write(e, address, 0, 6);
+      cycle = 6;
+      break;
+    case 0xEA:
+      x86_alu8_imm(e, X86_XOR, RAX, bit);
+      jit_write(e, address, 0, 5);
+      cycle = 5;
+      break;
+    }
+    e->insn_cycles = cycle;
+    return JIT_NEXT;
+
+  /* Control flow.  Branches the interpreter skips whole loops with are left
+     to it. */
+  case 0x10:  /* BPL */
+  case 0x30:  /* BMI */
+    x86_test_field(e, FIELD(N_flag), 0x80);
+    return jit_branch(e, opcode == 0x10 ? CC_Z : CC_NZ,
+                      jit_relative(e, code), 2);
+  case 0x50:  /* BVC */
+  case 0x70:  /* BVS */
+    x86_cmp_field(e, FIELD(V_flag), 0);
+    return jit_branch(e, opcode == 0x50 ? CC_Z : CC_NZ,
+                      jit_relative(e, code), 2);
+  case 0x90:  /* BCC */
+  case 0xB0:  /* BCS */
+    x86_cmp_field(e, FIELD(C_flag), 0);
+    return jit_branch(e, opcode == 0x90 ? CC_Z : CC_NZ,
+                      jit_relative(e, code), 2);
+  case 0xD0:  /* BNE */
+  case 0xF0:  /* BEQ */
+    if (code[1] == (opcode == 0xD0 ? 0xFD : 0xFC)) return JIT_NONE;
+    x86_cmp_field(e, FIELD(Z_flag), 0);
+    return jit_branch(e, opcode == 0xD0 ? CC_NZ : CC_Z,
+                      jit_relative(e, code), 2);
+
+  case 0x03: case 0x23: case 0x43: case 0x63:  /* BBS dp.bit,rel */
+  case 0x83: case 0xA3: case 0xC3: case 0xE3:
+  case 0x13: case 0x33: case 0x53: case 0x73:  /* BBC dp.bit,rel */
+  case 0x93: case 0xB3: case 0xD3: case 0xF3:
+    jit_read(e, dp + code[1], 0, 4);
+    x86_test8_imm(e, RAX, 1 << row);
+    return jit_branch(e, opcode & 0x10 ? CC_Z : CC_NZ,
+                      jit_relative(e, code), 5);
+
+  case 0x2E:  /* CBNE dp,rel */
+  case 0xDE:  /* CBNE dp+X,rel */
+    if (opcode == 0x2E)
+    {
+      jit_read(e, dp + code[1], 0, 4);
+    }
+    else
+    {
+      jit_operand(e, MODE_DP_X, code, &address, &page);
+      jit_read(e, -1, page, 5);
+    }
+    x86_load8(e, RCX, -1, FIELD_A);
+    x86_alu8(e, X86_CMP, RAX, RCX);
+    return jit_branch(e, CC_NZ, jit_relative(e, code),
+                      opcode == 0x2E ? 5 : 6);
+
+  case 0x6E:  /* DBNZ dp,rel */
+    jit_read(e, dp + code[1], 0, 4);
+    emit_rr(e, 0, 1, 0xFE, 1, RAX);  /* dec al */
+    x86_mov(e, SAVE1, RAX);
+    jit_write(e, dp + code[1], 0, 5);
+    x86_test8(e, SAVE1);
+    return jit_branch(e, CC_NZ, jit_relative(e, code), 5);
+
+  case 0xFE:  /* DBNZ Y,rel */
+    if (code[1] == 0xFE) return JIT_NONE;
+    x86_mem_imm8(e, 0x80, X86_SUB, -1, FIELD_Y, 1);
+    return jit_branch(e, CC_NZ, jit_relative(e, code), 4);
+
+  case 0x2F:  /* BRA */
+    jit_exit(e, jit_relative(e, code) & 0xFFFF, e->cycles + 4);
+    e->insn_cycles = 4;
+    return JIT_END;
+
+  case 0x5F:  /* JMP abs */
+    jit_exit(e, code[1] | code[2] << 8, e->cycles + 3);
+    e->insn_cycles = 3;
+    return JIT_END;
+
+  case 0x3F:  /* CALL abs */
+    x86_mov_imm(e, RAX, (e->pc + 3) >> 8 & 0xFF);
+    jit_push(e, 5);
+    x86_mov_imm(e, RAX, (e->pc + 3) & 0xFF);
+    jit_push(e, 6);
+    jit_exit(e, code[1] | code[2] << 8, e->cycles + 8);
+    e->insn_cycles = 8;
+    return JIT_END;
+
+  case 0x6F:  /* RET */
+    jit_pop(e, 4);
+    x86_mov(e, SAVE1, RAX);
+    x86_mem_imm8(e, 0x80, X86_ADD, -1, FIELD(SP), 1);
+    jit_stack_address(e);
+    jit_read(e, -1, 1, 5);
+    x86_shift(e, X86_SHL, RAX, 8);
+    x86_alu(e, X86_OR, RAX, SAVE1);
+    jit_exit(e, -1, e->cycles + 5);
+    e->insn_cycles = 5;
+    return JIT_END;
+  }
+
+  return JIT_NONE;
+}
+
+
+/* Block management */
+
+static void spc_jit_flush(struct SPC700_JIT *jit)
+{
+  int i;
+
+  jit->used = 0;
+  for (i = 0; i < 256; i++)
+  {
+    if (jit->page[i]) memset(jit->page[i], 0, sizeof(*jit->page[i]));
+  }
+  jit->stop = 1;
+}
+
+/* Names a new block for perf, in the map file it reads for code generated
+   at run time, if OPENSPC_PERF_MAP is set in the environment.  The file is
+   opened once for the whole process, and each line is appended by a single
+   write(), so that lines from contexts on other threads do not interleave */
+static void spc_jit_perf_map(const void *code, size_t size, uint16_t pc)
+{
+  int fd = atomic_load(&spc_jit_perf_map_fd);
+  char line[64];
+  int length;
+
+  if (fd == JIT_PERF_MAP_UNOPENED)
+  {
+    const char *enabled = getenv("OPENSPC_PERF_MAP");
+    int expected = JIT_PERF_MAP_UNOPENED;
+
+    fd = -1;
+    if (enabled && *enabled)
+    {
+      snprintf(line, sizeof(line), "/tmp/perf-%ld.map", (long) getpid());
+      fd = open(line, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+      if (fd < 0) fd = -1;
+    }
+    if (!atomic_compare_exchange_strong(&spc_jit_perf_map_fd, &expected, fd))
+    {
+      if (fd >= 0) close(fd);
+      fd = expected;
+    }
+  }
+  if (fd < 0) return;
+  length = snprintf(line, sizeof(line), "%" PRIxPTR " %zx spc700_%04X\n",
+                    (uintptr_t) code, size, pc);
+  if (write(fd, line, length) != length) return;
+}
+
+/* Maps the code buffer on first use, and makes the rest of it from the page
+   holding the next block writable, or executable again once that block is
+   written, returning zero and giving up on the buffer on failure */
+static int spc_jit_protect(struct SPC700_JIT *jit, int writable)
+{
+  size_t start = jit->used & ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+
+  if (jit->failed) return 0;
+  if (!jit->code)
+  {
+    jit->code = mmap(0, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED)
+    {
+      jit->code = 0;
+      jit->failed = 1;
+      return 0;
+    }
+    if (writable) return 1;
+  }
+  if (mprotect(jit->code + start, JIT_CODE_SIZE - start,
+               writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC))
+  {
+    munmap(jit->code, JIT_CODE_SIZE);
+    jit->code = 0;
+    jit->failed = 1;
+    spc_jit_flush(jit);
+    return 0;
+  }
+  return 1;
+}
+
+static SPC_JIT_BLOCK *spc_jit_translate(SPC700_CONTEXT *active_context,
+                                        uint16_t pc)
+{
+  struct SPC700_JIT *jit = active_context->jit;
+  const unsigned char *page = active_context->read_map[pc >> 8];
+  SPC_JIT_EMITTER emitter;
+  SPC_JIT_EMITTER *e = &emitter;
+  SPC_JIT_PAGE *jit_page;
+  SPC_JIT_BLOCK *block;
+  unsigned char *entry, *start, *end;
+  int result = JIT_NEXT, count, i;
+  int32_t last = 0, need = 0;
+  uint16_t next = pc;
+
+  if (!page || jit->drops[pc >> 8] >= JIT_MAX_DROPS) return 0;
+  if (JIT_CODE_SIZE - jit->used < 2 * JIT_INSN_ROOM) spc_jit_flush(jit);
+  if (!spc_jit_protect(jit, 1)) return 0;
+
+  block = (SPC_JIT_BLOCK *) (jit->code + jit->used);
+  end = jit->code + JIT_CODE_SIZE;
+  memset(e, 0, sizeof(*e));
+  e->jit = jit;
+  e->p = (unsigned char *) (block + 1);
+  e->pc = pc;
+  e->dp = active_context->direct_page.b.h ? 0x100 : 0;
+  e->traced = active_context->trace != 0;
+
+  start = e->p;
+  e->epilogue = e->p;
+  emit(e, 0x41);  /* pop r15 */
+  emit(e, 0x5F);
+  emit(e, 0x41);  /* pop r14 */
+  emit(e, 0x5E);
+  emit(e, 0x41);  /* pop r13 */
+  emit(e, 0x5D);
+  emit(e, 0x41);  /* pop r12 */
+  emit(e, 0x5C);
+  emit(e, 0x5B);  /* pop rbx */
+  emit(e, 0xC3);  /* ret */
+
+  entry = e->p;
+  emit(e, 0x53);  /* push rbx */
+  emit(e, 0x41);  /* push r12 */
+  emit(e, 0x54);
+  emit(e, 0x41);  /* push r13 */
+  emit(e, 0x55);
+  emit(e, 0x41);  /* push r14 */
+  emit(e, 0x56);
+  emit(e, 0x41);  /* push r15 */
+  emit(e, 0x57);
+  emit_rr(e, 1, 0, 0x89, RDI, CTX);
+  emit_mem(e, 0, 0, 0x8B, BASE_CYCLES, -1, FIELD(WorkCycles));
+
+  for (count = 0; count < JIT_MAX_INSNS && result == JIT_NEXT; count++)
+  {
+    const unsigned char *code = page + (e->pc & 0xFF);
+    unsigned char *mark = e->p;
+
+    if (e->pc >> 8 != pc >> 8 ||
+        (e->pc & 0xFF) + spc_jit_lengths[*code] > 0x100 ||
+        end - e->p < JIT_INSN_ROOM)
+    {
+      break;
+    }
+    if (e->traced && count)
+    {
+      emit_rr(e, 1, 0, 0x89, CTX, RDI);
+      x86_mov_imm(e, RSI, e->pc);
+      jit_cycle(e, RDX, 1);
+      x86_call(e, (uintptr_t) &spc_jit_trace);
+    }
+    e->length = spc_jit_lengths[*code];
+    e->taken = 0;
+    e->calls = 0;
+    result = jit_insn(e, code);
+    if (result == JIT_NONE)
+    {
+      e->p = mark;
+      break;
+    }
+    last = e->cycles;
+    if (e->cycles + 1 + e->insn_cycles + e->taken > need)
+    {
+      need = e->cycles + 1 + e->insn_cycles + e->taken;
+    }
+    e->pc += e->length;
+    e->cycles += e->insn_cycles;
+    next = e->pc;
+    if (result == JIT_NEXT && e->calls) jit_check_stop(e);
+  }
+
+  if (count && !e->failed)
+  {
+    if (result != JIT_END) jit_exit(e, e->pc, e->cycles);
+    memcpy(&block->code, &entry, sizeof(block->code));
+    block->last = last;
+    block->need = need;
+    block->direct_page = active_context->direct_page.b.h != 0;
+    block->traced = e->traced;
+  }
+  else
+  {
+    block = 0;
+  }
+  if (!spc_jit_protect(jit, 0) || !block) return 0;
+
+  jit->used = (e->p - jit->code + 15) & ~(size_t) 15;
+  jit_page = jit->page[pc >> 8];
+  jit_page->block[pc & 0xFF] = block;
+  jit_page->blocks = 1;
+  for (i = pc & 0xFF; i < (pc & 0xFF) + (uint16_t) (next - pc); i++)
+  {
+    jit_page->covered[i >> 3] |= 1 << (i & 7);
+  }
+  active_context->code_watch[pc >> 8] = 1;
+  spc_jit_perf_map(start, e->p - start, pc);
+  return block;
+}
+
+SPC_JIT_CODE spc_jit_block(SPC700_CONTEXT *active_context, uint16_t pc,
+                           int32_t work_cycles, int32_t limit)
+{
+  struct SPC700_JIT *jit = active_context->jit;
+  SPC_JIT_PAGE *page;
+  SPC_JIT_BLOCK *block;
+
+  if (!jit)
+  {
+    jit = calloc(1, sizeof(*jit));
+    if (!jit) return 0;
+    active_context->jit = jit;
+  }
+  if (jit->failed || active_context->watch[pc >> 8] & SPC_WATCH_READ)
+  {
+    return 0;
+  }
+  page = jit->page[pc >> 8];
+  if (!page)
+  {
+    page = calloc(1, sizeof(*page));
+    if (!page) return 0;
+    jit->page[pc >> 8] = page;
+  }
+
+  block = page->block[pc & 0xFF];
+  if (!block)
+  {
+    uint8_t *heat = &page->heat[pc & 0xFF];
+
+    if (*heat >= JIT_HOT || ++*heat < JIT_HOT) return 0;
+    block = spc_jit_translate(active_context, pc);
+  }
+  else if (block->traced != (active_context->trace != 0))
+  {
+    block = spc_jit_translate(active_context, pc);
+  }
+  if (!block ||
+      block->direct_page != (active_context->direct_page.b.h != 0) ||
+      work_cycles + block->last >= 0 || work_cycles + block->need > limit)
+  {
+    return 0;
+  }
+  jit->stop = 0;
+  return block->code;
+}
+
+void spc_jit_drop_page(SPC700_CONTEXT *active_context, int page)
+{
+  struct SPC700_JIT *jit = active_context->jit;
+
+  if (!jit || !jit->page[page] || !jit->page[page]->blocks) return;
+  memset(jit->page[page], 0, sizeof(*jit->page[page]));
+  jit->stop = 1;
+}
+
+void spc_jit_written(SPC700_CONTEXT *active_context, uint16_t address)
+{
+  struct SPC700_JIT *jit = active_context->jit;
+  SPC_JIT_PAGE *page = jit ? jit->page[address >> 8] : 0;
+
+  if (!page || !(page->covered[(address & 0xFF) >> 3] & 1 << (address & 7)))
+  {
+    return;
+  }
+  if (jit->drops[address >> 8] < JIT_MAX_DROPS) jit->drops[address >> 8]++;
+  spc_jit_drop_page(active_context, address >> 8);
+}
+
+void spc_jit_flush_all(SPC700_CONTEXT *active_context)
+{
+  struct SPC700_JIT *jit = active_context->jit;
+
+  if (!jit) return;
+  spc_jit_flush(jit);
+  memset(jit->drops, 0, sizeof(jit->drops));
+}
+
+void spc_jit_free(SPC700_CONTEXT *active_context)
+{
+  struct SPC700_JIT *jit = active_context->jit;
+  int i;
+
+  if (!jit) return;
+  if (jit->code) munmap(jit->code, JIT_CODE_SIZE);
+  for (i = 0; i < 256; i++) free(jit->page[i]);
+  free(jit);
+  active_context->jit = 0;
+}
@@ -0,0 +1,1818 @@
+/*
+
+SNEeSe, an Open Source Super NES emulator.
+
+
+Copyright (c) 1998-2006, Charles Bilyue'.
+Portions copyright (c) 1998-2020, Brad Martin.
+
+This is free software.  See 'LICENSE' for details.
+You must read and accept the license prior to use.
+
+*/
+
+// NOTE(bmartin) This is the body of the opcode switch from Execute_SPC() in
+// spc700.c, moved out so it can be expanded more than once.  It is not a
+// standalone header: the includer supplies CASE_OPCODE(), START_CYCLE(),
+// END_FETCH_CYCLE(), END_CYCLE(), EXIT_OPCODE(), END_OPCODE() and
+// END_INVALID_OPCODE() to suit the way it dispatches, and every one of the 256
+// opcodes must have a CASE_OPCODE() label so a full dispatch table can be
+// built from them.
+
+/* xxx00000 */
+CASE_OPCODE(0x00):  /* NOP */
+  {
+    START_CYCLE(2)
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x20):  /* CLRP */
+  {
+    START_CYCLE(2)
+    clr_flag_spc(active_context, SPC_FLAG_P);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x40):  /* SETP */
+  {
+    START_CYCLE(2)
+    set_flag_spc(active_context, SPC_FLAG_P);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x60):  /* CLRC */
+  {
+    START_CYCLE(2)
+    clr_flag_spc(active_context, SPC_FLAG_C);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x80):  /* SETC */
+  {
+    START_CYCLE(2)
+    set_flag_spc(active_context, SPC_FLAG_C);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xA0):  /* EI */
+  {
+    START_CYCLE(2)
+    set_flag_spc(active_context, SPC_FLAG_I);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xC0):  /* DI */
+  {
+    START_CYCLE(2)
+    clr_flag_spc(active_context, SPC_FLAG_I);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xE0):  /* CLRV */
+  {
+    START_CYCLE(2)
+    clr_flag_spc(active_context, SPC_FLAG_H | SPC_FLAG_V);
+    END_OPCODE(1)
+  }
+
+
+/* xxxx0001 */
+CASE_OPCODE(0x01): CASE_OPCODE(0x11):
+CASE_OPCODE(0x21): CASE_OPCODE(0x31):
+CASE_OPCODE(0x41): CASE_OPCODE(0x51):
+CASE_OPCODE(0x61): CASE_OPCODE(0x71):
+CASE_OPCODE(0x81): CASE_OPCODE(0x91):
+CASE_OPCODE(0xA1): CASE_OPCODE(0xB1):
+CASE_OPCODE(0xC1): CASE_OPCODE(0xD1):
+CASE_OPCODE(0xE1): CASE_OPCODE(0xF1):
+  {
+    OP_TCALL(_opcode >> 4)
+  }
+
+
+/* xxx00010 */
+CASE_OPCODE(0x02): CASE_OPCODE(0x22):
+CASE_OPCODE(0x42): CASE_OPCODE(0x62):
+CASE_OPCODE(0x82): CASE_OPCODE(0xA2):
+CASE_OPCODE(0xC2): CASE_OPCODE(0xE2):
+  {
+    OP_RMW_DP(WRITE_OP(SET1), 1)
+  }
+
+/* xxx00011 */
+CASE_OPCODE(0x03): CASE_OPCODE(0x23):
+CASE_OPCODE(0x43): CASE_OPCODE(0x63):
+CASE_OPCODE(0x83): CASE_OPCODE(0xA3):
+CASE_OPCODE(0xC3): CASE_OPCODE(0xE3):
+  {
+    COND_DP_REL(DP_REL_TEST_BBS)
+  }
+
+/* xxx00100 */
+CASE_OPCODE(0x04):  /* OR A,dp */
+  {
+    OP_READ_DP_A(OR)
+  }
+
+CASE_OPCODE(0x24):  /* AND A,dp */
+  {
+    OP_READ_DP_A(AND)
+  }
+
+CASE_OPCODE(0x44):  /* EOR A,dp */
+  {
+    OP_READ_DP_A(EOR)
+  }
+
+CASE_OPCODE(0x64):  /* CMP A,dp */
+  {
+    OP_READ_DP_A(CMP)
+  }
+
+CASE_OPCODE(0x84):  /* ADC A,dp */
+  {
+    OP_READ_DP_A(ADC)
+  }
+
+CASE_OPCODE(0xA4):  /* SBC A,dp */
+  {
+    OP_READ_DP_A(SBC)
+  }
+
+CASE_OPCODE(0xC4):  /* MOV dp,A */
+  {
+    OP_RMW_DP(WRITE_MOV(_A), 0)
+  }
+
+CASE_OPCODE(0xE4):  /* MOV A,dp */
+  {
+    OP_READ_DP_A(MOV_READ)
+  }
+
+
+/* xxx00101 */
+CASE_OPCODE(0x05):  /* OR A,abs */
+  {
+    OP_READ_ABS_A(OR)
+  }
+
+CASE_OPCODE(0x25):  /* AND A,abs */
+  {
+    OP_READ_ABS_A(AND)
+  }
+
+CASE_OPCODE(0x45):  /* EOR A,abs */
+  {
+    OP_READ_ABS_A(EOR)
+  }
+
+CASE_OPCODE(0x65):  /* CMP A,abs */
+  {
+    OP_READ_ABS_A(CMP)
+  }
+
+CASE_OPCODE(0x85):  /* ADC A,abs */
+  {
+    OP_READ_ABS_A(ADC)
+  }
+
+CASE_OPCODE(0xA5):  /* SBC A,abs */
+  {
+    OP_READ_ABS_A(SBC)
+  }
+
+CASE_OPCODE(0xC5):  /* MOV abs,A */
+  {
+    OP_RMW_ABS(WRITE_MOV(_A), 0)
+  }
+
+CASE_OPCODE(0xE5):  /* MOV A,abs */
+  {
+    OP_READ_ABS_A(MOV_READ)
+  }
+
+
+/* xxx00110 */
+CASE_OPCODE(0x06):  /* OR A,(X) */
+  {
+    OP_READ_INDIRECT_A(OR)
+  }
+
+CASE_OPCODE(0x26):  /* AND A,(X) */
+  {
+    OP_READ_INDIRECT_A(AND)
+  }
+
+CASE_OPCODE(0x46):  /* EOR A,(X) */
+  {
+    OP_READ_INDIRECT_A(EOR)
+  }
+
+CASE_OPCODE(0x66):  /* CMP A,(X) */
+  {
+    OP_READ_INDIRECT_A(CMP)
+  }
+
+CASE_OPCODE(0x86):  /* ADC A,(X) */
+  {
+    OP_READ_INDIRECT_A(ADC)
+  }
+
+CASE_OPCODE(0xA6):  /* SBC A,(X) */
+  {
+    OP_READ_INDIRECT_A(SBC)
+  }
+
+CASE_OPCODE(0xC6):  /* MOV (X),A */
+  {
+    OP_RMW_INDIRECT(WRITE_MOV(_A), 0)
+  }
+
+CASE_OPCODE(0xE6):  /* MOV A,(X) */
+  {
+    OP_READ_INDIRECT_A(MOV_READ)
+  }
+
+
+/* xxx00111 */
+CASE_OPCODE(0x07):  /* OR A,(dp+X) */
+  {
+    OP_READ_INDEXED_INDIRECT_A(OR)
+  }
+
+CASE_OPCODE(0x27):  /* AND A,(dp+X) */
+  {
+    OP_READ_INDEXED_INDIRECT_A(AND)
+  }
+
+CASE_OPCODE(0x47):  /* EOR A,(dp+X) */
+  {
+    OP_READ_INDEXED_INDIRECT_A(EOR)
+  }
+
+CASE_OPCODE(0x67):  /* CMP A,(dp+X) */
+  {
+    OP_READ_INDEXED_INDIRECT_A(CMP)
+  }
+
+CASE_OPCODE(0x87):  /* ADC A,(dp+X) */
+  {
+    OP_READ_INDEXED_INDIRECT_A(ADC)
+  }
+
+CASE_OPCODE(0xA7):  /* SBC A,(dp+X) */
+  {
+    OP_READ_INDEXED_INDIRECT_A(SBC)
+  }
+
+CASE_OPCODE(0xC7):  /* MOV (dp+X),A */
+  {
+    OP_RMW_INDEXED_INDIRECT(WRITE_MOV(_A), 0)
+  }
+
+CASE_OPCODE(0xE7):  /* MOV A,(dp+X) */
+  {
+    OP_READ_INDEXED_INDIRECT_A(MOV_READ)
+  }
+
+
+/* xxx01000 */
+CASE_OPCODE(0x08):  /* OR A,#imm */
+  {
+    OP_READ_IMM_A(OR)
+  }
+
+CASE_OPCODE(0x28):  /* AND A,#imm */
+  {
+    OP_READ_IMM_A(AND)
+  }
+
+CASE_OPCODE(0x48):  /* EOR A,#imm */
+  {
+    OP_READ_IMM_A(EOR)
+  }
+
+CASE_OPCODE(0x68):  /* CMP A,#imm */
+  {
+    OP_READ_IMM_A(CMP)
+  }
+
+CASE_OPCODE(0x88):  /* ADC A,#imm */
+  {
+    OP_READ_IMM_A(ADC)
+  }
+
+CASE_OPCODE(0xA8):  /* SBC A,#imm */
+  {
+    OP_READ_IMM_A(SBC)
+  }
+
+CASE_OPCODE(0xC8):  /* CMP X,#imm */
+  {
+    OP_READ_IMM(CMP, _X)
+  }
+
+CASE_OPCODE(0xE8):  /* MOV A,#imm */
+  {
+    OP_READ_IMM_A(MOV_READ)
+  }
+
+
+/* xxx01001 */
+CASE_OPCODE(0x09):  /* OR dp(d),dp(s) */
+  {
+    OP_RMW_DP_DP(OR)
+  }
+
+CASE_OPCODE(0x29):  /* AND dp(d),dp(s) */
+  {
+    OP_RMW_DP_DP(AND)
+  }
+
+CASE_OPCODE(0x49):  /* EOR dp(d),dp(s) */
+  {
+    OP_RMW_DP_DP(EOR)
+  }
+
+CASE_OPCODE(0x69):  /* CMP dp(d),dp(s) */
+  {
+    /*  6 cycles - opcode, src address, dest address, src read, */
+    /* dest read + op, dummy cycle */
+    START_CYCLE(2)
+    _address2 = _dp + get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address = _dp + get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data2 = get_byte_spc(active_context, _address2);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    _data = get_byte_spc(active_context, _address);
+    OP_CMP(_data, _data2)
+    END_OPCODE(2)
+  }
+
+CASE_OPCODE(0x89):  /* ADC dp(d),dp(s) */
+  {
+    OP_RMW_DP_DP(ADC)
+  }
+
+CASE_OPCODE(0xA9):  /* SBC dp(d),dp(s) */
+  {
+    OP_RMW_DP_DP(SBC)
+  }
+
+CASE_OPCODE(0xC9):  /* MOV abs,X */
+  {
+    OP_RMW_ABS(WRITE_MOV(_X), 0)
+  }
+
+CASE_OPCODE(0xE9):  /* MOV X,abs */
+  {
+    OP_READ_ABS(MOV_READ, _X)
+  }
+
+
+/* xxx01010 */
+CASE_OPCODE(0x0A):  /* OR1 C,mem.bit */
+  {
+    /*  5 cycles - opcode, address low, address high, data read, op */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    /* separate bit number, address */
+    _offset = _address >> 13;
+    _address &= 0x1FFF;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    if (_data & offset_to_bit[_offset]) set_flag_spc(active_context, SPC_FLAG_C);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x2A):  /* OR1 C,/mem.bit */
+  {
+    /*  5 cycles - opcode, address low, address high, data read, op */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    /* separate bit number, address */
+    _offset = _address >> 13;
+    _address &= 0x1FFF;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    if (!(_data & offset_to_bit[_offset])) set_flag_spc(active_context, SPC_FLAG_C);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x4A):  /* AND1 C,mem.bit */
+  {
+    /*  4 cycles - opcode, address low, address high, data read + op */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    /* separate bit number, address */
+    _offset = _address >> 13;
+    _address &= 0x1FFF;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    if (!(_data & offset_to_bit[_offset])) clr_flag_spc(active_context, SPC_FLAG_C);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x6A):  /* AND1 C,/mem.bit */
+  {
+    /*  4 cycles - opcode, address low, address high, data read + op */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    /* separate bit number, address */
+    _offset = _address >> 13;
+    _address &= 0x1FFF;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    if (_data & offset_to_bit[_offset]) clr_flag_spc(active_context, SPC_FLAG_C);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x8A):  /* EOR1 C,mem.bit */
+  {
+    /*  5 cycles - opcode, address low, address high, data read, op */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    /* separate bit number, address */
+    _offset = _address >> 13;
+    _address &= 0x1FFF;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    if (_data & offset_to_bit[_offset]) complement_carry_spc(active_context);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xAA):  /* MOV1 C,mem.bit */
+  {
+    /*  4 cycles - opcode, address low, address high, data read */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    /* separate bit number, address */
+    _offset = _address >> 13;
+    _address &= 0x1FFF;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    store_flag_c(active_context, _data & offset_to_bit[_offset]);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xCA):  /* MOV1 mem.bit,C */
+  {
+    /*  6 cycles - opcode, address low, address high, data read, op, */
+    /* data write */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    /* separate bit number, address */
+    _offset = _address >> 13;
+    _address &= 0x1FFF;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    if (flag_state_spc(active_context, SPC_FLAG_C)) _data |= offset_to_bit[_offset];
+    else _data &= offset_to_not[_offset];
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    set_byte_spc(active_context, _address, _data);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xEA):  /* NOT1 mem.bit */
+  {
+    /*  5 cycles - opcode, address low, address high, data read, */
+    /* op + data write */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    /* separate bit number, address */
+    _offset = _address >> 13;
+    _address &= 0x1FFF;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    _data ^= offset_to_bit[_offset];
+    set_byte_spc(active_context, _address, _data);
+    END_OPCODE(1)
+  }
+
+
+/* xxx01011 */
+CASE_OPCODE(0x0B):  /* ASL dp */
+  {
+    OP_RMW_DP(WRITE_OP(ASL), 1)
+  }
+
+CASE_OPCODE(0x2B):  /* ROL dp */
+  {
+    OP_RMW_DP(WRITE_OP(ROL), 1)
+  }
+
+CASE_OPCODE(0x4B):  /* LSR dp */
+  {
+    OP_RMW_DP(WRITE_OP(LSR), 1)
+  }
+
+CASE_OPCODE(0x6B):  /* ROR dp */
+  {
+    OP_RMW_DP(WRITE_OP(ROR), 1)
+  }
+
+CASE_OPCODE(0x8B):  /* DEC dp */
+  {
+    OP_RMW_DP(WRITE_OP(DEC), 1)
+  }
+
+CASE_OPCODE(0xAB):  /* INC dp */
+  {
+    OP_RMW_DP(WRITE_OP(INC), 1)
+  }
+
+CASE_OPCODE(0xCB):  /* MOV dp,Y */
+  {
+    OP_RMW_DP(WRITE_MOV(_Y), 0)
+  }
+
+CASE_OPCODE(0xEB):  /* MOV Y,dp */
+  {
+    OP_READ_DP(MOV_READ, _Y)
+  }
+
+
+/* xxx01100 */
+CASE_OPCODE(0x0C):  /* ASL abs */
+  {
+    OP_RMW_ABS(WRITE_OP(ASL), 1)
+  }
+
+CASE_OPCODE(0x2C):  /* ROL abs */
+  {
+    OP_RMW_ABS(WRITE_OP(ROL), 1)
+  }
+
+CASE_OPCODE(0x4C):  /* LSR abs */
+  {
+    OP_RMW_ABS(WRITE_OP(LSR), 1)
+  }
+
+CASE_OPCODE(0x6C):  /* ROR abs */
+  {
+    OP_RMW_ABS(WRITE_OP(ROR), 1)
+  }
+
+CASE_OPCODE(0x8C):  /* DEC abs */
+  {
+    OP_RMW_ABS(WRITE_OP(DEC), 1)
+  }
+
+CASE_OPCODE(0xAC):  /* INC abs */
+  {
+    OP_RMW_ABS(WRITE_OP(INC), 1)
+  }
+
+CASE_OPCODE(0xCC):  /* MOV abs,Y */
+  {
+    OP_RMW_ABS(WRITE_MOV(_Y), 0)
+  }
+
+CASE_OPCODE(0xEC):  /* MOV Y,abs */
+  {
+    OP_READ_ABS(MOV_READ, _Y)
+  }
+
+
+/* xxx01101 */
+CASE_OPCODE(0x0D):  /* PUSH PSW */
+  {
+    /*  4 cycles - opcode, address load, data write, SP decrement */
+    START_CYCLE(2)
+    _address = 0x0100 + _SP;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    spc_setup_flags(active_context, _B_flag);
+    set_byte_spc(active_context, _address, _PSW);
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _SP--;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x2D):  /* PUSH A */
+  {
+    OP_PUSH(_A)
+  }
+
+CASE_OPCODE(0x4D):  /* PUSH X */
+  {
+    OP_PUSH(_X)
+  }
+
+CASE_OPCODE(0x6D):  /* PUSH Y */
+  {
+    OP_PUSH(_Y)
+  }
+
+CASE_OPCODE(0x8D):  /* MOV Y,#imm */
+  {
+    OP_READ_IMM(MOV_READ, _Y)
+  }
+
+CASE_OPCODE(0xAD):  /* CMP Y,#imm */
+  {
+    OP_READ_IMM(CMP, _Y)
+  }
+
+CASE_OPCODE(0xCD):  /* MOV X,#imm */
+  {
+    OP_READ_IMM(MOV_READ, _X)
+  }
+
+CASE_OPCODE(0xED):  /* NOTC */
+  {
+    /*  2 cycles - opcode, op */
+    START_CYCLE(2)
+    complement_carry_spc(active_context);
+    END_OPCODE(1)
+  }
+
+
+/* xxx01110 */
+CASE_OPCODE(0x0E):  /* TSET1 abs */
+  {
+    /*  6 cycles - opcode, address low, address high, data read, */
+    /* test for flags, op + data write */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    store_flags_nz(active_context, _data & _A);
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    _data |= _A;
+    set_byte_spc(active_context, _address, _data);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x2E):  /* CBNE dp,rel */
+  {
+    COND_DP_REL(TEST_CBNE)
+  }
+
+CASE_OPCODE(0x4E):  /* TCLR1 abs */
+  {
+    /*  6 cycles - opcode, address low, address high, data read, */
+    /* test for flags, op + data write */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    store_flags_nz(active_context, _data & _A);
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    _data &= ~_A;
+    set_byte_spc(active_context, _address, _data);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x6E):  /* DBNZ dp,rel */
+  {
+    COND_DP_REL(DP_REL_TEST_DBNZ)
+  }
+
+CASE_OPCODE(0x8E):  /* POP PSW */
+  {
+    /*  4 cycles - opcode, SP increment, address load, data read */
+    START_CYCLE(2)
+    _SP++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address = 0x0100 + _SP;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _PSW = get_byte_spc(active_context, _address);
+    spc_restore_flags(active_context);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xAE):  /* POP A */
+  {
+    OP_POP(_A)
+  }
+
+CASE_OPCODE(0xCE):  /* POP X */
+  {
+    OP_POP(_X)
+  }
+
+CASE_OPCODE(0xEE):  /* POP Y */
+  {
+    OP_POP(_Y)
+  }
+
+
+/* xxx01111 */
+CASE_OPCODE(0x0F):  /* BRK */
+  {
+    /*  8 cycles - opcode, new PCL, new PCH, stack address load, */
+    /* PSW write, PCH write, PCL write, SP decrement */
+    /* fetch address for PC */
+    START_CYCLE(2)
+    /* same vector as TCALL 0 */
+    _address = 0xFFC0 + ((15 - (0)) * 2);
+    _address2 = get_byte_spc(active_context, _address);
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address2 += (get_byte_spc(active_context, _address + 1) << 8);
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _address = 0x0100 + _SP;
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    set_byte_spc(active_context, _address, _PC >> 8);
+    _SP--;
+    _address = 0x0100 + _SP;
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    set_byte_spc(active_context, _address, _PC);
+    _SP--;
+    _address = 0x0100 + _SP;
+    END_CYCLE(6, 1)
+
+    START_CYCLE(7)
+    spc_setup_flags(active_context, _B_flag);
+    set_byte_spc(active_context, _address, _PSW);
+    set_flag_spc(active_context, SPC_FLAG_B);
+    clr_flag_spc(active_context, SPC_FLAG_I);
+    END_CYCLE(7, 1)
+
+    START_CYCLE(8)
+    _PC = _address2;
+    _SP--;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x2F):  /* BRA rel */
+  {
+    COND_REL(REL_TEST_BRA)
+  }
+
+CASE_OPCODE(0x4F):  /* PCALL upage */
+  {
+    /*  6 cycles - opcode, new PCL, stack address load, PCH write, */
+    /* PCL write, SP decrement */
+    /* fetch address for PC */
+    START_CYCLE(2)
+    _address2 = 0xFF00 + get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address = 0x0100 + _SP;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    set_byte_spc(active_context, _address, _PC >> 8);
+    _SP--;
+    _address = 0x0100 + _SP;
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    set_byte_spc(active_context, _address, _PC);
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    _PC = _address2;
+    _SP--;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x6F):  /* RET */
+  {
+    /*  5 cycles - opcode, SP increment, address load, new PCL, new PCH */
+    /* pop address to PC */
+    START_CYCLE(2)
+    _SP++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3) \
+    _address = 0x0100 + _SP; \
+    END_CYCLE(3, 1) \
+
+    START_CYCLE(4) \
+    _address2 = get_byte_spc(active_context, _address);
+    _SP++;
+    _address = 0x0100 + _SP;
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    _PC = (get_byte_spc(active_context, _address) << 8) + _address2;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x8F):  /* MOV dp,#imm */
+  {
+    OP_RMW_DP_IMM(MOV_READ_NOFLAGS)
+  }
+
+CASE_OPCODE(0xAF):  /* MOV (X)+,A */
+  {
+    /*  4 cycles - opcode, address load, data write, X increment */
+    START_CYCLE(2)
+    _address = _dp + _X;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    set_byte_spc(active_context, _address, _A);
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _X++;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xCF):  /* MUL YA */
+  {
+    /*  9 cycles - opcode, 8(op) */
+    START_CYCLE(2)
+    _YA = (unsigned) _Y * _A;
+    store_flags_nz(active_context, _Y);
+    END_OPCODE(8)
+  }
+
+/* xxx10000 */
+CASE_OPCODE(0x10):  /* BPL rel */
+  {
+    COND_REL(REL_TEST_BPL)
+  }
+
+CASE_OPCODE(0x30):  /* BMI rel */
+  {
+    COND_REL(REL_TEST_BMI)
+  }
+
+CASE_OPCODE(0x50):  /* BVC rel */
+  {
+    COND_REL(REL_TEST_BVC)
+  }
+
+CASE_OPCODE(0x70):  /* BVS rel */
+  {
+    COND_REL(REL_TEST_BVS)
+  }
+
+CASE_OPCODE(0x90):  /* BCC rel */
+  {
+    COND_REL(REL_TEST_BCC)
+  }
+
+CASE_OPCODE(0xB0):  /* BCS rel */
+  {
+    COND_REL(REL_TEST_BCS)
+  }
+
+CASE_OPCODE(0xD0):  /* BNE rel */
+  {
+    COND_REL(REL_TEST_BNE)
+  }
+
+CASE_OPCODE(0xF0):  /* BEQ rel */
+  {
+    COND_REL(REL_TEST_BEQ)
+  }
+
+
+/* xxx10010 */
+CASE_OPCODE(0x12): CASE_OPCODE(0x32):
+CASE_OPCODE(0x52): CASE_OPCODE(0x72):
+CASE_OPCODE(0x92): CASE_OPCODE(0xB2):
+CASE_OPCODE(0xD2): CASE_OPCODE(0xF2):
+  {
+    OP_RMW_DP(WRITE_OP(CLR1), 1)
+  }
+
+
+/* xxx10011 */
+CASE_OPCODE(0x13): CASE_OPCODE(0x33):
+CASE_OPCODE(0x53): CASE_OPCODE(0x73):
+CASE_OPCODE(0x93): CASE_OPCODE(0xB3):
+CASE_OPCODE(0xD3): CASE_OPCODE(0xF3):
+  {
+    COND_DP_REL(DP_REL_TEST_BBC)
+  }
+
+
+/* xxx10100 */
+CASE_OPCODE(0x14):  /* OR A,dp+X */
+  {
+    OP_READ_DP_X_INDEXED_A(OR)
+  }
+
+CASE_OPCODE(0x34):  /* AND A,dp+X */
+  {
+    OP_READ_DP_X_INDEXED_A(AND)
+  }
+
+CASE_OPCODE(0x54):  /* EOR A,dp+X */
+  {
+    OP_READ_DP_X_INDEXED_A(EOR)
+  }
+
+CASE_OPCODE(0x74):  /* CMP A,dp+X */
+  {
+    OP_READ_DP_X_INDEXED_A(CMP)
+  }
+
+CASE_OPCODE(0x94):  /* ADC A,dp+X */
+  {
+    OP_READ_DP_X_INDEXED_A(ADC)
+  }
+
+CASE_OPCODE(0xB4):  /* SBC A,dp+X */
+  {
+    OP_READ_DP_X_INDEXED_A(SBC)
+  }
+
+CASE_OPCODE(0xD4):  /* MOV dp+X,A */
+  {
+    OP_RMW_DP_X_INDEXED(WRITE_MOV(_A), 0)
+  }
+
+CASE_OPCODE(0xF4):  /* MOV A,dp+X */
+  {
+    OP_READ_DP_X_INDEXED_A(MOV_READ)
+  }
+
+
+/* xxx10101 */
+CASE_OPCODE(0x15):  /* OR A,abs+X */
+  {
+    OP_READ_ABS_X_INDEXED_A(OR)
+  }
+
+CASE_OPCODE(0x35):  /* AND A,abs+X */
+  {
+    OP_READ_ABS_X_INDEXED_A(AND)
+  }
+
+CASE_OPCODE(0x55):  /* EOR A,abs+X */
+  {
+    OP_READ_ABS_X_INDEXED_A(EOR)
+  }
+
+CASE_OPCODE(0x75):  /* CMP A,abs+X */
+  {
+    OP_READ_ABS_X_INDEXED_A(CMP)
+  }
+
+CASE_OPCODE(0x95):  /* ADC A,abs+X */
+  {
+    OP_READ_ABS_X_INDEXED_A(ADC)
+  }
+
+CASE_OPCODE(0xB5):  /* SBC A,abs+X */
+  {
+    OP_READ_ABS_X_INDEXED_A(SBC)
+  }
+
+CASE_OPCODE(0xD5):  /* MOV abs+X,A */
+  {
+    OP_RMW_ABS_X_INDEXED(WRITE_MOV(_A), 0)
+  }
+
+CASE_OPCODE(0xF5):  /* MOV A,abs+X */
+  {
+    OP_READ_ABS_X_INDEXED_A(MOV_READ)
+  }
+
+
+/* xxx10110 */
+CASE_OPCODE(0x16):  /* OR A,abs+Y */
+  {
+    OP_READ_ABS_Y_INDEXED_A(OR)
+  }
+
+CASE_OPCODE(0x36):  /* AND A,abs+Y */
+  {
+    OP_READ_ABS_Y_INDEXED_A(AND)
+  }
+
+CASE_OPCODE(0x56):  /* EOR A,abs+Y */
+  {
+    OP_READ_ABS_Y_INDEXED_A(EOR)
+  }
+
+CASE_OPCODE(0x76):  /* CMP A,abs+Y */
+  {
+    OP_READ_ABS_Y_INDEXED_A(CMP)
+  }
+
+CASE_OPCODE(0x96):  /* ADC A,abs+Y */
+  {
+    OP_READ_ABS_Y_INDEXED_A(ADC)
+  }
+
+CASE_OPCODE(0xB6):  /* SBC A,abs+Y */
+  {
+    OP_READ_ABS_Y_INDEXED_A(SBC)
+  }
+
+CASE_OPCODE(0xD6):  /* MOV abs+Y,A */
+  {
+    OP_RMW_ABS_Y_INDEXED(WRITE_MOV(_A), 0)
+  }
+
+CASE_OPCODE(0xF6):  /* MOV A,abs+Y */
+  {
+    OP_READ_ABS_Y_INDEXED_A(MOV_READ)
+  }
+
+
+/* xxx10111 */
+CASE_OPCODE(0x17):  /* OR A,(dp)+Y */
+  {
+    OP_READ_INDIRECT_INDEXED_A(OR)
+  }
+
+CASE_OPCODE(0x37):  /* AND A,(dp)+Y */
+  {
+    OP_READ_INDIRECT_INDEXED_A(AND)
+  }
+
+CASE_OPCODE(0x57):  /* EOR A,(dp)+Y */
+  {
+    OP_READ_INDIRECT_INDEXED_A(EOR)
+  }
+
+CASE_OPCODE(0x77):  /* CMP A,(dp)+Y */
+  {
+    OP_READ_INDIRECT_INDEXED_A(CMP)
+  }
+
+CASE_OPCODE(0x97):  /* ADC A,(dp)+Y */
+  {
+    OP_READ_INDIRECT_INDEXED_A(ADC)
+  }
+
+CASE_OPCODE(0xB7):  /* SBC A,(dp)+Y */
+  {
+    OP_READ_INDIRECT_INDEXED_A(SBC)
+  }
+
+CASE_OPCODE(0xD7):  /* MOV (dp)+Y,A */
+  {
+    OP_RMW_INDIRECT_INDEXED(WRITE_MOV(_A), 0)
+  }
+
+CASE_OPCODE(0xF7):  /* MOV A,(dp)+Y */
+  {
+    OP_READ_INDIRECT_INDEXED_A(MOV_READ)
+  }
+
+
+/* xxx11000 */
+CASE_OPCODE(0x18):  /* OR dp,#imm */
+  {
+    OP_RMW_DP_IMM(OR)
+  }
+
+CASE_OPCODE(0x38):  /* AND dp,#imm */
+  {
+    OP_RMW_DP_IMM(AND)
+  }
+
+CASE_OPCODE(0x58):  /* EOR dp,#imm */
+  {
+    OP_RMW_DP_IMM(EOR)
+  }
+
+CASE_OPCODE(0x78):  /* CMP dp,#imm */
+  {
+    /*  5 cycles - opcode, src data, dest address, dest read + op, */
+    /* dummy cycle */
+    START_CYCLE(2)
+    _data2 = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address = _dp + get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    OP_CMP(_data, _data2)
+    END_OPCODE(2)
+  }
+
+CASE_OPCODE(0x98):  /* ADC dp,#imm */
+  {
+    OP_RMW_DP_IMM(ADC)
+  }
+
+CASE_OPCODE(0xB8):  /* SBC dp,#imm */
+  {
+    OP_RMW_DP_IMM(SBC)
+  }
+
+CASE_OPCODE(0xD8):  /* MOV dp,X */
+  {
+    OP_RMW_DP(WRITE_MOV(_X), 0)
+  }
+
+CASE_OPCODE(0xF8):  /* MOV X,dp */
+  {
+    OP_READ_DP(MOV_READ, _X)
+  }
+
+
+/* xxx11001 */
+CASE_OPCODE(0x19):  /* OR (X),(Y) */
+  {
+    OP_RMW_INDIRECT_INDIRECT(OR)
+  }
+
+CASE_OPCODE(0x39):  /* AND (X),(Y) */
+  {
+    OP_RMW_INDIRECT_INDIRECT(AND)
+  }
+
+CASE_OPCODE(0x59):  /* EOR (X),(Y) */
+  {
+    OP_RMW_INDIRECT_INDIRECT(EOR)
+  }
+
+CASE_OPCODE(0x79):  /* CMP (X),(Y) */
+  {
+    /*  5 cycles - opcode, address calc, src read, dest read + op, */
+    /* dummy cycle */
+    START_CYCLE(2)
+    _address = _dp + _Y;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _data2 = get_byte_spc(active_context, _address);
+    _address = _dp + _X;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address);
+    OP_CMP(_data, _data2)
+    END_OPCODE(2)
+  }
+
+CASE_OPCODE(0x99):  /* ADC (X),(Y) */
+  {
+    OP_RMW_INDIRECT_INDIRECT(ADC)
+  }
+
+CASE_OPCODE(0xB9):  /* SBC (X),(Y) */
+  {
+    OP_RMW_INDIRECT_INDIRECT(SBC)
+  }
+
+CASE_OPCODE(0xD9):  /* MOV dp+Y,X */
+  {
+    OP_RMW_DP_Y_INDEXED(WRITE_MOV(_X), 0)
+  }
+
+CASE_OPCODE(0xF9):  /* MOV X,dp+Y */
+  {
+    OP_READ_DP_Y_INDEXED(MOV_READ, _X)
+  }
+
+
+/* xxx11010 */
+CASE_OPCODE(0x1A):  /* DECW dp */
+  {
+    OP_RMW16_DP(DECW)
+  }
+
+CASE_OPCODE(0x3A):  /* INCW dp */
+  {
+    OP_RMW16_DP(INCW)
+  }
+
+CASE_OPCODE(0x5A):  /* CMPW YA,dp */
+  {
+    unsigned temp;
+
+    /*  4 cycles - opcode, address, data low read, data high read + op */
+    START_CYCLE(2)
+    _address = _dp + get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _data16 = get_byte_spc(active_context, _address);
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data16 += get_byte_spc(active_context, _address + 1) << 8;
+    temp = _YA - _data16;
+    store_flag_c(active_context, temp <= 0xFFFF);
+    store_flag_n(active_context, temp >> 8);
+    store_flag_z(active_context, temp != 0);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x7A):  /* ADDW YA,dp */
+  {
+    OP_READ16_YA_DP(ADDW)
+  }
+
+CASE_OPCODE(0x9A):  /* SUBW YA,dp */
+  {
+    OP_READ16_YA_DP(SUBW)
+  }
+
+CASE_OPCODE(0xBA):  /* MOVW YA,dp */
+  {
+    OP_READ16_YA_DP(MOVW_READ)
+  }
+
+CASE_OPCODE(0xDA):  /* MOVW dp,YA */
+  {
+    /*  5 cycles - opcode, address, (?), data low write, data high write, */
+    START_CYCLE(2)
+    _address = _dp + get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    get_byte_spc(active_context, _address);
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    set_byte_spc(active_context, _address, _A);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    set_byte_spc(active_context, _address + 1, _Y);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xFA):  /* MOV dp(d),dp(s) */
+  {
+    /*  5 cycles - opcode, src address, dest address, src read, */
+    /* dest write */
+    START_CYCLE(2)
+    _address2 = _dp + get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address = _dp + get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data = get_byte_spc(active_context, _address2);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    set_byte_spc(active_context, _address, _data);
+    END_OPCODE(1)
+  }
+
+/* xxx11011 */
+CASE_OPCODE(0x1B):  /* ASL dp+X */
+  {
+    OP_RMW_DP_X_INDEXED(WRITE_OP(ASL), 1)
+  }
+
+CASE_OPCODE(0x3B):  /* ROL dp+X */
+  {
+    OP_RMW_DP_X_INDEXED(WRITE_OP(ROL), 1)
+  }
+
+CASE_OPCODE(0x5B):  /* LSR dp+X */
+  {
+    OP_RMW_DP_X_INDEXED(WRITE_OP(LSR), 1)
+  }
+
+CASE_OPCODE(0x7B):  /* ROR dp+X */
+  {
+    OP_RMW_DP_X_INDEXED(WRITE_OP(ROR), 1)
+  }
+
+CASE_OPCODE(0x9B):  /* DEC dp+X */
+  {
+    OP_RMW_DP_X_INDEXED(WRITE_OP(DEC), 1)
+  }
+
+CASE_OPCODE(0xBB):  /* INC dp+X */
+  {
+    OP_RMW_DP_X_INDEXED(WRITE_OP(INC), 1)
+  }
+
+CASE_OPCODE(0xDB):  /* MOV dp+X,Y */
+  {
+    OP_RMW_DP_X_INDEXED(WRITE_MOV(_Y), 0)
+  }
+
+CASE_OPCODE(0xFB):  /* MOV Y,dp+X */
+  {
+    OP_READ_DP_X_INDEXED(MOV_READ, _Y)
+  }
+
+
+/* xxx11100 */
+CASE_OPCODE(0x1C):  /* ASL A */
+  {
+    OP_RMW_IMPLIED(ASL, _A)
+  }
+
+CASE_OPCODE(0x3C):  /* ROL A */
+  {
+    OP_RMW_IMPLIED(ROL, _A)
+  }
+
+CASE_OPCODE(0x5C):  /* LSR A */
+  {
+    OP_RMW_IMPLIED(LSR, _A)
+  }
+
+CASE_OPCODE(0x7C):  /* ROR A */
+  {
+    OP_RMW_IMPLIED(ROR, _A)
+  }
+
+CASE_OPCODE(0x9C):  /* DEC A */
+  {
+    OP_RMW_IMPLIED(DEC, _A)
+  }
+
+CASE_OPCODE(0xBC):  /* INC A */
+  {
+    OP_RMW_IMPLIED(INC, _A)
+  }
+
+CASE_OPCODE(0xDC):  /* DEC Y */
+  {
+    OP_RMW_IMPLIED(DEC, _Y)
+  }
+
+CASE_OPCODE(0xFC):  /* INC Y */
+  {
+    OP_RMW_IMPLIED(INC, _Y)
+  }
+
+
+/* xxx11101 */
+CASE_OPCODE(0x1D):  /* DEC X */
+  {
+    OP_RMW_IMPLIED(DEC, _X)
+  }
+
+CASE_OPCODE(0x3D):  /* INC X */
+  {
+    OP_RMW_IMPLIED(INC, _X)
+  }
+
+CASE_OPCODE(0x5D):  /* MOV X,A */
+  {
+    OP_MOV_IMPLIED(_X, _A)
+  }
+
+CASE_OPCODE(0x7D):  /* MOV A,X */
+  {
+    OP_MOV_IMPLIED(_A, _X)
+  }
+
+CASE_OPCODE(0x9D):  /* MOV X,SP */
+  {
+    OP_MOV_IMPLIED(_X, _SP)
+  }
+
+CASE_OPCODE(0xBD):  /* MOV SP,X */
+  {
+    OP_MOV_IMPLIED_NO_FLAGS(_SP, _X)
+  }
+
+CASE_OPCODE(0xDD):  /* MOV A,Y */
+  {
+    OP_MOV_IMPLIED(_A, _Y)
+  }
+
+CASE_OPCODE(0xFD):  /* MOV Y,A */
+  {
+    OP_MOV_IMPLIED(_Y, _A)
+  }
+
+
+/* xxx11110 */
+CASE_OPCODE(0x1E):  /* CMP X,abs */
+  {
+    OP_READ_ABS(CMP, _X)
+  }
+
+CASE_OPCODE(0x3E):  /* CMP X,dp */
+  {
+    OP_READ_DP(CMP, _X)
+  }
+
+CASE_OPCODE(0x5E):  /* CMP Y,abs */
+  {
+    OP_READ_ABS(CMP, _Y)
+  }
+
+CASE_OPCODE(0x7E):  /* CMP Y,dp */
+  {
+    OP_READ_DP(CMP, _Y)
+  }
+
+CASE_OPCODE(0x9E):  /* DIV YA,X */
+  {
+    /*  12 cycles - opcode, 11(op) */
+    /* timing of operations completely wrong here, at least */
+    START_CYCLE(2)
+      unsigned yva, work_x, i;
+      yva = _YA;
+      work_x = (unsigned) _X << 9;
+
+      if ((_X & 0xF) <= (_Y & 0xF)) set_flag_spc(active_context, SPC_FLAG_H);
+      else clr_flag_spc(active_context, SPC_FLAG_H);
+
+      for (i = 0; i < 9; i++)
+      {
+       yva <<= 1; if (yva & 0x20000) yva = (yva & 0x1FFFF) | 1;  /* 17-bit ROL */
+       if (yva >= work_x) yva ^= 1;  /* Why XOR i don't know, but it's what works */
+       /* and I guess this was easier than a compound if */
+       if (yva & 1) yva = (yva - work_x) & 0x1FFFF; /* enforce 17-bit register limit! */
+      }
+
+      if (yva & 0x100) set_flag_spc(active_context, SPC_FLAG_V);
+      else clr_flag_spc(active_context, SPC_FLAG_V);
+
+      _YA = (((yva >> 9) & 0xFF) << 8) + (yva & 0xFF);
+      store_flags_nz(active_context, _YA);
+    END_OPCODE(11)
+  }
+
+CASE_OPCODE(0xBE):  /* DAS */
+  {
+    /*  3 cycles - opcode, 2(op) */
+    START_CYCLE(2)
+    _data = _A;
+    if ((_data & 0x0F) > 9 || !flag_state_spc(active_context, SPC_FLAG_H))
+    {
+     _A -= 6;
+    }
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    if (_data > 0x99 || !flag_state_spc(active_context, SPC_FLAG_C))
+    {
+     _A -= 0x60;
+     clr_flag_spc(active_context, SPC_FLAG_C);
+    }
+    store_flags_nz(active_context, _A);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xDE):  /* CBNE dp+X,rel */
+  {
+    /*  6 cycles - opcode, address, branch offset, address index */
+    /* (add X), data read, branch logic; */
+    /* +2 cycles (taken branch) add PC to offset, reload PC */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _offset = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _address = _dp + ((_address + _X) & 0xFF);
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    _data = get_byte_spc(active_context, _address);
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    END_BRANCH_OPCODE(6, TEST_CBNE)
+  }
+
+CASE_OPCODE(0xFE):  /* DBNZ Y,rel */
+  {
+    /*  4 cycles - opcode, branch offset, decrement Y, branch logic; */
+    /* +2 cycles (taken branch) add PC to offset, reload PC */
+
+    START_CYCLE(2)
+    _offset = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _Y--;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    END_BRANCH_OPCODE(4, if (!_Y) EXIT_OPCODE(1))
+  }
+
+
+/* xxx11111 */
+CASE_OPCODE(0x1F):  /* JMP (abs+X) */
+  {
+    /*  6 cycles - opcode, address low, address high */
+    /* address index (add X), new PCL, new PCH */
+    /* fetch base adderss */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address += get_code_spc(active_context, _PC) << 8;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _address += _X;
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    _offset = get_byte_spc(active_context, _address);
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    _PC = (get_byte_spc(active_context, _address + 1) << 8) + _offset;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x3F):  /* CALL abs */
+  {
+    /*  8 cycles - opcode, new PCL, new PCH, stack address load, PCH */
+    /* write, PCL write, dummy cycle (PSW write in BRK?) */
+    /* SP decrement */
+    /* fetch address for PC */
+    START_CYCLE(2)
+    _address2 = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _address2 += (get_code_spc(active_context, _PC) << 8);
+    _PC++;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _address = 0x0100 + _SP;
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    set_byte_spc(active_context, _address, _PC >> 8);
+    _SP--;
+    _address = 0x0100 + _SP;
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    set_byte_spc(active_context, _address, _PC);
+    _SP--;
+    _address = 0x0100 + _SP;
+    END_CYCLE(6, 1)
+
+    START_CYCLE(7)
+    /* should we write PSW to stack here? */
+    END_CYCLE(7, 1)
+
+    START_CYCLE(8)
+    _PC = _address2;
+    END_OPCODE(1)
+  }
+
+
+CASE_OPCODE(0x5F):  /* JMP abs */
+  {
+    /*  3 cycles - opcode, new PCL, new PCH */
+    /* fetch address to PC */
+    START_CYCLE(2)
+    _address = get_code_spc(active_context, _PC);
+    _PC++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _PC = (get_code_spc(active_context, _PC) << 8) + _address;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x7F):  /* RETI */
+  {
+    /*  6 cycles - opcode, SP increment, address load, new PSW, new PCL, */
+    /* new PCH, pop address to PC */
+    START_CYCLE(2)
+    _SP++;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3) \
+    _address = 0x0100 + _SP; \
+    END_CYCLE(3, 1) \
+
+    START_CYCLE(4) \
+    _PSW = get_byte_spc(active_context, _address);
+    spc_restore_flags(active_context);
+    _SP++;
+    _address = 0x0100 + _SP;
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5) \
+    _address2 = get_byte_spc(active_context, _address);
+    _SP++;
+    _address = 0x0100 + _SP;
+    END_CYCLE(5, 1)
+
+    START_CYCLE(6)
+    _PC = (get_byte_spc(active_context, _address) << 8) + _address2;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0x9F):  /* XCN A */
+  {
+    /*  5 cycles - opcode, 4(op) */
+    /* timing of operations may be off here */
+    START_CYCLE(2)
+    _data = _A;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _A <<= 4;
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _data >>= 4;
+    END_CYCLE(4, 1)
+
+    START_CYCLE(5)
+    OP_OR(_A, _data);
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xBF):  /* MOV A,(X)+ */
+  {
+    /*  4 cycles - opcode, address load, data read, X increment */
+    START_CYCLE(2)
+    _address = _dp + _X;
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    _data = get_byte_spc(active_context, _address);
+    OP_MOV_READ(_A, _data)
+    END_CYCLE(3, 1)
+
+    START_CYCLE(4)
+    _X++;
+    END_OPCODE(1)
+  }
+
+CASE_OPCODE(0xDF):  /* DAA */
+  {
+    /*  3 cycles - opcode, 2(op) */
+    START_CYCLE(2)
+    _data = _A;
+    if ((_data & 0x0F) > 9 || flag_state_spc(active_context, SPC_FLAG_H))
+    {
+     _A += 6;
+     if (_A < 6) set_flag_spc(active_context, SPC_FLAG_C);
+    }
+    END_CYCLE(2, 1)
+
+    START_CYCLE(3)
+    if (_data > 0x99 || flag_state_spc(active_context, SPC_FLAG_C))
+    {
+     _A += 0x60;
+     set_flag_spc(active_context, SPC_FLAG_C);
+    }
+    store_flags_nz(active_context, _A);
+    END_OPCODE(1)
+  }
+
+
+/* halt the CPU; only a reset brings it back, and the DSP keeps running */
+CASE_OPCODE(0xEF):  /* SLEEP */
+CASE_OPCODE(0xFF):  /* STOP */
+  {
+    /* leave PC on the opcode, as there is nothing more to fetch */
+    _PC--;
+    _halted = 1;
+    END_INVALID_OPCODE()
+  }
@@ -16,68 +16,518 @@ See the file 'LICENSE' in this directory for more information.
 
 #include "spc_cpu.h"
 
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <utility>
+#include <vector>
 
 #include "SNEeSe/sneese_spc.h"
+#include "hash.h"
 
 namespace openspc {
 
+static_assert(SpcCpu::kWatchRead == SPC_WATCH_READ, "Watch flag mismatch");
+static_assert(SpcCpu::kWatchWrite == SPC_WATCH_WRITE, "Watch flag mismatch");
+static_assert(SpcCpu::kWatchNotify == SPC_WATCH_NOTIFY, "Watch flag mismatch");
+static_assert(SpcCpu::kMaxOverrun == SPC_MAX_OPCODE_CYCLES - 1,
+              "Overrun mismatch");
+
+// Layout of SaveState(): the cycle counters and ports, which SPC700_CONTEXT
+// keeps ahead of FFC0_Address, then the registers, timers and progress
+// through the instruction under way, which it keeps from PC up to
+// map_address, then whether the IPL ROM is mapped in, the halted flag and
+// RAM.  FFC0_Address is a host pointer, so the ROM flag stands in for it.
+static constexpr size_t kStateCountersSize =
+    offsetof(SPC700_CONTEXT, FFC0_Address);
+static constexpr size_t kStateRegsStart = offsetof(SPC700_CONTEXT, PC);
+static constexpr size_t kStateRegsOffset = kStateCountersSize;
+static constexpr size_t kStateRegsSize =
+    offsetof(SPC700_CONTEXT, map_address) - kStateRegsStart;
+static constexpr size_t kStateRomOffset = kStateRegsOffset + kStateRegsSize;
+static constexpr size_t kStateHaltedOffset = kStateRomOffset + 1;
+static constexpr size_t kStateRamOffset = kStateHaltedOffset + 1;
+static constexpr size_t kStateSize = kStateRamOffset + SpcCpu::kRamSize;
+// Snapshots from another layout must be turned away, so any change to the
+// parts of the context saved calls for a bump of OSPC_STATE_VERSION in
+// openspc.h, along with the sizes here.
+static_assert(kStateCountersSize == 24, "Snapshot layout changed");
+static_assert(kStateRegsSize == 52, "Snapshot layout changed");
+
 class SpcCpu::Impl {
  public:
-  explicit Impl(uint8_t* dsp_regs) {
+  virtual ~Impl() {}
+
+  virtual void SetState(uint16_t pc, uint8_t a, uint8_t x, uint8_t y,
+                        uint8_t psw, uint8_t sp, const uint8_t* ram) = 0;
+  virtual void SaveState(uint8_t* state) const = 0;
+  virtual void LoadState(const uint8_t* state) = 0;
+  virtual uint64_t HashState(uint64_t hash) const = 0;
+  virtual void Run(int cycles) = 0;
+  virtual bool halted() const = 0;
+  virtual void set_core(Core core) = 0;
+  virtual Core core() const = 0;
+  virtual std::string divergence() const { return std::string(); }
+  virtual void SetDspCallbacks(const DspCallbacks& callbacks) = 0;
+  virtual uint8_t* watch() = 0;
+  virtual uint8_t* ram() = 0;
+  virtual void RamWritten(int address, int len) = 0;
+  virtual void WritePort(int index, uint8_t data) = 0;
+  virtual uint8_t ReadPort(int index) = 0;
+};
+
+/// Backend running a single SNEeSe core, as either Core::kCycleExact or
+/// Core::kWholeInstruction.
+class SpcCpu::SneeseImpl : public SpcCpu::Impl {
+ public:
+  explicit SneeseImpl(uint8_t* dsp_regs) {
     // Ensure context is in a defined state.
-    std::memset(active_context, 0, sizeof(SPC700_CONTEXT));
-    active_context->dsp_regs = dsp_regs;
-    Reset_SPC();
+    std::memset(&context_, 0, sizeof(context_));
+    context_.dsp_regs = dsp_regs;
+    Reset_SPC(&context_);
+  }
+
+  /// Copies the state of @p other, but with its own RAM and DSP registers,
+  /// and without any callbacks, watch flags or translated code.
+  SneeseImpl(const SneeseImpl& other, uint8_t* dsp_regs) : end_(other.end_) {
+    std::memcpy(&context_, &other.context_, sizeof(context_));
+    context_.dsp_regs = dsp_regs;
+    context_.jit = nullptr;
+    if (other.context_.FFC0_Address == other.context_.ram) {
+      context_.FFC0_Address = context_.ram;
+    }
+    spc_setup_memory_map(&context_);
+    context_.dsp_sync = nullptr;
+    context_.dsp_reg_written = nullptr;
+    context_.dsp_ram_written = nullptr;
+    context_.dsp_opaque = nullptr;
+    std::memset(context_.watch, 0, sizeof(context_.watch));
+    set_trace(nullptr, nullptr);
   }
 
+#ifdef SPC_JIT
+  ~SneeseImpl() override { spc_jit_free(&context_); }
+#endif
+
   void SetState(uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t psw,
-                uint8_t sp, const uint8_t* ram) {
-    std::memcpy(SPCRAM, ram, kRamSize);
+                uint8_t sp, const uint8_t* ram) override {
+    std::memcpy(context_.ram, ram, kRamSize);
 
     // Initialize the state of the 0xFFC0 ROM being switched in or out.
-    if (!(SPC_CTRL & 0x80)) {
-      active_context->FFC0_Address = SPCRAM;
+    if (!(context_.ram[0xF1] & 0x80)) {
+      context_.FFC0_Address = context_.ram;
     }
+    spc_setup_memory_map(&context_);
 
-    // Initialize SPC timers to the values the saved RAM indicates were active.
+    // Initialize SPC timers to the values the saved RAM indicates were active,
+    // counting from now.
     for (int i = 0; i < 3; ++i) {
-      active_context->timers[i].target =
-          static_cast<uint8_t>(SPCRAM[0xFA + i] - 1) + 1;
-      active_context->timers[i].counter = SPCRAM[0xFD + i] & 0xF;
+      context_.timers[i].target =
+          static_cast<uint8_t>(context_.ram[0xFA + i] - 1) + 1;
+      spc_start_timer(&context_, i);
+      context_.timers[i].counter = context_.ram[0xFD + i] & 0xF;
     }
 
     // Initialize SPC <-> CPU communications registers to the values the saved
     // RAM indicates were active.
     for (int i = 0; i < 4; ++i) {
-      active_context->PORT_R[i] = SPCRAM[0xF4 + i];
+      context_.PORT_R[i] = context_.ram[0xF4 + i];
     }
 
     // Initialize SPC registers and associated values.
-    active_context->PC.w = pc;
-    active_context->YA.b.l = a;
-    active_context->X = x;
-    active_context->YA.b.h = y;
-    active_context->SP = sp;
+    context_.PC.w = pc;
+    context_.YA.b.l = a;
+    context_.X = x;
+    context_.YA.b.h = y;
+    context_.SP = sp;
 
     // Now we have to set up the PSW.  Fortunately, SNEeSe now has a function
     // to set its internal state up for us.
-    active_context->PSW = psw;
-    spc_restore_flags();
+    context_.PSW = psw;
+    spc_restore_flags(&context_);
+    context_.halted = 0;
+    spc_ram_written(&context_, 0, kRamSize);
+  }
+
+  void SaveState(uint8_t* state) const override {
+    const uint8_t* context = reinterpret_cast<const uint8_t*>(&context_);
+    std::memcpy(state, context, kStateCountersSize);
+    std::memcpy(&state[kStateRegsOffset], &context[kStateRegsStart],
+                kStateRegsSize);
+    state[kStateRomOffset] = context_.FFC0_Address != context_.ram;
+    state[kStateHaltedOffset] = context_.halted;
+    std::memcpy(&state[kStateRamOffset], context_.ram, kRamSize);
+  }
+
+  void LoadState(const uint8_t* state) override {
+    uint8_t* context = reinterpret_cast<uint8_t*>(&context_);
+    std::memcpy(context, state, kStateCountersSize);
+    std::memcpy(&context[kStateRegsStart], &state[kStateRegsOffset],
+                kStateRegsSize);
+    context_.halted = state[kStateHaltedOffset];
+    std::memcpy(context_.ram, &state[kStateRamOffset], kRamSize);
+    spc_map_rom(&context_, state[kStateRomOffset]);
+    spc_ram_written(&context_, 0, kRamSize);
+  }
+
+  uint64_t HashState(uint64_t hash) const override {
+    hash = HashBytes(hash, &context_.halted, sizeof(context_.halted));
+    hash = HashBytes(hash, context_.PORT_R, sizeof(context_.PORT_R));
+    hash = HashBytes(hash, context_.PORT_W, sizeof(context_.PORT_W));
+    for (const auto& timer : context_.timers) {
+      hash = HashBytes(hash, &timer.target, sizeof(timer.target));
+    }
+    return hash;
+  }
+
+  void Run(int cycles) override {
+    end_ += cycles;
+    SPC_START(&context_, cycles);
+  }
+  bool halted() const override { return context_.halted; }
+
+  void set_core(Core core) override {
+    context_.whole_instructions = (core == Core::kWholeInstruction);
+  }
+  Core core() const override {
+    return context_.whole_instructions ? Core::kWholeInstruction
+                                       : Core::kCycleExact;
+  }
+
+  void SetDspCallbacks(const DspCallbacks& callbacks) override {
+    context_.dsp_sync = callbacks.sync;
+    context_.dsp_reg_written = callbacks.reg_written;
+    context_.dsp_ram_written = callbacks.ram_written;
+    context_.dsp_opaque = callbacks.opaque;
+  }
+
+  uint8_t* watch() override { return context_.watch; }
+  uint8_t* ram() override { return context_.ram; }
+  void RamWritten(int address, int len) override {
+    spc_ram_written(&context_, address, len);
+  }
+
+  void WritePort(int index, uint8_t data) override {
+    SPC_WRITE_PORT_R(&context_, index, data);
+  }
+
+  uint8_t ReadPort(int index) override {
+    return SPC_READ_PORT_W(&context_, index);
   }
 
-  void Run(int cycles) { SPC_START(cycles); }
-  uint8_t* ram() { return SPCRAM; }
-  void WritePort(int index, uint8_t data) { SPC_WRITE_PORT_R(index, data); }
-  uint8_t ReadPort(int index) { return SPC_READ_PORT_W(index); }
+  /// Set the callback told of each instruction, write and register read; see
+  /// SPC700_CONTEXT::trace.
+  void set_trace(uint8_t (*trace)(void*, int, uint16_t, uint8_t),
+                 void* opaque) {
+    context_.trace = trace;
+    context_.trace_opaque = opaque;
+  }
+
+  /// Cycles run since construction as of the current point in Run(), which
+  /// is only up to date from within the trace callback.
+  int64_t time() const { return end_ + context_.WorkCycles; }
+
+  SPC700_CONTEXT* context() { return &context_; }
 
  private:
-  // TODO(bmartin) Make our own SPC700_CONTEXT and keep it here.  Make it
-  // active before calling any SNEeSe code, and null it out after.  (Blocked
-  // on dsp.c dependency on the context being set currently.)
+  SPC700_CONTEXT context_;
+  // Total of the cycles requested from Run().
+  int64_t end_ = 0;
 };
 
-SpcCpu::SpcCpu(uint8_t* dsp_regs) : impl_(std::make_unique<Impl>(dsp_regs)) {}
+/// Backend running Core::kWholeInstruction, and checking it against a second,
+/// Core::kCycleExact instance that runs every instruction cycle by cycle.
+/// Both expand the instruction bodies in spc700_ops.h, so a mistake in what
+/// an instruction does shows up in both alike.  What the check does not
+/// share is how the first splits up, dispatches and fetches instructions,
+/// along with its fused compares, fast memory accesses, loop skipping and
+/// translated blocks.  The first drives the DSP as usual.  The check runs the
+/// same cycles after it, with a private copy of RAM and the DSP registers.
+/// It is handed whatever the first read from the DSP data register and the
+/// ports, and the echo data the DSP wrote to RAM on the cycle the first saw
+/// it; see ReadFromOutside() and CheckSync().  The events each traced are
+/// compared after every Run() call, as far as both have got.
+class SpcCpu::LockstepImpl : public SpcCpu::Impl {
+ public:
+  explicit LockstepImpl(std::unique_ptr<SneeseImpl> cpu)
+      : cpu_(std::move(cpu)) {
+    cpu_->set_core(Core::kWholeInstruction);
+    cpu_->set_trace(&LockstepImpl::CpuTrace, this);
+    StartCheck();
+  }
+
+  /// Stops checking, and hands back the backend that was being checked.
+  std::unique_ptr<SneeseImpl> Release() {
+    cpu_->set_trace(nullptr, nullptr);
+    return std::move(cpu_);
+  }
+
+  void SetState(uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t psw,
+                uint8_t sp, const uint8_t* ram) override {
+    cpu_->SetState(pc, a, x, y, psw, sp, ram);
+    cpu_->set_trace(&LockstepImpl::CpuTrace, this);
+    divergence_.clear();
+    StartCheck();
+  }
+
+  void SaveState(uint8_t* state) const override { cpu_->SaveState(state); }
+
+  void LoadState(const uint8_t* state) override {
+    cpu_->LoadState(state);
+    cpu_->set_trace(&LockstepImpl::CpuTrace, this);
+    divergence_.clear();
+    StartCheck();
+  }
+
+  uint64_t HashState(uint64_t hash) const override {
+    return cpu_->HashState(hash);
+  }
+
+  void Run(int cycles) override {
+    if (!check_) {
+      cpu_->Run(cycles);
+      return;
+    }
+    cpu_->Run(cycles);
+    check_->Run(cycles);
+    Compare();
+  }
+
+  bool halted() const override { return cpu_->halted(); }
+
+  // The core is chosen by SpcCpu::set_core() switching backends.
+  void set_core(Core) override {}
+  Core core() const override { return Core::kLockstep; }
+
+  std::string divergence() const override { return divergence_; }
+
+  void SetDspCallbacks(const DspCallbacks& callbacks) override {
+    cpu_->SetDspCallbacks(callbacks);
+  }
+
+  uint8_t* watch() override { return cpu_->watch(); }
+  uint8_t* ram() override { return cpu_->ram(); }
+  void RamWritten(int address, int len) override {
+    cpu_->RamWritten(address, len);
+    if (check_) {
+      const uint8_t* ram = cpu_->ram();
+      writes_.push_back({cpu_->time(), static_cast<uint16_t>(address),
+                         std::vector<uint8_t>(ram + address,
+                                              ram + address + len)});
+    }
+  }
+
+  void WritePort(int index, uint8_t data) override {
+    cpu_->WritePort(index, data);
+    if (check_) {
+      check_->WritePort(index, data);
+    }
+  }
+
+  uint8_t ReadPort(int index) override { return cpu_->ReadPort(index); }
+
+ private:
+  struct Event {
+    int64_t time;
+    uint16_t address;
+    uint8_t kind;
+    uint8_t data;
+    // CPU registers, for SPC_TRACE_INSTRUCTION only.
+    uint8_t a, x, y, sp, psw;
+
+    bool operator==(const Event& other) const {
+      return time == other.time && address == other.address &&
+             kind == other.kind && data == other.data && a == other.a &&
+             x == other.x && y == other.y && sp == other.sp &&
+             psw == other.psw;
+    }
+  };
+
+  struct RamWrite {
+    int64_t time;
+    uint16_t address;
+    std::vector<uint8_t> data;
+  };
+
+  /// (Re)starts the check from the current state of the CPU.
+  void StartCheck() {
+    std::memcpy(check_regs_, cpu_->context()->dsp_regs, kDspRegsSize);
+    check_ = std::make_unique<SneeseImpl>(*cpu_, check_regs_);
+    check_->set_core(Core::kCycleExact);
+    check_->context()->cycle_by_cycle = 1;
+    check_->set_trace(&LockstepImpl::CheckTrace, this);
+    // Have the check stop before every access, to be handed the writes made
+    // behind cpu_'s back by then; see CheckSync().
+    check_->SetDspCallbacks({&LockstepImpl::CheckSync, nullptr, nullptr, this});
+    std::memset(check_->watch(), kWatchRead | kWatchWrite,
+                kRamSize / kPageSize);
+    cpu_events_.clear();
+    check_events_.clear();
+    reads_.clear();
+    writes_.clear();
+  }
+
+  /// Compares the events both have got to, and discards them.  Where cpu_
+  /// skipped iterations of a loop, the check ran them one by one, so its
+  /// events up to cpu_'s next one are passed over, as long as none of them is
+  /// a write; both are then compared at the instruction cpu_ landed on.
+  void Compare() {
+    size_t i = 0;
+    size_t j = 0;
+    while ((i < cpu_events_.size()) && (j < check_events_.size())) {
+      const Event& event = cpu_events_[i];
+      if (event.kind != SPC_TRACE_SKIP) {
+        if (!(event == check_events_[j])) {
+          Diverged(event, check_events_[j]);
+          return;
+        }
+        ++i;
+        ++j;
+        continue;
+      }
+      if (i + 1 == cpu_events_.size()) {
+        break;
+      }
+      const int64_t landed = cpu_events_[i + 1].time;
+      while ((j < check_events_.size()) && (check_events_[j].time < landed)) {
+        if (check_events_[j].kind == SPC_TRACE_WRITE) {
+          Diverged(event, check_events_[j]);
+          return;
+        }
+        ++j;
+      }
+      if (j == check_events_.size()) {
+        break;
+      }
+      ++i;
+    }
+    cpu_events_.erase(cpu_events_.begin(), cpu_events_.begin() + i);
+    check_events_.erase(check_events_.begin(), check_events_.begin() + j);
+  }
+
+  /// Records where the two first disagreed, and stops checking.
+  void Diverged(const Event& cpu_event, const Event& check_event) {
+    divergence_ = "whole-instruction core " + Describe(cpu_event) +
+                  ", but cycle-exact core " + Describe(check_event);
+    cpu_->set_trace(nullptr, nullptr);
+    check_.reset();
+    cpu_events_.clear();
+    check_events_.clear();
+    reads_.clear();
+    writes_.clear();
+  }
+
+  static Event MakeEvent(SneeseImpl* cpu, int kind, uint16_t address,
+                         uint8_t data) {
+    Event event = {cpu->time(), address, static_cast<uint8_t>(kind), data,
+                   0, 0, 0, 0, 0};
+    if (kind == SPC_TRACE_INSTRUCTION) {
+      SPC700_CONTEXT* context = cpu->context();
+      event.a = context->YA.b.l;
+      event.x = context->X;
+      event.y = context->YA.b.h;
+      event.sp = context->SP;
+      event.psw = get_SPC_PSW(context);
+    }
+    return event;
+  }
+
+  static std::string Describe(const Event& event) {
+    char buf[128];
+    switch (event.kind) {
+      case SPC_TRACE_INSTRUCTION:
+        std::snprintf(buf, sizeof(buf),
+                      "started the instruction at $%04X on cycle %" PRId64
+                      " with A=$%02X X=$%02X Y=$%02X SP=$%02X PSW=$%02X",
+                      event.address, event.time, event.a, event.x, event.y,
+                      event.sp, event.psw);
+        break;
+      case SPC_TRACE_WRITE:
+        std::snprintf(buf, sizeof(buf),
+                      "wrote $%02X to $%04X on cycle %" PRId64, event.data,
+                      event.address, event.time);
+        break;
+      case SPC_TRACE_SKIP:
+        std::snprintf(buf, sizeof(buf),
+                      "skipped through the loop at $%04X from cycle %" PRId64,
+                      event.address, event.time);
+        break;
+      default:
+        std::snprintf(buf, sizeof(buf),
+                      "read $%02X from $%04X on cycle %" PRId64, event.data,
+                      event.address, event.time);
+        break;
+    }
+    return buf;
+  }
+
+  /// Whether what a read of @p address from the register page returns
+  /// depends on events outside the CPU: how far the DSP, which only the first
+  /// instance drives, has got, or port writes made between Run() calls, which
+  /// the check sees that much earlier than the first whenever it overran.
+  /// Everything else, such as the timer counters, each reads for itself.
+  static bool ReadFromOutside(uint16_t address) {
+    return (address == 0xF3) || ((address >= 0xF4) && (address <= 0xF7));
+  }
+
+  static uint8_t CpuTrace(void* opaque, int kind, uint16_t address,
+                          uint8_t data) {
+    LockstepImpl* self = static_cast<LockstepImpl*>(opaque);
+    self->cpu_events_.push_back(
+        MakeEvent(self->cpu_.get(), kind, address, data));
+    if (kind == SPC_TRACE_READ && ReadFromOutside(address)) {
+      self->reads_.push_back(data);
+    }
+    return data;
+  }
+
+  /// Makes each write reported to RamWritten(), such as the DSP's echo
+  /// writes, on the cycle cpu_ saw it, so that both read the same RAM.  The
+  /// check calls this before every access, as every page is watched.
+  static void CheckSync(void* opaque, int) {
+    LockstepImpl* self = static_cast<LockstepImpl*>(opaque);
+    const int64_t time = self->check_->time();
+    while (!self->writes_.empty() && self->writes_.front().time <= time) {
+      const RamWrite& write = self->writes_.front();
+      std::memcpy(self->check_->ram() + write.address, write.data.data(),
+                  write.data.size());
+      self->check_->RamWritten(write.address,
+                               static_cast<int>(write.data.size()));
+      self->writes_.pop_front();
+    }
+  }
+
+  static uint8_t CheckTrace(void* opaque, int kind, uint16_t address,
+                            uint8_t data) {
+    LockstepImpl* self = static_cast<LockstepImpl*>(opaque);
+    if (kind == SPC_TRACE_READ && ReadFromOutside(address) &&
+        !self->reads_.empty()) {
+      data = self->reads_.front();
+      self->reads_.pop_front();
+    }
+    self->check_events_.push_back(
+        MakeEvent(self->check_.get(), kind, address, data));
+    return data;
+  }
+
+  std::unique_ptr<SneeseImpl> cpu_;
+  // The instance checking cpu_, or null once they have diverged.
+  std::unique_ptr<SneeseImpl> check_;
+  uint8_t check_regs_[kDspRegsSize];
+  // Events traced by each instance and not compared yet.
+  std::vector<Event> cpu_events_;
+  std::vector<Event> check_events_;
+  // Values read by cpu_ from outside, still to be read by check_.
+  std::deque<uint8_t> reads_;
+  // Writes to RAM made outside cpu_, still to be made to check_.
+  std::deque<RamWrite> writes_;
+  std::string divergence_;
+};
+
+SpcCpu::SpcCpu(uint8_t* dsp_regs)
+    : impl_(std::make_unique<SneeseImpl>(dsp_regs)) {}
 SpcCpu::~SpcCpu() {}
 
 void SpcCpu::SetState(uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t psw,
@@ -85,9 +535,47 @@ void SpcCpu::SetState(uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t psw,
   impl_->SetState(pc, a, x, y, psw, sp, ram);
 }
 
+size_t SpcCpu::state_size() { return kStateSize; }
+
+void SpcCpu::SaveState(uint8_t* state) const { impl_->SaveState(state); }
+void SpcCpu::LoadState(const uint8_t* state) { impl_->LoadState(state); }
+
+uint64_t SpcCpu::HashState(uint64_t hash) const {
+  return impl_->HashState(hash);
+}
+
 void SpcCpu::Run(int cycles) { impl_->Run(cycles); }
+bool SpcCpu::halted() const { return impl_->halted(); }
+
+void SpcCpu::set_core(Core core) {
+  if (core == impl_->core()) {
+    return;
+  }
+  if (impl_->core() == Core::kLockstep) {
+    impl_ = static_cast<LockstepImpl*>(impl_.get())->Release();
+  }
+  if (core == Core::kLockstep) {
+    impl_ = std::make_unique<LockstepImpl>(std::unique_ptr<SneeseImpl>(
+        static_cast<SneeseImpl*>(impl_.release())));
+  } else {
+    impl_->set_core(core);
+  }
+}
+SpcCpu::Core SpcCpu::core() const { return impl_->core(); }
+
+std::string SpcCpu::divergence() const { return impl_->divergence(); }
+
+void SpcCpu::SetDspCallbacks(const DspCallbacks& callbacks) {
+  impl_->SetDspCallbacks(callbacks);
+}
+
+uint8_t* SpcCpu::watch() { return impl_->watch(); }
 uint8_t* SpcCpu::ram() { return impl_->ram(); }
 
+void SpcCpu::RamWritten(int address, int len) {
+  impl_->RamWritten(address, len);
+}
+
 void SpcCpu::WritePort(int index, uint8_t data) {
   impl_->WritePort(index, data);
 }
@@ -29,13 +29,15 @@ specific implementations and prototypes are subject to change.
 
 /*========== INCLUDES ==========*/
 
+#include <limits.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "dsp.h"
-#include "gauss.h"
-// TODO(bmartin) Temporary hack pending rewrite
-#include "SNEeSe/sneese_spc.h"
+#include "dsp_simd.h"
 
 /*========== DEFINES ==========*/
 
@@ -52,28 +54,37 @@ specific implementations and prototypes are subject to change.
 
 #define CPU_RATE        ( 1024000 )
 #define SAMP_FREQ       ( 32000 )
-#define SPC_RAM SPCRAM
 
-/*========== VARIABLES ==========*/
+/*========== TYPES ==========*/
 
-int                     channel_mask;
-int                     keyed_on;
-int                     keys;
-voice_state_type        voice_state[ 8 ];
-
-/* Noise stuff */
-int	                noise_cnt;
-int                     noise_lev;
+typedef struct                      /* Per-sample data for a block  */
+    {
+    int             noise[ DSP_BLOCK_LEN ];     /* Noise level          */
+    signed long     outx[ DSP_BLOCK_LEN ];      /* OUTX of last voice   */
+    int             outl[ DSP_BLOCK_LEN ];      /* Sum of all voices    */
+    int             outr[ DSP_BLOCK_LEN ];
+    int             echol[ DSP_BLOCK_LEN ];     /* Sum of echoed voices */
+    int             echor[ DSP_BLOCK_LEN ];
 
-/* These are for the FIR echo filter */
 #ifndef NO_ECHO
-static short            FIRlbuf[ 8 ];
-static short            FIRrbuf[ 8 ];
-static int              FIRptr;
-static int              echo_ptr;
+    /* Echo FIR filter inputs, preceded by the filter history */
+    int             firl_in[ DSP_FIR_LEN - 1 + DSP_BLOCK_LEN ];
+    int             firr_in[ DSP_FIR_LEN - 1 + DSP_BLOCK_LEN ];
+    int             firl_out[ DSP_BLOCK_LEN ];  /* Echo FIR output      */
+    int             firr_out[ DSP_BLOCK_LEN ];
+    int             echo_addr[ DSP_BLOCK_LEN ]; /* Echo memory location */
 #endif
 
-uint8_t DSPregs[256];
+    int             quiet;                  /* Nonzero -> no output wanted,
+                                               only the state   */
+    int             last;                   /* Nonzero -> last block of
+                                               the call         */
+
+    /* The following are scratch space for the voice being mixed */
+    int             envx[ DSP_BLOCK_LEN ];  /* Envelope height      */
+    interp_block_type
+                    interp;                 /* Interpolation data   */
+    } block_type;
 
 /*========== CONSTANTS ==========*/
 
@@ -81,11 +92,9 @@ uint8_t DSPregs[256];
    (1024000/32000 = 32) cycles. */
 const int               TS_CYC = CPU_RATE / SAMP_FREQ;
 
-/* Ptrs to Gaussian table */
-static const int *      G1 = &gauss[ 256 ];
-static const int *      G2 = &gauss[ 512 ];
-static const int *      G3 = &gauss[ 255 ];
-static const int *      G4 = &gauss[ -1  ];
+/* The part of dsp_state_type DSP_SaveState() keeps, ahead of regs. */
+#define STATE_START     ( offsetof( dsp_state_type, keyed_on ) )
+#define STATE_LEN       ( offsetof( dsp_state_type, dirty ) - STATE_START )
 
 static const int        mask = 0xFF;
 
@@ -103,11 +112,16 @@ static const int        ENVCNT[ 0x20 ]
 
 /*========== MACROS ==========*/
 
-/* Make reading the ADSR code easier */
-#define SL( v )         ( DSPregs[ ( ( v ) << 4 ) + 6 ] >> 5 )
-                                    /* Returns SUSTAIN level        */
-#define SR( v )         ( DSPregs[ ( ( v ) << 4 ) + 6 ] & 0x1F )
-                                    /* Returns SUSTAIN rate         */
+/* Cache slot for the BRR block at address a.  Folding in the high bits keeps
+   samples that lie a multiple of the cache size apart from colliding. */
+#define BRR_SLOT( a )                                                \
+    ( ( ( a ) ^ ( ( a ) >> 10 ) ) & ( DSP_BRR_CACHE_LEN - 1 ) )
+
+/* Final output of the BRR filter x: clamped to 16 bits, then shifted back
+   up, which can wrap it around. */
+#define BRR_OUT( x )                                                 \
+    ( ( signed short )( ( ( x ) < -32768 ? -32768                    \
+                        : ( x ) > 32767  ? 32767 : ( x ) ) << 1 ) )
 
 /* Handle endianness */
 #ifdef WORDS_BIGENDIAN
@@ -124,15 +138,89 @@ static const int        ENVCNT[ 0x20 ]
 
 static int AdvanceEnvelope          /* Run envelope step & retn ENVX*/
     (
+    dsp_state_type *    dsp,        /* DSP owning the voice         */
     int                 v           /* Voice to process envelope for*/
     );
 
+static void WakeEnvelope            /* Stop skipping envelope steps */
+    (
+    voice_state_type *  vp          /* Voice to wake                */
+    );
+
+static void DecodeBRRBlock          /* Decode samples of a BRR block*/
+    (
+    const uint8_t *     ram,        /* SPC RAM                      */
+    int                 addr,       /* Address of block header      */
+    int                 range,      /* Block header's range         */
+    int                 filter,     /* Block header's filter        */
+    int                 first,      /* First sample to decode (0-15)*/
+    int                 smp1,       /* Last sample decoded          */
+    int                 smp2,       /* Second-to-last sample decoded*/
+    short *             out         /* Decoded block; only samples
+                                       first-15 are written         */
+    );
+
+static void CountBRRPage            /* Adjust cached blocks on page */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the cache         */
+    int                 page,       /* RAM page                     */
+    int                 delta       /* +1 or -1                     */
+    );
+
+static void CountBRRBlock           /* Adjust pages under a block   */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the cache         */
+    int                 addr,       /* Address of block header      */
+    int                 delta       /* +1 or -1                     */
+    );
+
+static void DropBRR                 /* Remove a block from cache    */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the cache         */
+    brr_block_type *    bp          /* Cached block to remove       */
+    );
+
+static void LoadParams              /* Refresh decoded regs         */
+    (
+    dsp_state_type *    dsp         /* DSP to refresh               */
+    );
+
+static void LookupBRR               /* Find or decode a BRR block   */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the cache         */
+    int                 addr,       /* Address of block header      */
+    int                 header,     /* Block header                 */
+    int                 smp1,       /* Last sample decoded          */
+    int                 smp2,       /* Second-to-last sample decoded*/
+    short *             out         /* Decoded block                */
+    );
+
+static void MixBlock                /* Apply echo & output a block  */
+    (
+    dsp_state_type *    dsp,        /* DSP to run                   */
+    block_type *        blk,        /* Block being mixed            */
+    int                 count,      /* Number of samples in block   */
+    int                 voices,     /* Zero -> no voice was on      */
+    short *             sound_ptr   /* Pointer to mix audio into    */
+    );
+
+static int RenderVoice              /* Mix one voice over a block;
+                                       zero -> voice was off        */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the voice         */
+    int                 v,          /* Voice to mix                 */
+    int                 count,      /* Number of samples in block   */
+    block_type *        blk         /* Block being mixed            */
+    );
+
 /* Privately shared functions (for internal library use only) */
 
 /***** DSP_Reset *****/
 
 void DSP_Reset                      /* Reset emulated DSP           */
-    ( void )
+    (
+    dsp_state_type *    dsp         /* DSP to reset                 */
+    )
 {
 int                     i;
 
@@ -142,98 +230,486 @@ fprintf( stderr,"DSP_Reset\n" );
 
 for( i = 0; i < 8; i++ )
     {
-#ifndef NO_ECHO
-    FIRlbuf[ i ]            = 0;
-    FIRrbuf[ i ]            = 0;
-#endif
-    voice_state[ i ].on_cnt = 0;
+    dsp->voice_state[ i ].on_cnt = 0;
     }
 
 #ifndef NO_ECHO
-FIRptr   = 0;
-echo_ptr = 0;
+for( i = 0; i < 7; i++ )
+    {
+    dsp->FIRlbuf[ i ] = 0;
+    dsp->FIRrbuf[ i ] = 0;
+    }
+dsp->echo_ptr    = 0;
 #endif
-keys             = 0;
-keyed_on         = 0;
-noise_cnt        = 0;
-noise_lev        = 0x4000;
-DSPregs[ 0x6C ] |= 0xE0;
-DSPregs[ 0x4C ]  = 0;
-DSPregs[ 0x5C ]  = 0;
+dsp->dirty       = ~0U;
+dsp->keys        = 0;
+dsp->keyed_on    = 0;
+dsp->noise_cnt   = 0;
+dsp->noise_lev   = 0x4000;
+dsp->regs[ 0x6C ] |= 0xE0;
+dsp->regs[ 0x4C ]  = 0;
+dsp->regs[ 0x5C ]  = 0;
 
 }   /* DSP_Reset() */
 
 
+/***** DSP_RegWritten *****/
+
+void DSP_RegWritten                 /* Note a DSP register write    */
+    (
+    dsp_state_type *    dsp,        /* DSP written to               */
+    int                 addr        /* Register address written     */
+    )
+{
+if( addr & 0x80 )
+    {
+    return;
+    }
+
+if( ( addr & 0x0F ) < 0x08 )
+    {
+    dsp->dirty |= DSP_DIRTY_VOICE( addr >> 4 );
+    }
+else if( ( addr & 0x0F ) == 0x0F )
+    {
+    dsp->dirty |= DSP_DIRTY_FIR;
+    }
+else if( ( ( addr & 0x0F ) >= 0x0C )
+      && ( addr != 0x4C ) && ( addr != 0x5C ) && ( addr != 0x7C ) )
+    {
+    /* KON, KOF and ENDX are changed by the DSP too, so they're always read
+       straight from the register file. */
+    dsp->dirty |= DSP_DIRTY_GLOBAL;
+    }
+
+}   /* DSP_RegWritten() */
+
+
+/***** DSP_RamWritten *****/
+
+void DSP_RamWritten                 /* Note a RAM write             */
+    (
+    dsp_state_type *    dsp,        /* DSP whose RAM was written    */
+    int                 addr        /* Address written              */
+    )
+{
+brr_block_type *        bp;
+int                     i;
+int                     start;
+int                     v;
+voice_state_type *      vp;
+
+if( !dsp->brr_pages[ ( addr >> 8 ) & 0xFF ] )
+    {
+    return;
+    }
+
+/* A voice partway through a block has the rest of it decoded again, from
+   where it has got to.  Its header was already read, so only the data bytes
+   matter. */
+for( v = 0; v < 8; v++ )
+    {
+    vp = &dsp->voice_state[ v ];
+    i  = ( addr - vp->brr_addr ) & 0xFFFF;
+    if( vp->brr_held && ( i >= 1 ) && ( i <= 8 )
+     && ( i > 8 - vp->header_cnt ) )
+        {
+        DecodeBRRBlock(
+                      dsp->ram,
+                      vp->brr_addr,
+                      vp->range,
+                      vp->filter,
+                      16 - ( vp->header_cnt << 1 ) + vp->half,
+                      vp->smp1,
+                      vp->smp2,
+                      vp->brrbuf
+                      );
+        }
+    }
+
+/* Drop any cached block which includes the written byte. */
+for( i = 0; i < 9; i++ )
+    {
+    start = ( addr - i ) & 0xFFFF;
+    bp    = &dsp->brr_cache[ BRR_SLOT( start ) ];
+    if( bp->valid && ( bp->addr == start ) )
+        {
+        DropBRR( dsp, bp );
+        }
+    }
+
+}   /* DSP_RamWritten() */
+
+
+/***** DSP_Loaded *****/
+
+void DSP_Loaded                     /* Note new DSP regs and RAM    */
+    (
+    dsp_state_type *    dsp         /* DSP loaded                   */
+    )
+{
+int                     i;
+
+dsp->dirty = ~0U;
+
+memset( dsp->brr_cache, 0, sizeof( dsp->brr_cache ) );
+memset( dsp->brr_pages, 0, sizeof( dsp->brr_pages ) );
+dsp->brr_pages_changed = 1;
+for( i = 0; i < 8; i++ )
+    {
+    dsp->voice_state[ i ].brr_held = 0;
+    }
+
+}   /* DSP_Loaded() */
+
+
+/***** DSP_SaveState *****/
+
+void DSP_SaveState                  /* Save the state of a DSP      */
+    (
+    const dsp_state_type *
+                        dsp,        /* DSP to save                  */
+    void *              state       /* DSP_STATE_SIZE bytes to fill */
+    )
+{
+memcpy( state, ( const char * )dsp + STATE_START, STATE_LEN );
+memcpy( ( char * )state + STATE_LEN, dsp->regs, 256 );
+
+}   /* DSP_SaveState() */
+
+
+/***** DSP_LoadState *****/
+
+void DSP_LoadState                  /* Restore a saved DSP state    */
+    (
+    dsp_state_type *    dsp,        /* DSP to restore               */
+    const void *        state       /* From DSP_SaveState()         */
+    )
+{
+int                     held;
+int                     i;
+
+memcpy( ( char * )dsp + STATE_START, state, STATE_LEN );
+memcpy( dsp->regs, ( const char * )state + STATE_LEN, 256 );
+
+/* The cache starts out empty, but the blocks the voices are partway through
+   must stay counted, as their decoded samples were restored with them. */
+held = 0;
+for( i = 0; i < 8; i++ )
+    {
+    held |= dsp->voice_state[ i ].brr_held ? 1 << i : 0;
+    }
+DSP_Loaded( dsp );
+for( i = 0; i < 8; i++ )
+    {
+    if( held & ( 1 << i ) )
+        {
+        dsp->voice_state[ i ].brr_held = 1;
+        CountBRRBlock( dsp, dsp->voice_state[ i ].brr_addr, 1 );
+        }
+    }
+
+}   /* DSP_LoadState() */
+
+
+/***** DSP_GetCourse *****/
+
+void DSP_GetCourse                  /* Get the course of a DSP      */
+    (
+    const dsp_state_type *
+                        dsp,        /* DSP to describe              */
+    uint8_t *           course      /* DSP_COURSE_SIZE bytes to fill*/
+    )
+{
+uint8_t *               regs;
+int                     v;
+
+course[ 0 ] = (uint8_t)dsp->keyed_on;
+course[ 1 ] = (uint8_t)dsp->keys;
+for( v = 0; v < 8; v++ )
+    {
+    course[ 2 + v ] = (uint8_t)dsp->voice_state[ v ].envstate;
+    }
+
+/* Only the first half of the register file is really there.  ENVX, OUTX
+   and ENDX are left out, as the DSP keeps changing them itself. */
+regs = &course[ 2 + 8 ];
+memcpy( regs, dsp->regs, 0x80 );
+for( v = 0; v < 8; v++ )
+    {
+    regs[ ( v << 4 ) + 8 ] = 0;
+    regs[ ( v << 4 ) + 9 ] = 0;
+    }
+regs[ 0x7C ] = 0;
+
+}   /* DSP_GetCourse() */
+
+
+/***** DSP_Silent *****/
+
+int DSP_Silent                      /* Check for lasting silence    */
+    (
+    const dsp_state_type *
+                        dsp,        /* DSP to check                 */
+    int                 threshold   /* Largest echo sample heard as
+                                       silence                      */
+    )
+{
+const voice_state_type *
+                        vp;
+int                     len;
+int                     gain;
+int                     i;
+int                     m;
+int                     rising;
+int                     v;
+int                     V;
+
+if( dsp->regs[ 0x6C ] & 0x40 )
+    {
+    return( 1 );
+    }
+
+/* A voice keyed on stays silent only at an envelope height of 0 that can't
+   rise again without a register write.  One being released is still heard
+   until its envelope has run all the way down. */
+for( v = 0; v < 8; v++ )
+    {
+    m  = 1 << v;
+    V  = v << 4;
+    vp = &dsp->voice_state[ v ];
+    if( ( dsp->regs[ 0x4C ] & m ) || vp->on_cnt )
+        {
+        return( 0 );
+        }
+    if( !( dsp->keys & m ) )
+        {
+        continue;
+        }
+    if( vp->envx )
+        {
+        return( 0 );
+        }
+    if( vp->envstate == RELEASE )
+        {
+        continue;
+        }
+    gain = dsp->regs[ V + 7 ];
+    if( dsp->regs[ V + 5 ] & 0x80 )
+        {
+        rising = ( vp->envstate == ATTACK );
+        }
+    else
+        {
+        /* Direct or increasing GAIN */
+        rising = ( gain >= 0xC0 ) || ( gain && ( gain < 0x80 ) );
+        }
+    if( rising )
+        {
+        return( 0 );
+        }
+    }
+
+/* With no voices to feed it, the echo can only die away, but it may have a
+   while to go. */
+if( !dsp->regs[ 0x2C ] && !dsp->regs[ 0x3C ] )
+    {
+    return( 1 );
+    }
+for( i = 0; i < DSP_FIR_LEN - 1; i++ )
+    {
+    if( ( abs( dsp->FIRlbuf[ i ] ) > threshold )
+     || ( abs( dsp->FIRrbuf[ i ] ) > threshold ) )
+        {
+        return( 0 );
+        }
+    }
+len = ( dsp->regs[ 0x7D ] & 0xF ) << 11;
+if( len < dsp->echo_ptr + 4 )
+    {
+    len = dsp->echo_ptr + 4;
+    }
+for( i = 0; i < len; i += sizeof( short ) )
+    {
+    if( abs( ( signed short )LEtoME16(
+                   *( unsigned short * )
+                     &dsp->ram[ ( ( dsp->regs[ 0x6D ] << 8 ) + i ) & 0xFFFF ]
+                   ) ) > threshold )
+        {
+        return( 0 );
+        }
+    }
+return( 1 );
+
+}   /* DSP_Silent() */
+
+
 /***** DSP_Update *****/
 
 void DSP_Update                     /* Mix one sample of audio      */
     (
+    dsp_state_type *    dsp,        /* DSP to run                   */
     short *             sound_ptr   /* Pointer to mix audio into    */
     )
 {
-int                     V;
-#ifndef NO_ECHO
-int                     echo_base;
+DSP_RenderBlock( dsp, sound_ptr, 1 );
+
+}   /* DSP_Update() */
+
+
+/***** DSP_RenderBlock *****/
+
+void DSP_RenderBlock                /* Mix a block of audio samples */
+    (
+    dsp_state_type *    dsp,        /* DSP to run                   */
+    short *             sound_ptr,  /* Pointer to mix audio into    */
+    int                 count       /* Number of samples to mix     */
+    )
+{
+block_type              blk;
+int                     n;
+int                     s;
+int                     v;
+int                     voices;
+
+while( count > 0 )
+    {
+    n = ( count < DSP_BLOCK_LEN ) ? count : DSP_BLOCK_LEN;
+
+    /* Check for reset.  The reset happens again every sample for as long as
+       the flag is set, so just go one sample at a time in that case. */
+    if( dsp->regs[ 0x6C ] & 0x80 )
+        {
+        DSP_Reset( dsp );
+        n = 1;
+        }
+
+    /* The registers can't change during the block, so anything derived from
+       them only needs refreshing here, and only after they've been
+       written. */
+    if( dsp->dirty & ( DSP_DIRTY_GLOBAL | DSP_DIRTY_VOICES ) )
+        {
+        LoadParams( dsp );
+        }
+
+    /* Here we check for keys on/off.  Docs say that successive writes to
+       KON/KOF must be separated by at least 2 Ts periods or risk being
+       neglected.  Therefore DSP only looks at these during an update, and not
+       at the time of the write.  Only need to do this once however, since the
+       regs haven't changed over the whole period we need to catch up with. */
+#ifdef DBG_KEY
+    dsp->regs[ 0x4C ] &= mask;
 #endif
-int                     echol;
-int                     echor;
+
+    for( s = 0; s < n; s++ )
+        {
+        /* Same table for noise and envelope */
+        dsp->noise_cnt -= dsp->params.noise_cnt;
+        if( dsp->noise_cnt <= 0 )
+            {
+            dsp->noise_cnt = CNT_INIT;
+            dsp->noise_lev = ( ( ( dsp->noise_lev << 13 )
+                               ^ ( dsp->noise_lev << 14 ) ) & 0x4000 )
+                           | ( dsp->noise_lev >> 1 );
+            }
+        blk.noise[ s ] = dsp->noise_lev;
+
+        /* Question: what is the expected behavior when pitch modulation is
+           enabled on voice 0?  Jurassic Park 2 does this.  For now, using
+           outx of zero for first voice. */
+        blk.outx[ s ]  = 0;
+        blk.outl[ s ]  = 0;
+        blk.outr[ s ]  = 0;
+        blk.echol[ s ] = 0;
+        blk.echor[ s ] = 0;
+        }
+
+    /* Voices only interact through pitch modulation and the final mix, so
+       each one can be run over the whole block in turn. */
+    blk.quiet = !sound_ptr;
+    blk.last  = ( n == count );
+    voices    = 0;
+    for( v = 0; v < 8; v++ )
+        {
+        voices |= RenderVoice( dsp, v, n, &blk );
+        }
+
+    MixBlock( dsp, &blk, n, voices, sound_ptr );
+    if( sound_ptr )
+        {
+        sound_ptr += 2 * n;
+        }
+
+    count -= n;
+    }
+
+}   /* DSP_RenderBlock() */
+
+
+/***** RenderVoice *****/
+
+static int RenderVoice              /* Mix one voice over a block;
+                                       zero -> voice was off        */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the voice         */
+    int                 v,          /* Voice to mix                 */
+    int                 count,      /* Number of samples in block   */
+    block_type *        blk         /* Block being mixed            */
+    )
+{
+int                     V;
 int                     envx;
+int                     full;
 int                     m;
-int                     outl;
-int                     outr;
 signed long             outx;       /* Smpl height (must be signed) */
+const voice_param_type *
+                        pp;
+int                     s;
 src_dir_type *          sd;
-int                     v;
 int                     vl;
 voice_state_type *      vp;
 int                     vr;
 
-sd = ( src_dir_type * )&SPC_RAM[ ( int )DSPregs[ 0x5D ] << 8 ];
+sd = ( src_dir_type * )&dsp->ram[ dsp->params.dir ];
+vp = &dsp->voice_state[ v ];
+pp = &dsp->voice_params[ v ];
+m  = 1 << v;
+V  = v << 4;
 
-/* Check for reset */
-if( DSPregs[ 0x6C ] & 0x80 )
+/* A voice which is off, and isn't being keyed on, contributes nothing.  All
+   it would do is keep its ENVX and OUTX at zero, and pass an OUTX of zero
+   on to the next voice for pitch modulation. */
+if( !( ( dsp->keys | dsp->regs[ 0x4C ] ) & m ) && !vp->on_cnt )
     {
-    DSP_Reset();
+    dsp->regs[ V + 8 ] = 0;
+    dsp->regs[ V + 9 ] = 0;
+    memset( blk->outx, 0, count * sizeof( blk->outx[ 0 ] ) );
+    return( 0 );
     }
 
-/* Here we check for keys on/off.  Docs say that successive writes to KON/KOF
-   must be separated by at least 2 Ts periods or risk being neglected.
-   Therefore DSP only looks at these during an update, and not at the time of
-   the write.  Only need to do this once however, since the regs haven't
-   changed over the whole period we need to catch up with. */
-#ifdef DBG_KEY
-DSPregs[ 0x4C ] &= mask;
-#endif
+/* With no output wanted, this voice's OUTX only matters for every sample if
+   the next voice is pitch modulated by it, or if it is being echoed and the
+   echo is written back to memory.  Otherwise all that's left of it is the
+   last one, in the register. */
+full = !blk->quiet
+    || ( dsp->params.pmon & ( m << 1 ) )
+    || ( !dsp->params.echo_off && ( dsp->params.eon & m )
+      && !( m & dsp->channel_mask ) );
+for( s = 0; s < count; s++ )
+    {
+    /* Keying on a voice resets that bit in ENDX */
+    dsp->regs[ 0x7C ] &= ~( dsp->regs[ 0x4C ] & m );
 
-/* Keying on a voice resets that bit in ENDX */
-DSPregs[ 0x7C ] &= ~DSPregs[ 0x4C ];
+    /* Pitch modulation input is OUTX from the previous voice */
+    outx = blk->outx[ s ];
 
-/* Question: what is the expected behavior when pitch modulation is enabled on
-   voice 0?  Jurassic Park 2 does this.  For now, using outx of zero for first
-   voice. */
-outx = 0;
-/* Same table for noise and envelope */
-noise_cnt -= ENVCNT[ DSPregs[ 0x6C ] & 0x1F ];
-if( noise_cnt <= 0 )
-    {
-    noise_cnt = CNT_INIT;
-    noise_lev = ( ( ( noise_lev << 13 ) ^ ( noise_lev << 14 ) ) & 0x4000 )
-              | ( noise_lev >> 1                                         );
-    }
-outl  = 0;
-outr  = 0;
-echol = 0;
-echor = 0;
-for( v = 0, m = 1, V = 0; v < 8; v++, V += 16, m <<= 1 )
-    {
-    vp = &voice_state[ v ];
     if( vp->on_cnt && ( --vp->on_cnt == 0 ) )
         {
         /* Voice was keyed on */
-        keys       |= m;
-        keyed_on   |= m;
-        vl          = DSPregs[ ( v<<4 ) + 4 ];
-        vp->samp_id = *( unsigned long * )&sd[ vl ];
+        dsp->keys       |= m;
+        dsp->keyed_on   |= m;
+        vl          = dsp->regs[ ( v<<4 ) + 4 ];
+        vp->samp_id = *( uint32_t * )&sd[ vl ];
         vp->mem_ptr = LEtoME16( sd[ vl ].vptr );
 
 #ifdef DBG_KEY
@@ -260,12 +736,13 @@ for( v = 0, m = 1, V = 0; v < 8; v++, V += 16, m <<= 1 )
            we'll go ahead and do the full time for now. */
         vp->envcnt   = CNT_INIT;
         vp->envstate = ATTACK;
+        vp->envwait  = 0;
         }
 
-    if( DSPregs[ 0x4C ] & m & ~DSPregs[ 0x5C ] )
+    if( dsp->regs[ 0x4C ] & m & ~dsp->regs[ 0x5C ] )
         {
         /* Voice doesn't come on if key off is set */
-        DSPregs[ 0x4C ] &= ~m;
+        dsp->regs[ 0x4C ] &= ~m;
         vp->on_cnt       = 8;
 
 #ifdef DBG_KEY
@@ -273,9 +750,10 @@ for( v = 0, m = 1, V = 0; v < 8; v++, V += 16, m <<= 1 )
 #endif
         }
 
-    if( keys & DSPregs[ 0x5C ] & m )
+    if( dsp->keys & dsp->regs[ 0x5C ] & m )
         {
         /* Voice was keyed off */
+        WakeEnvelope( vp );
         vp->envstate = RELEASE;
         vp->on_cnt   = 0;
 
@@ -284,21 +762,25 @@ for( v = 0, m = 1, V = 0; v < 8; v++, V += 16, m <<= 1 )
 #endif
         }
 
-    if( !( keys & m & mask ) || ( ( envx = AdvanceEnvelope( v ) ) < 0 ) )
+    if( !( dsp->keys & m & mask )
+     || ( ( envx = AdvanceEnvelope( dsp, v ) ) < 0 ) )
         {
-        DSPregs[ V + 8 ] = 0;
-        DSPregs[ V + 9 ] = 0;
-        outx             = 0;
+        dsp->regs[ V + 8 ]        = 0;
+        blk->envx[ s ]            = 0;
+        blk->interp.phase[ s ]    = 0;
+        blk->interp.smp[ 0 ][ s ] = 0;
+        blk->interp.smp[ 1 ][ s ] = 0;
+        blk->interp.smp[ 2 ][ s ] = 0;
+        blk->interp.smp[ 3 ][ s ] = 0;
         continue;
         }
 
-    vp->pitch = LEtoME16( *( ( unsigned short * )&DSPregs[ V + 2 ] ) )
-              & 0x3FFF;
+    vp->pitch = pp->pitch;
 
 #ifndef NO_PMOD
     /* Pitch mod uses OUTX from last voice for this one.  Luckily we haven't
        modified OUTX since it was used for last voice. */
-    if(DSPregs[ 0x2D ] & m )
+    if( dsp->params.pmon & m )
         {
 #ifdef DBG_PMOD
         fprintf(
@@ -332,10 +814,10 @@ for( v = 0, m = 1, V = 0; v < 8; v++, V += 16, m <<= 1 )
                 /* Docs say ENDX bit is set when decode of block with source
                    end flag set is done.  Does this apply to looping samples?
                    Some info I've seen suggests yes. */
-                DSPregs[ 0x7C ] |= m;
+                dsp->regs[ 0x7C ] |= m;
                 if( vp->end & 2 )
                     {
-                    vp->mem_ptr = LEtoME16( sd[ DSPregs[ V + 4 ] ].lptr );
+                    vp->mem_ptr = LEtoME16( sd[ dsp->regs[ V + 4 ] ].lptr );
 
 #ifdef DBG_BRR
                     fprintf(
@@ -351,9 +833,14 @@ for( v = 0, m = 1, V = 0; v < 8; v++, V += 16, m <<= 1 )
                     fprintf( stderr, "BRR decode end, voice %d\n", v );
 #endif
 
-                    keys &= ~m;
-                    DSPregs[ V + 8 ] = 0;
-                    vp->envx         = 0;
+                    dsp->keys         &= ~m;
+                    dsp->regs[ V + 8 ]  = 0;
+                    vp->envx            = 0;
+                    if( vp->brr_held )
+                        {
+                        CountBRRBlock( dsp, vp->brr_addr, -1 );
+                        vp->brr_held = 0;
+                        }
                     while( vp->mixfrac >= 0 )
                         {
                         vp->sampbuf[ vp->sampptr ] = 0;
@@ -365,7 +852,7 @@ for( v = 0, m = 1, V = 0; v < 8; v++, V += 16, m <<= 1 )
                     }
                 }
             vp->header_cnt = 8;
-            vl             = ( unsigned char )SPC_RAM[ vp->mem_ptr++ ];
+            vl             = ( unsigned char )dsp->ram[ vp->mem_ptr++ ];
             vp->range      = vl >> 4;
             vp->end        = vl & 3;
             vp->filter     = ( vl & 12 ) >> 2;
@@ -380,375 +867,758 @@ for( v = 0, m = 1, V = 0; v < 8; v++, V += 16, m <<= 1 )
                    vp->filter
                    );
 #endif
+
+            /* The whole block is decoded into brrbuf as soon as its header
+               is read.  Its pages stay counted in brr_pages while it plays,
+               so that a write to the rest of it still gets noticed. */
+            if( vp->brr_held )
+                {
+                CountBRRBlock( dsp, vp->brr_addr, -1 );
+                }
+            vp->brr_addr = vp->mem_ptr - 1;
+            vp->brr_held = 1;
+            CountBRRBlock( dsp, vp->brr_addr, 1 );
+            LookupBRR(
+                     dsp,
+                     vp->brr_addr,
+                     vl,
+                     vp->smp1,
+                     vp->smp2,
+                     vp->brrbuf
+                     );
             }
+
+        /* The voice's position is kept up to date, in case the rest of the
+           block has to be decoded again. */
+        outx = vp->brrbuf[ 16 - ( vp->header_cnt << 1 ) + vp->half ];
         if( vp->half == 0 )
             {
-            vp->half = 1;
-            outx     = ( ( signed char )SPC_RAM[ vp->mem_ptr ] ) >> 4;
+            vp->half = 1;
+            }
+        else
+            {
+            vp->half = 0;
+            vp->mem_ptr++;
+            vp->header_cnt--;
+            }
+
+        vp->smp2                   = ( signed short )vp->smp1;
+        vp->smp1                   = outx;
+        vp->sampbuf[ vp->sampptr ] = vp->smp1;
+
+#ifdef DBG_BRR
+        fprintf(
+               stderr,
+               "V%d: final output: %04X\n",
+               v,
+               vp->sampbuf[ vp->sampptr ]
+               );
+#endif
+
+        vp->sampptr = ( vp->sampptr + 1 ) & 3;
+        }
+
+    if( !( dsp->params.non & m )
+     && ( full || ( blk->last && ( s == count - 1 ) ) ) )
+        {
+        /* Gather the input for Gaussian interpolation, which is done for the
+           whole block below. */
+        blk->interp.phase[ s ]    = ( vp->mixfrac >> 4 ) + 256;
+        blk->interp.smp[ 0 ][ s ] = vp->sampbuf[ vp->sampptr ];
+        blk->interp.smp[ 1 ][ s ] = vp->sampbuf[ ( vp->sampptr + 1 ) & 3 ];
+        blk->interp.smp[ 2 ][ s ] = vp->sampbuf[ ( vp->sampptr + 2 ) & 3 ];
+        blk->interp.smp[ 3 ][ s ] = vp->sampbuf[ ( vp->sampptr + 3 ) & 3 ];
+        }
+
+    /* Advance the sample position for next update. */
+    vp->mixfrac += vp->pitch;
+
+    blk->envx[ s ] = envx;
+    }
+
+if( !full )
+    {
+    if( blk->last )
+        {
+        s = count - 1;
+        if( dsp->params.non & m )
+            {
+            outx = ( signed short )( blk->noise[ s ] << 1 );
+            }
+        else
+            {
+            blk->interp.phase[ 0 ]    = blk->interp.phase[ s ];
+            blk->interp.smp[ 0 ][ 0 ] = blk->interp.smp[ 0 ][ s ];
+            blk->interp.smp[ 1 ][ 0 ] = blk->interp.smp[ 1 ][ s ];
+            blk->interp.smp[ 2 ][ 0 ] = blk->interp.smp[ 2 ][ s ];
+            blk->interp.smp[ 3 ][ 0 ] = blk->interp.smp[ 3 ][ s ];
+            DSP_Interpolate( &blk->interp, 1 );
+            outx = blk->interp.out[ 0 ];
+            }
+        outx = ( ( outx * blk->envx[ s ] ) >> 11 ) & ~1;
+        dsp->regs[ V + 9 ] = outx >> 8;
+        }
+    return( 1 );
+    }
+
+if( !( dsp->params.non & m ) )
+    {
+    DSP_Interpolate( &blk->interp, count );
+    }
+
+/* Silent samples have an envelope height of zero, so they come out as zero
+   here without any special treatment. */
+for( s = 0; s < count; s++ )
+    {
+    if( dsp->params.non & m )
+        {
+#ifdef DBG_PMOD
+        fprintf( stderr, "Noise enabled, voice %d\n", v );
+#endif
+        outx = ( signed short )( blk->noise[ s ] << 1 );
+        }
+    else
+        {
+        outx = blk->interp.out[ s ];
+
+#ifdef DBG_INTRP
+        fprintf(
+               stderr,
+               "V%d: phase=%d: %d %d %d %d -> %ld\n",
+               v,
+               blk->interp.phase[ s ],
+               blk->interp.smp[ 0 ][ s ],
+               blk->interp.smp[ 1 ][ s ],
+               blk->interp.smp[ 2 ][ s ],
+               blk->interp.smp[ 3 ][ s ],
+               outx
+               );
+#endif
+        }
+
+    outx = ( ( outx * blk->envx[ s ] ) >> 11 ) & ~1;
+    dsp->regs[ V + 9 ] = outx >> 8;
+
+    vl = ( pp->voll * outx ) >> 7;
+    vr = ( pp->volr * outx ) >> 7;
+    blk->outx[ s ] = outx;
+    if( !( m & dsp->channel_mask ) )
+        {
+        blk->outl[ s ] += vl;
+        blk->outr[ s ] += vr;
+        if( dsp->params.eon & m )
+            {
+            blk->echol[ s ] += vl;
+            blk->echor[ s ] += vr;
+            }
+        }
+    }
+
+return( 1 );
+
+}   /* RenderVoice() */
+
+
+/***** DecodeBRRBlock *****/
+
+static void DecodeBRRBlock          /* Decode samples of a BRR block*/
+    (
+    const uint8_t *     ram,        /* SPC RAM                      */
+    int                 addr,       /* Address of block header      */
+    int                 range,      /* Block header's range         */
+    int                 filter,     /* Block header's filter        */
+    int                 first,      /* First sample to decode (0-15)*/
+    int                 smp1,       /* Last sample decoded          */
+    int                 smp2,       /* Second-to-last sample decoded*/
+    short *             out         /* Decoded block; only samples
+                                       first-15 are written         */
+    )
+{
+int                     delta[ 16 ];
+int                     i;
+int                     nybble;
+int                     outx;
+
+#ifdef DBG_BRR
+fprintf(
+       stderr,
+       "BRR: block %04X from %d, range=%d, filter=%d, smp1=%d, smp2=%d\n",
+       addr,
+       first,
+       range,
+       filter,
+       smp1,
+       smp2
+       );
+#endif
+
+/* For invalid ranges (D,E,F): if the nybble is negative, the result is F000.
+   If positive, 0000.  Nothing else like previous range, etc. seems to have
+   any effect.  If range is valid, do the shift normally.  Note these are both
+   shifted right once to do the filters properly, but the output will be
+   shifted back again at the end. */
+for( i = first; i < 16; i++ )
+    {
+    nybble = ram[ ( addr + 1 + ( i >> 1 ) ) & 0xFFFF ];
+    if( i & 1 )
+        {
+        nybble <<= 4;
+        }
+    /* Funkiness to get 4-bit signed to carry through */
+    delta[ i ] = ( ( signed char )nybble ) >> 4;
+    }
+if( range <= 0xC )
+    {
+    for( i = first; i < 16; i++ )
+        {
+        delta[ i ] = ( delta[ i ] << range ) >> 1;
+        }
+    }
+else
+    {
+    for( i = first; i < 16; i++ )
+        {
+        delta[ i ] &= ~0x7FF;
+        }
+    }
+
+/* Each filter gets its own loop, so none of them has to test which one it
+   is for every sample. */
+switch( filter )
+    {
+    case 0:
+        for( i = first; i < 16; i++ )
+            {
+            out[ i ] = BRR_OUT( delta[ i ] );
             }
-        else
+        break;
+
+    case 1:
+        for( i = first; i < 16; i++ )
             {
-            vp->half = 0;
-            /* Funkiness to get 4-bit signed to carry through */
-            outx   = ( signed char )( SPC_RAM[ vp->mem_ptr++ ] << 4 );
-            outx >>= 4;
-            vp->header_cnt--;
+            outx     = delta[ i ] + ( smp1 >> 1 ) + ( ( -smp1 ) >> 5 );
+            out[ i ] = BRR_OUT( outx );
+            smp1     = out[ i ];
             }
+        break;
 
-#ifdef DBG_BRR
-        fprintf(
-               stderr,
-               "V%d: nybble=%X, ptr=%04X, smp1=%d, smp2=%d\n",
-               v,
-               outx & 0xF,
-               vp->mem_ptr,
-               vp->smp1,
-               vp->smp2
-               );
-#endif
-
-        /* For invalid ranges (D,E,F): if the nybble is negative, the result
-           is F000.  If positive, 0000.  Nothing else like previous range,
-           etc. seems to have any effect.  If range is valid, do the shift
-           normally.  Note these are both shifted right once to do the filters
-           properly, but the output will be shifted back again at the end. */
-        if( vp->range <= 0xC )
+    case 2:
+        for( i = first; i < 16; i++ )
             {
-            outx = ( outx << vp->range ) >> 1;
+            outx     = delta[ i ] + smp1
+                     + ( ( -( smp1 + ( smp1 >> 1 ) ) ) >> 5 )
+                     - ( smp2 >> 1 ) + ( smp2 >> 5 );
+            out[ i ] = BRR_OUT( outx );
+            smp2     = smp1;
+            smp1     = out[ i ];
             }
-        else
-            {
-            outx &= ~0x7FF;
+        break;
 
-#ifdef DBG_BRR
-            fprintf( stderr, "V%d: invalid range! (%X)\n", v, vp->range );
-#endif
+    case 3:
+        for( i = first; i < 16; i++ )
+            {
+            outx     = delta[ i ] + smp1
+                     + ( ( -( smp1 + ( smp1 << 2 ) + ( smp1 << 3 ) ) ) >> 7 )
+                     - ( smp2 >> 1                                  )
+                     + ( ( smp2 + ( smp2 >> 1 )                  ) >> 4 );
+            out[ i ] = BRR_OUT( outx );
+            smp2     = smp1;
+            smp1     = out[ i ];
             }
+        break;
+    }
 
-#ifdef DBG_BRR
-        fprintf(
-               stderr,
-               "V%d: shifted delta=%04X\n",
-               v,
-               ( unsigned short )outx
-               );
-#endif
+}   /* DecodeBRRBlock() */
 
-        switch( vp->filter )
-            {
-            case 0:
-                break;
 
-            case 1:
-                outx += ( vp->smp1 >> 1 ) + ( ( -vp->smp1 ) >> 5 );
-                break;
+/***** CountBRRPage *****/
 
-            case 2:
-                outx += vp->smp1
-                      + ( ( -( vp->smp1 + ( vp->smp1 >> 1 ) ) ) >> 5 )
-                      - ( vp->smp2 >> 1 ) + ( vp->smp2 >> 5 );
-                break;
+static void CountBRRPage            /* Adjust cached blocks on page */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the cache         */
+    int                 page,       /* RAM page                     */
+    int                 delta       /* +1 or -1                     */
+    )
+{
+if( ( dsp->brr_pages[ page ] == 0 )
+ || ( dsp->brr_pages[ page ] + delta == 0 ) )
+    {
+    dsp->brr_pages_changed = 1;
+    }
+dsp->brr_pages[ page ] += delta;
 
-            case 3:
-                outx += vp->smp1
-                      + ( ( -( vp->smp1 + ( vp->smp1 << 2 )
-                             + ( vp->smp1 << 3 )            ) ) >> 7 )
-                      - ( vp->smp2 >> 1                              )
-                      + ( ( vp->smp2 + ( vp->smp2 >> 1 )      ) >> 4 );
-                break;
-            }
+}   /* CountBRRPage() */
 
-        if( outx < ( signed short )0x8000 )
-            {
-            outx = ( signed short )0x8000;
-            }
-        else if( outx > ( signed short )0x7FFF )
-            {
-            outx = ( signed short )0x7FFF;
-            }
 
-#ifdef DBG_BRR
-        fprintf(
-               stderr,
-               "V%d: filter + delta=%04X\n",
-               v,
-               ( unsigned short )outx
-               );
-#endif
+/***** CountBRRBlock *****/
 
-        vp->smp2                   = ( signed short )vp->smp1;
-        vp->smp1                   = ( signed short )( outx << 1 );
-        vp->sampbuf[ vp->sampptr ] = vp->smp1;
+static void CountBRRBlock           /* Adjust pages under a block   */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the cache         */
+    int                 addr,       /* Address of block header      */
+    int                 delta       /* +1 or -1                     */
+    )
+{
+CountBRRPage( dsp, addr >> 8, delta );
+if( ( addr >> 8 ) != ( ( ( addr + 8 ) & 0xFFFF ) >> 8 ) )
+    {
+    CountBRRPage( dsp, ( ( addr + 8 ) & 0xFFFF ) >> 8, delta );
+    }
 
-#ifdef DBG_BRR
-        fprintf(
-               stderr,
-               "V%d: final output: %04X\n",
-               v,
-               vp->sampbuf[ vp->sampptr ]
-               );
-#endif
+}   /* CountBRRBlock() */
 
-        vp->sampptr = ( vp->sampptr + 1 ) & 3;
-        }
 
-    if(DSPregs[ 0x3D ] & m )
+/***** DropBRR *****/
+
+static void DropBRR                 /* Remove a block from cache    */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the cache         */
+    brr_block_type *    bp          /* Cached block to remove       */
+    )
+{
+bp->valid = 0;
+CountBRRBlock( dsp, bp->addr, -1 );
+
+}   /* DropBRR() */
+
+
+/***** LoadParams *****/
+
+static void LoadParams              /* Refresh decoded regs         */
+    (
+    dsp_state_type *    dsp         /* DSP to refresh               */
+    )
+{
+voice_param_type *      pp;
+int                     t;
+int                     v;
+int                     V;
+
+if( dsp->dirty & DSP_DIRTY_GLOBAL )
+    {
+    dsp->params.mvoll     = ( signed char )dsp->regs[ 0x0C ];
+    dsp->params.mvolr     = ( signed char )dsp->regs[ 0x1C ];
+    dsp->params.evoll     = ( signed char )dsp->regs[ 0x2C ];
+    dsp->params.evolr     = ( signed char )dsp->regs[ 0x3C ];
+    dsp->params.efb       = ( signed char )dsp->regs[ 0x0D ];
+    dsp->params.pmon      = dsp->regs[ 0x2D ];
+    dsp->params.non       = dsp->regs[ 0x3D ];
+    dsp->params.eon       = dsp->regs[ 0x4D ];
+    dsp->params.mute      = dsp->regs[ 0x6C ] & 0x40;
+    dsp->params.echo_off  = dsp->regs[ 0x6C ] & 0x20;
+    dsp->params.noise_cnt = ENVCNT[ dsp->regs[ 0x6C ] & 0x1F ];
+    dsp->params.dir       = dsp->regs[ 0x5D ] << 8;
+    dsp->params.esa       = dsp->regs[ 0x6D ] << 8;
+    dsp->params.echo_len  = ( dsp->regs[ 0x7D ] & 0xF ) << 11;
+    dsp->dirty &= ~DSP_DIRTY_GLOBAL;
+    }
+
+for( v = 0; v < 8; v++ )
+    {
+    if( !( dsp->dirty & DSP_DIRTY_VOICE( v ) ) )
         {
-#ifdef DBG_PMOD
-        fprintf( stderr, "Noise enabled, voice %d\n", v );
-#endif
-        outx = ( signed short )( noise_lev << 1 );
+        continue;
         }
-    else
-        {
-        /* Perform 4-Point Gaussian interpolation.  Take an approximation of a
-           Gaussian bell-curve, and move it through the sample data at a rate
-           determined by the pitch.  The sample output at any given time is
-           the sum of the products of each input sample point with the value
-           of the bell-curve corresponding to that point. */
-        vl  = vp->mixfrac >> 4;
-        vr  = ( ( G4[ -vl ] * vp->sampbuf[ vp->sampptr ] ) >> 11 ) & ~1;
-        vr += ( ( G3[ -vl ]
-                * vp->sampbuf[ ( vp->sampptr + 1 ) & 3 ] ) >> 11 ) & ~1;
-        vr += ( ( G2[ vl ]
-                * vp->sampbuf[ ( vp->sampptr + 2 ) & 3 ] ) >> 11 ) & ~1;
-
-        /* This is to do the wrapping properly.  Based on my tests with the
-           SNES, it appears clipping is done only if it is the fourth addition
-           that would cause a wrap.  If it has already wrapped before the
-           fourth addition, it is not clipped. */
-        vr  = ( signed short )vr;
-        vr += ( ( G1[ vl ]
-                * vp->sampbuf[ ( vp->sampptr + 3 ) & 3 ] ) >> 11 ) & ~1;
-        if( vr > 32767 )
-            {
-            vr = 32767;
-            }
-        else if( vr < -32768 )
-            {
-            vr = -32768;
-            }
-        outx = ( signed short )vr;
+    pp = &dsp->voice_params[ v ];
+    V  = v << 4;
 
-#ifdef DBG_INTRP
-        fprintf(
-               stderr,
-               "V%d: mixfrac=%d: [%d]*%d + [%d]*%d + [%d]*%d + [%d]*%d "\
-                "= %d\n",
-               v,
-               vl,
-               G1[ vl ],
-               vp->sampbuf[ ( vp->sampptr + 3 ) & 3 ],
-               G2[ vl ],
-               vp->sampbuf[ ( vp->sampptr + 2 ) & 3 ],
-               G3[ -vl ],
-               vp->sampbuf[ ( vp->sampptr + 1 ) & 3 ],
-               G4[ -vl ],
-               vp->sampbuf[ vp->sampptr ],
-               outx
-               );
-#endif
+    /* The envelope may have been waiting on the old rates. */
+    WakeEnvelope( &dsp->voice_state[ v ] );
+
+    pp->pitch = LEtoME16( *( ( unsigned short * )&dsp->regs[ V + 2 ] ) )
+              & 0x3FFF;
+    pp->voll  = ( signed char )dsp->regs[ V     ];
+    pp->volr  = ( signed char )dsp->regs[ V + 1 ];
+
+    /* ADSR rates are looked up in ENVCNT now, rather than on every step.
+       The fastest attack rate is a special case with no count at all. */
+    t                = dsp->regs[ V + 5 ];
+    pp->adsr         = t & 0x80;
+    pp->attack_cnt   = ( ( t & 0xF ) == 0xF ) ? 0
+                     : ENVCNT[ ( ( t & 0xF ) << 1 ) + 1 ];
+    pp->decay_cnt    = ENVCNT[ ( ( t >> 3 ) & 0xE ) + 0x10 ];
+    t                = dsp->regs[ V + 6 ];
+    pp->sustain_lev  = 0x100 * ( ( t >> 5 ) + 1 );
+    pp->sustain_cnt  = ENVCNT[ t & 0x1F ];
+    pp->gain         = dsp->regs[ V + 7 ];
+    pp->gain_cnt     = ENVCNT[ pp->gain & 0x1F ];
+
+    dsp->dirty &= ~DSP_DIRTY_VOICE( v );
+    }
+
+}   /* LoadParams() */
+
+
+/***** LookupBRR *****/
+
+static void LookupBRR               /* Find or decode a BRR block   */
+    (
+    dsp_state_type *    dsp,        /* DSP owning the cache         */
+    int                 addr,       /* Address of block header      */
+    int                 header,     /* Block header                 */
+    int                 smp1,       /* Last sample decoded          */
+    int                 smp2,       /* Second-to-last sample decoded*/
+    short *             out         /* Decoded block                */
+    )
+{
+brr_block_type *        bp;
+int                     filter;
+int                     misses;
+
+bp     = &dsp->brr_cache[ BRR_SLOT( addr ) ];
+filter = ( header & 12 ) >> 2;
+misses = 0;
+
+/* The block's data can't have changed since it was cached, or it would
+   have been dropped.  The samples before it only matter if the filter uses
+   them. */
+if( bp->valid && ( bp->addr == addr ) && ( bp->header == header ) )
+    {
+    if( ( filter == 0 )
+     || ( ( bp->smp1 == smp1 )
+       && ( ( filter == 1 ) || ( bp->smp2 == smp2 ) ) ) )
+        {
+        bp->misses = 0;
+        memcpy( out, bp->out, sizeof( bp->out ) );
+        return;
         }
 
-    /* Advance the sample position for next update. */
-    vp->mixfrac += vp->pitch;
+    /* If the block keeps coming around with different samples before it,
+       as when a loop starts with a filtered block, caching it is a waste of
+       time.  Mostly leave such blocks to be decoded directly, but keep
+       checking every so often whether things have settled down. */
+    misses = bp->misses + 1;
+    if( ( misses >= 2 ) && ( misses & 7 ) )
+        {
+        bp->misses = misses;
+        DecodeBRRBlock(
+                      dsp->ram,
+                      addr,
+                      header >> 4,
+                      filter,
+                      0,
+                      smp1,
+                      smp2,
+                      out
+                      );
+        return;
+        }
+    }
 
-    outx = ( ( outx * envx ) >> 11 ) & ~1;
-    DSPregs[ V + 9 ] = outx >> 8;
-
-    vl = ( ( ( int )( signed char )DSPregs[ V     ] ) * outx ) >> 7;
-    vr = ( ( ( int )( signed char )DSPregs[ V + 1 ] ) * outx ) >> 7;
-    if (!(m & channel_mask)) {
-      outl += vl;
-      outr += vr;
-      if (DSPregs[0x4D] & m) {
-        echol += vl;
-        echor += vr;
-      }
+if( bp->valid )
+    {
+    DropBRR( dsp, bp );
     }
-  }
-outl = ( outl * ( signed char )DSPregs[ 0x0C ] ) >> 7;
-outr = ( outr * ( signed char )DSPregs[ 0x1C ] ) >> 7;
 
+bp->addr   = addr;
+bp->header = header;
+bp->misses = misses;
+bp->smp1   = smp1;
+bp->smp2   = smp2;
+DecodeBRRBlock( dsp->ram, addr, header >> 4, filter, 0, smp1, smp2, bp->out );
+memcpy( out, bp->out, sizeof( bp->out ) );
+
+bp->valid = 1;
+CountBRRBlock( dsp, addr, 1 );
+
+}   /* LookupBRR() */
+
+
+/***** MixBlock *****/
+
+static void MixBlock                /* Apply echo & output a block  */
+    (
+    dsp_state_type *    dsp,        /* DSP to run                   */
+    block_type *        blk,        /* Block being mixed            */
+    int                 count,      /* Number of samples in block   */
+    int                 voices,     /* Zero -> no voice was on      */
+    short *             sound_ptr   /* Pointer to mix audio into    */
+    )
+{
 #ifndef NO_ECHO
-/* Perform echo.  First, read mem at current location, and put those samples
-   into the FIR filter queue. */
-#ifdef DBG_ECHO
-fprintf(
-       stderr,
-       "Echo delay=%dms, feedback=%d%%, mask=0x%02X\n",
-       DSPregs[ 0x7D ] * 16,
-       ( ( signed char )DSPregs[ 0x0D ] * 100 ) / 0x7F,
-       DSPregs[0x4D]
-       );
+int                     echo_base;
+int                     echo_len;
+int                     echol;
+int                     echor;
+int                     i;
+int                     run;
+int                     s0;
 #endif
+int                     heard;
+int                     s;
+int                     vl;
+int                     vr;
 
-echo_base = ( ( DSPregs[ 0x6D ] << 8 ) + echo_ptr ) & 0xFFFF;
-FIRlbuf[ FIRptr ]
-  = ( signed short )LEtoME16(
-                            *( unsigned short * )
-                              &SPC_RAM[ echo_base ]
-                            );
-FIRrbuf[ FIRptr ]
-  = ( signed short )LEtoME16(
-                            *( unsigned short * )
-                              &SPC_RAM[ echo_base + sizeof( short ) ]
-                            );
-
-/* Now, evaluate the FIR filter, and add the results into the final output. */
-vl     = FIRlbuf[ FIRptr ] * ( signed char )DSPregs[ 0x7F ];
-vr     = FIRrbuf[ FIRptr ] * ( signed char )DSPregs[ 0x7F ];
-FIRptr = ( FIRptr + 1 ) & 7;
-vl    += FIRlbuf[ FIRptr ] * ( signed char )DSPregs[ 0x6F ];
-vr    += FIRrbuf[ FIRptr ] * ( signed char )DSPregs[ 0x6F ];
-FIRptr = ( FIRptr + 1 ) & 7;
-vl    += FIRlbuf[ FIRptr ] * ( signed char )DSPregs[ 0x5F ];
-vr    += FIRrbuf[ FIRptr ] * ( signed char )DSPregs[ 0x5F ];
-FIRptr = ( FIRptr + 1 ) & 7;
-vl    += FIRlbuf[ FIRptr ] * ( signed char )DSPregs[ 0x4F ];
-vr    += FIRrbuf[ FIRptr ] * ( signed char )DSPregs[ 0x4F ];
-FIRptr = ( FIRptr + 1 ) & 7;
-vl    += FIRlbuf[ FIRptr ] * ( signed char )DSPregs[ 0x3F ];
-vr    += FIRrbuf[ FIRptr ] * ( signed char )DSPregs[ 0x3F ];
-FIRptr = ( FIRptr + 1 ) & 7;
-vl    += FIRlbuf[ FIRptr ] * ( signed char )DSPregs[ 0x2F ];
-vr    += FIRrbuf[ FIRptr ] * ( signed char )DSPregs[ 0x2F ];
-FIRptr = ( FIRptr + 1 ) & 7;
-vl    += FIRlbuf[ FIRptr ] * ( signed char )DSPregs[ 0x1F ];
-vr    += FIRrbuf[ FIRptr ] * ( signed char )DSPregs[ 0x1F ];
-FIRptr = ( FIRptr + 1 ) & 7;
-vl    += FIRlbuf[ FIRptr ] * ( signed char )DSPregs[ 0x0F ];
-vr    += FIRrbuf[ FIRptr ] * ( signed char )DSPregs[ 0x0F ];
+/* Nothing is added to the output unless a voice was on, or the echo comes
+   through below. */
+heard = voices;
+if( voices && !blk->quiet )
+    {
+    for( s = 0; s < count; s++ )
+        {
+        blk->outl[ s ] = ( blk->outl[ s ] * dsp->params.mvoll ) >> 7;
+        blk->outr[ s ] = ( blk->outr[ s ] * dsp->params.mvolr ) >> 7;
+        }
+    }
 
+#ifndef NO_ECHO
 #ifdef DBG_ECHO
 fprintf(
        stderr,
-       "FIR Coefficients: %02X %02X %02X %02X %02X %02X %02X %02X\n",
-       DSPregs[ 0x0F ],
-       DSPregs[ 0x1F ],
-       DSPregs[ 0x2F ],
-       DSPregs[ 0x3F ],
-       DSPregs[ 0x4F ],
-       DSPregs[ 0x5F ],
-       DSPregs[ 0x6F ],
-       DSPregs[ 0x7F ]
+       "Echo delay=%dms, feedback=%d%%, mask=0x%02X\n",
+       dsp->regs[ 0x7D ] * 16,
+       ( ( signed char )dsp->regs[ 0x0D ] * 100 ) / 0x7F,
+       dsp->regs[0x4D]
        );
 #endif
 
-/* FIRptr is left in the position of the oldest sample, the one that will be
-   replaced next update. */
-outl += vl * ( signed char )DSPregs[ 0x2C ] >> 14;
-outr += vr * ( signed char )DSPregs[ 0x3C ] >> 14;
-
-if( !( DSPregs[ 0x6C ] & 0x20 ) )
+/* The FIR coefficients are only reloaded when one of them has been written.
+   Register 0x0F holds the one for the oldest input, and 0x7F the newest. */
+if( dsp->dirty & DSP_DIRTY_FIR )
     {
-    /* Add the echo feedback back into the original result, and save that into
-       memory for use later. */
-    echol += vl * ( signed char )DSPregs[ 0x0D ] >> 14;
-    if( echol > 32767 )
+    for( i = 0; i < DSP_FIR_LEN; i++ )
         {
-        echol = 32767;
-        }
-    else if( echol < -32768 )
-        {
-        echol = -32768;
-        }
-    echor += vr * ( signed char )DSPregs[ 0x0D ] >> 14;
-    if( echor > 32767 )
-        {
-        echor = 32767;
-        }
-    else if( echor < -32768 )
-        {
-        echor = -32768;
+        dsp->FIRcoef[ i ] = ( signed char )dsp->regs[ ( i << 4 ) + 0x0F ];
         }
+    dsp->dirty &= ~DSP_DIRTY_FIR;
 
 #ifdef DBG_ECHO
     fprintf(
            stderr,
-           "Echo: Writing %04X,%04X at location %04X\n",
-           ( unsigned short )echol,
-           ( unsigned short )echor,
-           echo_base
+           "FIR Coefficients: %02X %02X %02X %02X %02X %02X %02X %02X\n",
+           dsp->regs[ 0x0F ],
+           dsp->regs[ 0x1F ],
+           dsp->regs[ 0x2F ],
+           dsp->regs[ 0x3F ],
+           dsp->regs[ 0x4F ],
+           dsp->regs[ 0x5F ],
+           dsp->regs[ 0x6F ],
+           dsp->regs[ 0x7F ]
            );
 #endif
-
-    *( unsigned short * )&SPC_RAM[ echo_base ]
-        = MEtoLE16( ( unsigned short )echol );
-    *( unsigned short * )&SPC_RAM[ echo_base + sizeof( short ) ]
-        = MEtoLE16( ( unsigned short )echor );
     }
 
-echo_ptr += 2 * sizeof( short );
-if( echo_ptr >= ( ( DSPregs[ 0x7D ] & 0xF ) << 11 ) )
+/* Each sample's echo input is read from memory at the same location its
+   feedback is written back to, and that location isn't visited again until
+   the pointer wraps.  So the inputs for a whole run of samples can be read and
+   filtered at once, unless the echo region is so small that the pointer never
+   moves. */
+echo_len = dsp->params.echo_len;
+for( s0 = 0; s0 < count; s0 += run )
     {
-    echo_ptr = 0;
-    }
-#endif                              /* !defined( NO_ECHO )          */
+    run = echo_len ? count - s0 : 1;
 
-if( sound_ptr )
-    {
-    if( DSPregs[ 0x6C ] & 0x40 )
+    /* First, read mem at successive locations, and put those samples into
+       the FIR filter queue behind the history. */
+    for( i = 0; i < DSP_FIR_LEN - 1; i++ )
         {
-        /* MUTE */
-#ifdef DEBUG
-        fprintf( stderr, "MUTED!\n" );
-#endif
-
-        *sound_ptr = 0;
-        sound_ptr++;
-        *sound_ptr = 0;
-        sound_ptr++;
+        blk->firl_in[ i ] = dsp->FIRlbuf[ i ];
+        blk->firr_in[ i ] = dsp->FIRrbuf[ i ];
         }
-    else
+    for( i = 0; i < run; i++ )
+        {
+        echo_base = ( dsp->params.esa + dsp->echo_ptr ) & 0xFFFF;
+        blk->echo_addr[ i ] = echo_base;
+        blk->firl_in[ DSP_FIR_LEN - 1 + i ]
+          = ( signed short )LEtoME16(
+                                    *( unsigned short * )
+                                      &dsp->ram[ echo_base ]
+                                    );
+        blk->firr_in[ DSP_FIR_LEN - 1 + i ]
+          = ( signed short )LEtoME16(
+                                    *( unsigned short * )
+                                      &dsp->ram[ echo_base + sizeof( short ) ]
+                                    );
+
+        dsp->echo_ptr += 2 * sizeof( short );
+        if( dsp->echo_ptr >= echo_len )
+            {
+            dsp->echo_ptr = 0;
+            }
+        }
+    for( i = 0; i < DSP_FIR_LEN - 1; i++ )
+        {
+        dsp->FIRlbuf[ i ] = blk->firl_in[ run + i ];
+        dsp->FIRrbuf[ i ] = blk->firr_in[ run + i ];
+        }
+
+    /* With echo writes off, the filter is only there to be heard.  There's
+       no need to run it if it can't be, or if all it has to work on is
+       silence. */
+    if( dsp->params.echo_off )
         {
-        if( outl > 32767 )
+        if( blk->quiet )
             {
-            *sound_ptr = 32767;
+            continue;
             }
-        else if( outl < -32768 )
+        if( dsp->params.evoll || dsp->params.evolr )
             {
-            *sound_ptr = -32768;
+            for( i = 0; i < DSP_FIR_LEN - 1 + run; i++ )
+                {
+                if( blk->firl_in[ i ] | blk->firr_in[ i ] )
+                    {
+                    break;
+                    }
+                }
             }
         else
             {
-            *sound_ptr = outl;
+            i = DSP_FIR_LEN - 1 + run;
+            }
+        if( i == DSP_FIR_LEN - 1 + run )
+            {
+            continue;
+            }
+        }
+    heard = 1;
+
+    /* Now, evaluate the FIR filter, and add the results into the final
+       output. */
+    DSP_EchoFIR( dsp->FIRcoef, blk->firl_in, blk->firl_out, run );
+    DSP_EchoFIR( dsp->FIRcoef, blk->firr_in, blk->firr_out, run );
+
+    for( i = 0; i < run; i++ )
+        {
+        s  = s0 + i;
+        vl = blk->firl_out[ i ];
+        vr = blk->firr_out[ i ];
+        blk->outl[ s ] += vl * dsp->params.evoll >> 14;
+        blk->outr[ s ] += vr * dsp->params.evolr >> 14;
+
+        if( dsp->params.echo_off )
+            {
+            continue;
             }
-        sound_ptr++;
-        if( outr > 32767 )
+
+        /* Add the echo feedback back into the original result, and save that
+           into memory for use later. */
+        echol = blk->echol[ s ]
+              + ( vl * dsp->params.efb >> 14 );
+        if( echol > 32767 )
             {
-            *sound_ptr = 32767;
+            echol = 32767;
             }
-        else if( outr < -32768 )
+        else if( echol < -32768 )
             {
-            *sound_ptr = -32768;
+            echol = -32768;
             }
-        else
+        echor = blk->echor[ s ]
+              + ( vr * dsp->params.efb >> 14 );
+        if( echor > 32767 )
+            {
+            echor = 32767;
+            }
+        else if( echor < -32768 )
+            {
+            echor = -32768;
+            }
+
+        echo_base = blk->echo_addr[ i ];
+
+#ifdef DBG_ECHO
+        fprintf(
+               stderr,
+               "Echo: Writing %04X,%04X at location %04X\n",
+               ( unsigned short )echol,
+               ( unsigned short )echor,
+               echo_base
+               );
+#endif
+
+        *( unsigned short * )&dsp->ram[ echo_base ]
+            = MEtoLE16( ( unsigned short )echol );
+        *( unsigned short * )&dsp->ram[ echo_base + sizeof( short ) ]
+            = MEtoLE16( ( unsigned short )echor );
+        /* Between them, these cover every block including any of the four
+           bytes written. */
+        DSP_RamWritten( dsp, echo_base );
+        DSP_RamWritten( dsp, echo_base + 3 );
+        if( dsp->echo_written )
             {
-            *sound_ptr = outr;
+            dsp->echo_written( dsp->echo_opaque, echo_base );
             }
-        sound_ptr++;
         }
     }
+#endif                              /* !defined( NO_ECHO )          */
 
-}   /* DSP_Update() */
+if( !sound_ptr )
+    {
+    return;
+    }
+
+if( dsp->params.mute || !heard )
+    {
+#ifdef DEBUG
+    if( dsp->params.mute )
+        {
+        fprintf( stderr, "MUTED!\n" );
+        }
+#endif
+
+    memset( sound_ptr, 0, 2 * count * sizeof( *sound_ptr ) );
+    return;
+    }
+
+for( s = 0; s < count; s++ )
+    {
+    if( blk->outl[ s ] > 32767 )
+        {
+        *sound_ptr = 32767;
+        }
+    else if( blk->outl[ s ] < -32768 )
+        {
+        *sound_ptr = -32768;
+        }
+    else
+        {
+        *sound_ptr = blk->outl[ s ];
+        }
+    sound_ptr++;
+    if( blk->outr[ s ] > 32767 )
+        {
+        *sound_ptr = 32767;
+        }
+    else if( blk->outr[ s ] < -32768 )
+        {
+        *sound_ptr = -32768;
+        }
+    else
+        {
+        *sound_ptr = blk->outr[ s ];
+        }
+    sound_ptr++;
+    }
+
+}   /* MixBlock() */
 
 
 /***** AdvanceEnvelope *****/
 
 static int AdvanceEnvelope          /* Run envelope step & retn ENVX*/
     (
+    dsp_state_type *    dsp,        /* DSP owning the voice         */
     int                 v           /* Voice to process envelope for*/
     )
 {
 int                     envx;
 int                     cnt;
-int                     adsr1;
+const voice_param_type *
+                        pp;
 int                     t;
 
-envx = voice_state[ v ].envx;
+envx = dsp->voice_state[ v ].envx;
+pp   = &dsp->voice_params[ v ];
+
+/* Nothing happens between steps apart from the count going down, and that
+   was already taken care of when the wait was worked out. */
+if( dsp->voice_state[ v ].envwait )
+    {
+    dsp->voice_state[ v ].envwait--;
+    dsp->regs[ ( v << 4 ) + 8 ] = envx >> 4;
+    return( envx );
+    }
 
-if( voice_state[ v ].envstate == RELEASE )
+if( dsp->voice_state[ v ].envstate == RELEASE )
     {
     /* Docs: "When in the state of "key off". the "click" sound is prevented
        by the addition of the fixed value 1/256"  WTF???  Alright, I'm going
@@ -760,11 +1630,11 @@ if( voice_state[ v ].envstate == RELEASE )
     if( envx <= 0 )
         {
         envx = 0;
-        keys &= ~( 1 << v );
+        dsp->keys &= ~( 1 << v );
         return -1;
         }
-    voice_state[ v ].envx = envx;
-    DSPregs[ ( v << 4 ) + 8 ] = envx >> 8;
+    dsp->voice_state[ v ].envx = envx;
+    dsp->regs[ ( v << 4 ) + 8 ] = envx >> 8;
 
 #ifdef DBG_ENV
     fprintf(
@@ -778,19 +1648,17 @@ if( voice_state[ v ].envstate == RELEASE )
     return( envx );
     }
 
-cnt   = voice_state[ v ].envcnt;
-adsr1 = DSPregs[ ( v << 4 ) + 5 ];
-if( adsr1 & 0x80 )
+cnt = dsp->voice_state[ v ].envcnt;
+if( pp->adsr )
     {
-    switch( voice_state[ v ].envstate )
+    switch( dsp->voice_state[ v ].envstate )
         {
         case ATTACK:
             /* Docs are very confusing.  "AR is multiplied by the fixed value
                1/64..."  I believe it means to add 1/64th to ENVX once every
                time ATTACK is updated, and that's what I'm going to implement.
                */
-            t = adsr1 & 0xF;
-            if( t == 0xF )
+            if( pp->attack_cnt == 0 )
                 {
 #ifdef DBG_ENV
                 fprintf( stderr, "ENV voice %d: instant attack\n", v );
@@ -800,7 +1668,7 @@ if( adsr1 & 0x80 )
                 }
             else
                 {
-                cnt -= ENVCNT[ ( t << 1 ) + 1 ];
+                cnt -= pp->attack_cnt;
                 if( cnt > 0 )
                     {
                     break;
@@ -812,7 +1680,7 @@ if( adsr1 & 0x80 )
             if( envx > 0x7FF )
                 {
                 envx = 0x7FF;
-                voice_state[ v ].envstate = DECAY;
+                dsp->voice_state[ v ].envstate = DECAY;
                 }
 
 #ifdef DBG_ENV
@@ -824,7 +1692,7 @@ if( adsr1 & 0x80 )
                    );
 #endif
 
-            voice_state[ v ].envx = envx;
+            dsp->voice_state[ v ].envx = envx;
 
             break;
 
@@ -832,17 +1700,17 @@ if( adsr1 & 0x80 )
             /* Docs: "DR... [is multiplied] by the fixed value 1-1/256."
                Well, at least that makes some sense.  Multiplying ENVX by
                255/256 every time DECAY is updated. */
-            cnt -= ENVCNT[ ( ( adsr1 >> 3 ) & 0xE ) + 0x10 ];
+            cnt -= pp->decay_cnt;
             if( cnt <= 0 )
                 {
                 cnt   = CNT_INIT;
                 envx -= ( ( envx - 1 ) >> 8 ) + 1;
-                voice_state[ v ].envx = envx;
+                dsp->voice_state[ v ].envx = envx;
                 }
 
-            if( envx <= 0x100 * ( SL( v ) + 1 ) )
+            if( envx <= pp->sustain_lev )
                 {
-                voice_state[ v ].envstate = SUSTAIN;
+                dsp->voice_state[ v ].envstate = SUSTAIN;
                 }
 
 #ifdef DBG_ENV
@@ -860,7 +1728,7 @@ if( adsr1 & 0x80 )
             /* Docs: "SR [is multiplied] by the fixed value 1-1/256."
                Multiplying ENVX by 255/256 every time SUSTAIN is updated. */
 #ifdef DBG_ENV
-            if( ENVCNT[ SR( v ) ] == 0 )
+            if( pp->sustain_cnt == 0 )
                 {
                 fprintf(
                        stderr,
@@ -871,7 +1739,7 @@ if( adsr1 & 0x80 )
                 }
 #endif
 
-            cnt -= ENVCNT[ SR( v ) ];
+            cnt -= pp->sustain_cnt;
             if( cnt > 0 )
                 {
                 break;
@@ -888,7 +1756,7 @@ if( adsr1 & 0x80 )
                    );
 #endif
 
-            voice_state[ v ].envx = envx;
+            dsp->voice_state[ v ].envx = envx;
 
             /* Note: no way out of this state except by explicit KEY OFF (or
                switch to GAIN). */
@@ -910,11 +1778,11 @@ else
        update the count, unless I see a game that obviously wants the
        other behavior.  The effect would be pretty subtle, in any case.
        */
-    t = DSPregs[ ( v << 4 ) + 7 ];
+    t = pp->gain;
     if( t < 0x80 )
         {
         envx                  = t << 4;
-        voice_state[ v ].envx = envx;
+        dsp->voice_state[ v ].envx = envx;
 
 #ifdef DBG_ENV
         fprintf(
@@ -932,7 +1800,7 @@ else
             case 4:
                 /* Docs: "Decrease (linear): Subtraction of the fixed value
                    1/64." */
-                cnt -= ENVCNT[ t & 0x1F ];
+                cnt -= pp->gain_cnt;
                 if( cnt > 0 )
                     {
                     break;
@@ -953,14 +1821,14 @@ else
                        );
 #endif
 
-                voice_state[ v ].envx = envx;
+                dsp->voice_state[ v ].envx = envx;
 
                 break;
 
             case 5:
                 /* Docs: "Drecrease <sic> (exponential): Multiplication by
                    the fixed value 1-1/256." */
-                cnt -= ENVCNT[ t & 0x1F ];
+                cnt -= pp->gain_cnt;
                 if( cnt > 0 )
                     {
                     break;
@@ -977,14 +1845,14 @@ else
                        );
 #endif
 
-                voice_state[ v ].envx = envx;
+                dsp->voice_state[ v ].envx = envx;
 
                 break;
 
             case 6:
                 /* Docs: "Increase (linear): Addition of the fixed value
                    1/64." */
-                cnt -= ENVCNT[ t & 0x1F ];
+                cnt -= pp->gain_cnt;
                 if( cnt > 0 )
                 {
                     break;
@@ -1005,7 +1873,7 @@ else
                        );
 #endif
 
-                voice_state[ v ].envx = envx;
+                dsp->voice_state[ v ].envx = envx;
 
                 break;
 
@@ -1013,7 +1881,7 @@ else
                 /* Docs: "Increase (bent line): Addition of the constant
                    1/64 up to .75 of the constaint <sic> 1/256 from .75 to
                    1." */
-                cnt -= ENVCNT[ t & 0x1F ];
+                cnt -= pp->gain_cnt;
                 if( cnt > 0 )
                     {
                     break;
@@ -1041,16 +1909,71 @@ else
                        );
 #endif
 
-                voice_state[ v ].envx = envx;
+                dsp->voice_state[ v ].envx = envx;
 
                 break;
             }
         }
     }
 
-voice_state[ v ].envcnt   = cnt;
-DSPregs[ ( v << 4 ) + 8 ] = envx >> 4;
+/* Work out how many more updates will go by before the next step, using
+   the rate for the state and mode we've ended up in.  Those can then be
+   skipped until something changes the envelope's registers or state.  A
+   rate of zero or a direct GAIN setting leave ENVX alone for good.  An
+   instant attack steps on every update, and a DECAY which has just reached
+   the sustain level moves to SUSTAIN on the next one, so neither can be
+   skipped. */
+if( pp->adsr )
+    {
+    switch( dsp->voice_state[ v ].envstate )
+        {
+        case ATTACK:
+            t = pp->attack_cnt ? pp->attack_cnt : -1;
+            break;
+
+        case DECAY:
+            t = ( envx > pp->sustain_lev ) ? pp->decay_cnt : -1;
+            break;
+
+        default:
+            t = pp->sustain_cnt;
+            break;
+        }
+    }
+else
+    {
+    t = ( pp->gain < 0x80 ) ? 0 : pp->gain_cnt;
+    }
+
+if( t == 0 )
+    {
+    dsp->voice_state[ v ].envwait = INT_MAX;
+    dsp->voice_state[ v ].envrate = 0;
+    }
+else if( ( t > 0 ) && ( cnt > 0 ) )
+    {
+    dsp->voice_state[ v ].envwait = ( cnt - 1 ) / t;
+    dsp->voice_state[ v ].envrate = t;
+    cnt -= dsp->voice_state[ v ].envwait * t;
+    }
+
+dsp->voice_state[ v ].envcnt   = cnt;
+dsp->regs[ ( v << 4 ) + 8 ] = envx >> 4;
 
 return( envx );
 
 }    /* AdvanceEnvelope() */
+
+
+/***** WakeEnvelope *****/
+
+static void WakeEnvelope            /* Stop skipping envelope steps */
+    (
+    voice_state_type *  vp          /* Voice to wake                */
+    )
+{
+/* Give back the counts charged for the updates that didn't happen. */
+vp->envcnt  += vp->envwait * vp->envrate;
+vp->envwait  = 0;
+
+}   /* WakeEnvelope() */
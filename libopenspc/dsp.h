@@ -31,12 +31,28 @@ to change.
 #if !defined _DSP_H
 #define _DSP_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*========== CONSTANTS ==========*/
+
+extern const int    TS_CYC;
+
+#define DSP_COURSE_SIZE     ( 2 + 8 + 0x80 )    /* Bytes of DSP_GetCourse() */
+
+#define DSP_DIRTY_FIR       ( 0x01 )    /* FIRcoef needs reloading  */
+#define DSP_DIRTY_GLOBAL    ( 0x02 )    /* params needs reloading   */
+#define DSP_DIRTY_VOICES    ( 0xFF00 )  /* Any DSP_DIRTY_VOICE()    */
+/* voice_params[ v ] needs reloading */
+#define DSP_DIRTY_VOICE( v )    ( 0x100 << ( v ) )
+
+#define DSP_BRR_CACHE_LEN   ( 1024 )    /* Decoded BRR blocks cached;
+                                           must be a power of 2     */
+
 /*========== TYPES ==========*/
 
 typedef enum                        /* ADSR state type              */
@@ -47,6 +63,18 @@ typedef enum                        /* ADSR state type              */
     RELEASE
     } env_state_t32;
 
+typedef struct                      /* Decoded BRR block            */
+    {
+    unsigned short  addr;           /* Address of block header      */
+    unsigned char   valid;          /* Nonzero -> entry in use      */
+    unsigned char   header;         /* Block header                 */
+    unsigned char   misses;         /* Times in a row seen with a
+                                       different history            */
+    short           smp1;           /* Last two samples decoded     */
+    short           smp2;           /*   before the block           */
+    short           out[ 16 ];      /* Decoded samples              */
+    } brr_block_type;
+
 typedef struct                      /* Voice state type             */
     {
     unsigned short  mem_ptr;        /* Sample data memory pointer   */
@@ -54,6 +82,10 @@ typedef struct                      /* Voice state type             */
     int             envcnt;         /* Counts to envelope update    */
     env_state_t32   envstate;       /* Current envelope state       */
     int             envx;           /* Last env height (0-0x7FFF)   */
+    int             envwait;        /* Envelope updates to skip, as
+                                       nothing will change          */
+    int             envrate;        /* Counts per skipped update,
+                                       charged to envcnt up front   */
     int             filter;         /* Last header's filter         */
     int             half;           /* Active nybble of BRR         */
     int             header_cnt;     /* Bytes before new header (0-8)*/
@@ -61,64 +93,224 @@ typedef struct                      /* Voice state type             */
     int             on_cnt;         /* Is it time to turn on yet?   */
     int             pitch;          /* Sample pitch (4096->32000Hz) */
     int             range;          /* Last header's range          */
-    unsigned long   samp_id;        /* Sample ID#                   */
+    uint32_t        samp_id;        /* Sample ID#                   */
     int             sampptr;        /* Where in sampbuf we are      */
-    signed long     smp1;           /* Last sample (for BRR filter) */
-    signed long     smp2;           /* Second-to-last sample decoded*/
+    int32_t         smp1;           /* Last sample (for BRR filter) */
+    int32_t         smp2;           /* Second-to-last sample decoded*/
     short           sampbuf[ 4 ];   /* Buffer for Gaussian interp   */
+    short           brrbuf[ 16 ];   /* Decode of current BRR block  */
+    unsigned short  brr_addr;       /* Address of its header        */
+    int             brr_held;       /* Nonzero -> brr_addr counted
+                                       in brr_pages                 */
     } voice_state_type;
 
+typedef struct                      /* Voice regs, decoded for use  */
+    {
+    int             pitch;          /* PITCH (0-0x3FFF)             */
+    int             voll;           /* VOL (L), signed              */
+    int             volr;           /* VOL (R), signed              */
+    int             adsr;           /* Nonzero -> ADSR, else GAIN   */
+    int             attack_cnt;     /* Counts per ATTACK step, or 0
+                                       for an instant attack        */
+    int             decay_cnt;      /* Counts per DECAY step        */
+    int             sustain_lev;    /* ENVX at which DECAY ends     */
+    int             sustain_cnt;    /* Counts per SUSTAIN step      */
+    int             gain;           /* GAIN                         */
+    int             gain_cnt;       /* Counts per GAIN step         */
+    } voice_param_type;
+
+typedef struct                      /* Global regs, decoded for use */
+    {
+    int             mvoll;          /* Main volume (L), signed      */
+    int             mvolr;          /* Main volume (R), signed      */
+    int             evoll;          /* Echo volume (L), signed      */
+    int             evolr;          /* Echo volume (R), signed      */
+    int             efb;            /* Echo feedback, signed        */
+    int             pmon;           /* Pitch modulation mask        */
+    int             non;            /* Noise mask                   */
+    int             eon;            /* Echo mask                    */
+    int             mute;           /* Nonzero -> output muted      */
+    int             echo_off;       /* Nonzero -> echo writes off   */
+    int             noise_cnt;      /* Counts per noise step        */
+    int             dir;            /* Source directory address     */
+    int             esa;            /* Echo region address          */
+    int             echo_len;       /* Echo region length in bytes  */
+    } dsp_param_type;
+
 typedef struct                      /* Source directory entry       */
     {
     unsigned short  vptr;           /* Ptr to start of sample data  */
     unsigned short  lptr;           /* Loop pointer in sample data  */
     } src_dir_type;
 
-/*========== CONSTANTS ==========*/
-
-extern const int    TS_CYC;
-
-/*========== VARIABLES ==========*/
-
-/* The following three variables are all bitfields with one bit corresponding
-   to each of the 8 DSP channels. */
-extern int          channel_mask;   /* 1 -> channel muted           */
-extern int          keyed_on;       /* 1 -> channel requested on    */
-extern int          keys;           /* 1 -> channel audible         */
+typedef struct                      /* Complete state of one DSP    */
+    {
+    /* The following three variables are all bitfields with one bit
+       corresponding to each of the 8 DSP channels. */
+    int             channel_mask;   /* 1 -> channel muted           */
+    int             keyed_on;       /* 1 -> channel requested on    */
+    int             keys;           /* 1 -> channel audible         */
 
-extern voice_state_type
+    voice_state_type
                     voice_state[ 8 ];
 
-extern uint8_t DSPregs[256];
+    int             noise_cnt;      /* Counts to noise update       */
+    int             noise_lev;      /* Current noise level          */
+
+    int             FIRlbuf[ 7 ];   /* Echo FIR filter history,
+                                       oldest first                 */
+    int             FIRrbuf[ 7 ];
+    int             FIRcoef[ 8 ];   /* FIR coefs, oldest input first*/
+    int             echo_ptr;       /* Offset into echo region      */
+
+    unsigned int    dirty;          /* DSP_DIRTY_* flags for values
+                                       cached from regs             */
+    dsp_param_type  params;         /* Decoded global regs          */
+    voice_param_type
+                    voice_params[ 8 ];
+                                    /* Decoded voice regs           */
+
+    brr_block_type  brr_cache[ DSP_BRR_CACHE_LEN ];
+                                    /* Recently decoded BRR blocks,
+                                       indexed by address           */
+    unsigned short  brr_pages[ 256 ];
+                                    /* Number of cached or playing
+                                       blocks on each page of RAM   */
+    int             brr_pages_changed;
+                                    /* Nonzero -> an entry in
+                                       brr_pages became or stopped
+                                       being zero                   */
+
+    uint8_t         regs[ 256 ];    /* DSP register file            */
+    uint8_t *       ram;            /* SPC RAM; MUST BE SET BEFORE
+                                       USE!                         */
+    void         ( *echo_written )( void *, int );
+                                    /* Called after each write of
+                                       echo data to ram, with its
+                                       address; may be NULL         */
+    void *          echo_opaque;    /* First argument to
+                                       echo_written                 */
+    } dsp_state_type;
 
 /*========== MACROS ==========*/
 
+/* Bytes of DSP_SaveState(): everything from keyed_on up to the values
+   cached from the registers, which are rebuilt on loading, followed by the
+   register file.  The layout only uses fixed-size types, so it comes out
+   the same wherever int is 32 bits. */
+#define DSP_STATE_SIZE  ( offsetof( dsp_state_type, dirty )                 \
+                        - offsetof( dsp_state_type, keyed_on ) + 256 )
+
 /* The functions to actually read and write to the DSP registers must be
    implemented by the specific SPC core implementation, as this is too
    specific to generalize.  However, by defining these macros, we can
    generalize the DSP's behavior while staying out of the SPC's internals,
    by requiring that the SPC core must use these macros at the appropriate
-   times. */
+   times.  regs is the register file the SPC core was given. */
 
 /* All reads simply return the contents of the addressed register. */
 
 /* This macro must be used INSTEAD OF a normal write to register 0x7C
    (ENDX) */
-#define DSP_WRITE_7C( x )   ( DSPregs[ 0x7C ] = 0 )
+#define DSP_WRITE_7C( regs, x ) ( ( regs )[ 0x7C ] = 0 )
 
 /* All other writes should store the value in the addressed register as
-   expected. */
+   expected, and then call DSP_RegWritten(). */
 
 /*========== PROCEDURES ==========*/
 
 void DSP_Reset                      /* Reset emulated DSP           */
-    ( void );
+    (
+    dsp_state_type *    dsp         /* DSP to reset                 */
+    );
+
+/* Must be called after each write to a DSP register, so that any values the
+   DSP derives from it are refreshed before they are next used. */
+void DSP_RegWritten                 /* Note a DSP register write    */
+    (
+    dsp_state_type *    dsp,        /* DSP written to               */
+    int                 addr        /* Register address written     */
+    );
+
+/* Must be called after a RAM write to any page for which brr_pages is
+   nonzero, so that stale decoded samples are dropped or redone. */
+void DSP_RamWritten                 /* Note a RAM write             */
+    (
+    dsp_state_type *    dsp,        /* DSP whose RAM was written    */
+    int                 addr        /* Address written              */
+    );
+
+/* Must be called after the whole register file and/or RAM are replaced at
+   once. */
+void DSP_Loaded                     /* Note new DSP regs and RAM    */
+    (
+    dsp_state_type *    dsp         /* DSP loaded                   */
+    );
+
+/* Copies out everything about the DSP that isn't derived from its registers
+   and RAM, plus the registers themselves, in a layout specific to this
+   build.  The channel mask is left out. */
+void DSP_SaveState                  /* Save the state of a DSP      */
+    (
+    const dsp_state_type *
+                        dsp,        /* DSP to save                  */
+    void *              state       /* DSP_STATE_SIZE bytes to fill */
+    );
+
+/* The RAM the state was saved with must be restored too, before the DSP is
+   next run.  Implies DSP_Loaded(). */
+void DSP_LoadState                  /* Restore a saved DSP state    */
+    (
+    dsp_state_type *    dsp,        /* DSP to restore               */
+    const void *        state       /* From DSP_SaveState()         */
+    );
+
+/* Copies out which voices are keyed on and playing, what stage each
+   envelope is in, and the registers the CPU sets, for hashing into the
+   course of a song.  Left out is anything that depends on exactly how many
+   samples have passed, such as envelope heights, sample positions, noise
+   and echo, so that passes through the same music come out alike even if
+   their timing drifts apart by a few cycles.  RAM is not included. */
+void DSP_GetCourse                  /* Get the course of a DSP      */
+    (
+    const dsp_state_type *
+                        dsp,        /* DSP to describe              */
+    uint8_t *           course      /* DSP_COURSE_SIZE bytes to fill*/
+    );
+
+/* Returns nonzero if the DSP is silent and will stay so until the CPU
+   writes to it: output is muted, or no voice is keyed on or about to be
+   except at an envelope height of 0 that can't rise by itself, and the echo
+   volume is 0 or nothing louder than threshold is left in the echo region
+   or FIR history.  The latter reads the whole echo region, so is best not
+   done every sample. */
+int DSP_Silent                      /* Check for lasting silence    */
+    (
+    const dsp_state_type *
+                        dsp,        /* DSP to check                 */
+    int                 threshold   /* Largest echo sample heard as
+                                       silence                      */
+    );
 
 void DSP_Update                     /* Mix one sample of audio      */
     (
+    dsp_state_type *    dsp,        /* DSP to run                   */
     short *             sound_ptr   /* Pointer to mix audio into    */
     );
 
+/* Equivalent to calling DSP_Update() count times in a row, advancing
+   sound_ptr by one stereo sample each time, provided nothing else touches the
+   DSP registers or the memory it uses in between.  Much cheaper per sample
+   than DSP_Update().  With a NULL sound_ptr, only what the CPU can see or
+   future output depends on is kept up, which is cheaper still. */
+void DSP_RenderBlock                /* Mix a block of audio samples */
+    (
+    dsp_state_type *    dsp,        /* DSP to run                   */
+    short *             sound_ptr,  /* Pointer to mix audio into, or
+                                       NULL                         */
+    int                 count       /* Number of samples to mix     */
+    );
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
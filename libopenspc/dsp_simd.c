@@ -0,0 +1,406 @@
+/************************************************************************
+
+        Copyright (c) 2026 the OpenSPC contributors.
+
+This file is part of OpenSPC.
+
+OpenSPC is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+OpenSPC is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with OpenSPC; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+
+dsp_simd.c: implements the block-oriented inner loops of the DSP emulation.
+The functions defined in this file are shared only with dsp.c and not
+intended for external library use.
+
+ ************************************************************************/
+
+/*========== INCLUDES ==========*/
+
+#include "dsp_simd.h"
+#include "gauss.h"
+
+/*========== DEFINES ==========*/
+
+/* The vectorized implementations rely on GCC-style per-function target
+   attributes, so that the rest of the library doesn't need to be built for
+   any particular instruction set. */
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*========== CONSTANTS ==========*/
+
+/* Ptrs to Gaussian table */
+static const int *      G1 = &gauss[ 256 ];
+static const int *      G2 = &gauss[ 512 ];
+static const int *      G3 = &gauss[ 255 ];
+static const int *      G4 = &gauss[ -1  ];
+
+/*========== PROCEDURES ==========*/
+
+/***** InterpolateScalar *****/
+
+static void InterpolateScalar       /* Portable implementation      */
+    (
+    interp_block_type * ib,         /* Data to interpolate          */
+    int                 start,      /* First sample to interpolate  */
+    int                 count       /* Number of samples in block   */
+    )
+{
+int                     s;
+int                     vl;
+int                     vr;
+
+for( s = start; s < count; s++ )
+    {
+    /* Perform 4-Point Gaussian interpolation.  Take an approximation of a
+       Gaussian bell-curve, and move it through the sample data at a rate
+       determined by the pitch.  The sample output at any given time is the
+       sum of the products of each input sample point with the value of the
+       bell-curve corresponding to that point. */
+    vl  = ib->phase[ s ] - 256;
+    vr  = ( ( G4[ -vl ] * ib->smp[ 0 ][ s ] ) >> 11 ) & ~1;
+    vr += ( ( G3[ -vl ] * ib->smp[ 1 ][ s ] ) >> 11 ) & ~1;
+    vr += ( ( G2[ vl ]  * ib->smp[ 2 ][ s ] ) >> 11 ) & ~1;
+
+    /* This is to do the wrapping properly.  Based on my tests with the SNES,
+       it appears clipping is done only if it is the fourth addition that
+       would cause a wrap.  If it has already wrapped before the fourth
+       addition, it is not clipped. */
+    vr  = ( signed short )vr;
+    vr += ( ( G1[ vl ]  * ib->smp[ 3 ][ s ] ) >> 11 ) & ~1;
+    if( vr > 32767 )
+        {
+        vr = 32767;
+        }
+    else if( vr < -32768 )
+        {
+        vr = -32768;
+        }
+    ib->out[ s ] = vr;
+    }
+
+}   /* InterpolateScalar() */
+
+
+#ifdef HAVE_X86_SIMD
+
+/***** InterpolateSSE41 *****/
+
+__attribute__(( target( "sse4.1" ) ))
+static int InterpolateSSE41         /* 4 samples at a time; returns
+                                       number of samples done       */
+    (
+    interp_block_type * ib,         /* Data to interpolate          */
+    int                 count       /* Number of samples in block   */
+    )
+{
+const __m128i           even = _mm_set1_epi32( ~1 );
+const int *             p;
+__m128i                 g1;
+__m128i                 g2;
+__m128i                 g3;
+__m128i                 g4;
+int                     s;
+__m128i                 vr;
+
+for( s = 0; s + 4 <= count; s += 4 )
+    {
+    p  = &ib->phase[ s ];
+    g4 = _mm_setr_epi32(
+                       gauss[ 255 - p[ 0 ] ], gauss[ 255 - p[ 1 ] ],
+                       gauss[ 255 - p[ 2 ] ], gauss[ 255 - p[ 3 ] ]
+                       );
+    g3 = _mm_setr_epi32(
+                       gauss[ 511 - p[ 0 ] ], gauss[ 511 - p[ 1 ] ],
+                       gauss[ 511 - p[ 2 ] ], gauss[ 511 - p[ 3 ] ]
+                       );
+    g2 = _mm_setr_epi32(
+                       gauss[ 256 + p[ 0 ] ], gauss[ 256 + p[ 1 ] ],
+                       gauss[ 256 + p[ 2 ] ], gauss[ 256 + p[ 3 ] ]
+                       );
+    g1 = _mm_setr_epi32(
+                       gauss[ p[ 0 ] ], gauss[ p[ 1 ] ],
+                       gauss[ p[ 2 ] ], gauss[ p[ 3 ] ]
+                       );
+
+    /* Products fit easily in 32 bits, so this matches the scalar version
+       exactly, including the wrap after the third addition. */
+    vr = _mm_and_si128(
+           _mm_srai_epi32(
+             _mm_mullo_epi32(
+               g4, _mm_loadu_si128( ( const __m128i * )&ib->smp[ 0 ][ s ] ) ),
+             11 ),
+           even );
+    vr = _mm_add_epi32( vr, _mm_and_si128(
+           _mm_srai_epi32(
+             _mm_mullo_epi32(
+               g3, _mm_loadu_si128( ( const __m128i * )&ib->smp[ 1 ][ s ] ) ),
+             11 ),
+           even ) );
+    vr = _mm_add_epi32( vr, _mm_and_si128(
+           _mm_srai_epi32(
+             _mm_mullo_epi32(
+               g2, _mm_loadu_si128( ( const __m128i * )&ib->smp[ 2 ][ s ] ) ),
+             11 ),
+           even ) );
+    vr = _mm_srai_epi32( _mm_slli_epi32( vr, 16 ), 16 );
+    vr = _mm_add_epi32( vr, _mm_and_si128(
+           _mm_srai_epi32(
+             _mm_mullo_epi32(
+               g1, _mm_loadu_si128( ( const __m128i * )&ib->smp[ 3 ][ s ] ) ),
+             11 ),
+           even ) );
+    vr = _mm_min_epi32( _mm_max_epi32( vr, _mm_set1_epi32( -32768 ) ),
+                        _mm_set1_epi32( 32767 ) );
+    _mm_storeu_si128( ( __m128i * )&ib->out[ s ], vr );
+    }
+
+return( s );
+
+}   /* InterpolateSSE41() */
+
+
+/***** InterpolateAVX2 *****/
+
+__attribute__(( target( "avx2" ) ))
+static int InterpolateAVX2          /* 8 samples at a time; returns
+                                       number of samples done       */
+    (
+    interp_block_type * ib,         /* Data to interpolate          */
+    int                 count       /* Number of samples in block   */
+    )
+{
+const __m256i           even = _mm256_set1_epi32( ~1 );
+__m256i                 ph;
+int                     s;
+__m256i                 vr;
+
+for( s = 0; s + 8 <= count; s += 8 )
+    {
+    ph = _mm256_loadu_si256( ( const __m256i * )&ib->phase[ s ] );
+
+    vr = _mm256_and_si256(
+           _mm256_srai_epi32(
+             _mm256_mullo_epi32(
+               _mm256_i32gather_epi32(
+                 gauss, _mm256_sub_epi32( _mm256_set1_epi32( 255 ), ph ), 4 ),
+               _mm256_loadu_si256( ( const __m256i * )&ib->smp[ 0 ][ s ] ) ),
+             11 ),
+           even );
+    vr = _mm256_add_epi32( vr, _mm256_and_si256(
+           _mm256_srai_epi32(
+             _mm256_mullo_epi32(
+               _mm256_i32gather_epi32(
+                 gauss, _mm256_sub_epi32( _mm256_set1_epi32( 511 ), ph ), 4 ),
+               _mm256_loadu_si256( ( const __m256i * )&ib->smp[ 1 ][ s ] ) ),
+             11 ),
+           even ) );
+    vr = _mm256_add_epi32( vr, _mm256_and_si256(
+           _mm256_srai_epi32(
+             _mm256_mullo_epi32(
+               _mm256_i32gather_epi32(
+                 gauss, _mm256_add_epi32( _mm256_set1_epi32( 256 ), ph ), 4 ),
+               _mm256_loadu_si256( ( const __m256i * )&ib->smp[ 2 ][ s ] ) ),
+             11 ),
+           even ) );
+    vr = _mm256_srai_epi32( _mm256_slli_epi32( vr, 16 ), 16 );
+    vr = _mm256_add_epi32( vr, _mm256_and_si256(
+           _mm256_srai_epi32(
+             _mm256_mullo_epi32(
+               _mm256_i32gather_epi32( gauss, ph, 4 ),
+               _mm256_loadu_si256( ( const __m256i * )&ib->smp[ 3 ][ s ] ) ),
+             11 ),
+           even ) );
+    vr = _mm256_min_epi32(
+                         _mm256_max_epi32( vr, _mm256_set1_epi32( -32768 ) ),
+                         _mm256_set1_epi32( 32767 )
+                         );
+    _mm256_storeu_si256( ( __m256i * )&ib->out[ s ], vr );
+    }
+
+return( s );
+
+}   /* InterpolateAVX2() */
+
+#endif                              /* defined( HAVE_X86_SIMD )     */
+
+
+/***** EchoFIRScalar *****/
+
+static void EchoFIRScalar           /* Portable implementation      */
+    (
+    const int *         coef,       /* Coefs, oldest input first    */
+    const int *         in,         /* Input, oldest first          */
+    int *               out,        /* Filter output                */
+    int                 start,      /* First sample to filter       */
+    int                 count       /* Number of samples in block   */
+    )
+{
+int                     j;
+int                     s;
+int                     v;
+
+for( s = start; s < count; s++ )
+    {
+    v = 0;
+    for( j = 0; j < DSP_FIR_LEN; j++ )
+        {
+        v += coef[ j ] * in[ s + j ];
+        }
+    out[ s ] = v;
+    }
+
+}   /* EchoFIRScalar() */
+
+
+#ifdef HAVE_X86_SIMD
+
+/***** EchoFIRSSE41 *****/
+
+__attribute__(( target( "sse4.1" ) ))
+static int EchoFIRSSE41             /* 4 samples at a time; returns
+                                       number of samples done       */
+    (
+    const int *         coef,       /* Coefs, oldest input first    */
+    const int *         in,         /* Input, oldest first          */
+    int *               out,        /* Filter output                */
+    int                 count       /* Number of samples in block   */
+    )
+{
+__m128i                 c[ DSP_FIR_LEN ];
+int                     j;
+int                     s;
+__m128i                 v;
+
+for( j = 0; j < DSP_FIR_LEN; j++ )
+    {
+    c[ j ] = _mm_set1_epi32( coef[ j ] );
+    }
+
+/* Inputs are 16 bits and coefficients 8, so the sums can't overflow and
+   the order they're added in doesn't matter. */
+for( s = 0; s + 4 <= count; s += 4 )
+    {
+    v = _mm_setzero_si128();
+    for( j = 0; j < DSP_FIR_LEN; j++ )
+        {
+        v = _mm_add_epi32( v, _mm_mullo_epi32(
+              c[ j ], _mm_loadu_si128( ( const __m128i * )&in[ s + j ] ) ) );
+        }
+    _mm_storeu_si128( ( __m128i * )&out[ s ], v );
+    }
+
+return( s );
+
+}   /* EchoFIRSSE41() */
+
+
+/***** EchoFIRAVX2 *****/
+
+__attribute__(( target( "avx2" ) ))
+static int EchoFIRAVX2              /* 8 samples at a time; returns
+                                       number of samples done       */
+    (
+    const int *         coef,       /* Coefs, oldest input first    */
+    const int *         in,         /* Input, oldest first          */
+    int *               out,        /* Filter output                */
+    int                 count       /* Number of samples in block   */
+    )
+{
+__m256i                 c[ DSP_FIR_LEN ];
+int                     j;
+int                     s;
+__m256i                 v;
+
+for( j = 0; j < DSP_FIR_LEN; j++ )
+    {
+    c[ j ] = _mm256_set1_epi32( coef[ j ] );
+    }
+
+for( s = 0; s + 8 <= count; s += 8 )
+    {
+    v = _mm256_setzero_si256();
+    for( j = 0; j < DSP_FIR_LEN; j++ )
+        {
+        v = _mm256_add_epi32( v, _mm256_mullo_epi32(
+              c[ j ],
+              _mm256_loadu_si256( ( const __m256i * )&in[ s + j ] ) ) );
+        }
+    _mm256_storeu_si256( ( __m256i * )&out[ s ], v );
+    }
+
+return( s );
+
+}   /* EchoFIRAVX2() */
+
+#endif                              /* defined( HAVE_X86_SIMD )     */
+
+
+/* Privately shared functions (for internal library use only) */
+
+/***** DSP_Interpolate *****/
+
+void DSP_Interpolate                /* 4-pt Gaussian interpolation  */
+    (
+    interp_block_type * ib,         /* Data to interpolate          */
+    int                 count       /* Number of samples in block   */
+    )
+{
+int                     done;
+
+done = 0;
+#ifdef HAVE_X86_SIMD
+if( __builtin_cpu_supports( "avx2" ) )
+    {
+    done = InterpolateAVX2( ib, count );
+    }
+else if( __builtin_cpu_supports( "sse4.1" ) )
+    {
+    done = InterpolateSSE41( ib, count );
+    }
+#endif
+InterpolateScalar( ib, done, count );
+
+}   /* DSP_Interpolate() */
+
+
+/***** DSP_EchoFIR *****/
+
+void DSP_EchoFIR                    /* Echo FIR filter              */
+    (
+    const int *         coef,       /* Coefs, oldest input first    */
+    const int *         in,         /* Input, oldest first          */
+    int *               out,        /* Filter output                */
+    int                 count       /* Number of samples in block   */
+    )
+{
+int                     done;
+
+done = 0;
+#ifdef HAVE_X86_SIMD
+if( __builtin_cpu_supports( "avx2" ) )
+    {
+    done = EchoFIRAVX2( coef, in, out, count );
+    }
+else if( __builtin_cpu_supports( "sse4.1" ) )
+    {
+    done = EchoFIRSSE41( coef, in, out, count );
+    }
+#endif
+EchoFIRScalar( coef, in, out, done, count );
+
+}   /* DSP_EchoFIR() */
@@ -0,0 +1,79 @@
+/************************************************************************
+
+        Copyright (c) 2026 the OpenSPC contributors.
+
+This file is part of OpenSPC.
+
+OpenSPC is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+OpenSPC is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with OpenSPC; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+
+dsp_simd.h: defines the inner loops of the DSP emulation that operate on a
+whole block of samples at once.  Each one has a portable implementation, as
+well as vectorized implementations that are selected at runtime when the
+host CPU supports them.  All implementations produce identical results.
+These are not intended for external library use.
+
+ ************************************************************************/
+
+#if !defined _DSP_SIMD_H
+#define _DSP_SIMD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*========== CONSTANTS ==========*/
+
+#define DSP_BLOCK_LEN   ( 64 )      /* Max samples mixed in one pass*/
+#define DSP_FIR_LEN     ( 8 )       /* Taps in the echo FIR filter  */
+
+/*========== TYPES ==========*/
+
+typedef struct                      /* Gaussian interpolation data  */
+    {
+    int             phase[ DSP_BLOCK_LEN ];
+                                    /* Position between smp[ 1 ] and
+                                       smp[ 2 ], 0-255              */
+    int             smp[ 4 ][ DSP_BLOCK_LEN ];
+                                    /* Input samples, oldest first  */
+    int             out[ DSP_BLOCK_LEN ];
+                                    /* Interpolated output          */
+    } interp_block_type;
+
+/*========== PROCEDURES ==========*/
+
+void DSP_Interpolate                /* 4-pt Gaussian interpolation  */
+    (
+    interp_block_type * ib,         /* Data to interpolate          */
+    int                 count       /* Number of samples in block   */
+    );
+
+/* Computes out[ s ] as the sum of coef[ j ] * in[ s + j ] over all
+   DSP_FIR_LEN taps j, for each of count samples s.  in must therefore hold
+   count + DSP_FIR_LEN - 1 values. */
+void DSP_EchoFIR                    /* Echo FIR filter              */
+    (
+    const int *         coef,       /* Coefs, oldest input first    */
+    const int *         in,         /* Input, oldest first          */
+    int *               out,        /* Filter output                */
+    int                 count       /* Number of samples in block   */
+    );
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  /* _DSP_SIMD_H */
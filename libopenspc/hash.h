@@ -0,0 +1,43 @@
+/************************************************************************
+
+        Copyright (c) 2026 the OpenSPC contributors.
+
+This file is part of OpenSPC.
+
+OpenSPC is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+OpenSPC is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with OpenSPC; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ ************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace openspc {
+
+/// 64-bit FNV-1a parameters, for hashing the course of a song.
+constexpr uint64_t kHashBasis = 0xCBF29CE484222325;
+constexpr uint64_t kHashPrime = 0x100000001B3;
+
+/// Folds @p len bytes at @p data into the 64-bit FNV-1a hash @p hash.
+inline uint64_t HashBytes(uint64_t hash, const void* data, size_t len) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ bytes[i]) * kHashPrime;
+  }
+  return hash;
+}
+
+}  // namespace openspc
@@ -27,26 +27,42 @@ library.
 
 #include "openspc.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <map>
 #include <memory>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "dsp.h"
+#include "hash.h"
 #include "spc_cpu.h"
 
 namespace {
 
-/// Class to maintain the context for one SPC simulation.
-// TODO(bmartin) Currently this class operates on some global state, which
-// means no more than one of these is allowed to exist in a process.
-// Eventually this should change.
+/// Class to maintain the context for one SPC simulation.  All simulation state
+/// lives in this object, so independent instances may be run concurrently.
 class SpcContext {
  public:
-  SpcContext() : spc_cpu_(DSPregs) {
-    channel_mask = 0;
-    DSP_Reset();
+  SpcContext() : dsp_(), spc_cpu_(dsp_.regs) {
+    dsp_.ram = spc_cpu_.ram();
+    dsp_.echo_written = &SpcContext::EchoWritten;
+    dsp_.echo_opaque = this;
+    dsp_.channel_mask = 0;
+    DSP_Reset(&dsp_);
+    spc_cpu_.SetDspCallbacks({&SpcContext::DspSync, &SpcContext::DspRegWritten,
+                              &SpcContext::DspRamWritten, this});
   }
 
+  // The CPU keeps a pointer to this object.
+  SpcContext(const SpcContext&) = delete;
+  SpcContext& operator=(const SpcContext&) = delete;
+
   /// Loads a savestate from file content in memory.  State file format is
   /// auto-detected.
   ///
@@ -65,19 +81,76 @@ class SpcContext {
     // New file formats could go on from here.
 
     if (success && clear_echo) {
-      const int start = DSPregs[0x6D] << 8;
-      int len = DSPregs[0x7D] << 11;
+      const int start = dsp_.regs[0x6D] << 8;
+      int len = dsp_.regs[0x7D] << 11;
       if (start + len > 0x10000) {
         len = 0x10000 - start;
         // TODO(bmartin) Does this wrap around?  Do we need to clear at the
         // beginning of memory too?
       }
       std::memset(&spc_cpu_.ram()[start], 0, len);
+      spc_cpu_.RamWritten(start, len);
     }
+    DSP_Loaded(&dsp_);
 
     return success;
   }
 
+  /// Size of the snapshots taken by SaveState().
+  static size_t state_size() {
+    return sizeof(StateHeader) + openspc::SpcCpu::state_size() +
+           DSP_STATE_SIZE;
+  }
+
+  /// Takes a snapshot of the complete state of the simulation, which can be
+  /// restored with LoadState(), into this or any other context.  Snapshots
+  /// are laid out as the data is in memory, so only the same build of the
+  /// library can restore them.  The CPU core and channel mask are settings
+  /// rather than state, and are not included.
+  ///
+  /// @param buf points to state_size() bytes to write the snapshot to.
+  void SaveState(uint8_t* buf) const {
+    StateHeader header = {};
+    std::memcpy(header.magic, kStateMagic, sizeof(header.magic));
+    header.version = kStateVersion;
+    header.size = state_size();
+    header.now = now_;
+    header.next_sample = next_sample_;
+    std::memcpy(header.carry, carry_, sizeof(header.carry));
+    header.carry_count = carry_count_;
+    std::memcpy(buf, &header, sizeof(header));
+    buf += sizeof(header);
+    spc_cpu_.SaveState(buf);
+    DSP_SaveState(&dsp_, buf + openspc::SpcCpu::state_size());
+  }
+
+  /// How a buffer compares with the snapshots this build takes.
+  enum class StateMatch { kMatch, kNotSnapshot, kOtherVersion };
+
+  /// Restores a snapshot taken by SaveState().  Any keyframes are dropped,
+  /// and so is any loop found, with the search starting over, or end found.
+  ///
+  /// @param buf points to the snapshot.
+  /// @param size is the number of bytes in the snapshot.
+  /// @return StateMatch::kMatch if successful.  Otherwise nothing is
+  ///         changed, and StateMatch::kOtherVersion is returned if @p buf
+  ///         holds a snapshot of another format version than kStateVersion,
+  ///         or StateMatch::kNotSnapshot if it holds none this build can
+  ///         load.
+  StateMatch LoadState(const uint8_t* buf, size_t size) {
+    const StateMatch match = MatchState(buf, size);
+    if (match != StateMatch::kMatch) {
+      return match;
+    }
+    RestoreState(buf);
+    keyframes_.clear();
+    if (detect_loop_) {
+      StartLoopDetection();
+    }
+    ClearEnd();
+    return StateMatch::kMatch;
+  }
+
   /// Run the emulation, emitting sound samples to the given buffer, until
   /// either the given cycle limit is reached, or the given amount of buffer
   /// space is filled, whichever comes first.
@@ -88,63 +161,224 @@ class SpcContext {
   /// @param buf_size the size of the given buffer in bytes.  Ignored if buf
   ///        is null.
   /// @return the number of bytes that were either written to the buffer, or
-  ///         would have been had @p buf not been null.
+  ///         would have been had @p buf not been null.  This falls short if
+  ///         the song ends, or leading silence is skipped; see
+  ///         set_end_detection() and set_skip_silence().
   int Run(int cycle_limit, int16_t* buf, size_t buf_size) {
-    static constexpr int kWordsPerSample = 2;
-    static constexpr int kBytesPerSample = kWordsPerSample * sizeof(*buf);
-
-    const int buf_cycles = (buf_size / kBytesPerSample) * TS_CYC + mix_left_;
-    const int buf_inc = buf ? kWordsPerSample : 0;
-
-    if ((cycle_limit < 0) || (buf && (cycle_limit >= buf_cycles))) {
+    // Samples already rendered by the CPU overrunning the previous call are
+    // handed out first.
+    const uint64_t first_sample = next_sample_ - carry_count_ * TS_CYC;
+    const uint64_t buf_end =
+        first_sample + (buf_size / kBytesPerSample) * TS_CYC;
+    uint64_t end;
+    if ((cycle_limit < 0) || (buf && (now_ + cycle_limit >= buf_end))) {
       // Buffer size is the limiting factor.
-      buf_size &= ~(kBytesPerSample - 1);
-      if (mix_left_) {
-        spc_cpu_.Run(mix_left_);
-      }
-      for (size_t i = 0; i < buf_size; i += kBytesPerSample, buf += buf_inc) {
-        DSP_Update(buf);
-        spc_cpu_.Run(TS_CYC);
+      end = buf_end;
+    } else {
+      // Otherwise, use the cycle limit.
+      end = now_ + cycle_limit;
+    }
+
+    // Stop wherever a keyframe falls due to record it.  Running in parts
+    // renders the same as running all at once.
+    int rendered = 0;
+    while (keyframe_interval_ && (ended_ == End::kNone)) {
+      RecordKeyframe();
+      const uint64_t next =
+          (now_ / keyframe_interval_ + 1) * keyframe_interval_;
+      if (next >= end) {
+        break;
       }
-      mix_left_ = 0;
-      return buf_size;
+      rendered +=
+          RunUntil(next, buf ? &buf[rendered * kWordsPerSample] : nullptr);
     }
+    rendered += RunUntil(end, buf ? &buf[rendered * kWordsPerSample] : nullptr);
+    return kBytesPerSample * rendered;
+  }
 
-    // Otherwise, use the cycle limit.
-    if (cycle_limit < mix_left_) {
-      spc_cpu_.Run(cycle_limit);
-      mix_left_ -= cycle_limit;
-      return 0;
+  /// Sets the interval, in cycles, between the keyframes Run() records for
+  /// Seek() to start from.  Every time the simulation reaches a multiple of
+  /// it, a snapshot is kept, unless one was already kept at that time.  Zero,
+  /// the default, records none.  Changing the interval drops any keyframes
+  /// already kept.
+  void set_keyframe_interval(uint64_t interval) {
+    if (interval != keyframe_interval_) {
+      keyframes_.clear();
     }
-    if (mix_left_) {
-      spc_cpu_.Run(mix_left_);
-      cycle_limit -= mix_left_;
+    keyframe_interval_ = interval;
+  }
+
+  /// Moves the simulation to @p time, as if it had been run there without
+  /// any output, starting from the latest keyframe at or before that time if
+  /// that is closer than where it already is.
+  ///
+  /// Seeking goes on past the end of the song, and clears any end found.
+  ///
+  /// @param time is in cycles since the state was loaded.
+  /// @return false, with nothing changed, if @p time has already passed and
+  ///         there is no keyframe to go back to.
+  bool Seek(uint64_t time) {
+    auto keyframe = keyframes_.upper_bound(time);
+    if (keyframe != keyframes_.begin()) {
+      --keyframe;
+      if ((now_ > time) || (keyframe->first > now_)) {
+        RestoreState(keyframe->second.data());
+      }
     }
-    int samples_written = 0;
-    for (; cycle_limit >= TS_CYC; cycle_limit -= TS_CYC) {
-      DSP_Update(buf);
-      spc_cpu_.Run(TS_CYC);
-      ++samples_written;
-      buf += buf_inc;
+    if (now_ > time) {
+      return false;
     }
-    if (cycle_limit) {
-      DSP_Update(buf);
-      spc_cpu_.Run(cycle_limit);
-      mix_left_ = TS_CYC - cycle_limit;
-      ++samples_written;
+    const uint64_t end_silence = end_silence_;
+    end_silence_ = 0;
+    ended_ = End::kNone;
+    while (now_ < time) {
+      Run(std::min(time - now_, uint64_t{kMaxSeekStep}), nullptr, 0);
     }
-    return kBytesPerSample * samples_written;
+    end_silence_ = end_silence;
+    ClearEnd();
+    return true;
   }
 
+  /// Emulated time, in cycles since the state was loaded.
+  uint64_t position() const { return now_; }
+
+  /// Starts or stops looking for the point where the song loops.  While
+  /// looking, the state of the simulation is hashed every time the CPU keys
+  /// on a note.  Only the course of the song is hashed: RAM other than the
+  /// echo region, which just holds what was recently played, and what
+  /// SpcCpu::HashState() and DSP_GetCourse() cover.  That can come out the
+  /// same at two points that don't go on alike, so the song is only taken
+  /// to loop once a hash has been seen three times, at two intervals equal
+  /// to within kLoopTolerance, which ends the search.  The loop starts
+  /// where the hash was first seen.  The exact timing drifts by a few
+  /// cycles from one pass through the song to the next, so the loop is only
+  /// accurate to about a sample.  Starting clears any loop found before.
+  void set_loop_detection(bool enable) {
+    detect_loop_ = enable;
+    if (enable) {
+      StartLoopDetection();
+    } else {
+      loop_hashes_.clear();
+      UnhashPages();
+    }
+  }
+
+  /// Where the song was found to loop, if it has been.
+  ///
+  /// @param start receives the index of the first sample of the loop,
+  ///        counting samples since the state was loaded.
+  /// @param length receives the length of the loop in samples.
+  /// @return false, leaving @p start and @p length alone, if no loop has
+  ///         been found.
+  bool loop(uint64_t* start, uint64_t* length) const {
+    if (!loop_length_) {
+      return false;
+    }
+    *start = loop_start_;
+    *length = loop_length_;
+    return true;
+  }
+
+  /// Why Run() stopped short of what it was asked for; see
+  /// set_end_detection().
+  enum class End { kNone, kHalted, kSilence };
+
+  /// Sets how long, in cycles, the output must stay silent for the song to be
+  /// taken to have ended, or 0, the default, for it never to be.  Silence is
+  /// as DSP_Silent() sees it, checked every kEndCheckCycles, so the end falls
+  /// up to that long after the point the timeout runs out.  A CPU that has
+  /// halted can never break the silence, so that ends the song at the first
+  /// silent check instead, while one still idling along ends it once the
+  /// timeout passes.  Run() stops at the end, and hands out nothing more
+  /// until it is cleared by calling this again, LoadState(), Seek() or
+  /// WritePort().
+  void set_end_detection(uint64_t silence) {
+    end_silence_ = silence;
+    ClearEnd();
+  }
+  End end() const { return ended_; }
+
+  /// Starts or stops skipping leading silence.  While skipping, samples that
+  /// fall due while DSP_Silent() holds are rendered without being handed out,
+  /// so Run() hands out fewer than it otherwise would.  The first sample
+  /// heard stops the skipping, and so does its end, if it comes first.
+  void set_skip_silence(bool enable) { skip_silence_ = enable; }
+
   /// Perform a write to one of the SPC-CPU's four incoming communication
   /// ports, as if the SNES-CPU had written to the SPC.
-  void WritePort(int index, uint8_t data) { spc_cpu_.WritePort(index, data); }
+  /// Keyframes from this time on no longer show what happens next, and are
+  /// dropped.  Nor can a loop be taken to go on regardless, so the search
+  /// for one starts over, nor can the song be taken to have ended.
+  void WritePort(int index, uint8_t data) {
+    keyframes_.erase(keyframes_.lower_bound(now_), keyframes_.end());
+    if (detect_loop_) {
+      StartLoopDetection();
+    }
+    ClearEnd();
+    spc_cpu_.WritePort(index, data);
+  }
 
   /// Perform a read from one of the SPC-CPU's four outgoing communication
   /// ports, as if the SNES-CPU had read from the SPC.
   uint8_t ReadPort(int index) { return spc_cpu_.ReadPort(index); }
 
+  /// Select the CPU core; see openspc::SpcCpu::Core.
+  void set_cpu_core(openspc::SpcCpu::Core core) {
+    spc_cpu_.set_core(core);
+    overrun_ = (core != openspc::SpcCpu::Core::kCycleExact)
+                   ? openspc::SpcCpu::kMaxOverrun
+                   : 0;
+  }
+  openspc::SpcCpu::Core cpu_core() const { return spc_cpu_.core(); }
+
+  /// See openspc::SpcCpu::divergence().
+  std::string cpu_divergence() const { return spc_cpu_.divergence(); }
+
+  /// Whether the CPU has halted; see openspc::SpcCpu::halted().
+  bool cpu_halted() const { return spc_cpu_.halted(); }
+
+  /// Set the mask of DSP channels that are *not* to be heard.
+  void set_channel_mask(int mask) { dsp_.channel_mask = mask; }
+  int channel_mask() const { return dsp_.channel_mask; }
+
  private:
+  /// Checks the header of a snapshot, first for the format version it was
+  /// written in, then for the size of its parts, which only differs between
+  /// builds if the version was not bumped as it should have been.
+  static StateMatch MatchState(const uint8_t* buf, size_t size) {
+    StateHeader header;
+    if (size < sizeof(header)) {
+      return StateMatch::kNotSnapshot;
+    }
+    std::memcpy(&header, buf, sizeof(header));
+    if (std::memcmp(header.magic, kStateMagic, sizeof(header.magic)) != 0) {
+      return StateMatch::kNotSnapshot;
+    }
+    if (header.version != kStateVersion) {
+      return StateMatch::kOtherVersion;
+    }
+    if ((header.size != state_size()) || (size < state_size())) {
+      return StateMatch::kNotSnapshot;
+    }
+    return StateMatch::kMatch;
+  }
+
+  /// Restores a snapshot that passed MatchState(), keeping the keyframes.
+  void RestoreState(const uint8_t* buf) {
+    StateHeader header;
+    std::memcpy(&header, buf, sizeof(header));
+    now_ = header.now;
+    next_sample_ = header.next_sample;
+    std::memcpy(carry_, header.carry, sizeof(carry_));
+    carry_count_ = header.carry_count;
+    buf += sizeof(header);
+    // The DSP registers go first, as the lockstep core copies them when the
+    // CPU is restored.
+    DSP_LoadState(&dsp_, buf + openspc::SpcCpu::state_size());
+    spc_cpu_.LoadState(buf);
+    UnhashPages();
+  }
+
   /// Loads .spc file content into the simulation.
   ///
   /// @param buf points to the file content already in memory.
@@ -177,7 +411,7 @@ class SpcContext {
     spc_cpu_.SetState(buf[kPcOffset] + (buf[kPcOffset + 1] << 8), buf[kAOffset],
                       buf[kXOffset], buf[kYOffset], buf[kPSWOffset],
                       0x100 + buf[kSPOffset], &buf[kRamOffset]);
-    std::memcpy(DSPregs, &buf[kDspOffset], kDspLen);
+    std::memcpy(dsp_.regs, &buf[kDspOffset], kDspLen);
 
     return true;
   }
@@ -232,61 +466,742 @@ class SpcContext {
     spc_cpu_.SetState(buf[kPcOffset] + (buf[kPcOffset + 1] << 8), buf[kAOffset],
                       buf[kXOffset], buf[kYOffset], psw, 0x100 + buf[kSPOffset],
                       &buf[kRamOffset]);
-    std::memcpy(DSPregs, &buf[kDspOffset], kDspLen);
+    std::memcpy(dsp_.regs, &buf[kDspOffset], kDspLen);
     // This is a hack to turn on voices that were already on when the state
     // was saved.  This doesn't restore the entire state of the voice, it just
     // starts it over from the beginning.
     for (int v = 0; v < 8; ++v) {
       if (buf[kVOnOffset + v]) {
-        DSPregs[0x4C] |= 1 << v;
+        dsp_.regs[0x4C] |= 1 << v;
       }
     }
     return true;
   }
 
+  /// Runs until time @p end, handing out samples to @p buf, which may be
+  /// null, as Run() does.
+  ///
+  /// @return the number of samples handed out.
+  int RunUntil(uint64_t end, int16_t* buf) {
+    const uint64_t first_sample = next_sample_ - carry_count_ * TS_CYC;
+
+    // Let the CPU run freely for up to a slice at a time.  Samples falling
+    // due within a slice are rendered whenever the CPU is about to access
+    // something the DSP shares with it, and otherwise at the end of the slice.
+    // Once the CPU has halted, the rest of the call is a single slice, unless
+    // the end of the song is to be checked for along the way.
+    out_ = buf;
+    out_inc_ = buf ? kWordsPerSample : 0;
+    samples_rendered_ = 0;
+    end_ = end;
+    int carried = 0;
+    while ((carried < carry_count_) &&
+           (first_sample + carried * TS_CYC < end)) {
+      ++carried;
+    }
+    if (carried) {
+      if (out_) {
+        std::memcpy(out_, carry_, carried * kBytesPerSample);
+      }
+      out_ += carried * out_inc_;
+      samples_rendered_ = carried;
+      carry_count_ -= carried;
+      std::memmove(carry_, &carry_[carried * kWordsPerSample],
+                   carry_count_ * kBytesPerSample);
+    }
+    while ((now_ < end) && (ended_ == End::kNone)) {
+      slice_end_ = spc_cpu_.halted()
+                       ? end
+                       : now_ + std::min(end - now_, uint64_t{kSliceCycles});
+      if (end_silence_) {
+        slice_end_ = std::min(slice_end_, next_end_check_);
+      }
+      UpdateWatch();
+      spc_cpu_.Run(slice_end_ - now_);
+      now_ = slice_end_;
+      RenderUntil(now_ - 1);
+      if (end_silence_ && (now_ >= next_end_check_)) {
+        CheckEnd();
+      }
+    }
+    return samples_rendered_;
+  }
+
+  /// Forgets any end found, and any silence heard before now.
+  void ClearEnd() {
+    ended_ = End::kNone;
+    last_heard_ = now_;
+    next_end_check_ = now_ + kEndCheckCycles;
+  }
+
+  /// Ends the song if it has been silent since the last check that heard
+  /// anything for long enough, or at all with the CPU halted.
+  void CheckEnd() {
+    next_end_check_ = now_ + kEndCheckCycles;
+    if (!DSP_Silent(&dsp_, kSilenceThreshold)) {
+      last_heard_ = now_;
+    } else if (spc_cpu_.halted()) {
+      ended_ = End::kHalted;
+      skip_silence_ = false;
+    } else if (now_ - last_heard_ >= end_silence_) {
+      ended_ = End::kSilence;
+      skip_silence_ = false;
+    }
+  }
+
+  /// Keeps a snapshot of the current state if a keyframe is due now and has
+  /// not been recorded yet.
+  void RecordKeyframe() {
+    if ((now_ % keyframe_interval_ != 0) || keyframes_.count(now_)) {
+      return;
+    }
+    std::vector<uint8_t>& keyframe = keyframes_[now_];
+    keyframe.resize(state_size());
+    SaveState(keyframe.data());
+  }
+
+  /// Forgets any loop found, and every state hashed so far.
+  void StartLoopDetection() {
+    loop_hashes_.clear();
+    loop_start_ = 0;
+    loop_length_ = 0;
+    UnhashPages();
+  }
+
+  /// Marks every RAM page to be hashed again.
+  void UnhashPages() {
+    std::fill(std::begin(page_hashed_), std::end(page_hashed_), false);
+    notify_changed_ = true;
+  }
+
+  /// Hashes the state of the simulation as of the DSP register write just
+  /// made, which the next sample due is the first to hear, and ends the
+  /// search for a loop if the same hash was seen at an earlier sample.
+  void CheckLoop() {
+    const uint64_t sample = next_sample_ / TS_CYC;
+    uint64_t hash = HashRam();
+    hash = spc_cpu_.HashState(hash);
+    uint8_t course[DSP_COURSE_SIZE];
+    DSP_GetCourse(&dsp_, course);
+    hash = openspc::HashBytes(hash, course, sizeof(course));
+
+    std::vector<uint64_t>& seen = loop_hashes_[hash];
+    const auto at = std::lower_bound(seen.begin(), seen.end(), sample);
+    // Going back over the same ground after a Seek() finds the same hashes
+    // again in the same places, which is no loop.
+    if ((at != seen.end()) && (*at == sample)) {
+      return;
+    }
+    seen.insert(at, sample);
+
+    // Look for a third sighting, before or after this and one other, at the
+    // same interval again.
+    for (const uint64_t other : seen) {
+      const uint64_t first = std::min(other, sample);
+      const uint64_t second = std::max(other, sample);
+      const uint64_t length = second - first;
+      if (length <= kLoopTolerance) {
+        continue;
+      }
+      uint64_t found;
+      if ((first >= length) && FindSighting(seen, first - length, &found)) {
+        loop_start_ = found;
+        loop_length_ = first - found;
+      } else if (FindSighting(seen, second + length, &found)) {
+        loop_start_ = first;
+        loop_length_ = length;
+      } else {
+        continue;
+      }
+      loop_hashes_.clear();
+      UnhashPages();
+      return;
+    }
+  }
+
+  /// Finds the sample in @p seen, which is sorted, within kLoopTolerance of
+  /// @p sample, if there is one, and stores it to @p found.
+  static bool FindSighting(const std::vector<uint64_t>& seen, uint64_t sample,
+                           uint64_t* found) {
+    const auto at = std::lower_bound(
+        seen.begin(), seen.end(), sample - std::min(sample, kLoopTolerance));
+    if ((at == seen.end()) || (*at > sample + kLoopTolerance)) {
+      return false;
+    }
+    *found = *at;
+    return true;
+  }
+
+  /// Hashes RAM, outside of the echo region while the DSP writes it.  Only
+  /// the pages written since they were last hashed are hashed again.
+  uint64_t HashRam() {
+    uint8_t echo[kPages] = {};
+    FlagEchoPages(echo);
+    const uint8_t* ram = spc_cpu_.ram();
+    uint64_t hash = openspc::kHashBasis;
+    for (int p = 0; p < kPages; ++p) {
+      if (echo[p]) {
+        continue;
+      }
+      if (!page_hashed_[p]) {
+        page_hashes_[p] =
+            openspc::HashBytes(openspc::kHashBasis,
+                               &ram[p * openspc::SpcCpu::kPageSize],
+                               openspc::SpcCpu::kPageSize);
+        page_hashed_[p] = true;
+        notify_changed_ = true;
+      }
+      hash =
+          openspc::HashBytes(hash, &page_hashes_[p], sizeof(page_hashes_[p]));
+    }
+    return hash;
+  }
+
+  /// Marks the pages of the echo region, if the DSP is writing it, as not
+  /// hashed, as its writes go unseen by the watch flags, and sets them in
+  /// @p echo, if given.
+  void FlagEchoPages(uint8_t* echo = nullptr) {
+    const uint8_t* regs = dsp_.regs;
+    if (regs[0x6C] & 0x20) {
+      return;
+    }
+    uint8_t pages[kPages] = {};
+    FlagPages(pages, regs[0x6D] << 8,
+              std::max((regs[0x7D] & 0xF) << 11, dsp_.echo_ptr + 4), 1);
+    for (int p = 0; p < kPages; ++p) {
+      if (pages[p]) {
+        page_hashed_[p] = false;
+      }
+    }
+    if (echo) {
+      std::memcpy(echo, pages, kPages);
+    }
+  }
+
+  /// Callback from the CPU before it performs an access the DSP shares.
+  /// Brings the DSP up to date with all samples due at or before the time of
+  /// the access.
+  static void DspSync(void* opaque, int cycles_remaining) {
+    SpcContext* self = static_cast<SpcContext*>(opaque);
+    self->RenderUntil(self->slice_end_ - cycles_remaining);
+    self->UpdateWatch();
+  }
+
+  /// Callback from the CPU right after it writes a DSP register.
+  static void DspRegWritten(void* opaque, int addr) {
+    SpcContext* self = static_cast<SpcContext*>(opaque);
+    DSP_RegWritten(&self->dsp_, addr);
+    if (self->detect_loop_ && !self->loop_length_) {
+      // Songs are checked for looping at the start of each note.
+      if ((addr == 0x4C) && self->dsp_.regs[0x4C]) {
+        self->CheckLoop();
+      }
+      // An echo region the DSP may have started writing won't be seen
+      // changing by the time the next note comes round.
+      if ((addr == 0x6C) || (addr == 0x6D) || (addr == 0x7D)) {
+        self->FlagEchoPages();
+      }
+    }
+    self->UpdateWatch();
+  }
+
+  /// Callback from the CPU right after it writes to a RAM page flagged with
+  /// kWatchNotify.  The first write to a page since it was hashed marks it
+  /// to be hashed again, after which the page only needs watching for the
+  /// DSP's sake.
+  static void DspRamWritten(void* opaque, int address) {
+    SpcContext* self = static_cast<SpcContext*>(opaque);
+    DSP_RamWritten(&self->dsp_, address);
+    const int page = address / openspc::SpcCpu::kPageSize;
+    if (self->page_hashed_[page]) {
+      self->page_hashed_[page] = false;
+      self->notify_[page] = self->NotifyFlags(page);
+      uint8_t& watch = self->spc_cpu_.watch()[page];
+      watch = (watch & ~openspc::SpcCpu::kWatchNotify) | self->notify_[page];
+    }
+  }
+
+  /// Callback from the DSP right after it writes a sample to the echo region
+  /// at @p address, which the CPU has to be told about.
+  static void EchoWritten(void* opaque, int address) {
+    SpcContext* self = static_cast<SpcContext*>(opaque);
+    self->spc_cpu_.RamWritten(address, 4);
+  }
+
+  /// Renders all samples that are due at or before time @p t.  Those due
+  /// after the end of the Run() call in progress, which the CPU can only
+  /// reach by overrunning it, are kept for the next call.
+  void RenderUntil(uint64_t t) {
+    if (next_sample_ > t) {
+      return;
+    }
+    const int count = (t - next_sample_) / TS_CYC + 1;
+    // The DSP can only start making sound at a register write, which syncs
+    // first, so a silent DSP stays so for all of the samples due.
+    if (skip_silence_) {
+      if (DSP_Silent(&dsp_, kSilenceThreshold)) {
+        DSP_RenderBlock(&dsp_, nullptr, count);
+        next_sample_ += count * TS_CYC;
+        return;
+      }
+      skip_silence_ = false;
+    }
+    int own = count;
+    if (t >= end_) {
+      own = (next_sample_ < end_) ? (end_ - 1 - next_sample_) / TS_CYC + 1 : 0;
+    }
+    DSP_RenderBlock(&dsp_, out_, own);
+    out_ += own * out_inc_;
+    samples_rendered_ += own;
+    if (count > own) {
+      DSP_RenderBlock(&dsp_, &carry_[carry_count_ * 2], count - own);
+      carry_count_ += count - own;
+    }
+    next_sample_ += count * TS_CYC;
+  }
+
+  /// Flags every RAM page the DSP may access while rendering the samples
+  /// still due in the current slice, or before the CPU could overrun it, so
+  /// the CPU will sync with the DSP before touching any of them, plus every
+  /// page the DSP holds cached data from.
+  /// This must be redone whenever the DSP's state or registers change, which
+  /// can only happen during a sync.
+  void UpdateWatch() {
+    uint8_t* watch = spc_cpu_.watch();
+    // Writes to pages holding cached BRR data must be reported, however far
+    // ahead of the DSP the CPU is, and so must writes to pages hashed for
+    // loop detection.  Which pages those are rarely changes.
+    if (dsp_.brr_pages_changed || notify_changed_) {
+      for (int p = 0; p < kPages; ++p) {
+        notify_[p] = NotifyFlags(p);
+      }
+      dsp_.brr_pages_changed = 0;
+      notify_changed_ = false;
+    }
+    std::memcpy(watch, notify_, kPages);
+    const uint64_t watch_end = slice_end_ + overrun_;
+    if (next_sample_ >= watch_end) {
+      return;
+    }
+    const int samples = (watch_end - next_sample_ + TS_CYC - 1) / TS_CYC;
+
+    // The echo region is read every sample, and written unless disabled.
+    // echo_ptr may lie beyond the end of the region if EDL was just reduced.
+    const uint8_t* regs = dsp_.regs;
+    WatchRange(regs[0x6D] << 8,
+               std::max((regs[0x7D] & 0xF) << 11, dsp_.echo_ptr + 4),
+               (regs[0x6C] & 0x20) ? openspc::SpcCpu::kWatchWrite
+                                   : (openspc::SpcCpu::kWatchRead |
+                                      openspc::SpcCpu::kWatchWrite));
+
+    // A voice consumes at most 8 BRR samples (4.5 bytes with headers) per
+    // output sample, starting from the current position, or from the start
+    // or loop point in its source directory entry.
+    const int brr_len = samples * 5 + 16;
+    const uint8_t* ram = dsp_.ram;
+    for (int v = 0; v < 8; ++v) {
+      const int m = 1 << v;
+      const bool playing = dsp_.keys & m;
+      const bool starting = dsp_.voice_state[v].on_cnt || (regs[0x4C] & m);
+      if (!playing && !starting) {
+        continue;
+      }
+      const int entry = ((regs[0x5D] << 8) + regs[(v << 4) + 4] * 4) & 0xFFFF;
+      WatchRange(entry, 4, openspc::SpcCpu::kWatchWrite);
+      if (playing) {
+        WatchRange(dsp_.voice_state[v].mem_ptr, brr_len,
+                   openspc::SpcCpu::kWatchWrite);
+      }
+      if (starting) {
+        WatchRange(ram[entry] | (ram[entry + 1] << 8), brr_len,
+                   openspc::SpcCpu::kWatchWrite);
+      }
+      WatchRange(ram[entry + 2] | (ram[entry + 3] << 8), brr_len,
+                 openspc::SpcCpu::kWatchWrite);
+    }
+  }
+
+  /// The entry of notify_ for page @p p.
+  uint8_t NotifyFlags(int p) const {
+    return (dsp_.brr_pages[p] || page_hashed_[p])
+               ? openspc::SpcCpu::kWatchNotify
+               : 0;
+  }
+
+  /// Sets @p flags in the watch flags of every page overlapping @p len bytes
+  /// at @p start, wrapping around the end of RAM.
+  void WatchRange(int start, int len, uint8_t flags) {
+    FlagPages(spc_cpu_.watch(), start, len, flags);
+  }
+
+  /// Sets @p flags in the entry of @p pages for every page overlapping @p len
+  /// bytes at @p start, wrapping around the end of RAM.
+  static void FlagPages(uint8_t* pages, int start, int len, uint8_t flags) {
+    const int first = start / openspc::SpcCpu::kPageSize;
+    const int last = (start + len - 1) / openspc::SpcCpu::kPageSize;
+    for (int page = first; page <= std::min(last, first + kPages - 1);
+         ++page) {
+      pages[page % kPages] |= flags;
+    }
+  }
+
+  static constexpr int kWordsPerSample = 2;
+  static constexpr int kBytesPerSample = kWordsPerSample * sizeof(int16_t);
+  // Longest Run() call made by Seek().
+  static constexpr int kMaxSeekStep = 1 << 30;
+  static constexpr int kPages =
+      openspc::SpcCpu::kRamSize / openspc::SpcCpu::kPageSize;
+  // Maximum number of cycles the CPU runs between DSP syncs.
+  static constexpr int kSliceCycles = 1024;
+  // Interval between checks for the end of the song: 32 ms.
+  static constexpr uint64_t kEndCheckCycles = 32 * 1024;
+  // Most samples by which the intervals between three sightings of a state
+  // may differ for the song to be taken to loop.
+  static constexpr uint64_t kLoopTolerance = 2;
+  // Loudest echo sample that still counts as silence, about -72 dB.
+  static constexpr int kSilenceThreshold = 8;
+  // Bound on the samples that can fall due while the CPU overruns a Run()
+  // call.
+  static constexpr int kMaxCarry = openspc::SpcCpu::kMaxOverrun + 1;
+
+  // Leads off a snapshot, ahead of the CPU and DSP states.  openspc.h
+  // documents the magic and the version, which must stay where they are.
+  struct StateHeader {
+    char magic[8];
+    // kStateVersion, to be bumped whenever the layout of any part changes.
+    uint32_t version;
+    // state_size(), as a check on changes in layout between builds.
+    uint32_t size;
+    uint64_t now;
+    uint64_t next_sample;
+    int16_t carry[kMaxCarry * 2];
+    int32_t carry_count;
+  };
+  static constexpr char kStateMagic[] = "OSPCSNAP";
+  static constexpr uint32_t kStateVersion = OSPC_STATE_VERSION;
+  // Any change to the layout of the header or the DSP state calls for a bump
+  // of OSPC_STATE_VERSION, along with the sizes here; see spc_cpu.cc for the
+  // CPU.
+  static_assert(offsetof(StateHeader, version) == 8, "Snapshot layout changed");
+  static_assert(sizeof(StateHeader) == 88, "Snapshot layout changed");
+  static_assert(DSP_STATE_SIZE == 1324, "Snapshot layout changed");
+
+  // Must be declared before spc_cpu_, which keeps a pointer into it.
+  dsp_state_type dsp_;
   openspc::SpcCpu spc_cpu_;
-  // Number of SPC CPU cycles remaining until the next DSP sample is due, for
-  // use in between calls to Run().
-  int mix_left_ = 0;
+  // Watch flags for the pages the DSP holds cached data from, and those
+  // hashed for loop detection, and whether the latter have changed since
+  // they were last worked out.
+  uint8_t notify_[kPages] = {};
+  bool notify_changed_ = false;
+
+  // Emulated time, in SPC CPU cycles since the state was loaded, at which
+  // the CPU will have finished its current call to Run().
+  uint64_t now_ = 0;
+  // End time of the slice currently being run by the CPU.
+  uint64_t slice_end_ = 0;
+  // Time at which the next DSP sample to be rendered is due.  The DSP sees
+  // the effect of all CPU accesses before this time, and none after.
+  uint64_t next_sample_ = 0;
+
+  // Output state of the Run() call in progress, which ends at time end_.
+  int16_t* out_ = nullptr;
+  int out_inc_ = 0;
+  int samples_rendered_ = 0;
+  uint64_t end_ = 0;
+  // Samples rendered past the end of the last Run() call, still to be handed
+  // out.
+  int16_t carry_[kMaxCarry * 2] = {};
+  int carry_count_ = 0;
+  // Snapshots Seek() can start from, by the time they were taken at, which is
+  // a multiple of keyframe_interval_.
+  std::map<uint64_t, std::vector<uint8_t>> keyframes_;
+  uint64_t keyframe_interval_ = 0;
+  // Number of cycles the CPU may overrun the end of a slice by with the
+  // selected core, without the exact timing of its accesses being lost.
+  int overrun_ = 0;
+
+  // Loop detection; see set_loop_detection().
+  bool detect_loop_ = false;
+  // The samples each state hashed so far was seen at, in order, by its hash.
+  std::unordered_map<uint64_t, std::vector<uint64_t>> loop_hashes_;
+  // The hash of each RAM page, and whether it is up to date; the pages that
+  // are have writes to them reported through DspRamWritten().
+  uint64_t page_hashes_[kPages] = {};
+  bool page_hashed_[kPages] = {};
+  // The loop found, if loop_length_ is nonzero.
+  uint64_t loop_start_ = 0;
+  uint64_t loop_length_ = 0;
+
+  // End detection; see set_end_detection().
+  uint64_t end_silence_ = 0;
+  End ended_ = End::kNone;
+  // Last time the output was checked and found not to be silent, and the
+  // time of the next check.
+  uint64_t last_heard_ = 0;
+  uint64_t next_end_check_ = 0;
+  // See set_skip_silence().
+  bool skip_silence_ = false;
+};
+
+}  // namespace
+
+/// The type behind the opaque handle used by the public API.
+struct OSPC_Context {
+  // Replaced with a fresh instance by every OSPC_ContextInit() call.
+  std::unique_ptr<SpcContext> spc = std::make_unique<SpcContext>();
 };
 
-// TODO(bmartin) Eliminate this singleton once the context dependencies on
-// global state are eliminated, and the API is modified to specify a context.
-std::unique_ptr<SpcContext> g_spc_context;
+namespace {
+
+// Context used by the legacy API functions that don't take a context.  It
+// is created on first use by GlobalContext(), rather than during static
+// initialization, where running out of memory could not be reported.
+std::unique_ptr<OSPC_Context> g_spc_context;
+
+// Returns g_spc_context, creating it first if need be, or null if out of
+// memory.
+OSPC_Context *GlobalContext() {
+  if (!g_spc_context) {
+    g_spc_context.reset(OSPC_CreateContext());
+  }
+  return g_spc_context.get();
+}
 
 }  // namespace
 
 // Exported library interfaces
 
+// Nothing may throw through the C interface, so running out of memory while
+// setting up a context is reported as an error instead.
+
+extern "C" OSPC_Context *OSPC_CreateContext(void) {
+  try {
+    return new OSPC_Context;
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+extern "C" void OSPC_DestroyContext(OSPC_Context *ctx) { delete ctx; }
+
+extern "C" int OSPC_ContextInit(OSPC_Context *ctx, void *buf, size_t size) {
+  // The file is loaded into a fresh instance, which only replaces the old
+  // one once it has loaded, so that a failure leaves the context as it was.
+  std::unique_ptr<SpcContext> spc;
+  try {
+    spc = std::make_unique<SpcContext>();
+  } catch (const std::bad_alloc&) {
+    return -1;
+  }
+  if (!spc->Load(reinterpret_cast<uint8_t*>(buf), size)) {
+    return 1;
+  }
+  ctx->spc = std::move(spc);
+  return 0;
+}
+
+extern "C" size_t OSPC_ContextSaveState(OSPC_Context *ctx, void *buf,
+                                        size_t size) {
+  const size_t state_size = SpcContext::state_size();
+  if (buf && size >= state_size) {
+    ctx->spc->SaveState(static_cast<uint8_t*>(buf));
+  }
+  return state_size;
+}
+
+extern "C" int OSPC_ContextLoadState(OSPC_Context *ctx, const void *buf,
+                                     size_t size) {
+  switch (ctx->spc->LoadState(static_cast<const uint8_t*>(buf), size)) {
+    case SpcContext::StateMatch::kMatch:
+      return 0;
+    case SpcContext::StateMatch::kOtherVersion:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+extern "C" void OSPC_ContextSetKeyframeInterval(OSPC_Context *ctx,
+                                                unsigned long cycles) {
+  ctx->spc->set_keyframe_interval(cycles);
+}
+
+extern "C" int OSPC_ContextSeek(OSPC_Context *ctx, unsigned long long cycle) {
+  return ctx->spc->Seek(cycle) ? 0 : 1;
+}
+
+extern "C" unsigned long long OSPC_ContextGetPosition(OSPC_Context *ctx) {
+  return ctx->spc->position();
+}
+
+extern "C" void OSPC_ContextSetLoopDetection(OSPC_Context *ctx, int enable) {
+  ctx->spc->set_loop_detection(enable);
+}
+
+extern "C" int OSPC_ContextGetLoop(OSPC_Context *ctx,
+                                   unsigned long long *start,
+                                   unsigned long long *length) {
+  uint64_t loop_start, loop_length;
+  if (!ctx->spc->loop(&loop_start, &loop_length)) {
+    return 0;
+  }
+  *start = loop_start;
+  *length = loop_length;
+  return 1;
+}
+
+extern "C" void OSPC_ContextSetEndDetection(OSPC_Context *ctx,
+                                            unsigned long cycles) {
+  ctx->spc->set_end_detection(cycles);
+}
+
+extern "C" int OSPC_ContextGetEnd(OSPC_Context *ctx) {
+  switch (ctx->spc->end()) {
+    case SpcContext::End::kHalted:
+      return OSPC_END_HALTED;
+    case SpcContext::End::kSilence:
+      return OSPC_END_SILENCE;
+    default:
+      return OSPC_END_NONE;
+  }
+}
+
+extern "C" void OSPC_ContextSetSkipSilence(OSPC_Context *ctx, int enable) {
+  ctx->spc->set_skip_silence(enable);
+}
+
+extern "C" int OSPC_ContextRun(OSPC_Context *ctx, int cyc, short *s_buf,
+                               int s_size) {
+  return ctx->spc->Run(cyc, s_buf, s_size);
+}
+
+extern "C" void OSPC_ContextWritePort(OSPC_Context *ctx, int port,
+                                      char data) {
+  ctx->spc->WritePort(port & 3, data);
+}
+
+extern "C" char OSPC_ContextReadPort(OSPC_Context *ctx, int port) {
+  return ctx->spc->ReadPort(port & 3);
+}
+
+extern "C" void OSPC_ContextSetCpuCore(OSPC_Context *ctx, int core) {
+  switch (core) {
+    case OSPC_CORE_WHOLE_INSTRUCTION:
+      ctx->spc->set_cpu_core(openspc::SpcCpu::Core::kWholeInstruction);
+      break;
+    case OSPC_CORE_LOCKSTEP:
+      ctx->spc->set_cpu_core(openspc::SpcCpu::Core::kLockstep);
+      break;
+    default:
+      ctx->spc->set_cpu_core(openspc::SpcCpu::Core::kCycleExact);
+      break;
+  }
+}
+
+extern "C" int OSPC_ContextGetCpuCore(OSPC_Context *ctx) {
+  switch (ctx->spc->cpu_core()) {
+    case openspc::SpcCpu::Core::kWholeInstruction:
+      return OSPC_CORE_WHOLE_INSTRUCTION;
+    case openspc::SpcCpu::Core::kLockstep:
+      return OSPC_CORE_LOCKSTEP;
+    default:
+      return OSPC_CORE_CYCLE_EXACT;
+  }
+}
+
+extern "C" int OSPC_ContextGetCpuDivergence(OSPC_Context *ctx, char *buf,
+                                            int size) {
+  const std::string divergence = ctx->spc->cpu_divergence();
+  if (buf && size > 0) {
+    std::snprintf(buf, size, "%s", divergence.c_str());
+  }
+  return divergence.size();
+}
+
+extern "C" int OSPC_ContextCpuHalted(OSPC_Context *ctx) {
+  return ctx->spc->cpu_halted();
+}
+
+extern "C" void OSPC_ContextSetChannelMask(OSPC_Context *ctx, int mask) {
+  ctx->spc->set_channel_mask(mask);
+}
+
+extern "C" int OSPC_ContextGetChannelMask(OSPC_Context *ctx) {
+  return ctx->spc->channel_mask();
+}
+
 extern "C" int OSPC_Init(void *buf, size_t size) {
-  g_spc_context = std::make_unique<SpcContext>();
-  return g_spc_context->Load(reinterpret_cast<uint8_t*>(buf), size) ? 0 : 1;
+  OSPC_Context *ctx = GlobalContext();
+  return ctx ? OSPC_ContextInit(ctx, buf, size) : -1;
 }
 
 extern "C" int OSPC_Run(int cyc, short *s_buf, int s_size) {
-  return g_spc_context->Run(cyc, s_buf, s_size);
+  OSPC_Context *ctx = GlobalContext();
+  return ctx ? OSPC_ContextRun(ctx, cyc, s_buf, s_size) : 0;
+}
+
+extern "C" int OSPC_CpuHalted(void) {
+  OSPC_Context *ctx = GlobalContext();
+  return ctx ? OSPC_ContextCpuHalted(ctx) : 0;
 }
 
 extern "C" void OSPC_WritePort0(char data) {
-  g_spc_context->WritePort(0, data);
+  OSPC_Context *ctx = GlobalContext();
+  if (ctx) {
+    OSPC_ContextWritePort(ctx, 0, data);
+  }
 }
 
 extern "C" void OSPC_WritePort1(char data) {
-  g_spc_context->WritePort(1, data);
+  OSPC_Context *ctx = GlobalContext();
+  if (ctx) {
+    OSPC_ContextWritePort(ctx, 1, data);
+  }
 }
 
 extern "C" void OSPC_WritePort2(char data) {
-  g_spc_context->WritePort(2, data);
+  OSPC_Context *ctx = GlobalContext();
+  if (ctx) {
+    OSPC_ContextWritePort(ctx, 2, data);
+  }
 }
 
 extern "C" void OSPC_WritePort3(char data) {
-  g_spc_context->WritePort(3, data);
+  OSPC_Context *ctx = GlobalContext();
+  if (ctx) {
+    OSPC_ContextWritePort(ctx, 3, data);
+  }
+}
+
+extern "C" char OSPC_ReadPort0(void) {
+  OSPC_Context *ctx = GlobalContext();
+  return ctx ? OSPC_ContextReadPort(ctx, 0) : 0;
+}
+
+extern "C" char OSPC_ReadPort1(void) {
+  OSPC_Context *ctx = GlobalContext();
+  return ctx ? OSPC_ContextReadPort(ctx, 1) : 0;
 }
 
-extern "C" char OSPC_ReadPort0(void) { return g_spc_context->ReadPort(0); }
-extern "C" char OSPC_ReadPort1(void) { return g_spc_context->ReadPort(1); }
-extern "C" char OSPC_ReadPort2(void) { return g_spc_context->ReadPort(2); }
-extern "C" char OSPC_ReadPort3(void) { return g_spc_context->ReadPort(3); }
+extern "C" char OSPC_ReadPort2(void) {
+  OSPC_Context *ctx = GlobalContext();
+  return ctx ? OSPC_ContextReadPort(ctx, 2) : 0;
+}
+
+extern "C" char OSPC_ReadPort3(void) {
+  OSPC_Context *ctx = GlobalContext();
+  return ctx ? OSPC_ContextReadPort(ctx, 3) : 0;
+}
 
-extern "C" void OSPC_SetChannelMask(int mask) { channel_mask = mask; }
-extern "C" int OSPC_GetChannelMask(void) { return channel_mask; }
+extern "C" void OSPC_SetChannelMask(int mask) {
+  OSPC_Context *ctx = GlobalContext();
+  if (ctx) {
+    OSPC_ContextSetChannelMask(ctx, mask);
+  }
+}
+
+extern "C" int OSPC_GetChannelMask(void) {
+  OSPC_Context *ctx = GlobalContext();
+  return ctx ? OSPC_ContextGetChannelMask(ctx) : 0;
+}
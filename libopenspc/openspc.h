@@ -33,18 +33,155 @@ This file contains the exported interface for libopenspc.
 extern "C" {
 #endif
 
+typedef struct OSPC_Context OSPC_Context;
+/* An opaque handle to one independent emulator instance.  Each context holds
+   all of its own CPU and DSP state, so any number of them may exist at once,
+   and different contexts may be used concurrently from different threads.  A
+   single context must not be used from more than one thread at a time. */
+
+OSPC_Context *OSPC_CreateContext(void);
+/* Allocates a new emulator context.  OSPC_ContextInit() or
+   OSPC_ContextLoadState() should be called on it to load a state before it
+   is run.  Returns NULL if out of memory. */
+
+void OSPC_DestroyContext(OSPC_Context *ctx);
+/* Frees a context returned by OSPC_CreateContext(). */
+
+int OSPC_ContextInit(OSPC_Context *ctx, void *buf, size_t size);
+int OSPC_ContextRun(OSPC_Context *ctx, int cyc, short *s_buf, int s_size);
+int OSPC_ContextCpuHalted(OSPC_Context *ctx);
+void OSPC_ContextWritePort(OSPC_Context *ctx, int port, char data);
+char OSPC_ContextReadPort(OSPC_Context *ctx, int port);
+void OSPC_ContextSetChannelMask(OSPC_Context *ctx, int mask);
+int OSPC_ContextGetChannelMask(OSPC_Context *ctx);
+/* These methods operate on the given context, and otherwise behave exactly
+   like the corresponding methods below.  port is in the range 0-3. */
+
+#define OSPC_STATE_VERSION 2
+size_t OSPC_ContextSaveState(OSPC_Context *ctx, void *buf, size_t size);
+/* Takes a snapshot of the complete emulator state of a context into buf, if
+   size is enough to hold it, and returns the size of the snapshot either
+   way; pass a NULL buf to query it.  The size is the same for every
+   snapshot.  The CPU core and channel mask are settings, not part of the
+   state.  A snapshot starts with the 8 characters "OSPCSNAP", followed by
+   its format version, OSPC_STATE_VERSION, as a 32-bit integer in host byte
+   order.  The rest is a copy of the state as laid out in memory, which takes
+   little more than copying back to load; the version changes whenever that
+   layout does. */
+
+int OSPC_ContextLoadState(OSPC_Context *ctx, const void *buf, size_t size);
+/* Restores a snapshot taken by OSPC_ContextSaveState(), on the same context
+   or any other, keeping its CPU core and channel mask.  Returns 0 on
+   success, 2 if buf holds a snapshot of another format version than
+   OSPC_STATE_VERSION, or 1 if it holds no snapshot this build of the
+   library can load; on failure the context is left as it was. */
+
+void OSPC_ContextSetKeyframeInterval(OSPC_Context *ctx, unsigned long cycles);
+int OSPC_ContextSeek(OSPC_Context *ctx, unsigned long long cycle);
+unsigned long long OSPC_ContextGetPosition(OSPC_Context *ctx);
+/* Positions are counted in SPC cycles, of which there are 1024000 a second,
+   from the last OSPC_ContextInit().  OSPC_ContextGetPosition() returns where
+   a context has run to.  OSPC_ContextSeek() moves it to the given position,
+   as if it had been run there without output.  Given a nonzero interval,
+   OSPC_ContextRun() keeps a snapshot each time it reaches a multiple of it,
+   and seeking then starts from the latest one at or before the position
+   sought, so it only has to emulate the rest.  Snapshots from the position
+   of an OSPC_ContextWritePort() call onwards are dropped, as are all of them
+   by OSPC_ContextLoadState() or changing the interval.  Each one takes a
+   little over 64kB.  The interval is reset to 0, recording none, by
+   OSPC_ContextInit().  OSPC_ContextSeek() returns 0 on success, or 1 if
+   the position has passed and there is no snapshot before it. */
+
+void OSPC_ContextSetLoopDetection(OSPC_Context *ctx, int enable);
+int OSPC_ContextGetLoop(OSPC_Context *ctx, unsigned long long *start,
+                        unsigned long long *length);
+/* While loop detection is enabled, every note the SPC keys on has the
+   course of the song so far hashed: RAM outside the echo region, which holds
+   the sound driver's variables, the SPC's ports and timer settings, the DSP
+   registers, and which voices are playing and the stage of their
+   envelopes.  Timing details, like envelope heights or the phase of the
+   timers, are left out, as they drift by a few cycles from one pass through
+   a song to the next.
+   The same hash can come up by chance at points that go on differently, so
+   only once one has been seen three times, at intervals equal to within a
+   couple of samples, is the song taken to repeat from where it was first
+   seen.  OSPC_ContextGetLoop() then returns 1 and sets start to the first
+   sample of the loop and length to its length, both in samples, counting
+   from the last OSPC_ContextInit() like positions do; until then it
+   returns 0.  A loop is only found once the song has been through it twice
+   and started it over again, its length is accurate to about a sample, and
+   its start may be up to a note later than where the song data loops.
+   Enabling detection, or OSPC_ContextWritePort() or OSPC_ContextLoadState()
+   while it is enabled, forgets any loop found and starts the search over.
+   OSPC_ContextInit() disables it. */
+
+#define OSPC_END_NONE 0
+#define OSPC_END_HALTED 1
+#define OSPC_END_SILENCE 2
+void OSPC_ContextSetEndDetection(OSPC_Context *ctx, unsigned long cycles);
+int OSPC_ContextGetEnd(OSPC_Context *ctx);
+void OSPC_ContextSetSkipSilence(OSPC_Context *ctx, int enable);
+/* Given a nonzero number of cycles, OSPC_ContextRun() checks every 32ms
+   whether the output is silent: no voice keyed on but at an envelope height
+   of 0 it won't rise from, and an echo that is off or has died away.  Once
+   it has stayed so for that many cycles the song has ended, as it has at
+   the first silent check after the SPC halts, which leaves nothing to break
+   the silence.  OSPC_ContextRun() then stops there, returning what it
+   rendered up to that point, and renders nothing more until the end is
+   cleared by enabling detection again, OSPC_ContextSeek(),
+   OSPC_ContextLoadState() or OSPC_ContextWritePort().
+   OSPC_ContextGetEnd() returns why the song ended, OSPC_END_HALTED or
+   OSPC_END_SILENCE, or OSPC_END_NONE if it hasn't.  Seeking never stops at
+   the end.  Enabling OSPC_ContextSetSkipSilence() leaves out silence from
+   the output, until the first sample that is not, at which point it turns
+   itself off, so that leading silence before a song starts can be skipped.
+   OSPC_ContextInit() disables both. */
+
+#define OSPC_CORE_CYCLE_EXACT 0
+#define OSPC_CORE_WHOLE_INSTRUCTION 1
+#define OSPC_CORE_LOCKSTEP 2
+void OSPC_ContextSetCpuCore(OSPC_Context *ctx, int core);
+int OSPC_ContextGetCpuCore(OSPC_Context *ctx);
+/* Selects the SPC CPU core a context runs with, which is reset to
+   OSPC_CORE_CYCLE_EXACT by OSPC_ContextInit().  That core stops each
+   OSPC_ContextRun() call at the exact cycle requested.  The faster
+   OSPC_CORE_WHOLE_INSTRUCTION core only stops between instructions, and
+   makes up for any overrun in the next call.  The sound rendered is the
+   same either way; only the timing of port accesses relative to the calls
+   differs, so the exact core should be kept for anything that talks to the
+   SPC through its ports while it runs.  OSPC_CORE_LOCKSTEP behaves like
+   OSPC_CORE_WHOLE_INSTRUCTION, but also runs the exact core alongside it as
+   a check, at several times the cost. */
+
+int OSPC_ContextGetCpuDivergence(OSPC_Context *ctx, char *buf, int size);
+/* With OSPC_CORE_LOCKSTEP selected, describes the first point at which the
+   two cores disagreed, as a nul-terminated string truncated to fit in size
+   bytes of buf.  Returns the full length of the description, which is 0 if
+   they have not disagreed.  The cores are compared on the registers and
+   cycle at the start of every instruction, every write, and every read of
+   the SPC's registers at $F0-$FF, timer counters included.  Reads of the
+   DSP data register at $F3 and the ports at $F4-$F7 are the exception: the
+   exact core is handed what the other read, as only one of them drives the
+   DSP, and port writes fall earlier for the exact core whenever the other
+   overran the previous call. */
+
+/* The following methods all operate on a single, implicit context owned by
+   the library.  They are not safe to use from more than one thread. */
+
 int OSPC_Init(void *buf, size_t size);
 /* This method is used to load a new state into the emulator.  buf points to
    the memory region containing the image to be loaded.  Can be an SPC file,
    or a ZSNES or Snes9X savestate (autodetected).  Returns 0 on success, 1
    on failure to identify file type, and a negative value for any other
-   error (currently none are defined). */
+   error: -1 if out of memory.  On failure, the state already loaded, if
+   any, is left as it was. */
 
 int OSPC_Run(int cyc, short *s_buf, int s_size);
 /* This method performs the actual emulation.  cyc is the number of cycles
    desired to execute.  s_buf should point to an area of memory to render
-   the sound output into, or NULL if this is not desired.  s_size is the
-   size of s_buf, in bytes.  Execution will stop when either cyc cycles have
+   the sound output into, or NULL if this is not desired, which fast-forwards
+   somewhat quicker as the output mix is skipped.  s_size is the size of
+   s_buf, in bytes.  Execution will stop when either cyc cycles have
    been executed, or s_buf has been filled, whichever comes first.  If the
    number of cycles executed does not matter, pass a negative cyc value, and
    s_size will be used instead to determine the time to run.  s_size is
@@ -52,6 +189,13 @@ int OSPC_Run(int cyc, short *s_buf, int s_size);
    Returns the amount of data (in bytes) rendered into s_buf (or that would
    have been had it not been NULL). */
 
+int OSPC_CpuHalted(void);
+/* Returns nonzero once the SPC has halted itself with a SLEEP or STOP
+   instruction.  From then on, OSPC_Run() costs next to nothing, and only
+   renders what the DSP still has to play, such as a fading echo; a player
+   may take it as the end of the song once the output falls silent.  Loading
+   a new state with OSPC_Init() clears it. */
+
 void OSPC_WritePort0(char data);
 void OSPC_WritePort1(char data);
 void OSPC_WritePort2(char data);
@@ -25,11 +25,219 @@
 import ctypes
 
 SAMPLE_FREQ = 32000       # Hz
+CPU_FREQ = 1024000        # Hz, the unit of positions
 BYTES_PER_SAMPLE = 2 * 2  # 16-bit, stereo
 
+# CPU cores for Context.set_cpu_core().
+CORE_CYCLE_EXACT = 0
+CORE_WHOLE_INSTRUCTION = 1
+CORE_LOCKSTEP = 2
+
+# Reasons for the end of a song, from Context.get_end().
+END_NONE = 0
+END_HALTED = 1
+END_SILENCE = 2
+
+# Format version of save_state() snapshots, OSPC_STATE_VERSION in openspc.h.
+STATE_VERSION = 2
+
 libopenspc = None
 
 
+def _load_library(libpath):
+    global libopenspc
+    if libopenspc is None:
+        libopenspc = ctypes.cdll.LoadLibrary(
+            libpath if libpath is not None else 'libopenspc.so.0')
+        libopenspc.OSPC_CreateContext.restype = ctypes.c_void_p
+        libopenspc.OSPC_DestroyContext.argtypes = [ctypes.c_void_p]
+        libopenspc.OSPC_ContextInit.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+        libopenspc.OSPC_ContextRun.argtypes = [
+            ctypes.c_void_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_int]
+        libopenspc.OSPC_ContextWritePort.argtypes = [
+            ctypes.c_void_p, ctypes.c_int, ctypes.c_byte]
+        libopenspc.OSPC_ContextReadPort.argtypes = [
+            ctypes.c_void_p, ctypes.c_int]
+        libopenspc.OSPC_ContextReadPort.restype = ctypes.c_byte
+        libopenspc.OSPC_ContextSaveState.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+        libopenspc.OSPC_ContextSaveState.restype = ctypes.c_size_t
+        libopenspc.OSPC_ContextLoadState.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+        libopenspc.OSPC_ContextSetKeyframeInterval.argtypes = [
+            ctypes.c_void_p, ctypes.c_ulong]
+        libopenspc.OSPC_ContextSeek.argtypes = [
+            ctypes.c_void_p, ctypes.c_ulonglong]
+        libopenspc.OSPC_ContextGetPosition.argtypes = [ctypes.c_void_p]
+        libopenspc.OSPC_ContextGetPosition.restype = ctypes.c_ulonglong
+        libopenspc.OSPC_ContextSetLoopDetection.argtypes = [
+            ctypes.c_void_p, ctypes.c_int]
+        libopenspc.OSPC_ContextGetLoop.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(ctypes.c_ulonglong),
+            ctypes.POINTER(ctypes.c_ulonglong)]
+        libopenspc.OSPC_ContextSetEndDetection.argtypes = [
+            ctypes.c_void_p, ctypes.c_ulong]
+        libopenspc.OSPC_ContextGetEnd.argtypes = [ctypes.c_void_p]
+        libopenspc.OSPC_ContextSetSkipSilence.argtypes = [
+            ctypes.c_void_p, ctypes.c_int]
+        libopenspc.OSPC_ContextCpuHalted.argtypes = [ctypes.c_void_p]
+        libopenspc.OSPC_ContextSetCpuCore.argtypes = [
+            ctypes.c_void_p, ctypes.c_int]
+        libopenspc.OSPC_ContextGetCpuCore.argtypes = [ctypes.c_void_p]
+        libopenspc.OSPC_ContextGetCpuDivergence.argtypes = [
+            ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int]
+        libopenspc.OSPC_ContextSetChannelMask.argtypes = [
+            ctypes.c_void_p, ctypes.c_int]
+        libopenspc.OSPC_ContextGetChannelMask.argtypes = [ctypes.c_void_p]
+
+
+class Context:
+    """An independent emulator instance.
+
+    The module-level functions below all share a single implicit instance.
+    Any number of Context objects may be used instead, and separate contexts
+    may be run concurrently from different threads.  init(), run(),
+    cpu_halted(), write_port(), read_port(), set_channel_mask() and
+    get_channel_mask() behave exactly like the module-level functions of the
+    same name.  The other methods have no module-level counterparts, and are
+    documented individually.
+
+    `libpath` has the same meaning as for init().
+    """
+
+    def __init__(self, libpath=None):
+        _load_library(libpath)
+        self._ctx = libopenspc.OSPC_CreateContext()
+        if not self._ctx:
+            raise MemoryError('Unable to allocate emulator context')
+
+    def __del__(self):
+        if getattr(self, '_ctx', None):
+            libopenspc.OSPC_DestroyContext(self._ctx)
+            self._ctx = None
+
+    def init(self, buf):
+        assert isinstance(buf, bytes)
+        ret = libopenspc.OSPC_ContextInit(self._ctx, buf, len(buf))
+        if ret > 0:
+            raise ValueError('Unable to recognize supplied file format')
+        if ret < 0:
+            raise RuntimeError('Error %d from OSPC_ContextInit()' % ret)
+
+    def run(self, s_size, cyc=None):
+        out_buf = bytes(s_size)
+        out_size = libopenspc.OSPC_ContextRun(
+            self._ctx, cyc if cyc is not None else -1, out_buf, s_size)
+        return out_buf[:out_size]
+
+    def set_keyframe_interval(self, cycles):
+        """Keep a snapshot for seek() every `cycles` CPU cycles of running;
+        0, the default, keeps none."""
+        libopenspc.OSPC_ContextSetKeyframeInterval(self._ctx, cycles)
+
+    def seek(self, cycle):
+        """Move to the given position, counted in CPU cycles since init(), as
+        if run() had been called to get there.  Raises ValueError if it has
+        passed and no snapshot precedes it."""
+        if libopenspc.OSPC_ContextSeek(self._ctx, cycle):
+            raise ValueError('Cannot seek back to cycle %d' % cycle)
+
+    def get_position(self):
+        """Returns how far the context has run, in CPU cycles since
+        init()."""
+        return libopenspc.OSPC_ContextGetPosition(self._ctx)
+
+    def set_loop_detection(self, enable):
+        """Start or stop looking for where the song loops, from here on."""
+        libopenspc.OSPC_ContextSetLoopDetection(self._ctx, int(enable))
+
+    def get_loop(self):
+        """Returns the first sample and the length in samples of the loop
+        found, or None if none has been."""
+        start = ctypes.c_ulonglong()
+        length = ctypes.c_ulonglong()
+        if not libopenspc.OSPC_ContextGetLoop(
+                self._ctx, ctypes.byref(start), ctypes.byref(length)):
+            return None
+        return start.value, length.value
+
+    def set_end_detection(self, cycles):
+        """Stop run() once the output has been silent for `cycles` CPU
+        cycles, or right away if the CPU has halted; 0, the default, never
+        stops."""
+        libopenspc.OSPC_ContextSetEndDetection(self._ctx, cycles)
+
+    def get_end(self):
+        """Returns why the song ended, END_HALTED or END_SILENCE, or END_NONE
+        if it hasn't."""
+        return libopenspc.OSPC_ContextGetEnd(self._ctx)
+
+    def set_skip_silence(self, enable):
+        """Start or stop leaving silence out of the output of run(), until it
+        is first broken."""
+        libopenspc.OSPC_ContextSetSkipSilence(self._ctx, int(enable))
+
+    def cpu_halted(self):
+        return bool(libopenspc.OSPC_ContextCpuHalted(self._ctx))
+
+    def save_state(self):
+        """Return a snapshot of the complete emulator state, as a bytes
+        instance that only this build of the library can load_state()."""
+        size = libopenspc.OSPC_ContextSaveState(self._ctx, None, 0)
+        buf = bytes(size)
+        libopenspc.OSPC_ContextSaveState(self._ctx, buf, size)
+        return buf
+
+    def load_state(self, buf):
+        """Restore a snapshot from save_state(), keeping the CPU core and
+        channel mask.  Raises ValueError if `buf` holds a snapshot of another
+        format version than STATE_VERSION, or none that can be loaded."""
+        assert isinstance(buf, bytes)
+        ret = libopenspc.OSPC_ContextLoadState(self._ctx, buf, len(buf))
+        if ret == 2:
+            raise ValueError('Snapshot of another format version than %d' %
+                             STATE_VERSION)
+        if ret:
+            raise ValueError('Not a snapshot from this build of libopenspc')
+
+    def write_port(self, port, data):
+        assert (data >= -128) and (data < 256)
+        assert port in range(4), 'Illegal port %d' % port
+        libopenspc.OSPC_ContextWritePort(
+            self._ctx, port, data - 256 if data >= 128 else data)
+
+    def read_port(self, port):
+        assert port in range(4), 'Illegal port %d' % port
+        return libopenspc.OSPC_ContextReadPort(self._ctx, port)
+
+    def set_cpu_core(self, core):
+        """Select the CPU core, one of CORE_CYCLE_EXACT,
+        CORE_WHOLE_INSTRUCTION or CORE_LOCKSTEP.  init() resets it to
+        CORE_CYCLE_EXACT."""
+        libopenspc.OSPC_ContextSetCpuCore(self._ctx, core)
+
+    def get_cpu_core(self):
+        """Returns the CPU core selected by set_cpu_core()."""
+        return libopenspc.OSPC_ContextGetCpuCore(self._ctx)
+
+    def get_cpu_divergence(self):
+        """With CORE_LOCKSTEP, describe where the two cores first disagreed,
+        or return None if they have not."""
+        size = libopenspc.OSPC_ContextGetCpuDivergence(self._ctx, None, 0)
+        if not size:
+            return None
+        buf = ctypes.create_string_buffer(size + 1)
+        libopenspc.OSPC_ContextGetCpuDivergence(self._ctx, buf, size + 1)
+        return buf.value.decode()
+
+    def set_channel_mask(self, mask):
+        libopenspc.OSPC_ContextSetChannelMask(self._ctx, mask)
+
+    def get_channel_mask(self):
+        return libopenspc.OSPC_ContextGetChannelMask(self._ctx)
+
+
 def init(buf, libpath=None):
     """Load a new state into the emulator.
 
@@ -44,10 +252,7 @@ def init(buf, libpath=None):
     """
     assert isinstance(buf, bytes)
 
-    global libopenspc
-    if libopenspc is None:
-        libopenspc = ctypes.cdll.LoadLibrary(
-            libpath if libpath is not None else 'libopenspc.so.0')
+    _load_library(libpath)
 
     ret = libopenspc.OSPC_Init(ctypes.c_char_p(buf), ctypes.c_ulong(len(buf)))
     if ret > 0:
@@ -75,6 +280,15 @@ def run(s_size, cyc=None):
     return out_buf[:out_size]
 
 
+def cpu_halted():
+    """Whether the SPC has halted itself with SLEEP or STOP.
+
+    After that, run() only renders what the DSP still has to play, such as a
+    fading echo.  init() clears it.
+    """
+    return bool(libopenspc.OSPC_CpuHalted())
+
+
 def write_port(port, data):
     """Communicate with the SPC.
 
@@ -22,18 +22,76 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <string>
 
 namespace openspc {
 
-/// Module that simulates the CPU side of the SPC-700.
-// TODO(bmartin) The current implementation interacts with global state, hence
-// only one copy of this class may exist in a process.  Fix this eventually.
+/// Module that simulates the CPU side of the SPC-700.  All state is held per
+/// instance, so any number of instances may exist in a process, and separate
+/// instances may be used concurrently from different threads.  A single
+/// instance is not thread-safe.
 class SpcCpu {
  public:
   static constexpr int kRamSize = 65536;
   static constexpr int kDspRegsSize = 256;
+  static constexpr int kPageSize = 256;
+
+  /// Execution cores the CPU can run with.
+  enum class Core {
+    /// Stops each Run() call as close to the requested number of cycles as
+    /// possible, in the middle of an instruction if need be.
+    kCycleExact,
+    /// Only stops between instructions, which is cheaper.  Each Run() call
+    /// may overrun the requested number of cycles, and the overrun is
+    /// deducted from the next call.
+    kWholeInstruction,
+    /// Runs kWholeInstruction, and a second, kCycleExact instance alongside
+    /// it as a check, which runs every instruction cycle by cycle.  Both
+    /// expand the same instruction bodies, so this checks the dispatch and
+    /// fast paths of the first rather than what each instruction does.  After
+    /// every Run() call, the two are compared on the registers at the start
+    /// of each instruction, the cycle each instruction starts on, every
+    /// write, and every read from the register page other than the DSP data
+    /// register and the ports, which depend on what happens outside the CPU,
+    /// until they first disagree; see divergence().  Where the first skips
+    /// through iterations of a loop, the check runs them, and the two are
+    /// compared again at the instruction the first lands on.  Much slower
+    /// than either core alone.
+    kLockstep,
+  };
+
+  /// The most cycles a Run() call may overrun by, with either core.  The
+  /// cycle-exact core only ever overruns inside an instruction that makes no
+  /// further memory accesses.
+  static constexpr int kMaxOverrun = 11;
+
+  /// Flags for the entries of watch().
+  static constexpr uint8_t kWatchRead = 0x01;
+  static constexpr uint8_t kWatchWrite = 0x02;
+  static constexpr uint8_t kWatchNotify = 0x04;
+
+  /// Callbacks through which the CPU keeps the DSP informed of its activity.
+  /// Each one receives @p opaque as its first argument, and may be null.
+  struct DspCallbacks {
+    /// Invoked immediately before the CPU performs any access the DSP may
+    /// observe or affect: every DSP register access, and every access to a
+    /// RAM page flagged for that kind of access in watch().  Receives the
+    /// number of cycles remaining until the Run() call in progress returns;
+    /// i.e. the access happens that many cycles before the end of the Run()
+    /// call.  This is negative, down to -kMaxOverrun, for accesses made while
+    /// overrunning it.
+    void (*sync)(void* opaque, int cycles_remaining);
+    /// Invoked right after each DSP register write, with the address of the
+    /// register written.
+    void (*reg_written)(void* opaque, int addr);
+    /// Invoked right after each write to a RAM page flagged with
+    /// kWatchNotify in watch(), with the address written.
+    void (*ram_written)(void* opaque, int address);
+    void* opaque;
+  };
 
   /// @p dsp_regs is a pointer to external storage for DSP register contents.
   /// It must be at least kDspRegsSize.
@@ -45,13 +103,59 @@ class SpcCpu {
   void SetState(uint16_t pc, uint8_t a, uint8_t x, uint8_t y, uint8_t psw,
                 uint8_t sp, const uint8_t* ram);
 
+  /// Size of the buffer used by SaveState() and LoadState().
+  static size_t state_size();
+
+  /// Copy the complete state of the CPU, RAM included, to @p state, which
+  /// must be state_size() bytes.  The layout is specific to this build of the
+  /// library.  The core, callbacks and watch flags are not part of it.
+  void SaveState(uint8_t* state) const;
+
+  /// Restore a state written by SaveState().  With Core::kLockstep, checking
+  /// starts over from it.
+  void LoadState(const uint8_t* state);
+
+  /// Fold whether the CPU has halted, its ports and its timer targets into
+  /// the 64-bit FNV-1a hash @p hash, and return the result.  RAM is left out,
+  /// and so is anything that depends on exactly how many cycles have passed,
+  /// such as the timer counters and their progress towards the next tick.
+  /// So are the registers, which the cores only keep up to date in the
+  /// context between Run() calls.  May be called from within the DSP
+  /// callbacks.
+  uint64_t HashState(uint64_t hash) const;
+
   /// Run the CPU for the given number of cycles.
   void Run(int);
 
+  /// Whether the CPU has halted by executing SLEEP or STOP.  Once it has,
+  /// Run() only lets time pass, until the next SetState().
+  bool halted() const;
+
+  /// Select the core used by subsequent Run() calls.  The default is
+  /// Core::kCycleExact.
+  void set_core(Core core);
+  Core core() const;
+
+  /// With Core::kLockstep, a description of the first point at which the two
+  /// cores disagreed, or an empty string if they have not.
+  std::string divergence() const;
+
+  /// Register the callbacks used to keep the DSP informed.
+  void SetDspCallbacks(const DspCallbacks& callbacks);
+
+  /// Retrieve the mutable table of watch flags, with one entry for each
+  /// kPageSize bytes of RAM.  All entries are initially zero.
+  uint8_t* watch();
+
   /// Retrieve a mutable pointer to the memory space of the CPU, which is of
-  /// size kRamSize.
+  /// size kRamSize.  Writes through it must be reported to RamWritten().
   uint8_t* ram();
 
+  /// Report that @p len bytes of RAM at @p address, wrapping around the end
+  /// of RAM, were written other than by the CPU itself: through ram(), or by
+  /// the DSP.  The CPU drops any code it translated from them.
+  void RamWritten(int address, int len);
+
   /// Write to one of the CPU's four incoming communication ports.
   void WritePort(int index, uint8_t data);
 
@@ -59,7 +163,10 @@ class SpcCpu {
   uint8_t ReadPort(int index);
 
  private:
+  // Interface to a CPU backend, and the backends implementing it.
   class Impl;
+  class SneeseImpl;
+  class LockstepImpl;
   std::unique_ptr<Impl> impl_;
 };
 
@@ -32,10 +32,12 @@ expected value if the new behavior truly is intended.
 """
 
 import argparse
+import concurrent.futures
 import lzma
 import hashlib
 import os.path
 import pathlib
+import struct
 import sys
 
 # This script is intended to be run on the source directory and not on an
@@ -47,6 +49,15 @@ import openspc
 
 
 RUNTIME_S = 120
+# Each test case is also run separately carrying on from a snapshot in a
+# fresh context at SNAPSHOT_S seconds, and again seeking back SEEK_BACK_S
+# seconds at SEEK_S seconds, keeping keyframes every KEYFRAME_S seconds; both
+# must produce the same output as the plain run.  The seek starts from an
+# earlier keyframe and fast-forwards without output.
+SNAPSHOT_S = 60
+SEEK_S = 100
+SEEK_BACK_S = 3
+KEYFRAME_S = 30
 
 # List of test cases.  Each entry in this list is a tuple consisting of:
 # * Filename, expected to be found in the data/ subdirectory with a .xz suffix,
@@ -72,8 +83,56 @@ TESTS = [
     ('direct_env.spc', '130a83c49b3af1d4930cf3cd4b4def4e'),
     # Test loading a ZSNES savestate.
     ('zsnes.zst', 'eadc717e84b29614ba397af3d71026af'),
+    # Keys a voice on and then off again before sleeping, so the song halts
+    # while the note is still being released.
+    ('release_halt.spc', 'bd8a0f059c25597f9751814a3605ba10'),
+    # Rewrites its own opcodes as it goes, including within a compare and
+    # branch pair, and runs a routine after the echo region has been written
+    # over it, so the CPU must never run stale code.
+    ('self_modify.spc', 'e7ab4fb1030c9325d4e5309858876917'),
+    # Keeps reading the echo region as the DSP writes it, and sets a pitch
+    # from each byte, so the CPU must see every echo write when it is made.
+    ('echo_read.spc', '04ff1acc2eefdce07554903e7cda37f8'),
+    # Waits on each timer in turn and runs a delay loop of each kind the CPU
+    # skips through, setting pitches and volumes from the registers after.
+    ('loops.spc', '0d1342eaec87f5c409973670d6190657'),
 ]
 
+# Loops expected to be detected, as (first sample, length in samples), by
+# test case filename.  Each is looked for in a separate run of the test case,
+# as loading a snapshot starts the search over.
+LOOPS = {
+    'basic.spc': (14759, 2525118),
+}
+
+# Songs expected to end within RUNTIME_S seconds, given END_SILENCE_S
+# seconds of silence as the end, as (reason, samples up to the end), by test
+# case filename.  Every other test case is expected not to.
+END_SILENCE_S = 2
+ENDS = {
+    'noise.spc': (openspc.END_SILENCE, 953344),
+    'release_halt.spc': (openspc.END_HALTED, 2048),
+}
+
+# Samples of leading silence expected to be skipped, by test case filename.
+# Every other test case is expected to skip none.  Each is checked in a
+# separate run, which must otherwise match the output of the test case.
+SKIPPED = {
+    'basic.spc': 1574,
+    'release_halt.spc': 1,
+    'self_modify.spc': 1,
+    'echo_read.spc': 1,
+    'loops.spc': 2,
+}
+
+# The output is expected to be identical with any CPU core, and the lockstep
+# core additionally checks that the other two agree throughout.
+CORES = {
+    'exact': openspc.CORE_CYCLE_EXACT,
+    'whole': openspc.CORE_WHOLE_INSTRUCTION,
+    'lockstep': openspc.CORE_LOCKSTEP,
+}
+
 
 def _select_tests(test_str):
     if test_str is None:
@@ -100,10 +159,14 @@ def _data_filename(name):
     return os.path.join(this_dir, 'data', name + '.xz')
 
 
-def run_test(name, output_dir, libpath):
+def run_test(name, output_dir, libpath, core):
     with lzma.open(_data_filename(name)) as spcfile:
         spc_content = spcfile.read()
-    openspc.init(spc_content, libpath=libpath)
+    # Each test gets its own emulator context so that they may be run in
+    # parallel.
+    context = openspc.Context(libpath=libpath)
+    context.init(spc_content)
+    context.set_cpu_core(core)
 
     out_file = None
     if output_dir is not None:
@@ -112,16 +175,161 @@ def run_test(name, output_dir, libpath):
             'wb')
 
     hasher = hashlib.md5()
+    output = []
     for _ in range(RUNTIME_S):
-        data = openspc.run(openspc.SAMPLE_FREQ * openspc.BYTES_PER_SAMPLE)
+        data = context.run(openspc.SAMPLE_FREQ * openspc.BYTES_PER_SAMPLE)
         hasher.update(data)
+        output.append(data)
         if out_file is not None:
             out_file.write(data)
 
     if out_file is not None:
         out_file.close()
 
-    return hasher.hexdigest()
+    divergence = context.get_cpu_divergence()
+    if divergence:
+        return hasher.hexdigest(), 'cores diverged: %s' % divergence
+
+    # The remaining checks each run the test case again, and compare what
+    # they get with the output of the run above.
+    error = _check_snapshot(spc_content, libpath, core, output)
+    if error:
+        return hasher.hexdigest(), error
+
+    error = _check_seek(spc_content, libpath, core, output)
+    if error:
+        return hasher.hexdigest(), error
+
+    if name in LOOPS:
+        loop = _find_loop(spc_content, libpath, core, LOOPS[name], output)
+        if loop != LOOPS[name]:
+            return hasher.hexdigest(), 'found loop %r' % (loop,)
+
+    end = _find_end(spc_content, libpath, core, output)
+    if end != ENDS.get(name):
+        return hasher.hexdigest(), 'found end %r' % (end,)
+
+    skipped = _skip_silence(spc_content, libpath, core, output)
+    if skipped != SKIPPED.get(name, 0):
+        return hasher.hexdigest(), 'skipped silence %r' % (skipped,)
+    return hasher.hexdigest(), None
+
+
+def _check_snapshot(spc_content, libpath, core, output):
+    """Runs for SNAPSHOT_S seconds, carries on from a snapshot in a fresh
+    context, and returns an error if the output differs from `output` or the
+    cores diverged.  Loads that must fail along the way, of another snapshot
+    format version or of a file that is not a song, must change nothing."""
+    context = openspc.Context(libpath=libpath)
+    context.init(spc_content)
+    context.set_cpu_core(core)
+    for second in range(SNAPSHOT_S):
+        if context.run(len(output[second])) != output[second]:
+            return 'output changed before taking a snapshot'
+    divergence = context.get_cpu_divergence()
+    if divergence:
+        return 'cores diverged: %s' % divergence
+    state = context.save_state()
+
+    context = openspc.Context(libpath=libpath)
+    context.set_cpu_core(core)
+    context.load_state(state)
+    version = struct.pack('=I', openspc.STATE_VERSION + 1)
+    for bad_load in (
+            lambda: context.load_state(state[:8] + version + state[12:]),
+            lambda: context.init(b'not a song' * 100)):
+        try:
+            bad_load()
+        except ValueError:
+            pass
+        else:
+            return 'a load that should have failed succeeded'
+    for second in range(SNAPSHOT_S, RUNTIME_S):
+        if context.run(len(output[second])) != output[second]:
+            return 'output changed after loading a snapshot'
+    divergence = context.get_cpu_divergence()
+    if divergence:
+        return 'cores diverged after loading a snapshot: %s' % divergence
+    return None
+
+
+def _check_seek(spc_content, libpath, core, output):
+    """Runs for SEEK_S seconds keeping keyframes, seeks back SEEK_BACK_S
+    seconds, and returns an error if the output from there on differs from
+    `output`."""
+    context = openspc.Context(libpath=libpath)
+    context.init(spc_content)
+    context.set_cpu_core(core)
+    context.set_keyframe_interval(KEYFRAME_S * openspc.CPU_FREQ)
+    for second in range(SEEK_S):
+        context.run(len(output[second]))
+    context.seek((SEEK_S - SEEK_BACK_S) * openspc.CPU_FREQ)
+    for second in range(SEEK_S - SEEK_BACK_S, RUNTIME_S):
+        if context.run(len(output[second])) != output[second]:
+            return 'output changed after seeking back'
+    divergence = context.get_cpu_divergence()
+    if divergence:
+        return 'cores diverged after seeking back: %s' % divergence
+    return None
+
+
+def _find_loop(spc_content, libpath, core, expected, output):
+    """Runs until a loop is detected, or for a second past where the
+    expected loop would have been confirmed by coming round a second time,
+    and returns the loop found, if any.  Returns 'output changed' instead if
+    the output differs from `output` while looking."""
+    context = openspc.Context(libpath=libpath)
+    context.init(spc_content)
+    context.set_cpu_core(core)
+    context.set_loop_detection(True)
+    start, length = expected
+    for second in range((start + 2 * length) // openspc.SAMPLE_FREQ + 2):
+        data = context.run(openspc.SAMPLE_FREQ * openspc.BYTES_PER_SAMPLE)
+        if second < len(output) and data != output[second]:
+            return 'output changed'
+        loop = context.get_loop()
+        if loop is not None:
+            return loop
+    return None
+
+
+def _find_end(spc_content, libpath, core, output):
+    """Runs for up to RUNTIME_S seconds looking for the end of the song, and
+    returns the reason and the number of samples up to it, if found, or
+    'output changed' if the output up to there differs from `output`."""
+    context = openspc.Context(libpath=libpath)
+    context.init(spc_content)
+    context.set_cpu_core(core)
+    context.set_end_detection(END_SILENCE_S * openspc.CPU_FREQ)
+    samples = 0
+    for second in range(RUNTIME_S):
+        data = context.run(openspc.SAMPLE_FREQ * openspc.BYTES_PER_SAMPLE)
+        if not output[second].startswith(data):
+            return 'output changed'
+        samples += len(data) // openspc.BYTES_PER_SAMPLE
+        if context.get_end() != openspc.END_NONE:
+            return context.get_end(), samples
+    return None
+
+
+def _skip_silence(spc_content, libpath, core, output):
+    """Runs for a second with and without skipping leading silence, and
+    returns the number of samples skipped, or None if the rest differs from
+    the first second of `output`."""
+    outputs = []
+    for skip in (False, True):
+        context = openspc.Context(libpath=libpath)
+        context.init(spc_content)
+        context.set_cpu_core(core)
+        context.set_skip_silence(skip)
+        outputs.append(
+            context.run(openspc.SAMPLE_FREQ * openspc.BYTES_PER_SAMPLE,
+                        openspc.CPU_FREQ))
+    full, skipped = outputs
+    skipped_bytes = len(full) - len(skipped)
+    if full != output[0] or full[skipped_bytes:] != skipped:
+        return None
+    return skipped_bytes // openspc.BYTES_PER_SAMPLE
 
 
 def main():
@@ -143,6 +351,9 @@ def main():
     parser.add_argument(
         '--libpath',
         help='Optionally specify path to libopenspc.so library to use')
+    parser.add_argument(
+        '--core', choices=sorted(CORES), default='exact',
+        help='SPC CPU core to run the test cases with (default: %(default)s)')
     parser.add_argument(
         '--passed-file',
         help='On success, touch a file with this filename')
@@ -168,15 +379,23 @@ def main():
                  ' '.join(_data_filename(n) for _, (n, _) in selected_tests)),
                 file=depfile)
 
+    # The library releases the GIL while emulating, so threads are enough to
+    # run the test cases in parallel.
+    with concurrent.futures.ThreadPoolExecutor(os.cpu_count()) as executor:
+        results = [executor.submit(run_test, name, args.output_dir,
+                                   args.libpath, CORES[args.core])
+                   for _, (name, _) in selected_tests]
+
     failed = False
-    for test_no, (name, expected_md5) in selected_tests:
-        # TODO(bmartin) Could run these in parallel with multiprocessing.
-        actual_md5 = run_test(name, args.output_dir, args.libpath)
-        ok = (actual_md5 == expected_md5)
+    for (test_no, (name, expected_md5)), result in zip(selected_tests,
+                                                       results):
+        actual_md5, error = result.result()
+        ok = (actual_md5 == expected_md5) and error is None
         if args.verbose:
             print('%d (%s): %s' %
                   (test_no, _visible_name(name),
                    'OK' if ok else
+                   ('FAILED (%s)' % error) if error is not None else
                    ('FAILED (expected %r got %r)' %
                     (expected_md5, actual_md5))))
         if not ok: